@@ -22,6 +22,8 @@ sys.path.insert(0, os.path.join(this_dir, '..', '..', 'lib'))
 import pprint
 import cv2
 import random
+import threading
+import Queue
 from socketCom.Communication import Server
 from socket import error as SocketError
 import errno
@@ -46,8 +48,10 @@ from symbols import *
 from utils.load_model import load_param
 from utils.show_masks import show_masks
 from utils.tictoc import tic, toc
-from nms.nms import py_nms_wrapper
+from nms.nms import cpu_nms_wrapper
+from bbox.bbox_transform import clip_boxes
 from mask.mask_transform import gpu_mask_voting, cpu_mask_voting
+from mask.cpu_mask_post import mask_centroids, decode_mask
 import matplotlib.pyplot as plt
 
 FX = 523.5967
@@ -65,95 +69,67 @@ def show_mask(color, roimask, name, alpha=0.4):
     plt.imshow(color[:, :, -1::-1])
     plt.show()
 
-def generate_point_cloud(depth, roimask, cod):
-    """Transform a depth image data (CV_32F) into a point cloud with one point for each
-    pixel in the image, using the camera transform for a camera
-    centred at cx, cy with field of view fx, fy.
-
-    The result is a 3-D array with
-    shape (rows, cols, 3). Pixels with invalid depth in the input have
-    NaN for the z-coordinate in the result.
-
-    """
-    rows, cols = depth.shape
-    c, r = np.meshgrid(np.arange(cols), np.arange(rows), sparse=True)
-    c += cod[0]
-    r += cod[1]
-    valid = (depth >= 0.1) & (depth <= 12.0) & roimask
-    valid = valid.astype(bool)
-    z = np.where(valid, depth, np.nan)
-    x = np.where(valid, z * (c - CX) / FX, 0)
-    y = np.where(valid, z * (r - CY) / FY, 0)
-    cloud = np.dstack((x, y, z))
-    cloud_roi = cloud[valid]
-    return cloud_roi
-
-def cal_centroid(cloud):
-    # The following method takes less time than
-    # np.mean(cloud, axis=0) or np.sum(cloud, axis=0)/length
-    length = cloud.shape[0]
-    if not length:
-        return np.zeros(3)
-    sum_x = np.sum(cloud[:, 0])
-    sum_y = np.sum(cloud[:, 1])
-    sum_z = np.sum(cloud[:, 2])
-    return np.asarray([sum_x, sum_y, sum_z]) / length
-
-def get_predictor(sym, image, arg_params, aux_params):
-    data = []
+def image_data(image):
     target_size = config.SCALES[0][0]
     max_size = config.SCALES[0][1]
     im, im_scale = resize(image, target_size, max_size, stride=config.network.IMAGE_STRIDE)
     im_tensor = transform(im, config.network.PIXEL_MEANS)
     im_info = np.array([[im_tensor.shape[2], im_tensor.shape[3], im_scale]], dtype=np.float32)
-    data.append({'data': im_tensor, 'im_info': im_info})
+    return [mx.nd.array(im_tensor), mx.nd.array(im_info)]
+
+def get_predictor(sym, image, arg_params, aux_params, ctx):
+    # one image per context, a micro-batch of len(ctx) images runs in a single forward
     data_names = ['data', 'im_info']
     label_names = []
-    data = [[mx.nd.array(data[i][name]) for name in data_names] for i in xrange(len(data))]
-    max_data_shape = [[('data', (1, 3, max([v[0] for v in config.SCALES]), max([v[1] for v in config.SCALES])))]]
+    data = [image_data(image) for _ in ctx]
+    max_data_shape = [[('data', (1, 3, max([v[0] for v in config.SCALES]), max([v[1] for v in config.SCALES])))]
+                      for _ in ctx]
     provide_data = [[(k, v.shape) for k, v in zip(data_names, data[i])] for i in xrange(len(data))]
     provide_label = [None for i in xrange(len(data))]
     predictor = Predictor(sym, data_names, label_names,
-                          context=[mx.gpu(0)], max_data_shapes=max_data_shape,
+                          context=ctx, max_data_shapes=max_data_shape,
                           provide_data=provide_data, provide_label=provide_label,
                           arg_params=arg_params, aux_params=aux_params)
     return predictor
 
 
-def fcis_seg(image, classes, predictor, args):
-    num_classes = len(classes) + 1
-    data = []
-    target_size = config.SCALES[0][0]
-    max_size = config.SCALES[0][1]
-    im, im_scale = resize(image, target_size, max_size, stride=config.network.IMAGE_STRIDE)
-    im_tensor = transform(im, config.network.PIXEL_MEANS)
-    start = time.time()
-    im_info = np.array([[im_tensor.shape[2], im_tensor.shape[3], im_scale]], dtype=np.float32)
-    data.append({'data': im_tensor, 'im_info': im_info})
+def fcis_seg(images, classes, predictor, ctx, args):
+    """Segment a micro-batch of images, returns (boxes, masks, names) for each of them"""
     data_names = ['data', 'im_info']
-    data = [[mx.nd.array(data[i][name]) for name in data_names] for i in xrange(len(data))]
-    data_batch = mx.io.DataBatch(data=[data[0]], label=[], pad=0, index=0,
-                                 provide_data=[[(k, v.shape) for k, v in zip(data_names, data[0])]],
-                                 provide_label=[None])
-    scales = [data_batch.data[i][1].asnumpy()[0, 2] for i in xrange(len(data_batch.data))]
-    scores, boxes, masks, data_dict = im_detect(predictor, data_batch, data_names, scales, config)
-    im_shapes = [data_batch.data[i][0].shape[2:4] for i in xrange(len(data_batch.data))]
+    results = []
+    for i in xrange(0, len(images), len(ctx)):
+        chunk = images[i:i + len(ctx)]
+        data = [image_data(image) for image in chunk]
+        # every context needs an image, pad the last chunk and drop the padded outputs
+        pad = len(ctx) - len(data)
+        data.extend([data[-1]] * pad)
+        data_batch = mx.io.DataBatch(data=data, label=[], pad=pad, index=0,
+                                     provide_data=[[(k, v.shape) for k, v in zip(data_names, d)] for d in data],
+                                     provide_label=[None for _ in data])
+        scales = [data_batch.data[j][1].asnumpy()[0, 2] for j in xrange(len(data_batch.data))]
+        scores, boxes, masks, data_dict = im_detect(predictor, data_batch, data_names, scales, config)
+        im_shapes = [data_batch.data[j][0].shape[2:4] for j in xrange(len(data_batch.data))]
+        for j in xrange(len(chunk)):
+            results.append(postprocess(scores[j], boxes[j], masks[j], im_shapes[j], scales[j], classes, args))
+    return results
 
+def postprocess(scores, boxes, masks, im_shape, scale, classes, args):
+    num_classes = len(classes) + 1
     if not config.TEST.USE_MASK_MERGE:
         all_boxes = [[] for _ in xrange(num_classes)]
         all_masks = [[] for _ in xrange(num_classes)]
-        nms = py_nms_wrapper(config.TEST.NMS)
+        nms = cpu_nms_wrapper(config.TEST.NMS)
         for j in range(1, num_classes):
-            indexes = np.where(scores[0][:, j] > 0.7)[0]
-            cls_scores = scores[0][indexes, j, np.newaxis]
-            cls_masks = masks[0][indexes, 1, :, :]
+            indexes = np.where(scores[:, j] > 0.7)[0]
+            cls_scores = scores[indexes, j, np.newaxis]
+            cls_masks = masks[indexes, 1, :, :]
             try:
                 if config.CLASS_AGNOSTIC:
-                    cls_boxes = boxes[0][indexes, :]
+                    cls_boxes = boxes[indexes, :]
                 else:
                     raise Exception()
             except:
-                cls_boxes = boxes[0][indexes, j * 4:(j + 1) * 4]
+                cls_boxes = boxes[indexes, j * 4:(j + 1) * 4]
 
             cls_dets = np.hstack((cls_boxes, cls_scores))
             keep = nms(cls_dets)
@@ -162,42 +138,106 @@ def fcis_seg(image, classes, predictor, args):
         dets = [all_boxes[j] for j in range(1, num_classes)]
         masks = [all_masks[j] for j in range(1, num_classes)]
     else:
-        masks = masks[0][:, 1:, :, :]
-        im_height = np.round(im_shapes[0][0] / scales[0]).astype('int')
-        im_width = np.round(im_shapes[0][1] / scales[0]).astype('int')
+        masks = masks[:, 1:, :, :]
+        im_height = np.round(im_shape[0] / scale).astype('int')
+        im_width = np.round(im_shape[1] / scale).astype('int')
         # print (im_height, im_width)
-        boxes = clip_boxes(boxes[0], (im_height, im_width))
-        result_masks, result_dets = gpu_mask_voting(masks, boxes, scores[0], num_classes,
+        boxes = clip_boxes(boxes, (im_height, im_width))
+        result_masks, result_dets = gpu_mask_voting(masks, boxes, scores, num_classes,
                                                     100, im_width, im_height,
                                                     config.TEST.NMS, config.TEST.MASK_MERGE_THRESH,
                                                     config.BINARY_THRESH, 0)
 
         dets = [result_dets[j] for j in range(1, num_classes)]
         masks = [result_masks[j][:, 0, :, :] for j in range(1, num_classes)]
-    cods, bimsks, names = decode_mask(im, dets, masks, classes, config, args)
-    return cods, bimsks, names
+    return select_detections(dets, masks, classes, args)
 
-def decode_mask(im, detections, masks, class_names, cfg, args, scale=1.0):
-    cods = []
-    bimsks = []
+def select_detections(detections, masks, class_names, args):
+    """Keep the detections scored above args.seg_threshold, stacked over all classes"""
+    boxes = []
+    msks = []
     names = []
     for j, name in enumerate(class_names):
         if name == '__background__':
             continue
-        keep = np.where(detections[j][:, -1] > args.seg_threshold)
-        dets = detections[j][keep]
-        msks = masks[j][keep]
-        for det, msk in zip(dets, msks):
-            bbox = det[:4] * scale
-            cod = bbox.astype(int)
-            if im[cod[1]:cod[3], cod[0]:cod[2], 0].size > 0:
-                msk = cv2.resize(msk, im[cod[1]:cod[3] + 1, cod[0]:cod[2] + 1, 0].T.shape)
-                bimsk = msk >= cfg.BINARY_THRESH
-                bimsk = bimsk.astype(int)
-                cods.append(cod)
-                bimsks.append(bimsk)
-                names.append(name)
-    return cods, bimsks, names
+        keep = np.where(detections[j][:, -1] > args.seg_threshold)[0]
+        if len(keep) == 0:
+            continue
+        boxes.append(detections[j][keep, :4])
+        msks.append(masks[j][keep])
+        names.extend([name] * len(keep))
+    if not names:
+        return np.zeros((0, 4), dtype=np.float32), np.zeros((0, 1, 1), dtype=np.float32), names
+    return np.vstack(boxes).astype(np.float32), np.vstack(msks).astype(np.float32), names
+
+def seg_centroids(depth, boxes, masks, names, args):
+    """Decode the masks over the depth image and compute the camera frame centroid
+    of every detection in native code (lib/mask/mask_post_kernel.cpp).
+    The decoded masks of the dynamic classes are returned too, SLAM does not extract
+    features on them."""
+    seg_result = {}
+    centroids, _ = mask_centroids(boxes, masks, depth, FX, FY, CX, CY, config.BINARY_THRESH,
+                                  outlier_sigma=args.centroid_sigma)
+    for centroid, name in zip(centroids, names):
+        seg_result.setdefault(name, []).append(centroid)
+
+    instance_masks = []
+    for box, mask, name in zip(boxes, masks, names):
+        if name in args.dynamic_classes:
+            cod, bimask = decode_mask(box, mask, config.BINARY_THRESH, depth.shape[0], depth.shape[1])
+            if cod is not None:
+                instance_masks.append((name, cod, bimask))
+    return seg_result, instance_masks
+
+class RequestReader(threading.Thread):
+    """Receive the requests of the SLAM client as soon as they arrive, so that keyframes sent
+    in a burst queue up here and are segmented in micro-batches instead of one at a time.
+    The queue holds (arrival time, connection, (keyframe id, color, depth)), or the exception
+    that stopped the reader."""
+    def __init__(self, server, requests):
+        super(RequestReader, self).__init__()
+        self.daemon = True
+        self.server = server
+        self.requests = requests
+        # incremented on reconnection, results of the previous connection are not sent back
+        self.connection = 0
+
+    def run(self):
+        while True:
+            try:
+                request = self.server.get_request()
+                self.requests.put((time.time(), self.connection, request))
+            except SocketError as e:
+                if e.errno == errno.ECONNRESET:
+                    print("Connection reset by peer, waiting for reconnnection...")
+                    self.server.setup_connect_server()
+                    self.connection += 1
+                else:
+                    self.requests.put(e)
+                    return
+            except Exception as e:
+                self.requests.put(e)
+                return
+
+def next_batch(requests, max_batch, batch_wait):
+    """Block for a request, then keep collecting until max_batch requests or batch_wait seconds
+    after the first one arrived. Requests already queued are taken even past the deadline."""
+    batch = [requests.get()]
+    if isinstance(batch[0], Exception):
+        return batch
+    deadline = batch[0][0] + batch_wait
+    while len(batch) < max_batch:
+        remaining = deadline - time.time()
+        try:
+            if remaining > 0:
+                batch.append(requests.get(True, remaining))
+            else:
+                batch.append(requests.get_nowait())
+        except Queue.Empty:
+            break
+        if isinstance(batch[-1], Exception):
+            break
+    return batch
 
 def main(args):
     kwargs = {'host': 'localhost',
@@ -230,36 +270,29 @@ def main(args):
     #            'clock', 'vase', 'scissors', 'teddy bear', 'hair drier', 'toothbrush', 'floor']
     warmup_img = './warmup.jpg'
     im = cv2.imread(warmup_img, cv2.IMREAD_COLOR | cv2.IMREAD_IGNORE_ORIENTATION)
-    predictor = get_predictor(sym, im, arg_params, aux_params)
-    fcis_seg(im, classes, predictor, args)
+    ctx = [mx.gpu(int(i)) for i in args.gpus.split(',')]
+    predictor = get_predictor(sym, im, arg_params, aux_params, ctx)
+    fcis_seg([im], classes, predictor, ctx, args)
 
     server = Server(**kwargs)
+    requests = Queue.Queue()
+    reader = RequestReader(server, requests)
+    reader.start()
 
     while True:
+        batch = next_batch(requests, args.max_batch, args.batch_wait)
+        if isinstance(batch[-1], Exception):
+            print(batch[-1])
+            sys.exit("Unexpected error occurred")
         try:
-            color_imgs = server.get_images()
-            depth_imgs = server.get_images()
-            color_img = color_imgs[0]
-            depth_img = depth_imgs[0]
-            cods, bimsks, names = fcis_seg(color_img, classes, predictor, args)#fcis_seg(sym, color_img, classes, arg_params, aux_params, args)
-            seg_result = {}
-            for cod, bimsk, name in zip(cods, bimsks, names):
-                if name not in seg_result:
-                    seg_result[name] = []
-                depth_roi = depth_img[cod[1]:cod[3] + 1, cod[0]:cod[2] + 1, 0]
-                cloud = generate_point_cloud(depth_roi, bimsk, cod)
-                # color_roi = color_img[cod[1]:cod[3] + 1, cod[0]:cod[2] + 1, :]
-                # show_mask(color_roi, bimsk, name)
-                centroid = cal_centroid(cloud)
-                seg_result[name].append(centroid)
-            server.send_seg_result(seg_result)
+            results = fcis_seg([color_img for _, _, (_, color_img, _) in batch], classes, predictor, ctx, args)
+            for (_, connection, (request_id, _, depth_img)), (boxes, masks, names) in zip(batch, results):
+                seg_result, instance_masks = seg_centroids(depth_img[:, :, 0], boxes, masks, names, args)
+                if connection == reader.connection:
+                    server.send_seg_result(seg_result, request_id, instance_masks)
         except SocketError as e:
-            if e.errno == errno.ECONNRESET:
-                print("Connection reset by peer, waiting for reconnnection...")
-                server.setup_connect_server()
-            else:
-                print(e)
-                sys.exit("Unexpected socket error occurred")
+            # the reader sees the reset too and waits for the client to reconnect
+            print(e)
         except Exception as e:
             print(e)
             sys.exit("Unexpected error occurred")
@@ -274,5 +307,17 @@ if __name__ == '__main__':
                                                                             'on the trained model')
     parser.add_argument('--seg_threshold', '-sh', type=float, default=0.75,
                         help='threshold value for a successful segmentation')
+    parser.add_argument('--centroid_sigma', '-cs', type=float, default=3.0,
+                        help='reject object points further than this many robust deviations '
+                             'from the median depth, 0 keeps all the points')
+    parser.add_argument('--gpus', type=str, default='0',
+                        help='comma separated GPU ids, a micro-batch runs one image per GPU in each forward')
+    parser.add_argument('--max_batch', '-mb', type=int, default=4,
+                        help='maximum number of keyframes segmented together')
+    parser.add_argument('--batch_wait', '-bw', type=float, default=0.02,
+                        help='seconds to wait after a request for more to batch with it')
+    parser.add_argument('--dynamic_classes', type=str, default='person',
+                        help='comma separated classes whose instance masks are sent back to SLAM')
     args = parser.parse_args()
+    args.dynamic_classes = set(c.strip() for c in args.dynamic_classes.split(',') if c.strip())
     main(args)
@@ -45,6 +45,23 @@ class Server:
         imgs = self.get_imgmat()
         return imgs
 
+    def get_request(self):
+        """Receive one segmentation request: (keyframe id, color image, depth image)"""
+        bytesize = struct.calcsize("q")
+        nbytes = self.conn.recv(bytesize, socket.MSG_WAITALL)
+        if len(nbytes) != bytesize:
+            err = SocketError()
+            err.errno = errno.ECONNRESET
+            raise err
+        request_id = struct.unpack("q", nbytes)[0]
+        color_imgs = self.get_images()
+        depth_imgs = self.get_images()
+        if not color_imgs or not depth_imgs:
+            err = SocketError()
+            err.errno = errno.ECONNRESET
+            raise err
+        return request_id, color_imgs[0], depth_imgs[0]
+
     def get_imgheader(self):
         # nbytes = ''
         # count = struct.calcsize("i") * 6
@@ -82,7 +99,11 @@ class Server:
                 imgs.append(img)
         return imgs
 
-    def send_seg_result(self, cls_pos):
+    def send_seg_result(self, cls_pos, request_id=None, instance_masks=None):
+        """Results of pipelined requests are tagged with the id of their request and followed
+        by the masks of the dynamic instances, a list of (class name, [x0, y0, x1, y1], uint8 mask)"""
+        if request_id is not None:
+            self.conn.sendall(struct.pack("q", request_id))
         num_objs = np.array([len(cls_pos)], dtype=np.int32)
         self.conn.sendall(num_objs.tostring())
         for cls, poses in cls_pos.iteritems():
@@ -97,6 +118,17 @@ class Server:
             except:
                 print('\x1B[31mCannot send segmentation result \x1B[0m')
                 break
+        if request_id is not None:
+            self.send_instance_masks(instance_masks or [])
+
+    def send_instance_masks(self, instance_masks):
+        self.conn.sendall(struct.pack("i", len(instance_masks)))
+        for cls, cod, mask in instance_masks:
+            height, width = mask.shape
+            self.conn.sendall(struct.pack("i", len(cls)))
+            self.conn.sendall(cls)
+            self.conn.sendall(struct.pack("iiii", cod[0], cod[1], width, height))
+            self.conn.sendall(np.ascontiguousarray(mask, dtype=np.uint8).tostring())
 
     def decode_image(self, sock_data):
         sock_data = np.fromstring(sock_data, self.int_to_nptype[self.imType])
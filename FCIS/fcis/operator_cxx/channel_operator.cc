@@ -11,6 +11,8 @@
 #include <mshadow/packet-inl.h>
 #include <mshadow/dot_engine-inl.h>
 #include <cassert>
+#include <cfloat>
+#include <algorithm>
 
 using std::max;
 using std::min;
@@ -23,16 +25,65 @@ namespace mshadow {
     const Tensor<cpu, 4, DType> &data,
     const Tensor<cpu, 4, DType> &max_idx,
     const int group) {
-    // NOT_IMPLEMENTED;
-    return;
+    const DType *bottom_data = data.dptr_;
+    DType *top_data = out.dptr_;
+    DType *max_idx_data = max_idx.dptr_;
+    const int num = data.size(0);
+    const int channels = data.size(1);
+    const int spatial_dim = data.size(2) * data.size(3);
+    const int channels_in_group = channels / group;
+
+    // Each (n, g) owns one output plane. Channels are swept plane by plane so
+    // the inner loop runs over contiguous memory.
+    #pragma omp parallel for
+    for (int ng = 0; ng < num * group; ++ng) {
+      const int g = ng % group;
+      const int n = ng / group;
+      DType *offset_top_data = top_data + ng * spatial_dim;
+      DType *offset_max_idx_data = max_idx_data + ng * spatial_dim;
+      for (int s = 0; s < spatial_dim; ++s) {
+        offset_top_data[s] = -FLT_MAX;
+        offset_max_idx_data[s] = -1;
+      }
+      for (int i = 0; i < channels_in_group; ++i) {
+        const int c = g*channels_in_group + i;
+        const DType *offset_bottom_data = bottom_data + (n*channels + c)*spatial_dim;
+        for (int s = 0; s < spatial_dim; ++s) {
+          if (offset_bottom_data[s] > offset_top_data[s]) {
+            offset_top_data[s] = offset_bottom_data[s];
+            offset_max_idx_data[s] = c;
+          }
+        }
+      }
+    }
   }
+
   template<typename DType>
   inline void GroupPickForward(const Tensor<cpu, 4, DType> &out,
     const Tensor<cpu, 4, DType> &data,
     const Tensor<cpu, 4, DType> &pick_idx,
     const int group) {
-    // NOT_IMPLEMENTED;
-    return;
+    const DType *bottom_data = data.dptr_;
+    DType *top_data = out.dptr_;
+    const DType *pick_idx_data = pick_idx.dptr_;
+    const int num = data.size(0);
+    const int channels = data.size(1);
+    const int spatial_dim = data.size(2) * data.size(3);
+    const int channels_in_group = channels / group;
+    const int block = channels_in_group * spatial_dim;
+
+    // The picked group of a sample is one contiguous block of channels
+    #pragma omp parallel for
+    for (int n = 0; n < num; ++n) {
+      const int g = pick_idx_data[n];
+      DType *offset_top_data = top_data + n * block;
+      if (g < group && g >= 0) {
+        const DType *offset_bottom_data = bottom_data + (n*channels + g*channels_in_group)*spatial_dim;
+        std::copy(offset_bottom_data, offset_bottom_data + block, offset_top_data);
+      } else {
+        std::fill(offset_top_data, offset_top_data + block, DType(0));
+      }
+    }
   }
 
   template<typename DType>
@@ -40,8 +91,26 @@ namespace mshadow {
     const Tensor<cpu, 4, DType> &out_grad,
     const Tensor<cpu, 4, DType> &max_idx,
     const int group) {
-    // NOT_IMPLEMENTED;
-    return;
+    const DType *top_diff = out_grad.dptr_;
+    DType *bottom_diff = in_grad.dptr_;
+    const DType *max_idx_data = max_idx.dptr_;
+    const int num = in_grad.size(0);
+    const int channels = in_grad.size(1);
+    const int spatial_dim = in_grad.size(2) * in_grad.size(3);
+
+    // (n, g) only writes channels of group g of sample n
+    #pragma omp parallel for
+    for (int ng = 0; ng < num * group; ++ng) {
+      const int n = ng / group;
+      const DType *offset_top_diff = top_diff + ng * spatial_dim;
+      const DType *offset_max_idx_data = max_idx_data + ng * spatial_dim;
+      for (int s = 0; s < spatial_dim; ++s) {
+        const int c = offset_max_idx_data[s];
+        if (c < 0)
+          continue;
+        bottom_diff[(n*channels + c)*spatial_dim + s] = offset_top_diff[s];
+      }
+    }
   }
 
   template<typename DType>
@@ -49,16 +118,49 @@ namespace mshadow {
     const Tensor<cpu, 4, DType> &out_grad,
     const Tensor<cpu, 4, DType> &pick_idx,
     const int group) {
-    // NOT_IMPLEMENTED;
-    return;
+    const DType *top_diff = out_grad.dptr_;
+    DType *bottom_diff = in_grad.dptr_;
+    const DType *pick_idx_data = pick_idx.dptr_;
+    const int num = in_grad.size(0);
+    const int channels = in_grad.size(1);
+    const int spatial_dim = in_grad.size(2) * in_grad.size(3);
+    const int channels_in_group = channels / group;
+    const int block = channels_in_group * spatial_dim;
+
+    #pragma omp parallel for
+    for (int n = 0; n < num; ++n) {
+      const int g = pick_idx_data[n];
+      // Gradients of samples with an invalid pick stay as assigned by the caller
+      if (g >= group || g < 0)
+        continue;
+      const DType *offset_top_diff = top_diff + n * block;
+      DType *offset_bottom_diff = bottom_diff + (n*channels + g*channels_in_group)*spatial_dim;
+      std::copy(offset_top_diff, offset_top_diff + block, offset_bottom_diff);
+    }
   }
 
   template<typename DType>
   inline void GetMaxIdx(const Tensor<cpu, 4, DType> &pick_score,
     const Tensor<cpu, 4, DType> &argmax,
     const int group) {
-    // NOT_IMPLEMENTED;
-    return;
+    const DType *pick_score_data = pick_score.dptr_;
+    DType *argmax_data = argmax.dptr_;
+    const int count = argmax.shape_.Size();
+
+    // As in the CUDA kernel, the first entry (background) is never picked
+    #pragma omp parallel for
+    for (int index = 0; index < count; ++index) {
+      const DType* offset_pick_score_data = pick_score_data + index*group;
+      int max_idx = -1;
+      DType max_val = -FLT_MAX;
+      for (int i = 1; i < group; ++i) {
+        if (offset_pick_score_data[i] > max_val) {
+          max_idx = i;
+          max_val = offset_pick_score_data[i];
+        }
+      }
+      argmax_data[index] = static_cast<DType>(max_idx);
+    }
   }
 }  // namespace mshadow
 
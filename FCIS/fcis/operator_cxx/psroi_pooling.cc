@@ -12,6 +12,8 @@
 #include <mshadow/packet-inl.h>
 #include <mshadow/dot_engine-inl.h>
 #include <cassert>
+#include <cmath>
+#include <vector>
 
 using std::max;
 using std::min;
@@ -19,6 +21,49 @@ using std::floor;
 using std::ceil;
 
 namespace mshadow {
+// Bin boundaries of one ROI on the feature map, clipped to the input. Same arithmetic as
+// the CUDA kernels, but done once per ROI instead of once per output element.
+template<typename DType>
+inline int PSROIPoolBins(const DType *offset_bottom_rois,
+                         const DType spatial_scale,
+                         const int height, const int width,
+                         const int pooled_height, const int pooled_width,
+                         int *hstart, int *hend, int *wstart, int *wend) {
+  int roi_batch_ind = offset_bottom_rois[0];
+  DType roi_start_w = static_cast<DType>(round(offset_bottom_rois[1])) * spatial_scale;
+  DType roi_start_h = static_cast<DType>(round(offset_bottom_rois[2])) * spatial_scale;
+  DType roi_end_w = static_cast<DType>(round(offset_bottom_rois[3]) + 1.) * spatial_scale;
+  DType roi_end_h = static_cast<DType>(round(offset_bottom_rois[4]) + 1.) * spatial_scale;
+
+  // Force too small ROIs to be 1x1
+  DType roi_width = max(roi_end_w - roi_start_w, static_cast<DType>(0.1));  // avoid 0
+  DType roi_height = max(roi_end_h - roi_start_h, static_cast<DType>(0.1));
+
+  // Compute w and h at bottom
+  DType bin_size_h = roi_height / static_cast<DType>(pooled_height);
+  DType bin_size_w = roi_width / static_cast<DType>(pooled_width);
+
+  for (int ph = 0; ph < pooled_height; ++ph) {
+    int hs = floor(static_cast<DType>(ph) * bin_size_h + roi_start_h);
+    int he = ceil(static_cast<DType>(ph + 1) * bin_size_h + roi_start_h);
+    hstart[ph] = min(max(hs, 0), height);
+    hend[ph] = min(max(he, 0), height);
+  }
+  for (int pw = 0; pw < pooled_width; ++pw) {
+    int ws = floor(static_cast<DType>(pw) * bin_size_w + roi_start_w);
+    int we = ceil(static_cast<DType>(pw + 1) * bin_size_w + roi_start_w);
+    wstart[pw] = min(max(ws, 0), width);
+    wend[pw] = min(max(we, 0), width);
+  }
+  return roi_batch_ind;
+}
+
+// Position-sensitive group of a bin
+inline int PSROIPoolGroup(const int p, const int group_size, const int pooled) {
+  int g = floor(static_cast<float>(p) * group_size / pooled);
+  return min(max(g, 0), group_size - 1);
+}
+
 template<typename DType>
 inline void PSROIPoolForward(const Tensor<cpu, 4, DType> &out,
                            const Tensor<cpu, 4, DType> &data,
@@ -26,8 +71,60 @@ inline void PSROIPoolForward(const Tensor<cpu, 4, DType> &out,
                            const float spatial_scale_,
                            const int output_dim_, 
                            const int group_size_) {
-  // NOT_IMPLEMENTED;
-  return;
+  const DType *bottom_data = data.dptr_;
+  const DType *bottom_rois = bbox.dptr_;
+  DType *top_data = out.dptr_;
+  const int channels = data.size(1);
+  const int height = data.size(2);
+  const int width = data.size(3);
+  const int pooled_height = out.size(2);
+  const int pooled_width = out.size(3);
+  const int num_rois = bbox.size(0);
+  const DType spatial_scale = static_cast<DType>(spatial_scale_);
+
+  #pragma omp parallel
+  {
+    std::vector<int> hstart(pooled_height), hend(pooled_height);
+    std::vector<int> wstart(pooled_width), wend(pooled_width);
+
+    // Every (roi, output channel) pair fills its own pooled_height x pooled_width block.
+    // Each bin reads whole row segments of a single input channel.
+    #pragma omp for schedule(dynamic)
+    for (int index = 0; index < num_rois * output_dim_; ++index) {
+      const int ctop = index % output_dim_;
+      const int n = index / output_dim_;
+
+      const int roi_batch_ind = PSROIPoolBins(bottom_rois + n * 5, spatial_scale, height, width,
+                                              pooled_height, pooled_width,
+                                              &hstart[0], &hend[0], &wstart[0], &wend[0]);
+
+      DType *offset_top_data = top_data + index * pooled_height * pooled_width;
+      for (int ph = 0; ph < pooled_height; ++ph) {
+        const int gh = PSROIPoolGroup(ph, group_size_, pooled_height);
+        for (int pw = 0; pw < pooled_width; ++pw) {
+          const int gw = PSROIPoolGroup(pw, group_size_, pooled_width);
+          const int c = (ctop*group_size_ + gh)*group_size_ + gw;
+          const bool is_empty = (hend[ph] <= hstart[ph]) || (wend[pw] <= wstart[pw]);
+          if (is_empty) {
+            offset_top_data[ph*pooled_width + pw] = 0;
+            continue;
+          }
+
+          const DType *offset_bottom_data = bottom_data + (roi_batch_ind * channels + c) * height * width;
+          DType out_sum = 0;
+          for (int h = hstart[ph]; h < hend[ph]; ++h) {
+            const DType *row = offset_bottom_data + h*width;
+            for (int w = wstart[pw]; w < wend[pw]; ++w) {
+              out_sum += row[w];
+            }
+          }
+
+          DType bin_area = (hend[ph] - hstart[ph])*(wend[pw] - wstart[pw]);
+          offset_top_data[ph*pooled_width + pw] = out_sum/bin_area;
+        }
+      }
+    }
+  }
 }
 
 template<typename DType>
@@ -37,8 +134,55 @@ inline void PSROIPoolBackwardAcc(const Tensor<cpu, 4, DType> &in_grad,
                             const float spatial_scale_,
                             const int output_dim_, 
                             const int group_size_) {
-  // NOT_IMPLEMENTED;
-  return;
+  const DType *top_diff = out_grad.dptr_;
+  const DType *bottom_rois = bbox.dptr_;
+  DType *bottom_diff = in_grad.dptr_;
+  const int channels = in_grad.size(1);
+  const int height = in_grad.size(2);
+  const int width = in_grad.size(3);
+  const int pooled_height = out_grad.size(2);
+  const int pooled_width = out_grad.size(3);
+  const int num_rois = bbox.size(0);
+  const DType spatial_scale = static_cast<DType>(spatial_scale_);
+
+  #pragma omp parallel
+  {
+    std::vector<int> hstart(pooled_height), hend(pooled_height);
+    std::vector<int> wstart(pooled_width), wend(pooled_width);
+
+    // Output channel ctop only scatters into input channels
+    // [ctop*group_size^2, (ctop+1)*group_size^2), so threads never write the same element.
+    #pragma omp for schedule(dynamic)
+    for (int ctop = 0; ctop < output_dim_; ++ctop) {
+      for (int n = 0; n < num_rois; ++n) {
+        const int roi_batch_ind = PSROIPoolBins(bottom_rois + n * 5, spatial_scale, height, width,
+                                                pooled_height, pooled_width,
+                                                &hstart[0], &hend[0], &wstart[0], &wend[0]);
+
+        const DType *offset_top_diff = top_diff + (n * output_dim_ + ctop) * pooled_height * pooled_width;
+        for (int ph = 0; ph < pooled_height; ++ph) {
+          const int gh = PSROIPoolGroup(ph, group_size_, pooled_height);
+          for (int pw = 0; pw < pooled_width; ++pw) {
+            const bool is_empty = (hend[ph] <= hstart[ph]) || (wend[pw] <= wstart[pw]);
+            if (is_empty)
+              continue;
+
+            const int gw = PSROIPoolGroup(pw, group_size_, pooled_width);
+            const int c = (ctop*group_size_ + gh)*group_size_ + gw;
+            DType *offset_bottom_diff = bottom_diff + (roi_batch_ind * channels + c) * height * width;
+            DType bin_area = (hend[ph] - hstart[ph])*(wend[pw] - wstart[pw]);
+            DType diff_val = offset_top_diff[ph*pooled_width + pw] / bin_area;
+            for (int h = hstart[ph]; h < hend[ph]; ++h) {
+              DType *row = offset_bottom_diff + h*width;
+              for (int w = wstart[pw]; w < wend[pw]; ++w) {
+                row[w] += diff_val;
+              }
+            }
+          }
+        }
+      }
+    }
+  }
 }
 }  // namespace mshadow
 
@@ -0,0 +1,251 @@
+# --------------------------------------------------------
+# Fully Convolutional Instance-aware Semantic Segmentation
+# Copyright (c) 2017 Microsoft
+# Licensed under The Apache-2.0 License [see LICENSE for details]
+# --------------------------------------------------------
+
+"""
+Parity tests for the PSROIPooling and ChannelOperator contrib operators.
+
+The CPU kernels are checked, forward and backward, against NumPy ports of the
+CUDA kernels in psroi_pooling.cu and channel_operator.cu. When MXNet was built
+with CUDA and a GPU is present, the CPU outputs are also checked against the
+GPU operator itself.
+
+Run after the operators have been copied into MXNet and MXNet was rebuilt:
+    python fcis/operator_cxx/test_operators.py
+"""
+
+import unittest
+
+import numpy as np
+import mxnet as mx
+
+
+def _gpu_available():
+    try:
+        mx.nd.zeros((1,), ctx=mx.gpu(0)).asnumpy()
+        return True
+    except mx.base.MXNetError:
+        return False
+
+
+def _run(sym, ctx, args, out_grads, grad_req):
+    """Bind sym on ctx, run forward and backward, return (outputs, grads)."""
+    arg_arrays = dict((k, mx.nd.array(v, ctx=ctx)) for k, v in args.items())
+    grad_arrays = dict((k, mx.nd.zeros(v.shape, ctx=ctx))
+                       for k, v in args.items() if grad_req.get(k, 'null') != 'null')
+    exe = sym.bind(ctx, args=arg_arrays, args_grad=grad_arrays, grad_req=grad_req)
+    exe.forward(is_train=True)
+    exe.backward([mx.nd.array(g, ctx=ctx) for g in out_grads])
+    outputs = [o.asnumpy() for o in exe.outputs]
+    grads = dict((k, v.asnumpy()) for k, v in grad_arrays.items())
+    return outputs, grads
+
+
+def _cuda_round(x):
+    # CUDA round() rounds halfway cases away from zero
+    return np.float32(np.sign(x) * np.floor(np.abs(x) + 0.5))
+
+
+def psroi_pooling_reference(data, rois, top_diff, spatial_scale, output_dim, pooled_size, group_size):
+    """NumPy port of PSROIPoolForwardKernel / PSROIPoolBackwardAccKernel."""
+    _, channels, height, width = data.shape
+    num_rois = rois.shape[0]
+    out = np.zeros((num_rois, output_dim, pooled_size, pooled_size), dtype=np.float32)
+    bottom_diff = np.zeros_like(data)
+    scale = np.float32(spatial_scale)
+    for n in range(num_rois):
+        batch_ind = int(rois[n, 0])
+        roi_start_w = _cuda_round(rois[n, 1]) * scale
+        roi_start_h = _cuda_round(rois[n, 2]) * scale
+        roi_end_w = np.float32(_cuda_round(rois[n, 3]) + 1.) * scale
+        roi_end_h = np.float32(_cuda_round(rois[n, 4]) + 1.) * scale
+        roi_width = max(roi_end_w - roi_start_w, np.float32(0.1))
+        roi_height = max(roi_end_h - roi_start_h, np.float32(0.1))
+        bin_size_h = np.float32(roi_height / np.float32(pooled_size))
+        bin_size_w = np.float32(roi_width / np.float32(pooled_size))
+        for ctop in range(output_dim):
+            for ph in range(pooled_size):
+                for pw in range(pooled_size):
+                    hstart = int(np.floor(np.float32(ph) * bin_size_h + roi_start_h))
+                    wstart = int(np.floor(np.float32(pw) * bin_size_w + roi_start_w))
+                    hend = int(np.ceil(np.float32(ph + 1) * bin_size_h + roi_start_h))
+                    wend = int(np.ceil(np.float32(pw + 1) * bin_size_w + roi_start_w))
+                    hstart = min(max(hstart, 0), height)
+                    hend = min(max(hend, 0), height)
+                    wstart = min(max(wstart, 0), width)
+                    wend = min(max(wend, 0), width)
+                    if hend <= hstart or wend <= wstart:
+                        continue
+                    gw = min(max(pw * group_size // pooled_size, 0), group_size - 1)
+                    gh = min(max(ph * group_size // pooled_size, 0), group_size - 1)
+                    c = (ctop * group_size + gh) * group_size + gw
+                    bin_area = np.float32((hend - hstart) * (wend - wstart))
+                    out[n, ctop, ph, pw] = data[batch_ind, c, hstart:hend, wstart:wend].sum() / bin_area
+                    bottom_diff[batch_ind, c, hstart:hend, wstart:wend] += top_diff[n, ctop, ph, pw] / bin_area
+    return out, bottom_diff
+
+
+def group_max_reference(data, top_diff, group):
+    """NumPy port of GroupMaxForwardKernel / GroupMaxBackwardAccKernel."""
+    num, channels, height, width = data.shape
+    channels_in_group = channels // group
+    grouped = data.reshape(num, group, channels_in_group, height, width)
+    arg = grouped.argmax(axis=2)
+    out = grouped.max(axis=2)
+    max_idx = (arg + np.arange(group).reshape(1, group, 1, 1) * channels_in_group).astype(np.float32)
+    bottom_diff = np.zeros_like(data)
+    n_idx, g_idx, h_idx, w_idx = np.indices(out.shape)
+    bottom_diff[n_idx, max_idx.astype(np.int64), h_idx, w_idx] = top_diff
+    return out, max_idx, bottom_diff
+
+
+def group_pick_reference(data, pick_idx, top_diff, group):
+    """NumPy port of GroupPickForwardKernel / GroupPickBackwardAccKernel."""
+    num, channels, height, width = data.shape
+    channels_in_group = channels // group
+    out = np.zeros((num, channels_in_group, height, width), dtype=np.float32)
+    bottom_diff = np.zeros_like(data)
+    for n in range(num):
+        g = int(pick_idx[n, 0, 0, 0])
+        if 0 <= g < group:
+            out[n] = data[n, g * channels_in_group:(g + 1) * channels_in_group]
+            bottom_diff[n, g * channels_in_group:(g + 1) * channels_in_group] = top_diff[n]
+    return out, bottom_diff
+
+
+def group_softmax_reference(data, group):
+    num, channels, height, width = data.shape
+    grouped = data.reshape(num * group, channels // group, -1)
+    e = np.exp(grouped - grouped.max(axis=1, keepdims=True))
+    return (e / e.sum(axis=1, keepdims=True)).reshape(data.shape)
+
+
+class TestPSROIPooling(unittest.TestCase):
+    spatial_scale = 0.0625
+    output_dim = 3
+    pooled_size = 7
+    group_size = 7
+
+    def setUp(self):
+        rng = np.random.RandomState(0)
+        channels = self.output_dim * self.group_size * self.group_size
+        self.data = rng.randn(2, channels, 24, 30).astype(np.float32)
+        # integer corners keep the CUDA/NumPy rounding identical; the last
+        # ROIs are degenerate and partially outside the feature map
+        self.rois = np.array([[0, 0, 0, 479, 383],
+                              [1, 32, 48, 300, 200],
+                              [0, 100, 60, 180, 100],
+                              [1, 200, 100, 200, 100],
+                              [0, 400, 300, 700, 600]], dtype=np.float32)
+        out_shape = (self.rois.shape[0], self.output_dim, self.pooled_size, self.pooled_size)
+        self.top_diff = rng.randn(*out_shape).astype(np.float32)
+        self.sym = mx.contrib.sym.PSROIPooling(data=mx.sym.Variable('data'), rois=mx.sym.Variable('rois'),
+                                               spatial_scale=self.spatial_scale, output_dim=self.output_dim,
+                                               pooled_size=self.pooled_size, group_size=self.group_size)
+
+    def run_on(self, ctx):
+        return _run(self.sym, ctx, {'data': self.data, 'rois': self.rois}, [self.top_diff],
+                    {'data': 'write', 'rois': 'null'})
+
+    def test_cpu_matches_reference(self):
+        outputs, grads = self.run_on(mx.cpu())
+        ref_out, ref_diff = psroi_pooling_reference(self.data, self.rois, self.top_diff, self.spatial_scale,
+                                                    self.output_dim, self.pooled_size, self.group_size)
+        np.testing.assert_allclose(outputs[0], ref_out, rtol=1e-5, atol=1e-5)
+        np.testing.assert_allclose(grads['data'], ref_diff, rtol=1e-5, atol=1e-5)
+
+    @unittest.skipUnless(_gpu_available(), 'no GPU available')
+    def test_cpu_matches_gpu(self):
+        cpu_outputs, cpu_grads = self.run_on(mx.cpu())
+        gpu_outputs, gpu_grads = self.run_on(mx.gpu(0))
+        np.testing.assert_allclose(cpu_outputs[0], gpu_outputs[0], rtol=1e-5, atol=1e-5)
+        np.testing.assert_allclose(cpu_grads['data'], gpu_grads['data'], rtol=1e-5, atol=1e-5)
+
+
+class TestChannelOperator(unittest.TestCase):
+    group = 4
+    channels_in_group = 5
+
+    def setUp(self):
+        rng = np.random.RandomState(1)
+        self.data = rng.randn(3, self.group * self.channels_in_group, 6, 7).astype(np.float32)
+        # the last label is out of range and must produce zeros
+        self.pick_idx = np.array([2, 0, self.group], dtype=np.float32).reshape(3, 1, 1, 1)
+        self.rng = rng
+
+    def max_sym(self):
+        return mx.contrib.sym.ChannelOperator(data=mx.sym.Variable('data'), group=self.group,
+                                              op_type='Group_Max')
+
+    def pick_sym(self):
+        return mx.contrib.sym.ChannelOperator(data=mx.sym.Variable('data'),
+                                              pick_idx=mx.sym.Variable('pick_idx'), group=self.group,
+                                              op_type='Group_Pick', pick_type='Label_Pick')
+
+    def softmax_sym(self):
+        return mx.contrib.sym.ChannelOperator(data=mx.sym.Variable('data'), group=self.group,
+                                              op_type='Group_Softmax')
+
+    def run_max(self, ctx, top_diff):
+        return _run(self.max_sym(), ctx, {'data': self.data}, [top_diff, np.zeros_like(top_diff)],
+                    {'data': 'write'})
+
+    def run_pick(self, ctx, top_diff):
+        return _run(self.pick_sym(), ctx, {'data': self.data, 'pick_idx': self.pick_idx}, [top_diff],
+                    {'data': 'write', 'pick_idx': 'null'})
+
+    def run_softmax(self, ctx):
+        exe = self.softmax_sym().bind(ctx, args={'data': mx.nd.array(self.data, ctx=ctx)})
+        exe.forward(is_train=False)
+        return exe.outputs[0].asnumpy()
+
+    def max_diff(self):
+        num, _, height, width = self.data.shape
+        return self.rng.randn(num, self.group, height, width).astype(np.float32)
+
+    def pick_diff(self):
+        num, _, height, width = self.data.shape
+        return self.rng.randn(num, self.channels_in_group, height, width).astype(np.float32)
+
+    def test_group_max_cpu_matches_reference(self):
+        top_diff = self.max_diff()
+        outputs, grads = self.run_max(mx.cpu(), top_diff)
+        ref_out, ref_idx, ref_diff = group_max_reference(self.data, top_diff, self.group)
+        np.testing.assert_allclose(outputs[0], ref_out)
+        np.testing.assert_array_equal(outputs[1], ref_idx)
+        np.testing.assert_allclose(grads['data'], ref_diff)
+
+    def test_group_pick_cpu_matches_reference(self):
+        top_diff = self.pick_diff()
+        outputs, grads = self.run_pick(mx.cpu(), top_diff)
+        ref_out, ref_diff = group_pick_reference(self.data, self.pick_idx, top_diff, self.group)
+        np.testing.assert_allclose(outputs[0], ref_out)
+        np.testing.assert_allclose(grads['data'], ref_diff)
+
+    def test_group_softmax_cpu_matches_reference(self):
+        np.testing.assert_allclose(self.run_softmax(mx.cpu()), group_softmax_reference(self.data, self.group),
+                                   rtol=1e-5, atol=1e-6)
+
+    @unittest.skipUnless(_gpu_available(), 'no GPU available')
+    def test_cpu_matches_gpu(self):
+        top_diff = self.max_diff()
+        cpu_outputs, cpu_grads = self.run_max(mx.cpu(), top_diff)
+        gpu_outputs, gpu_grads = self.run_max(mx.gpu(0), top_diff)
+        for cpu, gpu in zip(cpu_outputs, gpu_outputs):
+            np.testing.assert_allclose(cpu, gpu)
+        np.testing.assert_allclose(cpu_grads['data'], gpu_grads['data'])
+
+        top_diff = self.pick_diff()
+        cpu_outputs, cpu_grads = self.run_pick(mx.cpu(), top_diff)
+        gpu_outputs, gpu_grads = self.run_pick(mx.gpu(0), top_diff)
+        np.testing.assert_allclose(cpu_outputs[0], gpu_outputs[0])
+        np.testing.assert_allclose(cpu_grads['data'], gpu_grads['data'])
+
+        np.testing.assert_allclose(self.run_softmax(mx.cpu()), self.run_softmax(mx.gpu(0)),
+                                   rtol=1e-5, atol=1e-6)
+
+
+if __name__ == '__main__':
+    unittest.main()
@@ -0,0 +1,69 @@
+# --------------------------------------------------------
+# Fully Convolutional Instance-aware Semantic Segmentation
+# Copyright (c) 2017 Microsoft
+# Licensed under The Apache-2.0 License [see LICENSE for details]
+# Written by Haozhi Qi
+# --------------------------------------------------------
+
+"""
+Compare the CPU mask voting kernel (cpu_mv) against gpu_mv on random detections.
+Run from FCIS/lib after building with setup_linux.py:
+    python -m mask.benchmark_mv
+"""
+
+import time
+import numpy as np
+
+from mask.cpu_mv import mv as cpu_mv
+try:
+    from mask.gpu_mv import mv as gpu_mv
+except ImportError:
+    gpu_mv = None
+
+
+def random_inputs(num_boxes, num_results, im_height, im_width, mask_size=21, max_candidates=8, seed=0):
+    rng = np.random.RandomState(seed)
+    x1 = rng.uniform(-10, im_width * 0.9, num_boxes)
+    y1 = rng.uniform(-10, im_height * 0.9, num_boxes)
+    x2 = x1 + rng.uniform(10, im_width * 0.4, num_boxes)
+    y2 = y1 + rng.uniform(10, im_height * 0.4, num_boxes)
+    boxes = np.round(np.vstack((x1, y1, x2, y2)).T).astype(np.float32)
+    masks = rng.uniform(0, 1, (num_boxes, 1, mask_size, mask_size)).astype(np.float32)
+
+    candidate_inds = []
+    candidate_weights = []
+    candidate_start = []
+    for _ in xrange(num_results):
+        num = rng.randint(1, max_candidates + 1)
+        weights = rng.uniform(0, 1, num)
+        candidate_inds.extend(rng.randint(0, num_boxes, num))
+        candidate_weights.extend(weights / weights.sum())
+        candidate_start.append(len(candidate_inds))
+    return boxes, masks, np.array(candidate_inds, dtype=np.int32), \
+        np.array(candidate_start, dtype=np.int32), np.array(candidate_weights, dtype=np.float32)
+
+
+def time_kernel(kernel, args, repeat):
+    result = kernel(*args)
+    tic = time.time()
+    for _ in xrange(repeat):
+        kernel(*args)
+    return result, (time.time() - tic) / repeat
+
+
+def main(repeat=10):
+    im_height, im_width, binary_thresh = 600, 1000, 0.4
+    for num_boxes, num_results in [(50, 20), (300, 100), (1000, 300)]:
+        boxes, masks, inds, start, weights = random_inputs(num_boxes, num_results, im_height, im_width)
+        args = (boxes, masks, inds, start, weights, binary_thresh, im_height, im_width)
+        (cpu_mask, cpu_box), cpu_time = time_kernel(cpu_mv, args, repeat)
+        line = 'boxes %4d results %4d  cpu_mv %8.2f ms' % (num_boxes, num_results, cpu_time * 1000)
+        if gpu_mv is not None:
+            (gpu_mask, gpu_box), gpu_time = time_kernel(gpu_mv, args, repeat)
+            line += '  gpu_mv %8.2f ms  max mask diff %.2e  box mismatches %d' % (
+                gpu_time * 1000, np.abs(cpu_mask - gpu_mask).max(), np.any(cpu_box != gpu_box, axis=1).sum())
+        print line
+
+
+if __name__ == '__main__':
+    main()
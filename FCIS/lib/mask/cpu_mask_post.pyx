@@ -0,0 +1,61 @@
+# --------------------------------------------------------
+# Fully Convolutional Instance-aware Semantic Segmentation
+# Copyright (c) 2017 Microsoft
+# Licensed under The Apache-2.0 License [see LICENSE for details]
+# --------------------------------------------------------
+
+import numpy as np
+cimport numpy as np
+
+assert sizeof(int) == sizeof(np.int32_t)
+
+cdef extern from "mask_post.hpp":
+    cdef struct MaskBox:
+        int x0, y0, width, height
+    bint _mask_box(np.float32_t* box, np.int32_t image_height, np.int32_t image_width, MaskBox* mask_box)
+    void _decode_mask(np.float32_t* mask, np.int32_t mask_height, np.int32_t mask_width, MaskBox& mask_box, np.float32_t binary_thresh, np.uint8_t* bimask)
+    void _mask_centroids(np.float32_t* boxes, np.int32_t box_dim, np.float32_t* masks, np.int32_t num_dets, np.int32_t mask_height, np.int32_t mask_width, np.float32_t* depth, np.int32_t image_height, np.int32_t image_width, np.float32_t fx, np.float32_t fy, np.float32_t cx, np.float32_t cy, np.float32_t binary_thresh, np.float32_t min_depth, np.float32_t max_depth, np.float32_t outlier_sigma, np.float64_t* centroids, np.int32_t* num_points)
+
+# box: x1, y1, x2, y2 (, score)
+# mask: mask_size * mask_size
+# returns [x0, y0, x1, y1] of the decoded pixels and the binary mask of that window,
+# or None, None if the box is outside of the image
+def decode_mask(np.ndarray[np.float32_t, ndim=1] box,
+                np.ndarray[np.float32_t, ndim=2] mask,
+                np.float32_t binary_thresh,
+                np.int32_t image_height,
+                np.int32_t image_width):
+    cdef MaskBox mask_box
+    mask = np.ascontiguousarray(mask)
+    if not _mask_box(&box[0], image_height, image_width, &mask_box):
+        return None, None
+    cdef np.ndarray[np.uint8_t, ndim=2] \
+        bimask = np.empty((mask_box.height, mask_box.width), dtype=np.uint8)
+    _decode_mask(&mask[0, 0], mask.shape[0], mask.shape[1], mask_box, binary_thresh, &bimask[0, 0])
+    cod = np.array([mask_box.x0, mask_box.y0,
+                    mask_box.x0 + mask_box.width - 1, mask_box.y0 + mask_box.height - 1], dtype=np.int32)
+    return cod, bimask
+
+# boxes: n * 4 (or n * 5 detections)
+# masks: n * mask_size * mask_size
+# depth: image_height * image_width in meters
+# returns the camera frame centroids n * 3 and the number of depth points behind each
+def mask_centroids(np.ndarray[np.float32_t, ndim=2] boxes,
+                   np.ndarray[np.float32_t, ndim=3] masks,
+                   np.ndarray[np.float32_t, ndim=2] depth,
+                   np.float32_t fx, np.float32_t fy, np.float32_t cx, np.float32_t cy,
+                   np.float32_t binary_thresh,
+                   np.float32_t min_depth = 0.1,
+                   np.float32_t max_depth = 12.0,
+                   np.float32_t outlier_sigma = 3.0):
+    cdef int num_dets = boxes.shape[0]
+    boxes = np.ascontiguousarray(boxes)
+    masks = np.ascontiguousarray(masks)
+    depth = np.ascontiguousarray(depth)
+    cdef np.ndarray[np.float64_t, ndim=2] centroids = np.zeros((num_dets, 3), dtype=np.float64)
+    cdef np.ndarray[np.int32_t, ndim=1] num_points = np.zeros(num_dets, dtype=np.int32)
+    if num_dets > 0:
+        _mask_centroids(&boxes[0, 0], boxes.shape[1], &masks[0, 0, 0], num_dets, masks.shape[1], masks.shape[2],
+                        &depth[0, 0], depth.shape[0], depth.shape[1], fx, fy, cx, cy,
+                        binary_thresh, min_depth, max_depth, outlier_sigma, &centroids[0, 0], &num_points[0])
+    return centroids, num_points
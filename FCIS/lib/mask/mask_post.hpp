@@ -0,0 +1,51 @@
+// ------------------------------------------------------------------
+// Fully Convolutional Instance-aware Semantic Segmentation
+// Copyright (c) 2017 Microsoft
+// Licensed under The Apache-2.0 License [see LICENSE for details]
+// ------------------------------------------------------------------
+
+// Post-processing of the detections sent to SLAM: mask decoding, masked depth
+// back-projection and object centroids. Plain C++, wrapped for the python server
+// by cpu_mask_post.pyx.
+
+#ifndef FCIS_MASK_POST_HPP
+#define FCIS_MASK_POST_HPP
+
+// Pixels of the image covered by a detection box: the box corners truncated to
+// integers, right and bottom inclusive, clipped to the image
+struct MaskBox {
+  int x0, y0, width, height;
+};
+
+// Returns false when the box covers no pixel of the image
+bool _mask_box(const float* box, const int image_height, const int image_width, MaskBox* mask_box);
+
+// Resizes a mask_height x mask_width probability mask to the box with the same
+// sampling as cv2.resize (INTER_LINEAR) and thresholds it.
+// bimask is mask_box.height x mask_box.width, 1 inside the object and 0 outside.
+void _decode_mask(const float* mask, const int mask_height, const int mask_width,
+        const MaskBox& mask_box, const float binary_thresh, unsigned char* bimask);
+
+// Back-projects the depth (meters, image_width per row) under the decoded mask with
+// the pinhole intrinsics and writes the centroid of the points to centroid[3].
+// Depths outside [min_depth, max_depth] are invalid. With outlier_sigma > 0 the
+// points whose depth is further than outlier_sigma robust deviations (MAD) from the
+// median depth (and by at least 1% of it) are rejected first, these are usually
+// background seen through the mask border. Returns the number of points used, the centroid is 0 if there are none.
+int _mask_centroid(const unsigned char* bimask, const MaskBox& mask_box,
+        const float* depth, const int image_width,
+        const float fx, const float fy, const float cx, const float cy,
+        const float min_depth, const float max_depth, const float outlier_sigma,
+        double* centroid);
+
+// Decodes all the detections of one image and computes their centroids.
+// boxes is num_dets x box_dim (x1, y1, x2, y2, ...), masks num_dets x mask_height x mask_width,
+// centroids num_dets x 3 and num_points num_dets.
+void _mask_centroids(const float* boxes, const int box_dim,
+        const float* masks, const int num_dets, const int mask_height, const int mask_width,
+        const float* depth, const int image_height, const int image_width,
+        const float fx, const float fy, const float cx, const float cy,
+        const float binary_thresh, const float min_depth, const float max_depth, const float outlier_sigma,
+        double* centroids, int* num_points);
+
+#endif // FCIS_MASK_POST_HPP
@@ -0,0 +1,173 @@
+// ------------------------------------------------------------------
+// Fully Convolutional Instance-aware Semantic Segmentation
+// Copyright (c) 2017 Microsoft
+// Licensed under The Apache-2.0 License [see LICENSE for details]
+// ------------------------------------------------------------------
+
+#include "mask_post.hpp"
+#include <algorithm>
+#include <cmath>
+#include <vector>
+
+bool _mask_box(const float* box, const int image_height, const int image_width, MaskBox* mask_box) {
+  const int x1 = std::max(0, (int) box[0]);
+  const int y1 = std::max(0, (int) box[1]);
+  const int x2 = (int) box[2];
+  const int y2 = (int) box[3];
+  // a box of zero width or height is dropped even though it touches one pixel column/row
+  if (std::min(x2, image_width) <= x1 || std::min(y2, image_height) <= y1) return false;
+  mask_box->x0 = x1;
+  mask_box->y0 = y1;
+  mask_box->width = std::min(x2 + 1, image_width) - x1;
+  mask_box->height = std::min(y2 + 1, image_height) - y1;
+  return true;
+}
+
+// Source index and weight of the second sample for each destination pixel,
+// as computed by cv::resize with INTER_LINEAR
+static void linear_table(const int src_size, const int dst_size, int* index, float* weight) {
+  const double scale = (double) src_size / dst_size;
+  for (int d = 0; d < dst_size; ++d) {
+    float f = (float) ((d + 0.5) * scale - 0.5);
+    int s = (int) std::floor(f);
+    f -= s;
+    if (s < 0) {
+      s = 0;
+      f = 0.f;
+    }
+    if (s >= src_size - 1) {
+      s = src_size - 1;
+      f = 0.f;
+    }
+    index[d] = s;
+    weight[d] = f;
+  }
+}
+
+void _decode_mask(const float* mask, const int mask_height, const int mask_width,
+        const MaskBox& mask_box, const float binary_thresh, unsigned char* bimask) {
+  const int width = mask_box.width;
+  const int height = mask_box.height;
+  std::vector<int> xs(width), ys(height);
+  std::vector<float> wx(width), wy(height);
+  linear_table(mask_width, width, &xs[0], &wx[0]);
+  linear_table(mask_height, height, &ys[0], &wy[0]);
+
+  // horizontal pass over the mask rows, then vertical interpolation of two rows
+  std::vector<float> rows((size_t) mask_height * width);
+  for (int h = 0; h < mask_height; ++h) {
+    const float* src = mask + h * mask_width;
+    float* dst = &rows[0] + (size_t) h * width;
+    for (int x = 0; x < width; ++x) {
+      const int s = xs[x];
+      const int s1 = std::min(s + 1, mask_width - 1);
+      dst[x] = src[s] * (1.f - wx[x]) + src[s1] * wx[x];
+    }
+  }
+  for (int y = 0; y < height; ++y) {
+    const int s = ys[y];
+    const int s1 = std::min(s + 1, mask_height - 1);
+    const float* top = &rows[0] + (size_t) s * width;
+    const float* bottom = &rows[0] + (size_t) s1 * width;
+    const float b = wy[y], t = 1.f - b;
+    unsigned char* out = bimask + (size_t) y * width;
+    for (int x = 0; x < width; ++x) {
+      out[x] = (top[x] * t + bottom[x] * b) >= binary_thresh ? 1 : 0;
+    }
+  }
+}
+
+static inline float median(std::vector<float>& values) {
+  std::vector<float>::iterator mid = values.begin() + values.size() / 2;
+  std::nth_element(values.begin(), mid, values.end());
+  return *mid;
+}
+
+int _mask_centroid(const unsigned char* bimask, const MaskBox& mask_box,
+        const float* depth, const int image_width,
+        const float fx, const float fy, const float cx, const float cy,
+        const float min_depth, const float max_depth, const float outlier_sigma,
+        double* centroid) {
+  const int width = mask_box.width;
+  const int height = mask_box.height;
+  float lo = min_depth, hi = max_depth;
+
+  if (outlier_sigma > 0) {
+    std::vector<float> zs;
+    zs.reserve((size_t) width * height);
+    for (int y = 0; y < height; ++y) {
+      const float* d = depth + (size_t) (mask_box.y0 + y) * image_width + mask_box.x0;
+      const unsigned char* m = bimask + (size_t) y * width;
+      for (int x = 0; x < width; ++x) {
+        if (m[x] && d[x] >= min_depth && d[x] <= max_depth) zs.push_back(d[x]);
+      }
+    }
+    // too few points to tell the object from the outliers
+    if (zs.size() >= 3) {
+      const float med = median(zs);
+      for (size_t i = 0; i < zs.size(); ++i) zs[i] = std::fabs(zs[i] - med);
+      // the MAD is 0 when most samples share the median (quantized depth, flat
+      // surfaces), the band is kept at least 1% of the depth
+      const float band = std::max(outlier_sigma * 1.4826f * median(zs), 0.01f * med);
+      lo = std::max(lo, med - band);
+      hi = std::min(hi, med + band);
+    }
+  }
+
+  double sum_x = 0, sum_y = 0, sum_z = 0;
+  int num = 0;
+  for (int y = 0; y < height; ++y) {
+    const int v = mask_box.y0 + y;
+    const float* d = depth + (size_t) v * image_width + mask_box.x0;
+    const unsigned char* m = bimask + (size_t) y * width;
+    const double ry = (v - cy) / (double) fy;
+    for (int x = 0; x < width; ++x) {
+      const float z = d[x];
+      if (!m[x] || !(z >= lo && z <= hi)) continue;
+      sum_x += z * ((mask_box.x0 + x - cx) / (double) fx);
+      sum_y += z * ry;
+      sum_z += z;
+      ++num;
+    }
+  }
+
+  if (num == 0) {
+    centroid[0] = centroid[1] = centroid[2] = 0;
+  } else {
+    centroid[0] = sum_x / num;
+    centroid[1] = sum_y / num;
+    centroid[2] = sum_z / num;
+  }
+  return num;
+}
+
+void _mask_centroids(const float* boxes, const int box_dim,
+        const float* masks, const int num_dets, const int mask_height, const int mask_width,
+        const float* depth, const int image_height, const int image_width,
+        const float fx, const float fy, const float cx, const float cy,
+        const float binary_thresh, const float min_depth, const float max_depth, const float outlier_sigma,
+        double* centroids, int* num_points) {
+#ifdef _OPENMP
+  #pragma omp parallel
+#endif
+  {
+    std::vector<unsigned char> bimask;
+#ifdef _OPENMP
+    #pragma omp for schedule(dynamic)
+#endif
+    for (int n = 0; n < num_dets; ++n) {
+      double* centroid = centroids + n * 3;
+      MaskBox mask_box;
+      if (!_mask_box(boxes + n * box_dim, image_height, image_width, &mask_box)) {
+        centroid[0] = centroid[1] = centroid[2] = 0;
+        num_points[n] = 0;
+        continue;
+      }
+      bimask.resize((size_t) mask_box.width * mask_box.height);
+      _decode_mask(masks + (size_t) n * mask_height * mask_width, mask_height, mask_width,
+                   mask_box, binary_thresh, &bimask[0]);
+      num_points[n] = _mask_centroid(&bimask[0], mask_box, depth, image_width, fx, fy, cx, cy,
+                                     min_depth, max_depth, outlier_sigma, centroid);
+    }
+  }
+}
@@ -12,7 +12,12 @@ import hickle as hkl
 
 from bbox.bbox_transform import bbox_overlaps
 from nms.nms import py_nms_wrapper, gpu_nms_wrapper, cpu_nms_wrapper
-from mask.gpu_mv import mv as mask_voting_kernel
+from mask.cpu_mv import mv as cpu_mask_voting_kernel
+try:
+    from mask.gpu_mv import mv as mask_voting_kernel
+except ImportError:
+    # built without CUDA, only cpu_mv_mask_voting is usable
+    mask_voting_kernel = None
 
 
 def get_gt_masks(gt_mask_file, size):
@@ -195,6 +200,22 @@ def gpu_mask_voting(masks, boxes, scores, num_classes, max_per_image, im_width,
     A wrapper function, note we already know the class of boxes and masks
     """
     nms = gpu_nms_wrapper(nms_thresh, device_id)
+    return _kernel_mask_voting(mask_voting_kernel, nms, masks, boxes, scores, num_classes, max_per_image,
+                               im_width, im_height, merge_thresh, binary_thresh, device_id)
+
+
+def cpu_mv_mask_voting(masks, boxes, scores, num_classes, max_per_image, im_width, im_height,
+                       nms_thresh, merge_thresh, binary_thresh=0.4):
+    """
+    Same as gpu_mask_voting, with the native CPU kernel (cpu_mv) and cpu_nms
+    """
+    nms = cpu_nms_wrapper(nms_thresh)
+    return _kernel_mask_voting(cpu_mask_voting_kernel, nms, masks, boxes, scores, num_classes, max_per_image,
+                               im_width, im_height, merge_thresh, binary_thresh, 0)
+
+
+def _kernel_mask_voting(kernel, nms, masks, boxes, scores, num_classes, max_per_image, im_width, im_height,
+                        merge_thresh, binary_thresh, device_id):
     # Intermediate results
     t_boxes = [[] for _ in xrange(num_classes)]
     t_scores = [[] for _ in xrange(num_classes)]
@@ -227,11 +248,14 @@ def gpu_mask_voting(masks, boxes, scores, num_classes, max_per_image, im_width,
         t_scores[i] = t_scores[i][keep]
 
     # organize helper variable for gpu mask voting
+    all_boxes = boxes.astype(np.float)
     for c in xrange(1, num_classes):
         num_boxes = len(t_boxes[c])
+        # overlaps of all boxes with every kept box of the class in one call
+        if num_boxes > 0:
+            cls_ov = bbox_overlaps(all_boxes, t_boxes[c].astype(np.float))
         for i in xrange(num_boxes):
-            cur_ov = bbox_overlaps(boxes.astype(np.float), t_boxes[c][i, np.newaxis].astype(np.float))
-            cur_inds = np.where(cur_ov >= merge_thresh)[0]
+            cur_inds = np.where(cls_ov[:, i] >= merge_thresh)[0]
             candidate_inds.extend(cur_inds)
             cur_weights = scores[cur_inds, c]
             cur_weights = cur_weights / sum(cur_weights)
@@ -258,8 +282,8 @@ def gpu_mask_voting(masks, boxes, scores, num_classes, max_per_image, im_width,
     masks = masks[unique_inds, ...]
 
     boxes = np.round(boxes)
-    result_mask, result_box = mask_voting_kernel(boxes, masks, candidate_inds, candidate_start, candidate_weights,
-                                                 binary_thresh, im_height, im_width, device_id)
+    result_mask, result_box = kernel(boxes, masks, candidate_inds, candidate_start, candidate_weights,
+                                     binary_thresh, im_height, im_width, device_id)
     result_box = np.hstack((result_box, candidate_scores[:, np.newaxis]))
 
     list_result_box = [[] for _ in xrange(num_classes)]
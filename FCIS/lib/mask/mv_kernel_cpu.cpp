@@ -0,0 +1,233 @@
+// ------------------------------------------------------------------
+// Fully Convolutional Instance-aware Semantic Segmentation
+// Copyright (c) 2017 Microsoft
+// Licensed under The Apache-2.0 License [see LICENSE for details]
+// Written by Haozhi Qi
+// ------------------------------------------------------------------
+
+#include "cpu_mv.hpp"
+#include <algorithm>
+#include <cmath>
+#include <vector>
+
+// Reads a dense image
+struct DenseSampler {
+  const float* data;
+  int width;
+  inline float operator()(const int h, const int w) const {
+    return data[h * width + w];
+  }
+};
+
+// Reads an image that is zero outside the window [x0, x1] x [y0, y1]
+struct WindowSampler {
+  const float* data;
+  int x0, y0, x1, y1;
+  inline float operator()(const int h, const int w) const {
+    if (h < y0 || h > y1 || w < x0 || w > x1) return 0.f;
+    return data[(h - y0) * (x1 - x0 + 1) + (w - x0)];
+  }
+};
+
+// Same arithmetic as bilinear_interpolate in mv_kernel.cu
+template <typename Sampler>
+inline float bilinear_interpolate(const Sampler& bottom_data,
+                                  const int input_height, const int input_width,
+                                  float inverse_y, float inverse_x) {
+
+  // deal with cases that inverse elements are out of feature map boundary
+  if (inverse_y <= 0) inverse_y = 0;
+  if (inverse_x <= 0) inverse_x = 0;
+
+  int h_low = (int) inverse_y;
+  int w_low = (int) inverse_x;
+  int h_high;
+  int w_high;
+
+  // handle boundary case
+  if (h_low >= input_height - 1) {
+    h_high = h_low = input_height - 1;
+    inverse_y = (float) h_low;
+  } else {
+    h_high = h_low + 1;
+  }
+
+  if (w_low >= input_width - 1) {
+    w_high = w_low = input_width - 1;
+    inverse_x = (float) w_low;
+  } else {
+    w_high = w_low + 1;
+  }
+
+  float lh = inverse_y - h_low;
+  float lw = inverse_x - w_low;
+  float hh = 1 - lh, hw = 1 - lw;
+  // corner point of interpolation
+  float v1 = bottom_data(h_low, w_low);
+  float v2 = bottom_data(h_low, w_high);
+  float v3 = bottom_data(h_high, w_low);
+  float v4 = bottom_data(h_high, w_high);
+  // weight for each corner
+  float w1 = hh * hw, w2 = hh * lw, w3 = lh * hw, w4 = lh * lw;
+  // do bilinear interpolation
+  float val = (w1 * v1 + w2 * v2 + w3 * v3 + w4 * v4);
+  return val;
+}
+
+// Pixel window of the image touched by a rendered mask
+struct MaskWindow {
+  int x0, y0, width, height;
+  size_t offset;
+};
+
+void _cpu_mv(const float* all_boxes, const float* all_masks, const int all_boxes_num, const int* candidate_inds, const int* candidate_start, const float* candidate_weights, const int candidate_num, const float binary_thresh, const int image_height, const int image_width, const int box_dim, const int mask_size, const int result_num, float* finalize_output_mask, int* finalize_output_box) {
+
+  // 1. Masks are of size mask_size x mask_size. The GPU version renders every mask
+  //    over the whole image, here only the pixels inside the box are rendered and
+  //    stored already binarized. Outside the box the rendered value is 0, so the
+  //    whole image is only needed when binary_thresh <= 0.
+  std::vector<MaskWindow> windows(all_boxes_num);
+  size_t render_size = 0;
+  for (int n = 0; n < all_boxes_num; ++n) {
+    const float* offset_box = all_boxes + n * box_dim;
+    MaskWindow& win = windows[n];
+    if (binary_thresh > 0) {
+      win.x0 = std::max(0, (int) std::ceil(offset_box[0]));
+      win.y0 = std::max(0, (int) std::ceil(offset_box[1]));
+      win.width = std::max(0, std::min(image_width - 1, (int) std::floor(offset_box[2])) - win.x0 + 1);
+      win.height = std::max(0, std::min(image_height - 1, (int) std::floor(offset_box[3])) - win.y0 + 1);
+    } else {
+      win.x0 = 0;
+      win.y0 = 0;
+      win.width = image_width;
+      win.height = image_height;
+    }
+    win.offset = render_size;
+    render_size += (size_t) win.width * win.height;
+  }
+
+  std::vector<unsigned char> render_mask(render_size);
+
+  #pragma omp parallel for schedule(dynamic)
+  for (int n = 0; n < all_boxes_num; ++n) {
+    const MaskWindow& win = windows[n];
+    const float* offset_box = all_boxes + n * box_dim;
+    DenseSampler mask = {all_masks + n * mask_size * mask_size, mask_size};
+    const float box_x1 = offset_box[0];
+    const float box_y1 = offset_box[1];
+    const float box_x2 = offset_box[2];
+    const float box_y2 = offset_box[3];
+    const float box_width = box_x2 - box_x1 + 1.0;
+    const float box_height = box_y2 - box_y1 + 1.0;
+    const float ratio_w = (float) mask_size / box_width;
+    const float ratio_h = (float) mask_size / box_height;
+    unsigned char* offset_render = &render_mask[0] + win.offset;
+    for (int y = 0; y < win.height; ++y) {
+      const int h = win.y0 + y;
+      const float inverse_y = ((float) h - box_y1 + 0.5) * ratio_h - 0.5;
+      for (int x = 0; x < win.width; ++x) {
+        const int w = win.x0 + x;
+        float val = 0.f;
+        if (!(w < box_x1 || w > box_x2 || h < box_y1 || h > box_y2)) {
+          const float inverse_x = ((float) w - box_x1 + 0.5) * ratio_w - 0.5;
+          val = bilinear_interpolate(mask, mask_size, mask_size, inverse_y, inverse_x);
+        }
+        offset_render[y * win.width + x] = val >= binary_thresh ? 1 : 0;
+      }
+    }
+  }
+
+  // 2. Each result is the weighted sum of its candidate masks. It is only non zero
+  //    inside the union of the candidate windows, so it is accumulated there.
+  // 3. Tight boundary of the aggregated mask.
+  // 4. Resize the aggregated mask inside that boundary back to mask_size x mask_size.
+  #pragma omp parallel for schedule(dynamic)
+  for (int r = 0; r < result_num; ++r) {
+    const int start = (r == 0) ? 0 : candidate_start[r-1];
+    const int end = candidate_start[r];
+
+    // with binary_thresh <= 0 every pixel passes, even without candidates
+    int ux0 = image_width, uy0 = image_height, ux1 = -1, uy1 = -1;
+    if (binary_thresh <= 0) {
+      ux0 = 0;
+      uy0 = 0;
+      ux1 = image_width - 1;
+      uy1 = image_height - 1;
+    }
+    for (int i = start; i < end; ++i) {
+      const MaskWindow& win = windows[candidate_inds[i]];
+      if (win.width == 0 || win.height == 0) continue;
+      ux0 = std::min(ux0, win.x0);
+      uy0 = std::min(uy0, win.y0);
+      ux1 = std::max(ux1, win.x0 + win.width - 1);
+      uy1 = std::max(uy1, win.y0 + win.height - 1);
+    }
+
+    std::vector<float> aggregate_mask;
+    const int uw = ux1 - ux0 + 1;
+    const int uh = uy1 - uy0 + 1;
+    if (ux1 >= ux0 && uy1 >= uy0) {
+      aggregate_mask.assign((size_t) uw * uh, 0.f);
+      for (int i = start; i < end; ++i) {
+        const MaskWindow& win = windows[candidate_inds[i]];
+        const float weight = candidate_weights[i];
+        const unsigned char* offset_render = &render_mask[0] + win.offset;
+        for (int y = 0; y < win.height; ++y) {
+          float* dst = &aggregate_mask[0] + (size_t) (win.y0 - uy0 + y) * uw + (win.x0 - ux0);
+          const unsigned char* src = offset_render + y * win.width;
+          for (int x = 0; x < win.width; ++x) {
+            dst[x] += src[x] * weight;
+          }
+        }
+      }
+    }
+
+    // default boundary when the aggregated mask is empty, as in reduce_bounding_x/y
+    int bbox_x1 = image_width / 2, bbox_x2 = image_width / 2;
+    int bbox_y1 = image_height / 2, bbox_y2 = image_height / 2;
+    if (!aggregate_mask.empty()) {
+      int min_x = uw, max_x = -1, min_y = uh, max_y = -1;
+      for (int y = 0; y < uh; ++y) {
+        const float* row = &aggregate_mask[0] + (size_t) y * uw;
+        int row_min = uw, row_max = -1;
+        for (int x = 0; x < uw; ++x) {
+          if (row[x] >= binary_thresh) {
+            row_min = std::min(row_min, x);
+            row_max = x;
+          }
+        }
+        if (row_max >= 0) {
+          min_x = std::min(min_x, row_min);
+          max_x = std::max(max_x, row_max);
+          min_y = std::min(min_y, y);
+          max_y = y;
+        }
+      }
+      if (max_x >= 0) {
+        bbox_x1 = ux0 + min_x;
+        bbox_x2 = ux0 + max_x;
+        bbox_y1 = uy0 + min_y;
+        bbox_y2 = uy0 + max_y;
+      }
+    }
+
+    WindowSampler original_mask = {aggregate_mask.empty() ? NULL : &aggregate_mask[0], ux0, uy0, ux1, uy1};
+    float bbox_width = bbox_x2 - bbox_x1 + 1.0;
+    float bbox_height = bbox_y2 - bbox_y1 + 1.0;
+    float ratio_w = bbox_width / static_cast<float>(mask_size);
+    float ratio_h = bbox_height / static_cast<float>(mask_size);
+    float* resized_mask = finalize_output_mask + r * mask_size * mask_size;
+    for (int h = 0; h < mask_size; ++h) {
+      float inverse_y = bbox_y1 + static_cast<float>(h + 0.5) * ratio_h - 0.5;
+      for (int w = 0; w < mask_size; ++w) {
+        float inverse_x = bbox_x1 + static_cast<float>(w + 0.5) * ratio_w - 0.5;
+        resized_mask[h * mask_size + w] = bilinear_interpolate(original_mask, image_height, image_width, inverse_y, inverse_x);
+      }
+    }
+
+    finalize_output_box[r * box_dim] = bbox_x1;
+    finalize_output_box[r * box_dim + 1] = bbox_y1;
+    finalize_output_box[r * box_dim + 2] = bbox_x2;
+    finalize_output_box[r * box_dim + 3] = bbox_y2;
+  }
+}
@@ -53,7 +53,11 @@ def locate_cuda():
             raise EnvironmentError('The CUDA %s path could not be located in %s' % (k, v))
 
     return cudaconfig
-CUDA = locate_cuda()
+# CUDA is optional, without it only the CPU extensions are built
+try:
+    CUDA = locate_cuda()
+except EnvironmentError:
+    CUDA = None
 
 
 # Obtain the numpy include directory.  This logic works across numpy versions.
@@ -107,25 +111,43 @@ class custom_build_ext(build_ext):
 
 
 ext_modules = [
-    Extension('gpu_mv',
-        ['mv_kernel.cu', 'gpu_mv.pyx'],
-        library_dirs=[CUDA['lib64']],
-        libraries=['cudart'],
+    Extension('cpu_mv',
+        ['mv_kernel_cpu.cpp', 'cpu_mv.pyx'],
+        language='c++',
+        extra_compile_args={'gcc': ["-Wno-unused-function", "-O3", "-fopenmp"]},
+        extra_link_args=['-fopenmp'],
+        include_dirs = [numpy_include]
+    ),
+    Extension('cpu_mask_post',
+        ['mask_post_kernel.cpp', 'cpu_mask_post.pyx'],
         language='c++',
-        runtime_library_dirs=[CUDA['lib64']],
-        # this syntax is specific to this build system
-        # we're only going to use certain compiler args with nvcc and not with
-        # gcc the implementation of this trick is in customize_compiler() below
-        extra_compile_args={'gcc': ["-Wno-unused-function"],
-                            'nvcc': ['-arch=sm_35',
-                                     '--ptxas-options=-v',
-                                     '-c',
-                                     '--compiler-options',
-                                     "'-fPIC'"]},
-        include_dirs = [numpy_include, CUDA['include']]
+        extra_compile_args={'gcc': ["-Wno-unused-function", "-O3", "-fopenmp"]},
+        extra_link_args=['-fopenmp'],
+        include_dirs = [numpy_include]
     ),
 ]
 
+if CUDA is not None:
+    ext_modules.append(
+        Extension('gpu_mv',
+            ['mv_kernel.cu', 'gpu_mv.pyx'],
+            library_dirs=[CUDA['lib64']],
+            libraries=['cudart'],
+            language='c++',
+            runtime_library_dirs=[CUDA['lib64']],
+            # this syntax is specific to this build system
+            # we're only going to use certain compiler args with nvcc and not with
+            # gcc the implementation of this trick is in customize_compiler() below
+            extra_compile_args={'gcc': ["-Wno-unused-function"],
+                                'nvcc': ['-arch=sm_35',
+                                         '--ptxas-options=-v',
+                                         '-c',
+                                         '--compiler-options',
+                                         "'-fPIC'"]},
+            include_dirs = [numpy_include, CUDA['include']]
+        )
+    )
+
 setup(
     name='fast_rcnn',
     ext_modules=ext_modules,
@@ -1,7 +1,11 @@
 import numpy as np
 
 from cpu_nms import cpu_nms
-from gpu_nms import gpu_nms
+try:
+    from gpu_nms import gpu_nms
+except ImportError:
+    # built without CUDA, only the CPU wrappers are usable
+    gpu_nms = None
 
 def py_nms_wrapper(thresh):
     def _nms(dets):
@@ -26,6 +26,7 @@
 
 #include<ros/ros.h>
 #include <cv_bridge/cv_bridge.h>
+#include <sensor_msgs/image_encodings.h>
 #include <message_filters/subscriber.h>
 #include <message_filters/time_synchronizer.h>
 #include <message_filters/sync_policies/approximate_time.h>
@@ -84,8 +85,52 @@ int main(int argc, char **argv)
     return 0;
 }
 
+// Pixel format of a ROS image, false if it has to be converted by cv_bridge
+bool GetPixelFormat(const sensor_msgs::Image& msg, ORB_SLAM2::ImageBuffer::PixelFormat &format)
+{
+    namespace enc = sensor_msgs::image_encodings;
+    const string &e = msg.encoding;
+    if(e==enc::MONO8)
+        format = ORB_SLAM2::ImageBuffer::GRAY8;
+    else if(e==enc::RGB8)
+        format = ORB_SLAM2::ImageBuffer::RGB8;
+    else if(e==enc::BGR8)
+        format = ORB_SLAM2::ImageBuffer::BGR8;
+    else if(e==enc::RGBA8)
+        format = ORB_SLAM2::ImageBuffer::RGBA8;
+    else if(e==enc::BGRA8)
+        format = ORB_SLAM2::ImageBuffer::BGRA8;
+    else if(e==enc::YUV422)
+        format = ORB_SLAM2::ImageBuffer::UYVY;
+    else if(e==enc::BAYER_RGGB8)
+        format = ORB_SLAM2::ImageBuffer::BAYER_RGGB8;
+    else if(e==enc::BAYER_BGGR8)
+        format = ORB_SLAM2::ImageBuffer::BAYER_BGGR8;
+    else if(e==enc::BAYER_GBRG8)
+        format = ORB_SLAM2::ImageBuffer::BAYER_GBRG8;
+    else if(e==enc::BAYER_GRBG8)
+        format = ORB_SLAM2::ImageBuffer::BAYER_GRBG8;
+    else if((e==enc::TYPE_16UC1 || e==enc::MONO16) && !msg.is_bigendian)
+        format = ORB_SLAM2::ImageBuffer::DEPTH16;
+    else if(e==enc::TYPE_32FC1 && !msg.is_bigendian)
+        format = ORB_SLAM2::ImageBuffer::DEPTH32F;
+    else
+        return false;
+    return true;
+}
+
 void ImageGrabber::GrabRGBD(const sensor_msgs::ImageConstPtr& msgRGB,const sensor_msgs::ImageConstPtr& msgD)
 {
+    // Track the message buffers in place, the tracker does not refer to them after the call
+    ORB_SLAM2::ImageBuffer::PixelFormat rgbFormat, depthFormat;
+    if(GetPixelFormat(*msgRGB,rgbFormat) && GetPixelFormat(*msgD,depthFormat))
+    {
+        ORB_SLAM2::ImageBuffer imRGB(msgRGB->data.data(),msgRGB->width,msgRGB->height,msgRGB->step,rgbFormat);
+        ORB_SLAM2::ImageBuffer imD(msgD->data.data(),msgD->width,msgD->height,msgD->step,depthFormat);
+        mpSLAM->TrackRGBD(imRGB,imD,msgRGB->header.stamp.toSec());
+        return;
+    }
+
     // Copy the ros image message to cv::Mat.
     cv_bridge::CvImageConstPtr cv_ptrRGB;
     try
@@ -68,16 +68,27 @@ int main(int argc, char **argv)
     stringstream ss(argv[3]);
 	ss >> boolalpha >> igb.do_rectify;
 
-    if(igb.do_rectify)
-    {      
-        // Load settings related to stereo calibration
-        cv::FileStorage fsSettings(argv[2], cv::FileStorage::READ);
-        if(!fsSettings.isOpened())
+    // The tracker rectifies the images itself if Stereo.Rectify is set
+    cv::FileStorage fsSettings(argv[2], cv::FileStorage::READ);
+    if(!fsSettings.isOpened())
+    {
+        cerr << "ERROR: Wrong path to settings" << endl;
+        return -1;
+    }
+    if((int)fsSettings["Stereo.Rectify"] != 0)
+    {
+        // Rectified input would be warped a second time
+        if(!igb.do_rectify)
         {
-            cerr << "ERROR: Wrong path to settings" << endl;
+            cerr << "ERROR: do_rectify is false but Stereo.Rectify is set, unset it for rectified input" << endl;
+            ros::shutdown();
             return -1;
         }
+        igb.do_rectify = false;
+    }
 
+    if(igb.do_rectify)
+    {
         cv::Mat K_l, K_r, P_l, P_r, R_l, R_r, D_l, D_r;
         fsSettings["LEFT.K"] >> K_l;
         fsSettings["RIGHT.K"] >> K_r;
@@ -93,6 +93,9 @@ int main(int argc, char **argv)
         return -1;
     }
 
+    // The tracker rectifies the images itself if Stereo.Rectify is set
+    const bool bRectifyInTracker = (int)fsSettings["Stereo.Rectify"] != 0;
+
     cv::Mat M1l,M2l,M1r,M2r;
     cv::initUndistortRectifyMap(K_l,D_l,R_l,P_l.rowRange(0,3).colRange(0,3),cv::Size(cols_l,rows_l),CV_32F,M1l,M2l);
     cv::initUndistortRectifyMap(K_r,D_r,R_r,P_r.rowRange(0,3).colRange(0,3),cv::Size(cols_r,rows_r),CV_32F,M1r,M2r);
@@ -133,8 +136,16 @@ int main(int argc, char **argv)
             return 1;
         }
 
-        cv::remap(imLeft,imLeftRect,M1l,M2l,cv::INTER_LINEAR);
-        cv::remap(imRight,imRightRect,M1r,M2r,cv::INTER_LINEAR);
+        if(bRectifyInTracker)
+        {
+            imLeftRect = imLeft;
+            imRightRect = imRight;
+        }
+        else
+        {
+            cv::remap(imLeft,imLeftRect,M1l,M2l,cv::INTER_LINEAR);
+            cv::remap(imRight,imRightRect,M1r,M2r,cv::INTER_LINEAR);
+        }
 
         double tframe = vTimeStamp[ni];
 
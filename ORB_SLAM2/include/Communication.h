@@ -2,6 +2,7 @@
 #define COMMUNICATION_H
 
 #include <vector>
+#include <atomic>
 #include <opencv2/opencv.hpp>
 #include <netinet/in.h>
 
@@ -9,17 +10,36 @@ class Client
 {
 public:
     typedef std::vector<std::pair<std::string, std::vector<std::vector<double> > > > ClsPosPairs;
+    // Binary mask (CV_8U, 1 on the object) of an instance inside its box of the image
+    struct InstanceMask {
+        std::string className;
+        cv::Rect box;
+        cv::Mat mask;
+    };
+    typedef std::vector<InstanceMask> InstanceMasks;
     Client();
     Client(std::string hostname, int port);
     ~Client();
     void sendImages(const std::vector<cv::Mat>& images);
     void getSegResult(ClsPosPairs& pairs);
+    // A segmentation request is the color and depth image of a keyframe tagged with a request id.
+    // Requests can be pipelined, the server batches them and tags each result with the id
+    // of its request, so sending and receiving can run in different threads.
+    // The result also carries the masks of the instances of dynamic classes (see --dynamic_classes).
+    void sendRequest(long unsigned int id, const cv::Mat& color, const cv::Mat& depth);
+    // Returns false if the connection was shut down by shutdownConnection() meanwhile.
+    bool getSegResult(long unsigned int& id, ClsPosPairs& pairs, InstanceMasks& masks);
+    // Unblocks a getSegResult waiting in another thread, the client cannot be used afterwards.
+    void shutdownConnection();
     void error(const char *msg);
     bool recvAll(int socket, void *buffer, int length);
     bool sendAll(int socket, void *buffer, int length);
 
 
 private:
+    bool recvClsPosPairs(ClsPosPairs& pairs);
+    // Exits with msg, unless the connection was shut down on purpose
+    bool failed(const char *msg);
     void closeSocket();
     void setupSocket();
     void connectSocket();
@@ -39,6 +59,7 @@ private:
     int mImMemSize;
     struct hostent *mServer;
     struct sockaddr_in mServAddr;
+    std::atomic<bool> mbShutdown;
 };
 
 
@@ -0,0 +1,133 @@
+/**
+* This file is part of ORB-SLAM2.
+*
+* Copyright (C) 2014-2016 Raúl Mur-Artal <raulmur at unizar dot es> (University of Zaragoza)
+* For more information see <https://github.com/raulmur/ORB_SLAM2>
+*
+* ORB-SLAM2 is free software: you can redistribute it and/or modify
+* it under the terms of the GNU General Public License as published by
+* the Free Software Foundation, either version 3 of the License, or
+* (at your option) any later version.
+*
+* ORB-SLAM2 is distributed in the hope that it will be useful,
+* but WITHOUT ANY WARRANTY; without even the implied warranty of
+* MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+* GNU General Public License for more details.
+*
+* You should have received a copy of the GNU General Public License
+* along with ORB-SLAM2. If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#ifndef DENSEEXPORTER_H
+#define DENSEEXPORTER_H
+
+#include <string>
+#include <vector>
+#include <deque>
+#include <mutex>
+#include <condition_variable>
+
+#include "TsdfVolume.h"
+
+namespace ORB_SLAM2
+{
+
+class Map;
+
+// Builds dense maps from the depth images of the keyframes in its own thread and writes them to
+// disk. Each keyframe is inserted as one scan from its camera center, so octomaps get the free
+// space along the rays and not only the occupied voxels. The exports queued while the worker is
+// busy are built together in a single pass over the keyframes. Meshes come from a TSDF volume kept
+// across exports, only the new keyframes and the ones moved by the optimization are integrated.
+// Only the keyframes of the current sub-map are used, the other sub-maps are in unrelated world
+// frames until loop closing merges them.
+class DenseExporter
+{
+public:
+    enum eFormat{
+        OCTOMAP_FULL=0,   // .ot
+        OCTOMAP_BINARY=1, // .bt
+        PCD=2,
+        PLY=3,
+        MESH_PLY=4
+    };
+
+    DenseExporter(Map* pMap, const std::string &strSettingPath);
+
+    // Main function
+    void Run();
+
+    // Queues an export. The format follows the file extension (.ot, .bt, .pcd, .ply). The resolution
+    // is the voxel size in meters, the default one (DenseMap.Resolution) if not positive.
+    // Returns false if the format is unknown or the exporter has finished.
+    bool RequestExport(const std::string &filename, const float resolution);
+
+    // Queues the export of the TSDF surface as a colored PLY mesh
+    bool RequestMeshExport(const std::string &filename);
+
+    // Fraction of the keyframes processed by the running pass, negative if the exporter is idle
+    float GetProgress();
+
+    // Pending exports are completed before finishing
+    void RequestFinish();
+
+    bool isFinished();
+
+    // Pauses the worker before the next keyframe it reads, the running export is abandoned.
+    // The keyframes can be deleted once isStopped() (Tracking::Reset), then call Release().
+    void RequestStop();
+    bool isStopped();
+    void Release();
+
+protected:
+
+    struct Job
+    {
+        std::string mFilename;
+        eFormat mFormat;
+        float mResolution;
+    };
+
+    bool QueueJob(const Job &job);
+
+    // Returns false if a stop was requested before all the keyframes were read
+    bool Export(const std::vector<Job> &vJobs);
+
+    bool CheckFinish();
+    void SetFinish();
+
+    bool Stop();
+    bool CheckStopRequested();
+
+    Map* mpMap;
+
+    // Back-projection of the depth images
+    int mnPixelStep;
+    float mMinDepth;
+    float mMaxDepth;
+    float mDefaultResolution;
+
+    TsdfVolume mTsdf;
+    // Seconds between background integrations of the TSDF, only at mesh exports if not positive
+    float mTsdfPeriod;
+
+    std::deque<Job> mdJobs;
+    int mnKeyFramesDone;
+    int mnKeyFramesTotal;
+    bool mbExporting;
+    std::mutex mMutexJobs;
+    std::condition_variable mcvJobs;
+
+    bool mbFinishRequested;
+    bool mbFinished;
+    std::mutex mMutexFinish;
+
+    bool mbStopRequested;
+    bool mbStopped;
+    std::mutex mMutexStop;
+    std::condition_variable mcvStop;
+};
+
+}// namespace ORB_SLAM
+
+#endif // DENSEEXPORTER_H
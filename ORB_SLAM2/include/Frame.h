@@ -51,14 +51,15 @@ public:
     // Constructor for stereo cameras.
     Frame(const cv::Mat &imLeft, const cv::Mat &imRight, const double &timeStamp, ORBextractor* extractorLeft, ORBextractor* extractorRight, ORBVocabulary* voc, cv::Mat &K, cv::Mat &distCoef, const float &bf, const float &thDepth);
 
-    // Constructor for RGB-D cameras.
-    Frame(const cv::Mat &imGray, const cv::Mat &imColor, const cv::Mat &imDepth, const double &timeStamp, ORBextractor* extractor,ORBVocabulary* voc, cv::Mat &K, cv::Mat &distCoef, const float &bf, const float &thDepth);
+    // Constructor for RGB-D cameras. Features are only extracted where mask is non zero, if given.
+    Frame(const cv::Mat &imGray, const cv::Mat &imColor, const cv::Mat &imDepth, const double &timeStamp, ORBextractor* extractor,ORBVocabulary* voc, cv::Mat &K, cv::Mat &distCoef, const float &bf, const float &thDepth, const cv::Mat &mask = cv::Mat());
 
     // Constructor for Monocular cameras.
     Frame(const cv::Mat &imGray, const double &timeStamp, ORBextractor* extractor,ORBVocabulary* voc, cv::Mat &K, cv::Mat &distCoef, const float &bf, const float &thDepth);
 
     // Extract ORB on the image. 0 for left image and 1 for right image.
-    void ExtractORB(int flag, const cv::Mat &im);
+    // Features are only extracted where mask is non zero, an empty mask extracts everywhere.
+    void ExtractORB(int flag, const cv::Mat &im, const cv::Mat &mask);
 
     // Compute Bag of Words representation.
     void ComputeBoW();
@@ -149,7 +150,12 @@ public:
     // ORB descriptor, each row associated to a keypoint.
     cv::Mat mDescriptors, mDescriptorsRight;
 
+    // RGB-D images. The depth belongs to the tracker. The color image is the caller's input, only
+    // valid while the frame is tracked, and is not kept by copies of the frame. Keyframes convert it
+    // to their own color image with the cvtColor code mnColorConversion (-1 copies it as is).
     cv::Mat mImColor, mImDepth;
+    int mnColorConversion;
+
     // MapPoints associated to keypoints, NULL pointer if no association.
     std::vector<MapPoint*> mvpMapPoints;
 
@@ -188,13 +194,22 @@ public:
 
     static bool mbInitialComputations;
 
+    // Undistorted position of every pixel, interpolated for the keypoints (CV_32FC2). Computed again
+    // when the image size or the calibration it was computed with (mUndistortK, mUndistortDistCoef) change.
+    static cv::Mat mUndistortLUT;
+    static cv::Mat mUndistortK;
+    static cv::Mat mUndistortDistCoef;
+
 
 private:
 
-    // Undistort keypoints given OpenCV distortion parameters.
-    // Only for the RGB-D case. Stereo must be already rectified!
+    // Undistort keypoints given OpenCV distortion parameters, by bilinear interpolation in
+    // mUndistortLUT. Only for the RGB-D case. Stereo must be already rectified!
     // (called in the constructor).
-    void UndistortKeyPoints();
+    void UndistortKeyPoints(const cv::Size &imSize);
+
+    // Undistorts all the pixel positions of the image into mUndistortLUT, on the shared ThreadPool
+    void ComputeUndistortLUT(const cv::Size &imSize);
 
     // Computes image bounds for the undistorted image (called in the constructor).
     void ComputeImageBounds(const cv::Mat &imLeft);
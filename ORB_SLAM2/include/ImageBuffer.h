@@ -0,0 +1,89 @@
+/**
+* This file is part of ORB-SLAM2.
+*
+* Copyright (C) 2014-2016 Raúl Mur-Artal <raulmur at unizar dot es> (University of Zaragoza)
+* For more information see <https://github.com/raulmur/ORB_SLAM2>
+*
+* ORB-SLAM2 is free software: you can redistribute it and/or modify
+* it under the terms of the GNU General Public License as published by
+* the Free Software Foundation, either version 3 of the License, or
+* (at your option) any later version.
+*
+* ORB-SLAM2 is distributed in the hope that it will be useful,
+* but WITHOUT ANY WARRANTY; without even the implied warranty of
+* MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+* GNU General Public License for more details.
+*
+* You should have received a copy of the GNU General Public License
+* along with ORB-SLAM2. If not, see <http://www.gnu.org/licenses/>.
+*/
+
+
+#ifndef IMAGEBUFFER_H
+#define IMAGEBUFFER_H
+
+#include <opencv2/core/core.hpp>
+
+namespace ORB_SLAM2
+{
+
+// Input image described by its pixel format, wrapping the caller's memory without copying it.
+// Ownership rules: the tracker only reads the buffer during the Track* call (until the future is
+// ready in the pipelined mode). The gray image is converted directly into the first level of the
+// ORB pyramid and the depth into a CV_32F buffer of the tracker. Keyframes keep their own copy of
+// the color image, so the caller can recycle the buffer as soon as the call returns.
+class ImageBuffer
+{
+public:
+    enum PixelFormat
+    {
+        GRAY8=0,
+        RGB8,
+        BGR8,
+        RGBA8,
+        BGRA8,
+        // 4:2:2, Y0 U Y1 V and U Y0 V Y1
+        YUYV,
+        UYVY,
+        // Bayer mosaics named after their first row, as in ROS
+        BAYER_RGGB8,
+        BAYER_BGGR8,
+        BAYER_GBRG8,
+        BAYER_GRBG8,
+        // Depth, in sensor units (see DepthMapFactor)
+        DEPTH16,
+        DEPTH32F
+    };
+
+    ImageBuffer();
+
+    // Buffer of height rows of stride bytes, that must outlive its use (see above)
+    ImageBuffer(const void* data, const int width, const int height, const size_t stride,
+                const PixelFormat format);
+
+    // Shares the image, which is kept alive as long as the ImageBuffer
+    ImageBuffer(const cv::Mat &im, const PixelFormat format);
+
+    bool empty() const { return mData.empty(); }
+
+    // cvtColor code to grayscale, -1 if the image is already gray
+    int GrayConversion() const;
+
+    // cvtColor code to the color image kept by the keyframes, RGB or BGR (4 channels are kept),
+    // -1 if the image is copied as it is
+    int ColorConversion(const bool bRGB) const;
+
+    // Writes the grayscale image in gray, which is used as is if it has the right size and type
+    void ToGray(cv::Mat &gray) const;
+
+    // OpenCV type of the pixels of a format, YUYV/UYVY are CV_8UC2
+    static int PixelType(const PixelFormat format);
+
+    // Header over the pixels, no copy. YUYV/UYVY are seen as CV_8UC2.
+    cv::Mat mData;
+    PixelFormat mFormat;
+};
+
+} //namespace ORB_SLAM
+
+#endif // IMAGEBUFFER_H
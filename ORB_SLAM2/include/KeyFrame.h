@@ -68,6 +68,13 @@ public:
     std::vector<KeyFrame*> GetCovisiblesByWeight(const int &w);
     int GetWeight(KeyFrame* pKF);
 
+    // For every keyframe (except pSkip) observing some of the good MapPoints in vpMPs,
+    // count how many of them it observes. Counting is done on a dense per-thread array
+    // indexed by KeyFrame::mnId. Output is in order of first appearance.
+    static void CountCovisibility(const std::vector<MapPoint*> &vpMPs,
+                                  std::vector<std::pair<KeyFrame*,int> > &vKFCounts,
+                                  KeyFrame* pSkip=NULL);
+
     // Spanning tree functions
     void AddChild(KeyFrame* pKF);
     void EraseChild(KeyFrame* pKF);
@@ -124,6 +131,14 @@ public:
     long unsigned int mnId;
     const long unsigned int mnFrameId;
 
+    // Sub-map of the atlas (see Map), the id of its origin keyframe. Changed by loop closing when merging.
+    long unsigned int mnSubmapId;
+
+    // Set by Map::AddOrigin before the keyframe is shared. An origin is a root of the spanning tree
+    // and is never erased, also once its sub-map has been merged into another one, unless tracking
+    // discards the whole sub-map (Map::EraseOrigin).
+    bool mbOrigin;
+
     const double mTimeStamp;
 
     // Grid (to speed up feature matching)
@@ -140,14 +155,6 @@ public:
     long unsigned int mnBALocalForKF;
     long unsigned int mnBAFixedForKF;
 
-    // Variables used by the keyframe database
-    long unsigned int mnLoopQuery;
-    int mnLoopWords;
-    float mLoopScore;
-    long unsigned int mnRelocQuery;
-    int mnRelocWords;
-    float mRelocScore;
-
     // Variables used by loop closing
     cv::Mat mTcwGBA;
     cv::Mat mTcwBefGBA;
@@ -174,6 +181,8 @@ public:
     cv::Mat mTcp;
 
     const cv::Mat mImDepth;
+    // Color image (RGB-D input), in the order given by Camera.RGB
+    const cv::Mat mImColor;
 
     // Scale
     const int mnScaleLevels;
@@ -28,6 +28,7 @@
 #include "KeyFrame.h"
 #include "Frame.h"
 #include "ORBVocabulary.h"
+#include "Thirdparty/DBoW2/DBoW2/BowVector.h"
 
 #include<mutex>
 
@@ -59,11 +60,44 @@ public:
 
 protected:
 
+  // Entry of the inverted file: a keyframe containing the word and the word weight in it
+  struct Posting
+  {
+      unsigned int nKFId;
+      float weight;
+  };
+
+  // Per-query counters, indexed by keyframe id. Kept outside the keyframes so that loop
+  // detection and relocalization queries do not interfere with each other.
+  struct QueryScratch
+  {
+      std::vector<int> vnWords;
+      std::vector<float> vScore;
+      std::vector<char> vbExcluded;
+      std::vector<unsigned int> vTouched;
+  };
+
+  // Traverse the posting lists of the words in BowVec. Counts shared words and, for L1
+  // scoring, accumulates the similarity score of every keyframe reached.
+  void SearchSharingWords(const DBoW2::BowVector &BowVec, QueryScratch &scratch, std::vector<KeyFrame*> &vpKFsSharingWords);
+
+  // Remove the postings of erased keyframes. Requires mMutex.
+  void Compact();
+
   // Associated vocabulary
   const ORBVocabulary* mpVoc;
 
-  // Inverted file
-  std::vector<list<KeyFrame*> > mvInvertedFile;
+  // True if the vocabulary scores with L1 norm, whose score decomposes per shared word
+  bool mbAccumulateScore;
+
+  // Inverted file. Postings of erased keyframes stay (tombstones) until the next compaction.
+  std::vector<std::vector<Posting> > mvInvertedFile;
+
+  // Keyframes in the database indexed by id, NULL if not added or erased
+  std::vector<KeyFrame*> mvpKeyFrames;
+
+  size_t mnPostings;
+  size_t mnTombstones;
 
   // Mutex
   std::mutex mMutex;
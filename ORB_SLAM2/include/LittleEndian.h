@@ -0,0 +1,75 @@
+/**
+* This file is part of ORB-SLAM2.
+*
+* Copyright (C) 2014-2016 Raúl Mur-Artal <raulmur at unizar dot es> (University of Zaragoza)
+* For more information see <https://github.com/raulmur/ORB_SLAM2>
+*
+* ORB-SLAM2 is free software: you can redistribute it and/or modify
+* it under the terms of the GNU General Public License as published by
+* the Free Software Foundation, either version 3 of the License, or
+* (at your option) any later version.
+*
+* ORB-SLAM2 is distributed in the hope that it will be useful,
+* but WITHOUT ANY WARRANTY; without even the implied warranty of
+* MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+* GNU General Public License for more details.
+*
+* You should have received a copy of the GNU General Public License
+* along with ORB-SLAM2. If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#ifndef LITTLEENDIAN_H
+#define LITTLEENDIAN_H
+
+#include <algorithm>
+#include <cstddef>
+#include <cstring>
+#include <stdint.h>
+
+namespace ORB_SLAM2
+{
+
+// The binary logs and the Publisher protocol are little-endian whatever the host byte order.
+// Integers and IEEE floats are stored with their bytes reversed on a big-endian host.
+
+inline bool IsBigEndianHost()
+{
+    const uint16_t one = 1;
+    return *reinterpret_cast<const unsigned char*>(&one)==0;
+}
+
+// Writes the sizeof(T) bytes of value at p, little-endian
+template<typename T>
+inline void EncodeLittleEndian(const T &value, void *p)
+{
+    unsigned char *bytes = static_cast<unsigned char*>(p);
+    memcpy(bytes, &value, sizeof(T));
+    if(IsBigEndianHost())
+        std::reverse(bytes, bytes+sizeof(T));
+}
+
+// Reads a value written by EncodeLittleEndian
+template<typename T>
+inline T DecodeLittleEndian(const void *p)
+{
+    T value;
+    unsigned char *bytes = reinterpret_cast<unsigned char*>(&value);
+    memcpy(bytes, p, sizeof(T));
+    if(IsBigEndianHost())
+        std::reverse(bytes, bytes+sizeof(T));
+    return value;
+}
+
+// Converts n values of nSize bytes at p between the host and little-endian order, in place
+inline void SwapLittleEndianArray(void *p, const size_t n, const size_t nSize)
+{
+    if(!IsBigEndianHost() || nSize<2)
+        return;
+    unsigned char *bytes = static_cast<unsigned char*>(p);
+    for(size_t i=0; i<n; i++)
+        std::reverse(bytes+i*nSize, bytes+(i+1)*nSize);
+}
+
+} //namespace ORB_SLAM
+
+#endif // LITTLEENDIAN_H
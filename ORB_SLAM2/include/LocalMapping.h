@@ -26,8 +26,12 @@
 #include "LoopClosing.h"
 #include "Tracking.h"
 #include "KeyFrameDatabase.h"
+#include "ORBmatcher.h"
 
 #include <mutex>
+#include <atomic>
+#include <condition_variable>
+#include <chrono>
 
 
 namespace ORB_SLAM2
@@ -40,6 +44,18 @@ class Map;
 class LocalMapping
 {
 public:
+    // Keyframe queue statistics, accumulated since construction or last reset
+    struct QueueStats
+    {
+        unsigned long nInserted;        // keyframes received from Tracking
+        unsigned long nProcessed;       // keyframes taken from the queue
+        unsigned long nLocalBA;         // local BAs started
+        unsigned long nLocalBAAborted;  // local BAs interrupted before convergence
+        size_t nCurrentDepth;
+        size_t nMaxDepth;
+        double dMeanWaitMs;             // mean time a keyframe spends in the queue
+    };
+
     LocalMapping(Map* pMap, const float bMonocular);
 
     void SetLoopCloser(LoopClosing* pLoopCloser);
@@ -72,12 +88,39 @@ public:
         return mlNewKeyFrames.size();
     }
 
+    // Queue depth from which Tracking stops inserting keyframes while Local Mapping is busy
+    int MaxQueuedKeyFrames() const {
+        return mnMaxQueuedKFs;
+    }
+
+    QueueStats GetQueueStats();
+
 protected:
 
     bool CheckNewKeyFrames();
     void ProcessNewKeyFrame();
+
+    // Block until a keyframe is queued or a stop/reset/finish/release is signaled
+    void WaitForWork();
+    // Block until a stop/reset/finish/release is signaled
+    void WaitForSignal();
+    void Signal();
     void CreateNewMapPoints();
 
+    // MapPoint triangulated from a match between the current keyframe and a neighbor,
+    // waiting to be inserted in the map by CreateNewMapPoints
+    struct NewPointCandidate
+    {
+        size_t idx1;
+        size_t idx2;
+        cv::Vec3f x3D;
+    };
+    void TriangulateNeighbors(const std::vector<KeyFrame*> &vpNeighKFs, std::atomic<int> &nNextNeigh,
+                              std::vector<std::vector<NewPointCandidate> > &vvCandidates, std::vector<char> &vbProcessed);
+    void TriangulateWithNeighbor(ORBmatcher &matcher, KeyFrame* pKF2, std::vector<NewPointCandidate> &vCandidates);
+    static bool Triangulate(const cv::Vec3f &xn1, const cv::Matx33f &Rcw1, const cv::Vec3f &tcw1,
+                            const cv::Vec3f &xn2, const cv::Matx33f &Rcw2, const cv::Vec3f &tcw2, cv::Vec3f &x3D);
+
     void MapPointCulling();
     void SearchInNeighbors();
 
@@ -92,6 +135,7 @@ protected:
     void ResetIfRequested();
     bool mbResetRequested;
     std::mutex mMutexReset;
+    std::condition_variable mcvReset;
 
     bool CheckFinish();
     void SetFinish();
@@ -111,6 +155,23 @@ protected:
     std::list<MapPoint*> mlpRecentAddedMapPoints;
 
     std::mutex mMutexNewKFs;
+    std::condition_variable mcvNewKFs;
+    // Incremented by Signal(), guarded by mMutexNewKFs
+    unsigned long mnSignals;
+    unsigned long mnSignalsSeen;
+
+    // Insertion time of each keyframe in mlNewKeyFrames
+    std::list<std::chrono::steady_clock::time_point> mlNewKeyFrameTimes;
+    QueueStats mQueueStats;
+    double mdTotalWaitMs;
+
+    // Scheduling policy. A local BA is aborted by new keyframes only when mnAbortBADepth of
+    // them are waiting, and pending keyframes are batched under one local BA up to
+    // mnMaxKFsPerLocalBA keyframes.
+    int mnAbortBADepth;
+    int mnMaxKFsPerLocalBA;
+    int mnMaxQueuedKFs;
+    int mnKFsSinceLocalBA;
 
     bool mbAbortBA;
 
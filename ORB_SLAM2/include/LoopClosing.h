@@ -28,9 +28,12 @@
 #include "Tracking.h"
 
 #include "KeyFrameDatabase.h"
+#include "ORBmatcher.h"
 
 #include <thread>
 #include <mutex>
+#include <atomic>
+#include <condition_variable>
 #include "Thirdparty/g2o/g2o/types/types_seven_dof_expmap.h"
 
 namespace ORB_SLAM2
@@ -62,6 +65,11 @@ public:
 
     void InsertKeyFrame(KeyFrame *pKF);
 
+    int KeyframesInQueue(){
+        unique_lock<std::mutex> lock(mMutexLoopQueue);
+        return mlpLoopKeyFrameQueue.size();
+    }
+
     void RequestReset();
 
     // This function will run in a separate thread
@@ -86,17 +94,47 @@ protected:
 
     bool CheckNewKeyFrames();
 
+    // Block until a keyframe is queued or a reset/finish is signaled
+    void WaitForWork();
+    void Signal();
+
     bool DetectLoop();
 
+    // Outcome of the geometric verification of one consistent candidate
+    struct Sim3Candidate
+    {
+        g2o::Sim3 gScm;
+        std::vector<MapPoint*> vpMatchedPoints;
+        EIGEN_MAKE_ALIGNED_OPERATOR_NEW
+    };
+    typedef std::vector<Sim3Candidate,Eigen::aligned_allocator<Sim3Candidate> > Sim3CandidateVector;
+
     bool ComputeSim3();
 
+    // Worker loop of ComputeSim3. Candidates are taken in order from nNext, and a worker
+    // gives up on a candidate as soon as a better ranked one (lower index) is accepted.
+    void VerifyCandidates(std::atomic<int> &nNext, std::atomic<int> &nBestAccepted, Sim3CandidateVector &vCandidates);
+    bool VerifyCandidate(ORBmatcher &matcher, const int idx, const std::atomic<int> &nBestAccepted, Sim3Candidate &candidate);
+
     void SearchAndFuse(const KeyFrameAndPose &CorrectedPosesMap);
 
     void CorrectLoop();
 
+    // Moves the keyframes and points of the sub-map of the current keyframe by the similarity
+    // given by the loop (mg2oScw), and welds them to the sub-map of the matched keyframe
+    void MergeSubmap();
+
+    // The result of the global BA is first propagated through the spanning tree into the staging
+    // buffers of keyframes (mTcwGBA) and map points (mPosGBA) while Local Mapping keeps running,
+    // then copied to the map under the map update mutex. Keyframes and points created between
+    // both steps are corrected when publishing.
+    void StageGlobalBundleAdjustment(unsigned long nLoopKF);
+    void PublishGlobalBundleAdjustment(unsigned long nLoopKF);
+
     void ResetIfRequested();
     bool mbResetRequested;
     std::mutex mMutexReset;
+    std::condition_variable mcvReset;
 
     bool CheckFinish();
     void SetFinish();
@@ -115,6 +153,10 @@ protected:
     std::list<KeyFrame*> mlpLoopKeyFrameQueue;
 
     std::mutex mMutexLoopQueue;
+    std::condition_variable mcvLoopQueue;
+    // Incremented by Signal(), guarded by mMutexLoopQueue
+    unsigned long mnSignals;
+    unsigned long mnSignalsSeen;
 
     // Loop detector parameters
     float mnCovisibilityConsistencyTh;
@@ -23,9 +23,11 @@
 
 #include "MapPoint.h"
 #include "KeyFrame.h"
+#include "ObjectMap.h"
 #include <set>
 #include <Eigen/Dense>
 #include <mutex>
+#include <atomic>
 #include <iomanip>
 #include <unordered_map>
 
@@ -36,29 +38,6 @@ namespace ORB_SLAM2
 
 class MapPoint;
 class KeyFrame;
-    struct ObjectPos {
-        std::vector<Eigen::Vector3d> Pcs;
-
-        ObjectPos() {}
-
-        ObjectPos(std::vector<Eigen::Vector3d> pcs) : Pcs(pcs){}
-
-        void addInstance(Eigen::Vector3d &Pc) {
-            Pcs.push_back(Pc);
-        }
-
-
-        friend std::ostream &operator<<(std::ostream &os, const ObjectPos &pos) {
-
-            os << std::setw(6) << std::fixed << std::setprecision(3);
-            os << "       " << "Pcs: " << std::endl;
-            for (auto &Pc: pos.Pcs) {
-                os << "       " << "[" << Pc[0] << " " << Pc[1] << " " << Pc[2] << "]" << std::endl;
-            }
-            os << "       "<< "--------------------------" << std::endl;
-            return os;
-        }
-    };
 class Map
 {
 public:
@@ -69,11 +48,45 @@ public:
     void EraseMapPoint(MapPoint* pMP);
     void EraseKeyFrame(KeyFrame* pKF);
     void SetReferenceMapPoints(const std::vector<MapPoint*> &vpMPs);
+
+    // Big changes (loop closure, global BA) are published under mMutexMapUpdate by incrementing this
+    // epoch. Tracking re-anchors its last frame and local BA discards its result when it changes.
     void InformNewBigChange();
     int GetLastBigChangeIdx();
 
+    // Called when a MapPoint moves or a KeyFrame pose changes
+    void InformMapPointChanged(MapPoint* pMP);
+    void InformKeyFrameChanged(KeyFrame* pKF);
+
+    // Moves out the MapPoints and KeyFrames added, moved or erased since the previous call.
+    // There is a single consumer (the map viewer), changes are only recorded after its first call.
+    // Returns the clear index, the objects reported before a clear must not be accessed anymore.
+    int GetChanges(std::vector<MapPoint*> &vpMPs, std::vector<KeyFrame*> &vpKFs);
+
+    // Incremented by clear()
+    int GetClearIdx();
+
     std::vector<KeyFrame*> GetAllKeyFrames();
     std::vector<MapPoint*> GetAllMapPoints();
+
+    // The map is an atlas of sub-maps. Tracking starts a new one at an origin keyframe
+    // (mvpKeyFrameOrigins) when it is lost for too long, and its id is the one of this keyframe.
+    // Each sub-map has its own world frame until loop closing finds a loop with an older one and
+    // merges them. A MapPoint belongs to the sub-map of its reference keyframe.
+    void AddOrigin(KeyFrame* pKF);
+    // Turns the origin of a discarded sub-map into a keyframe that can be erased
+    void EraseOrigin(KeyFrame* pKF);
+    std::vector<KeyFrame*> GetKeyFrameOrigins();
+    long unsigned int GetCurrentSubmapId();
+    void SetCurrentSubmapId(const long unsigned int nSubmapId);
+    std::vector<KeyFrame*> GetSubmapKeyFrames(const long unsigned int nSubmapId);
+    std::vector<MapPoint*> GetSubmapMapPoints(const long unsigned int nSubmapId);
+    long unsigned int KeyFramesInSubmap(const long unsigned int nSubmapId);
+
+    // Moves the keyframes of sub-map nSubmapId to nTargetId, whose world frame they must be in already
+    // (LoopClosing::MergeSubmap transforms them first). Until then the world frames are unrelated, so
+    // the dense maps only use the current sub-map and the objects are fused and searched per sub-map.
+    void MergeSubmap(const long unsigned int nSubmapId, const long unsigned int nTargetId);
     std::vector<MapPoint*> GetReferenceMapPoints();
 
     long unsigned int MapPointsInMap();
@@ -93,11 +106,9 @@ public:
     // This avoid that two points are created simultaneously in separate threads (id conflict)
     std::mutex mMutexPointCreation;
 
-    // hash map1: class name --> hash map2
-    // hash map2: keyframe id --> ObjectPos
-    std::unordered_map<std::string, std::unordered_map<long unsigned int, ObjectPos> > mObjectMap;
+    // Semantic objects detected by the segmentation, anchored to keyframes
+    ObjectMap mObjectMap;
 
-    std::mutex mMutexObjectMap;
     void CreateLookup(cv::FileStorage& fsSettings);
     cv::Mat mLookupX;
     cv::Mat mLookupY;
@@ -110,8 +121,18 @@ protected:
 
     long unsigned int mnMaxKFid;
 
+    // Sub-map the new keyframes belong to
+    long unsigned int mnCurrentSubmapId;
+
     // Index related to a big change in the map (loop closure, global BA)
-    int mnBigChangeIdx;
+    std::atomic<int> mnBigChangeIdx;
+
+    // Changes not yet read by GetChanges
+    bool mbRecordChanges;
+    std::vector<MapPoint*> mvpChangedMapPoints;
+    std::vector<KeyFrame*> mvpChangedKeyFrames;
+    int mnClearIdx;
+    std::mutex mMutexChanges;
 
     std::mutex mMutexMap;
 };
@@ -30,6 +30,7 @@
 #include <mutex>
 #include <thread>
 #include <memory>
+#include <unordered_map>
 namespace ORB_SLAM2 {
 
 class MapDrawer {
@@ -38,16 +39,16 @@ class MapDrawer {
 
   Map *mpMap;
   bool mbCalPointCloud;
-  std::unique_ptr<std::thread> mpThreadOctomap;
   pcl::PointCloud<pcl::PointXYZ>::Ptr mCloud;
 
   void GeneratePointCloud(const vector<KeyFrame *> &vpKFs, pcl::PointCloud<pcl::PointXYZ>::Ptr cloud,
                           int begin, int step);
 
-  void FilterPointCloud(pcl::PointCloud<pcl::PointXYZ>::Ptr cloud, pcl::PointCloud<pcl::PointXYZ>::Ptr output);
-
   void DrawPointCloud();
 
+  // Applies the map changes since the previous frame to the vertex buffers. Called once per frame.
+  void UpdateBuffers();
+
   void DrawMapPoints();
 
   void DrawKeyFrames(const bool bDrawKF, const bool bDrawGraph);
@@ -60,8 +61,6 @@ class MapDrawer {
 
   void GetCurrentOpenGLCameraMatrix(pangolin::OpenGlMatrix &M);
 
-  void BuildOctomap(pcl::PointCloud<pcl::PointXYZ>::Ptr cloud);
-
  private:
 
   float mKeyFrameSize;
@@ -71,6 +70,39 @@ class MapDrawer {
   float mCameraSize;
   float mCameraLineWidth;
 
+  // Points farther than mLodDistance from the camera are decimated, keeping one in
+  // distance/mLodDistance points (at most one in mLodMaxStride). Disabled if not positive.
+  float mLodDistance;
+  int mLodMaxStride;
+
+  void UpdateMapPoint(MapPoint *pMP);
+  void UpdateKeyFrame(KeyFrame *pKF);
+  void ClearBuffers();
+  void UpdateGraph();
+  void UpdateLodIndices(const cv::Mat &Ow);
+
+  // Vertex buffers drawn with one call per layer. Objects are swapped with the last slot on removal.
+  int mnClearIdx;
+  bool mbBuffersLoaded;
+
+  std::vector<float> mvPointVertices;
+  std::vector<long unsigned int> mvPointIds;
+  std::vector<MapPoint *> mvpPointSlots;
+  std::unordered_map<MapPoint *, size_t> mmPointSlots;
+  bool mbPointsChanged;
+
+  std::vector<unsigned int> mvLodIndices;
+  cv::Mat mLodCenter;
+
+  std::vector<float> mvKeyFrameVertices;
+  std::vector<KeyFrame *> mvpKeyFrameSlots;
+  std::unordered_map<KeyFrame *, size_t> mmKeyFrameSlots;
+
+  std::vector<float> mvGraphVertices;
+  bool mbGraphChanged;
+
+  std::vector<float> mvReferenceVertices;
+
   cv::Mat mCameraPose;
 
   std::mutex mMutexCamera;
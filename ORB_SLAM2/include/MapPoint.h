@@ -27,6 +27,8 @@
 
 #include<opencv2/core/core.hpp>
 #include<mutex>
+#include<vector>
+#include<utility>
 
 namespace ORB_SLAM2
 {
@@ -39,6 +41,11 @@ class Frame;
 class MapPoint
 {
 public:
+    // Observing keyframes and the index of the keypoint in each of them, in insertion order.
+    // Kept as a flat vector: points are seen by a handful of keyframes and are iterated far
+    // more often than they are modified.
+    typedef std::vector<std::pair<KeyFrame*,size_t> > ObsVector;
+
     MapPoint(const cv::Mat &Pos, KeyFrame* pRefKF, Map* pMap);
     MapPoint(const cv::Mat &Pos,  Map* pMap, Frame* pFrame, const int &idxF);
 
@@ -48,7 +55,7 @@ public:
     cv::Mat GetNormal();
     KeyFrame* GetReferenceKeyFrame();
 
-    std::map<KeyFrame*,size_t> GetObservations();
+    ObsVector GetObservations();
     int Observations();
 
     void AddObservation(KeyFrame* pKF,size_t idx);
@@ -117,8 +124,9 @@ protected:
      // Position in absolute coordinates
      cv::Mat mWorldPos;
 
-     // Keyframes observing the point and associated index in keyframe
-     std::map<KeyFrame*,size_t> mObservations;
+     // Keyframes observing the point and associated index in keyframe.
+     // The reverse direction (keypoint index -> MapPoint) is KeyFrame::mvpMapPoints.
+     ObsVector mObservations;
 
      // Mean viewing direction
      cv::Mat mNormalVector;
@@ -145,6 +153,10 @@ protected:
 
      std::mutex mMutexPos;
      std::mutex mMutexFeatures;
+
+private:
+     // Position of pKF in mObservations or -1. Requires mMutexFeatures.
+     int FindObservation(KeyFrame* pKF) const;
 };
 
 } //namespace ORB_SLAM
@@ -55,11 +55,15 @@ public:
 
     // Compute the ORB features and descriptors on an image.
     // ORB are dispersed on the image using an octree.
-    // Mask is ignored in the current implementation.
+    // If a mask (CV_8UC1, image size) is given, features are only extracted where it is non zero.
     void operator()( cv::InputArray image, cv::InputArray mask,
       std::vector<cv::KeyPoint>& keypoints,
       cv::OutputArray descriptors);
 
+    // New image of the given size with room around for the border of the first pyramid level.
+    // An image written there (e.g. by a color conversion) is used as the first level without copy.
+    cv::Mat CreateInputImage(const cv::Size &size);
+
     int inline GetLevels(){
         return nlevels;}
 
@@ -87,6 +91,7 @@ public:
 protected:
 
     void ComputePyramid(cv::Mat image);
+    void ComputeMaskPyramid(const cv::Mat &mask);
     void ComputeKeyPointsOctTree(std::vector<std::vector<cv::KeyPoint> >& allKeypoints);    
     std::vector<cv::KeyPoint> DistributeOctTree(const std::vector<cv::KeyPoint>& vToDistributeKeys, const int &minX,
                                            const int &maxX, const int &minY, const int &maxY, const int &nFeatures, const int &level);
@@ -108,6 +113,9 @@ protected:
     std::vector<float> mvInvScaleFactor;    
     std::vector<float> mvLevelSigma2;
     std::vector<float> mvInvLevelSigma2;
+
+    // Mask of each pyramid level, empty when extracting on the whole image
+    std::vector<cv::Mat> mvMaskPyramid;
 };
 
 } //namespace ORB_SLAM
@@ -0,0 +1,165 @@
+/**
+* This file is part of ORB-SLAM2.
+*
+* Copyright (C) 2014-2016 Raúl Mur-Artal <raulmur at unizar dot es> (University of Zaragoza)
+* For more information see <https://github.com/raulmur/ORB_SLAM2>
+*
+* ORB-SLAM2 is free software: you can redistribute it and/or modify
+* it under the terms of the GNU General Public License as published by
+* the Free Software Foundation, either version 3 of the License, or
+* (at your option) any later version.
+*
+* ORB-SLAM2 is distributed in the hope that it will be useful,
+* but WITHOUT ANY WARRANTY; without even the implied warranty of
+* MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+* GNU General Public License for more details.
+*
+* You should have received a copy of the GNU General Public License
+* along with ORB-SLAM2. If not, see <http://www.gnu.org/licenses/>.
+*/
+
+
+#ifndef OBJECTMAP_H
+#define OBJECTMAP_H
+
+#include <opencv2/core/core.hpp>
+#include <Eigen/Core>
+#include <vector>
+#include <string>
+#include <unordered_map>
+#include <unordered_set>
+#include <mutex>
+
+namespace ORB_SLAM2
+{
+
+class Map;
+class KeyFrame;
+
+// Object instance returned by the queries of ObjectMap
+struct SemanticObject
+{
+    long unsigned int mnId;
+    std::string mClassName;
+    // Fused position in world coordinates
+    Eigen::Vector3d mPw;
+    int mnObservations;
+    // Distance to the query point (0 for queries without a point)
+    double mDistance;
+    // Sub-map whose world frame mPw is in (see Map)
+    long unsigned int mnSubmapId;
+};
+
+// Semantic landmark layer on top of the keyframes.
+// Every detection is anchored to the keyframe it was seen from (camera coordinates), so world
+// positions are recomputed when the pose of one of its keyframes changes (local BA, loop closure,
+// global BA). Repeated detections of the same class
+// close to an existing object are fused into it. Objects of each class are indexed in a voxel hash.
+// Sub-maps are in unrelated world frames until they are merged: detections are only fused with
+// objects of their sub-map, and the spatial queries only return objects of the current sub-map.
+class ObjectMap
+{
+public:
+    ObjectMap(Map* pMap, cv::FileStorage &fsSettings);
+
+    // Add the detections of one class seen in a keyframe (camera coordinates)
+    void AddDetections(KeyFrame* pKF, const std::string &className, const std::vector<Eigen::Vector3d> &vPc);
+
+    // All objects, or all objects of a class if className is not empty
+    std::vector<SemanticObject> GetObjects(const std::string &className = std::string());
+
+    // Objects closer than radius to Pw, sorted by distance. Pw is in the world of the current sub-map.
+    std::vector<SemanticObject> SearchRadius(const Eigen::Vector3d &Pw, const double radius, const std::string &className = std::string());
+
+    // k closest objects to Pw, sorted by distance
+    std::vector<SemanticObject> SearchKNN(const Eigen::Vector3d &Pw, const size_t k, const std::string &className = std::string());
+
+    // Closest object of a class to Pw. Returns false if there is no object of that class.
+    bool SearchNearest(const Eigen::Vector3d &Pw, const std::string &className, SemanticObject &object);
+
+    size_t ObjectsInMap();
+
+    // Write all objects in world coordinates, grouped by class
+    void Save(const std::string &filename);
+
+    void clear();
+
+    // Called when the pose of a keyframe changes, its objects are moved by the next query
+    void InformKeyFrameMoved(KeyFrame* pKF);
+
+protected:
+
+    struct Observation
+    {
+        KeyFrame* pKF;
+        Eigen::Vector3d Pc;
+    };
+
+    struct Landmark
+    {
+        std::string mClassName;
+        std::vector<Observation> mvObservations;
+        Eigen::Vector3d mPw;
+        long long mnVoxel;
+    };
+
+    struct ClassIndex
+    {
+        std::vector<size_t> vLandmarks;
+        // voxel key --> landmarks
+        std::unordered_map<long long, std::vector<size_t> > mGrid;
+        // Voxel bounds of the class, they only grow until the next rebuild
+        int minVoxel[3];
+        int maxVoxel[3];
+    };
+
+    // k closest objects within maxDist, of one class or of all classes if className is empty
+    std::vector<SemanticObject> Query(const Eigen::Vector3d &Pw, const size_t k, const double maxDist, const std::string &className);
+
+    // Recompute the world positions and the index of the objects seen by the keyframes that moved
+    void UpdateIfPosesChanged();
+
+    // Recompute all world positions and rebuild the index
+    void Rebuild();
+
+    Eigen::Vector3d ComputeWorldPos(const Landmark &landmark) const;
+
+    void InsertInIndex(ClassIndex &index, const size_t idx);
+    void EraseFromIndex(ClassIndex &index, const size_t idx);
+
+    // Keep in vBest (max-heap on distance) the k closest landmarks of a class within maxDist,
+    // among the ones of sub-map nSubmapId
+    void Search(const ClassIndex &index, const Eigen::Vector3d &Pw, const size_t k, const double maxDist,
+                const long unsigned int nSubmapId, std::vector<std::pair<double,size_t> > &vBest) const;
+
+    // Sub-map of the first keyframe that observed the landmark, merged sub-maps are relabeled
+    static long unsigned int SubmapOf(const Landmark &landmark);
+
+    void VoxelCoords(const Eigen::Vector3d &Pw, int coords[3]) const;
+    static long long VoxelKey(const int x, const int y, const int z);
+
+    SemanticObject MakeObject(const size_t idx, const double dist) const;
+
+    Map* mpMap;
+
+    std::vector<Landmark> mvLandmarks;
+    std::unordered_map<std::string, ClassIndex> mClasses;
+
+    // Objects observed by each keyframe
+    std::unordered_map<KeyFrame*, std::vector<size_t> > mmKeyFrameObjects;
+
+    // Keyframes moved since the positions were computed, locked apart as KeyFrame::SetPose reports them
+    std::unordered_set<KeyFrame*> msMovedKeyFrames;
+    std::mutex mMutexMoved;
+
+    // Detections of the same class closer than this are fused in one object
+    double mfFuseRadius;
+
+    double mfVoxelSize;
+
+    std::mutex mMutexObjectMap;
+};
+
+} //namespace ORB_SLAM
+
+#endif // OBJECTMAP_H
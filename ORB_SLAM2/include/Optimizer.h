@@ -52,6 +52,12 @@ public:
                                        const map<KeyFrame *, set<KeyFrame *> > &LoopConnections,
                                        const bool &bFixScale);
 
+    // Moves each map point from the pose vSrw[vnRef[i]] of its reference keyframe to the corrected
+    // one vCorrectedSwr[vnRef[i]] (points with a negative vnRef are skipped), in parallel chunks
+    static void CorrectMapPoints(const std::vector<MapPoint*> &vpMPs, const std::vector<int> &vnRef,
+                                 const std::vector<g2o::Sim3,Eigen::aligned_allocator<g2o::Sim3> > &vSrw,
+                                 const std::vector<g2o::Sim3,Eigen::aligned_allocator<g2o::Sim3> > &vCorrectedSwr);
+
     // if bFixScale is true, optimize SE3 (stereo,rgbd), Sim3 otherwise (mono)
     static int OptimizeSim3(KeyFrame* pKF1, KeyFrame* pKF2, std::vector<MapPoint *> &vpMatches1,
                             g2o::Sim3 &g2oS12, const float th2, const bool bFixScale);
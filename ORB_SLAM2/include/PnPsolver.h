@@ -52,6 +52,7 @@
 #define PNPSOLVER_H
 
 #include <opencv2/core/core.hpp>
+#include <Eigen/Core>
 #include "MapPoint.h"
 #include "Frame.h"
 
@@ -73,9 +74,17 @@ class PnPsolver {
 
  private:
 
-  void CheckInliers();
+  typedef Eigen::Matrix<double, 6, 10, Eigen::RowMajor> Matrix6x10;
+  typedef Eigen::Matrix<double, 6, 4, Eigen::RowMajor> Matrix6x4;
+  typedef Eigen::Matrix<double, 6, 1> Vector6;
+
+  // Returns false as soon as the hypothesis can not have nMinInliers inliers
+  bool CheckInliers(const int nMinInliers);
   bool Refine();
 
+  // Minimal set of matches for the next hypothesis in mvSampleIndices, PROSAC sampling
+  void SampleMinimalSet();
+
   // Functions from the original EPnP code
   void set_maximum_number_of_correspondences(const int n);
   void reset_correspondences(void);
@@ -93,16 +102,15 @@ class PnPsolver {
 
   void choose_control_points(void);
   void compute_barycentric_coordinates(void);
-  void fill_M(CvMat * M, const int row, const double * alphas, const double u, const double v);
+  void fill_M(double * M1, double * M2, const double * alphas, const double u, const double v);
   void compute_ccs(const double * betas, const double * ut);
   void compute_pcs(void);
 
   void solve_for_sign(void);
 
-  void find_betas_approx_1(const CvMat * L_6x10, const CvMat * Rho, double * betas);
-  void find_betas_approx_2(const CvMat * L_6x10, const CvMat * Rho, double * betas);
-  void find_betas_approx_3(const CvMat * L_6x10, const CvMat * Rho, double * betas);
-  void qr_solve(CvMat * A, CvMat * b, CvMat * X);
+  void find_betas_approx_1(const Matrix6x10 & L_6x10, const Vector6 & Rho, double * betas);
+  void find_betas_approx_2(const Matrix6x10 & L_6x10, const Vector6 & Rho, double * betas);
+  void find_betas_approx_3(const Matrix6x10 & L_6x10, const Vector6 & Rho, double * betas);
 
   double dot(const double * v1, const double * v2);
   double dist2(const double * p1, const double * p2);
@@ -110,9 +118,9 @@ class PnPsolver {
   void compute_rho(double * rho);
   void compute_L_6x10(const double * ut, double * l_6x10);
 
-  void gauss_newton(const CvMat * L_6x10, const CvMat * Rho, double current_betas[4]);
+  void gauss_newton(const Matrix6x10 & L_6x10, const Vector6 & Rho, double current_betas[4]);
   void compute_A_and_b_gauss_newton(const double * l_6x10, const double * rho,
-				    double cb[4], CvMat * A, CvMat * b);
+				    double cb[4], Matrix6x4 & A, Vector6 & b);
 
   double compute_R_and_t(const double * ut, const double * betas,
 			 double R[3][3], double t[3]);
@@ -136,12 +144,15 @@ class PnPsolver {
 
   vector<MapPoint*> mvpMapPointMatches;
 
+  // Correspondences are sorted by descriptor distance (best first) and stored one array per
+  // coordinate for the inlier check
+
   // 2D Points
-  vector<cv::Point2f> mvP2D;
+  vector<float> mvU, mvV;
   vector<float> mvSigma2;
 
   // 3D Points
-  vector<cv::Point3f> mvP3Dw;
+  vector<float> mvXw, mvYw, mvZw;
 
   // Index in Frame
   vector<size_t> mvKeyPointIndices;
@@ -167,8 +178,13 @@ class PnPsolver {
   // Number of Correspondences
   int N;
 
-  // Indices for random selection [0 .. N-1]
-  vector<size_t> mvAllIndices;
+  // Minimal set of the current iteration
+  vector<int> mvSampleIndices;
+
+  // PROSAC state: size of the sampling pool and its growth function T_n, T'_n
+  int mnProsacN;
+  double mProsacTn;
+  int mnProsacTnPrime;
 
   // RANSAC probability
   double mRansacProb;
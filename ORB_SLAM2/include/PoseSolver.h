@@ -0,0 +1,118 @@
+/**
+* This file is part of ORB-SLAM2.
+*
+* Copyright (C) 2014-2016 Raúl Mur-Artal <raulmur at unizar dot es> (University of Zaragoza)
+* For more information see <https://github.com/raulmur/ORB_SLAM2>
+*
+* ORB-SLAM2 is free software: you can redistribute it and/or modify
+* it under the terms of the GNU General Public License as published by
+* the Free Software Foundation, either version 3 of the License, or
+* (at your option) any later version.
+*
+* ORB-SLAM2 is distributed in the hope that it will be useful,
+* but WITHOUT ANY WARRANTY; without even the implied warranty of
+* MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+* GNU General Public License for more details.
+*
+* You should have received a copy of the GNU General Public License
+* along with ORB-SLAM2. If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#ifndef POSESOLVER_H
+#define POSESOLVER_H
+
+#include <opencv2/core/core.hpp>
+#include <Eigen/Core>
+#include <vector>
+
+#include "Thirdparty/g2o/g2o/types/se3quat.h"
+
+namespace ORB_SLAM2
+{
+
+// Motion-only optimization of a camera pose against fixed map points. It computes the same
+// iterations as g2o with a VertexSE3Expmap, EdgeSE3ProjectXYZOnlyPose/EdgeStereoSE3ProjectXYZOnlyPose
+// edges with Huber kernels and OptimizationAlgorithmLevenberg, without building a graph.
+// Correspondences are stored as one array per coordinate, so that residuals and Jacobians of
+// consecutive correspondences are evaluated together by the vectorized loops, and the 6x6 normal
+// equations are accumulated directly. The buffers are kept between problems.
+class PoseSolver
+{
+public:
+    typedef Eigen::Matrix<double,6,6> Matrix6d;
+    typedef Eigen::Matrix<double,6,1> Vector6d;
+
+    PoseSolver();
+
+    // Starts a new problem, bf is only used by stereo correspondences
+    void Reset(const float fx, const float fy, const float cx, const float cy, const float bf);
+
+    // Return the index of the correspondence. The information matrix is invSigma2*I, and the Huber
+    // kernel has threshold delta (on the reprojection error, not the chi2).
+    int AddMonocular(const cv::Mat &Xw, const float u, const float v, const float invSigma2,
+                     const float delta);
+    int AddStereo(const cv::Mat &Xw, const float u, const float v, const float ur, const float invSigma2,
+                  const float delta);
+
+    int Size() const { return mN; }
+
+    // Inactive correspondences are ignored by Optimize (edges out of the optimized level in g2o)
+    void SetActive(const int i, const bool bActive) { mvActive[i] = bActive ? 1.0 : 0.0; }
+    int ActiveSize() const;
+
+    void SetRobust(const bool bRobust) { mbRobust = bRobust; }
+
+    void SetPose(const g2o::SE3Quat &Tcw) { mTcw = Tcw; }
+    const g2o::SE3Quat& GetPose() const { return mTcw; }
+
+    // Levenberg-Marquardt iterations over the active correspondences
+    void Optimize(const int nIterations);
+
+    // Chi2 of every correspondence (active or not) at the current pose, read with GetChi2
+    void ComputeChi2();
+    double GetChi2(const int i) const { return mvChi2[i]; }
+
+protected:
+
+    // Correspondences evaluated at once by the vectorized loops. Buffers are padded to a multiple.
+    static const int LANES = 4;
+
+    void Grow();
+
+    // Fills the padding after the last correspondence with neutral ones
+    void ClearPadding();
+
+    // Errors, chi2 and normal-equation weights of all the correspondences seen from Tcw.
+    // Returns the robust chi2 of the active ones.
+    double Evaluate(const g2o::SE3Quat &Tcw);
+
+    // Normal equations of the active correspondences from the last Evaluate
+    void BuildSystem(Matrix6d &H, Vector6d &b);
+
+    double mfx, mfy, mcx, mcy, mbf;
+
+    int mN;
+    bool mbRobust;
+
+    g2o::SE3Quat mTcw;
+
+    // Correspondences
+    std::vector<double> mvX, mvY, mvZ;
+    std::vector<double> mvU, mvV, mvUr;
+    std::vector<double> mvInfo;
+    std::vector<double> mvDelta;
+    // 1 for stereo correspondences, 0 for monocular
+    std::vector<double> mvStereo;
+    std::vector<double> mvActive;
+
+    // Evaluation at the last pose: camera coordinates, errors, chi2 and weights
+    std::vector<double> mvXc, mvYc, mvInvZ;
+    std::vector<double> mvE0, mvE1, mvE2;
+    std::vector<double> mvChi2;
+    std::vector<double> mvRobustChi2;
+    std::vector<double> mvWeight;
+};
+
+} //namespace ORB_SLAM
+
+#endif // POSESOLVER_H
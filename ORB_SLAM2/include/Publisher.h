@@ -0,0 +1,169 @@
+/**
+* This file is part of ORB-SLAM2.
+*
+* Copyright (C) 2014-2016 Raúl Mur-Artal <raulmur at unizar dot es> (University of Zaragoza)
+* For more information see <https://github.com/raulmur/ORB_SLAM2>
+*
+* ORB-SLAM2 is free software: you can redistribute it and/or modify
+* it under the terms of the GNU General Public License as published by
+* the Free Software Foundation, either version 3 of the License, or
+* (at your option) any later version.
+*
+* ORB-SLAM2 is distributed in the hope that it will be useful,
+* but WITHOUT ANY WARRANTY; without even the implied warranty of
+* MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+* GNU General Public License for more details.
+*
+* You should have received a copy of the GNU General Public License
+* along with ORB-SLAM2. If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#ifndef PUBLISHER_H
+#define PUBLISHER_H
+
+#include <opencv2/core/core.hpp>
+#include <string>
+#include <vector>
+#include <deque>
+#include <unordered_map>
+#include <mutex>
+#include <condition_variable>
+
+namespace ORB_SLAM2
+{
+
+class Map;
+
+// Streams the tracked poses and the changes of the map to out-of-process consumers, over a
+// unix domain socket (Publisher.Socket) or a TCP port on the loopback (Publisher.Port).
+//
+// Every message is a header {uint32 type, uint32 payload bytes} followed by the payload,
+// all little-endian whatever the host byte order (see LittleEndian.h):
+//  POSE (1): uint64 frame id, float64 timestamp, int32 tracking state,
+//            float32 Tcw[12] (3x4 row major, zeros when the tracking is lost)
+//  MAP  (2): uint8 flags (1 snapshot: drop the previous state, 2 big change: loop closure or
+//            global BA since the previous message), int32 big change index, then
+//            keyframes:  uint32 n, n x {uint64 id, float64 timestamp, float32 Twc[12]}  added or moved
+//                        uint32 n, n x {uint64 id}                                        removed
+//            points:     uint32 n, n x {uint64 id, float32 Pw[3]}                         added or moved
+//                        uint32 n, n x {uint64 id}                                        removed
+//            objects:    uint32 n, n x {uint64 id, uint16 name length, char name[],
+//                                       float64 Pw[3], int32 observations}                added or updated
+//                        uint32 n, n x {uint64 id}                                        removed
+//
+// A new consumer first receives a snapshot of the map, then the deltas. Each consumer has a
+// bounded queue (Publisher.MaxQueueKB): poses are dropped when it is full, and if map deltas
+// do not fit the queue is replaced by a fresh snapshot, so a slow consumer never blocks SLAM
+// and never sees an inconsistent map.
+class Publisher
+{
+public:
+    Publisher(Map* pMap, const std::string &strSettingPath);
+
+    // Main thread function. Accepts consumers, diffs the map every Publisher.Period ms
+    // and sends the queued messages.
+    void Run();
+
+    // Called after every tracked frame. Tcw is empty if the tracking is lost.
+    void PublishPose(const long unsigned int nFrameId, const double timestamp, const int state, const cv::Mat &Tcw);
+
+    void RequestFinish();
+
+    bool isFinished();
+
+    // Pauses the worker between two map diffs, the consumers stay connected.
+    // The keyframes can be deleted once isStopped() (Tracking::Reset), then call Release().
+    void RequestStop();
+    bool isStopped();
+    void Release();
+
+protected:
+
+    struct KeyFrameState
+    {
+        double mTimeStamp;
+        float mTwc[12];
+        unsigned int mnSweep;
+    };
+
+    struct MapPointState
+    {
+        float mPw[3];
+        unsigned int mnSweep;
+    };
+
+    struct ObjectState
+    {
+        std::string mClassName;
+        double mPw[3];
+        int mnObservations;
+        unsigned int mnSweep;
+    };
+
+    struct Subscriber
+    {
+        int mFd;
+        std::deque<std::string> mdQueue;
+        size_t mnQueuedBytes;
+        // Bytes of the front message already sent
+        size_t mnFrontSent;
+    };
+
+    bool SetupSocket();
+    void AcceptSubscribers();
+
+    // Diffs the map against the published state, returns the delta message (empty if nothing changed)
+    std::string UpdateMap();
+    // The whole published state as a snapshot message
+    std::string Snapshot();
+
+    void Broadcast(const std::string &msg, const bool bMapDelta);
+    void Enqueue(Subscriber &sub, const std::string &msg);
+    // Drops the queued messages of a subscriber and sends it a snapshot instead
+    void Resync(Subscriber &sub);
+    void Flush();
+    bool HasBacklog();
+    void CloseAll();
+
+    bool CheckFinish();
+    void SetFinish();
+
+    bool Stop();
+    bool CheckStopRequested();
+
+    Map* mpMap;
+
+    std::string mStrSocketPath;
+    int mnPort;
+    // Map diff period in ms
+    int mnPeriod;
+    size_t mnMaxQueueBytes;
+
+    int mListenFd;
+    std::vector<Subscriber> mvSubscribers;
+
+    // Published state of the map, consumers rebuild the same from the messages
+    std::unordered_map<long unsigned int, KeyFrameState> mmKeyFrames;
+    std::unordered_map<long unsigned int, MapPointState> mmMapPoints;
+    std::unordered_map<long unsigned int, ObjectState> mmObjects;
+    unsigned int mnSweep;
+    int mnLastBigChangeIdx;
+
+    // Poses from the tracking thread, already serialized
+    std::deque<std::string> mdPoses;
+    std::mutex mMutexPoses;
+    std::condition_variable mcvPoses;
+
+    bool mbFinishRequested;
+    bool mbFinished;
+    std::mutex mMutexFinish;
+
+    bool mbStopRequested;
+    bool mbStopped;
+    std::mutex mMutexStop;
+    std::condition_variable mcvStop;
+};
+
+}// namespace ORB_SLAM
+
+#endif // PUBLISHER_H
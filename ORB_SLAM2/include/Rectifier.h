@@ -0,0 +1,66 @@
+/**
+* This file is part of ORB-SLAM2.
+*
+* Copyright (C) 2014-2016 Raúl Mur-Artal <raulmur at unizar dot es> (University of Zaragoza)
+* For more information see <https://github.com/raulmur/ORB_SLAM2>
+*
+* ORB-SLAM2 is free software: you can redistribute it and/or modify
+* it under the terms of the GNU General Public License as published by
+* the Free Software Foundation, either version 3 of the License, or
+* (at your option) any later version.
+*
+* ORB-SLAM2 is distributed in the hope that it will be useful,
+* but WITHOUT ANY WARRANTY; without even the implied warranty of
+* MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+* GNU General Public License for more details.
+*
+* You should have received a copy of the GNU General Public License
+* along with ORB-SLAM2. If not, see <http://www.gnu.org/licenses/>.
+*/
+
+
+#ifndef RECTIFIER_H
+#define RECTIFIER_H
+
+#include <opencv2/core/core.hpp>
+#include <string>
+
+#include "ImageBuffer.h"
+
+namespace ORB_SLAM2
+{
+
+// Undistortion and rectification of one camera of a stereo pair, from the prefix.K, .D, .R, .P,
+// .width and .height settings (prefix LEFT or RIGHT). The map is computed once in fixed point,
+// as cv::remap with CV_16SC2 maps, and the bilinear interpolation is fused with the grayscale
+// conversion: the rectified gray image is written directly where the caller wants it, the first
+// level of the ORB pyramid in Tracking. Rows are split on the shared
+// ThreadPool.
+class Rectifier
+{
+public:
+    Rectifier(const cv::FileStorage &fSettings, const std::string &prefix);
+
+    // False if the calibration is missing
+    bool IsValid() const { return !mMapXY.empty(); }
+
+    cv::Size GetSize() const { return mSize; }
+
+    // gray must be CV_8U of GetSize()
+    void Rectify(const ImageBuffer &im, cv::Mat &gray) const;
+
+protected:
+
+    void RectifyRows(const cv::Mat &src, const ImageBuffer::PixelFormat format, cv::Mat &gray,
+                     const int nRowBegin, const int nRowEnd) const;
+
+    cv::Size mSize;
+
+    // Integer source coordinates (CV_16SC2) and interpolation table index (CV_16UC1)
+    cv::Mat mMapXY;
+    cv::Mat mMapFrac;
+};
+
+} //namespace ORB_SLAM
+
+#endif // RECTIFIER_H
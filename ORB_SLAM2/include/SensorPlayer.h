@@ -0,0 +1,89 @@
+/**
+* This file is part of ORB-SLAM2.
+*
+* Copyright (C) 2014-2016 Raúl Mur-Artal <raulmur at unizar dot es> (University of Zaragoza)
+* For more information see <https://github.com/raulmur/ORB_SLAM2>
+*
+* ORB-SLAM2 is free software: you can redistribute it and/or modify
+* it under the terms of the GNU General Public License as published by
+* the Free Software Foundation, either version 3 of the License, or
+* (at your option) any later version.
+*
+* ORB-SLAM2 is distributed in the hope that it will be useful,
+* but WITHOUT ANY WARRANTY; without even the implied warranty of
+* MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+* GNU General Public License for more details.
+*
+* You should have received a copy of the GNU General Public License
+* along with ORB-SLAM2. If not, see <http://www.gnu.org/licenses/>.
+*/
+
+
+#ifndef SENSORPLAYER_H
+#define SENSORPLAYER_H
+
+#include <opencv2/core/core.hpp>
+#include <string>
+#include <vector>
+#include <fstream>
+
+#include "ImageBuffer.h"
+#include "SensorRecorder.h"
+
+namespace ORB_SLAM2
+{
+
+// Reads back a log written by SensorRecorder, frame by frame and one chunk in memory at a time.
+// The index at the end of the log allows seeking; a log that was not closed (crash) is indexed
+// by scanning its chunk headers, up to the last complete chunk.
+class SensorPlayer
+{
+public:
+    SensorPlayer();
+
+    bool Open(const std::string &filename);
+
+    // System::eSensor of the recording
+    int GetSensor() const { return mnSensor; }
+
+    size_t Frames() const { return mnFrames; }
+    double FirstTimeStamp() const;
+    double LastTimeStamp() const;
+
+    // Moves to the first frame at or after timestamp
+    bool Seek(const double timestamp);
+
+    // Next frame, vImages has the images in the order of Track* (left/right or color/depth).
+    // Returns false at the end of the log.
+    bool Next(double &timestamp, std::vector<ImageBuffer> &vImages);
+
+protected:
+
+    // Reads and decodes a header of the log at the current position
+    template<typename T>
+    bool ReadHeader(T &header);
+
+    bool ReadIndex(const uint64_t nFileSize);
+    void ScanChunks(const uint64_t nFileSize);
+
+    bool LoadChunk(const size_t nChunk);
+
+    // Decodes the frame at mnPos of the current chunk
+    bool ReadFrame(double &timestamp, std::vector<ImageBuffer> &vImages);
+
+    std::ifstream mFile;
+    int mnSensor;
+    size_t mnFrames;
+
+    std::vector<SensorRecorder::IndexEntry> mvIndex;
+
+    // Current chunk and position of the next frame in it
+    size_t mnChunk;
+    std::string mChunk;
+    size_t mnPos;
+    uint32_t mnFrameInChunk;
+};
+
+}// namespace ORB_SLAM
+
+#endif // SENSORPLAYER_H
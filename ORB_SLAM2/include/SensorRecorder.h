@@ -0,0 +1,177 @@
+/**
+* This file is part of ORB-SLAM2.
+*
+* Copyright (C) 2014-2016 Raúl Mur-Artal <raulmur at unizar dot es> (University of Zaragoza)
+* For more information see <https://github.com/raulmur/ORB_SLAM2>
+*
+* ORB-SLAM2 is free software: you can redistribute it and/or modify
+* it under the terms of the GNU General Public License as published by
+* the Free Software Foundation, either version 3 of the License, or
+* (at your option) any later version.
+*
+* ORB-SLAM2 is distributed in the hope that it will be useful,
+* but WITHOUT ANY WARRANTY; without even the implied warranty of
+* MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+* GNU General Public License for more details.
+*
+* You should have received a copy of the GNU General Public License
+* along with ORB-SLAM2. If not, see <http://www.gnu.org/licenses/>.
+*/
+
+
+#ifndef SENSORRECORDER_H
+#define SENSORRECORDER_H
+
+#include <opencv2/core/core.hpp>
+#include <string>
+#include <vector>
+#include <deque>
+#include <fstream>
+#include <mutex>
+#include <condition_variable>
+#include <stdint.h>
+
+#include "ImageBuffer.h"
+
+namespace ORB_SLAM2
+{
+
+// Records the images given to System (Recorder.File), to replay them later with SensorPlayer.
+// The images are copied by the tracking thread and compressed and written by a background thread.
+// If it falls behind more than Recorder.QueueSize frames, frames are dropped (and counted) rather
+// than stalling the tracking.
+//
+// The log is chunked, all little-endian whatever the host byte order (see LittleEndian.h):
+//   file header:  char magic[8] "ORBSENS1", uint32 sensor (System::eSensor), uint32 reserved
+//   chunk:        uint32 type (1 frames, 2 index), uint32 count, uint64 payload bytes,
+//                 float64 first timestamp, float64 last timestamp, then the payload
+//     frames:     count x {float64 timestamp, uint32 images, images x
+//                          {uint32 pixel format (ImageBuffer::PixelFormat), uint32 codec (0 raw, 1 png),
+//                           int32 cols, int32 rows, uint64 bytes, data}}
+//     index:      count x {float64 first timestamp, float64 last timestamp, uint64 chunk offset,
+//                          uint32 frames, uint32 reserved}
+//   trailer:      uint64 index chunk offset, char magic[8] "ORBSIDX1"
+// 8 and 16 bit images with 1, 3 or 4 channels, including the depth, are stored as PNG (lossless),
+// the others raw with tightly packed rows of little-endian values. A chunk is written every
+// Recorder.ChunkFrames frames; the index and the trailer at the end. A log without them (crash)
+// is indexed by scanning.
+class SensorRecorder
+{
+public:
+    enum ChunkType
+    {
+        CHUNK_FRAMES = 1,
+        CHUNK_INDEX = 2
+    };
+
+    enum Codec
+    {
+        CODEC_RAW = 0,
+        CODEC_PNG = 1
+    };
+
+    struct FileHeader
+    {
+        char mMagic[8];
+        uint32_t mnSensor;
+        uint32_t mnReserved;
+    };
+
+    struct ChunkHeader
+    {
+        uint32_t mnType;
+        uint32_t mnCount;
+        uint64_t mnBytes;
+        double mFirstTimeStamp;
+        double mLastTimeStamp;
+    };
+
+    struct IndexEntry
+    {
+        double mFirstTimeStamp;
+        double mLastTimeStamp;
+        uint64_t mnOffset;
+        uint32_t mnFrames;
+        uint32_t mnReserved;
+    };
+
+    struct Trailer
+    {
+        uint64_t mnIndexOffset;
+        char mMagic[8];
+    };
+
+    static const char* const kFileMagic;
+    static const char* const kIndexMagic;
+
+    // The headers as stored in the log, sizeof(header) little-endian bytes at p
+    static void Encode(const FileHeader &header, char* p);
+    static void Encode(const ChunkHeader &header, char* p);
+    static void Encode(const IndexEntry &entry, char* p);
+    static void Encode(const Trailer &trailer, char* p);
+    static void Decode(const char* p, FileHeader &header);
+    static void Decode(const char* p, ChunkHeader &header);
+    static void Decode(const char* p, IndexEntry &entry);
+    static void Decode(const char* p, Trailer &trailer);
+
+    SensorRecorder(const std::string &strSettingPath, const int sensor);
+
+    // Main thread function. Compresses the queued frames and writes them in chunks.
+    void Run();
+
+    // Called with the images given to Track*, im2 is the right or depth image (empty if monocular).
+    // The images are copied, the caller keeps its buffers.
+    void AddFrame(const double timestamp, const ImageBuffer &im, const ImageBuffer &im2);
+
+    void RequestFinish();
+
+    bool isFinished();
+
+protected:
+
+    struct QueuedFrame
+    {
+        double mTimeStamp;
+        std::vector<ImageBuffer> mvImages;
+    };
+
+    bool OpenLog();
+
+    // Appends the frame to the current chunk
+    void EncodeFrame(const QueuedFrame &frame);
+
+    void WriteChunk();
+    void WriteIndex();
+
+    bool CheckFinish();
+    void SetFinish();
+
+    std::string mStrLogFile;
+    int mnSensor;
+    int mnChunkFrames;
+    size_t mnQueueSize;
+    int mnPngCompression;
+
+    std::ofstream mFile;
+    bool mbLogFailed;
+
+    // Chunk being filled
+    std::string mChunk;
+    ChunkHeader mChunkHeader;
+
+    std::vector<IndexEntry> mvIndex;
+
+    // Frames from the tracking thread, not written yet
+    std::deque<QueuedFrame> mdQueue;
+    size_t mnDropped;
+    std::mutex mMutexQueue;
+    std::condition_variable mcvQueue;
+
+    bool mbFinishRequested;
+    bool mbFinished;
+    std::mutex mMutexFinish;
+};
+
+}// namespace ORB_SLAM
+
+#endif // SENSORRECORDER_H
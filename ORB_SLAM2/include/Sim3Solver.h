@@ -23,7 +23,9 @@
 #define SIM3SOLVER_H
 
 #include <opencv2/opencv.hpp>
+#include <Eigen/Core>
 #include <vector>
+#include <random>
 
 #include "KeyFrame.h"
 
@@ -51,14 +53,13 @@ public:
 
 protected:
 
-    void ComputeCentroid(cv::Mat &P, cv::Mat &Pr, cv::Mat &C);
-
-    void ComputeSim3(cv::Mat &P1, cv::Mat &P2);
+    // Horn's closed form on a minimal set. Each column of P1/P2 is a point in camera 1/2.
+    void ComputeSim3(const Eigen::Matrix3f &P1, const Eigen::Matrix3f &P2);
 
     void CheckInliers();
 
-    void Project(const std::vector<cv::Mat> &vP3Dw, std::vector<cv::Mat> &vP2D, cv::Mat Tcw, cv::Mat K);
-    void FromCameraToImage(const std::vector<cv::Mat> &vP3Dc, std::vector<cv::Mat> &vP2D, cv::Mat K);
+    void FromCameraToImage(const std::vector<Eigen::Vector3f> &vP3Dc, std::vector<Eigen::Vector2f> &vP2D,
+                           const float fx, const float fy, const float cx, const float cy);
 
 
 protected:
@@ -67,14 +68,12 @@ protected:
     KeyFrame* mpKF1;
     KeyFrame* mpKF2;
 
-    std::vector<cv::Mat> mvX3Dc1;
-    std::vector<cv::Mat> mvX3Dc2;
+    std::vector<Eigen::Vector3f> mvX3Dc1;
+    std::vector<Eigen::Vector3f> mvX3Dc2;
     std::vector<MapPoint*> mvpMapPoints1;
     std::vector<MapPoint*> mvpMapPoints2;
     std::vector<MapPoint*> mvpMatches12;
     std::vector<size_t> mvnIndices1;
-    std::vector<size_t> mvSigmaSquare1;
-    std::vector<size_t> mvSigmaSquare2;
     std::vector<size_t> mvnMaxError1;
     std::vector<size_t> mvnMaxError2;
 
@@ -82,11 +81,10 @@ protected:
     int mN1;
 
     // Current Estimation
-    cv::Mat mR12i;
-    cv::Mat mt12i;
+    Eigen::Matrix3f mR12i;
+    Eigen::Vector3f mt12i;
     float ms12i;
-    cv::Mat mT12i;
-    cv::Mat mT21i;
+
     std::vector<bool> mvbInliersi;
     int mnInliersi;
 
@@ -95,19 +93,23 @@ protected:
     std::vector<bool> mvbBestInliers;
     int mnBestInliers;
     cv::Mat mBestT12;
-    cv::Mat mBestRotation;
-    cv::Mat mBestTranslation;
+    Eigen::Matrix3f mBestRotation;
+    Eigen::Vector3f mBestTranslation;
     float mBestScale;
 
     // Scale is fixed to 1 in the stereo/RGBD case
     bool mbFixScale;
 
-    // Indices for random selection
+    // Indices for random selection. The minimal set is drawn by swapping to the front.
     std::vector<size_t> mvAllIndices;
 
+    // Each solver owns its generator, so that solvers running on different
+    // threads do not share state and a candidate always draws the same sets.
+    std::mt19937 mRandom;
+
     // Projections
-    std::vector<cv::Mat> mvP1im1;
-    std::vector<cv::Mat> mvP2im2;
+    std::vector<Eigen::Vector2f> mvP1im1;
+    std::vector<Eigen::Vector2f> mvP2im2;
 
     // RANSAC probability
     double mRansacProb;
@@ -123,8 +125,8 @@ protected:
     float mSigma2;
 
     // Calibration
-    cv::Mat mK1;
-    cv::Mat mK2;
+    float fx1, fy1, cx1, cy1;
+    float fx2, fy2, cx2, cy2;
 
 };
 
@@ -24,9 +24,15 @@
 
 #include<string>
 #include<thread>
+#include<future>
+#include<deque>
+#include<memory>
+#include<mutex>
+#include<condition_variable>
 #include<opencv2/core/core.hpp>
 
 #include "Tracking.h"
+#include "ImageBuffer.h"
 #include "FrameDrawer.h"
 #include "MapDrawer.h"
 #include "Map.h"
@@ -35,11 +41,19 @@
 #include "KeyFrameDatabase.h"
 #include "ORBVocabulary.h"
 #include "Viewer.h"
+#include "Publisher.h"
+#include "DenseExporter.h"
+#include "TrajectoryRecorder.h"
+#include "SensorRecorder.h"
 
 namespace ORB_SLAM2
 {
 
 class Viewer;
+class Publisher;
+class DenseExporter;
+class TrajectoryRecorder;
+class SensorRecorder;
 class FrameDrawer;
 class Map;
 class Tracking;
@@ -59,16 +73,20 @@ public:
 public:
 
     // Initialize the SLAM system. It launches the Local Mapping, Loop Closing and Viewer threads.
-    System(const string &strVocFile, const string &strSettingsFile, const eSensor sensor, const bool bUseViewer = true);
+    // The input images are recorded only if Recorder.File is set and bRecordSensors (false when
+    // replaying a sensor log).
+    System(const string &strVocFile, const string &strSettingsFile, const eSensor sensor, const bool bUseViewer = true,
+           const bool bRecordSensors = true);
 
-    // Proccess the given stereo frame. Images must be synchronized and rectified.
+    // Proccess the given stereo frame. Images must be synchronized and rectified, unless
+    // Stereo.Rectify is set and the tracker rectifies them (LEFT/RIGHT calibration).
     // Input images: RGB (CV_8UC3) or grayscale (CV_8U). RGB is converted to grayscale.
     // Returns the camera pose (empty if tracking fails).
     cv::Mat TrackStereo(const cv::Mat &imLeft, const cv::Mat &imRight, const double &timestamp);
 
     // Process the given rgbd frame. Depthmap must be registered to the RGB frame.
     // Input image: RGB (CV_8UC3) or grayscale (CV_8U). RGB is converted to grayscale.
-    // Input depthmap: Float (CV_32F).
+    // Input depthmap: Float (CV_32F) or 16-bit (CV_16U), scaled by DepthMapFactor into a buffer of the tracker.
     // Returns the camera pose (empty if tracking fails).
     cv::Mat TrackRGBD(const cv::Mat &im, const cv::Mat &depthmap, const double &timestamp);
 
@@ -77,6 +95,27 @@ public:
     // Returns the camera pose (empty if tracking fails).
     cv::Mat TrackMonocular(const cv::Mat &im, const double &timestamp);
 
+    // Pipelined versions of the calls above: color conversion and feature extraction of a frame
+    // run on their own thread while the previous frames are tracked, and the pose is returned
+    // through the future. A call blocks while Pipeline.QueueSize frames wait to be extracted.
+    // The images are not copied, they must not be modified until the future is ready.
+    // Do not mix them with the synchronous calls.
+    std::future<cv::Mat> TrackStereoAsync(const cv::Mat &imLeft, const cv::Mat &imRight, const double &timestamp);
+    std::future<cv::Mat> TrackRGBDAsync(const cv::Mat &im, const cv::Mat &depthmap, const double &timestamp);
+    std::future<cv::Mat> TrackMonocularAsync(const cv::Mat &im, const double &timestamp);
+
+    // Zero-copy versions of the calls above over caller-owned buffers of any stride, in the pixel
+    // formats of ImageBuffer (gray, RGB, YUYV, Bayer, 16-bit or float depth). The gray image is
+    // converted directly into the ORB pyramid and the depth into a buffer of the tracker. Nothing
+    // refers to the buffers after the call returns (after the future is ready for the Async ones).
+    cv::Mat TrackStereo(const ImageBuffer &imLeft, const ImageBuffer &imRight, const double &timestamp);
+    cv::Mat TrackRGBD(const ImageBuffer &im, const ImageBuffer &depthmap, const double &timestamp);
+    cv::Mat TrackMonocular(const ImageBuffer &im, const double &timestamp);
+    std::future<cv::Mat> TrackStereoAsync(const ImageBuffer &imLeft, const ImageBuffer &imRight,
+                                          const double &timestamp);
+    std::future<cv::Mat> TrackRGBDAsync(const ImageBuffer &im, const ImageBuffer &depthmap, const double &timestamp);
+    std::future<cv::Mat> TrackMonocularAsync(const ImageBuffer &im, const double &timestamp);
+
     // This stops local mapping thread (map building) and performs only camera tracking.
     void ActivateLocalizationMode();
     // This resumes local mapping thread and performs SLAM again.
@@ -96,7 +135,7 @@ public:
 
     // Save camera trajectory in the TUM RGB-D dataset format.
     // Only for stereo and RGB-D. This method does not work for monocular.
-    // Call first Shutdown()
+    // Call first Shutdown(). A log of a previous run can be converted with TrajectoryRecorder::ConvertLog.
     // See format details at: http://vision.in.tum.de/data/datasets/rgbd-dataset
     void SaveTrajectoryTUM(const string &filename);
 
@@ -112,6 +151,20 @@ public:
     // See format details at: http://www.cvlibs.net/datasets/kitti/eval_odometry.php
     void SaveTrajectoryKITTI(const string &filename);
 
+    // Export the dense map built from the keyframe depth images (RGB-D) in background.
+    // The format follows the extension: .ot or .bt (octomap with free space), .pcd or .ply.
+    // The resolution is the voxel size in meters, DenseMap.Resolution if not given.
+    // Call before Shutdown(), which waits for the pending exports.
+    bool ExportDenseMap(const string &filename, const float resolution = 0);
+
+    // Export the surface of the TSDF volume integrated from the RGB-D keyframes as a colored PLY
+    // mesh, in background. Voxel size and truncation are set by DenseMap.TsdfVoxelSize and
+    // DenseMap.TsdfTruncation.
+    bool ExportDenseMesh(const string &filename);
+
+    // Fraction of the keyframes processed by the running export, negative if none is running
+    float GetDenseMapExportProgress();
+
     // TODO: Save/Load functions
     // SaveMap(const string &filename);
     // LoadMap(const string &filename);
@@ -122,8 +175,47 @@ public:
     std::vector<MapPoint*> GetTrackedMapPoints();
     std::vector<cv::KeyPoint> GetTrackedKeyPointsUn();
 
+    // Semantic objects in world coordinates (radius, k-NN and class queries)
+    ObjectMap* GetObjectMap();
+
 private:
 
+    // Applies the pending mode change and reset requests
+    void CheckModeAndReset();
+    bool ModeOrResetRequested();
+    bool ResetRequested();
+
+    // Publishes the pose and stores the state of the frame just tracked
+    void UpdateTrackingState(const cv::Mat &Tcw, const double &timestamp);
+
+    // Copies the input to the sensor log, if one is recorded. im2 is empty for monocular.
+    void RecordInput(const ImageBuffer &im, const ImageBuffer &im2, const double &timestamp);
+
+    // Pipelined mode: the extraction stage preprocesses the inputs and feeds the tracking stage.
+    // im2 is the right image (stereo) or the depthmap (RGB-D).
+    struct PipelineInput
+    {
+        ImageBuffer im;
+        ImageBuffer im2;
+        double timestamp;
+        std::promise<cv::Mat> promise;
+    };
+
+    // A null frame marks the end of the queue
+    struct PipelineFrame
+    {
+        std::unique_ptr<Frame> pFrame;
+        cv::Mat imGray;
+        std::promise<cv::Mat> promise;
+    };
+
+    std::future<cv::Mat> EnqueueFrame(const ImageBuffer &im, const ImageBuffer &im2, const double &timestamp);
+    void RunExtraction();
+    void RunPipelineTracking();
+
+    // Tracks the queued frames and joins the pipeline threads
+    void StopPipeline();
+
     // Input sensor
     eSensor mSensor;
 
@@ -151,14 +243,35 @@ private:
     // The viewer draws the map and the current camera pose. It uses Pangolin.
     Viewer* mpViewer;
 
+    // Streams poses and map changes to other processes (Publisher.Port or Publisher.Socket).
+    Publisher* mpPublisher;
+
+    // Writes dense maps to disk without stalling the other threads.
+    DenseExporter* mpDenseExporter;
+
+    // Logs the pose of every frame to disk (Trajectory.Log, CameraTrajectory.log by default),
+    // SaveTrajectory* read it back.
+    TrajectoryRecorder* mpTrajectoryRecorder;
+
+    // Records the input images (Recorder.File) to replay them with SensorPlayer.
+    SensorRecorder* mpSensorRecorder;
+
     FrameDrawer* mpFrameDrawer;
     MapDrawer* mpMapDrawer;
 
-    // System threads: Local Mapping, Loop Closing, Viewer.
+    // System threads: Local Mapping, Loop Closing, Viewer, Publisher, Dense Exporter, Trajectory Recorder,
+    // Sensor Recorder.
     // The Tracking thread "lives" in the main execution thread that creates the System object.
+    // In the pipelined mode (Track*Async) extraction and tracking run on their own threads.
     std::thread* mptLocalMapping;
     std::thread* mptLoopClosing;
     std::thread* mptViewer;
+    std::thread* mptPublisher;
+    std::thread* mptDenseExporter;
+    std::thread* mptTrajectoryRecorder;
+    std::thread* mptSensorRecorder;
+    std::thread* mptExtraction;
+    std::thread* mptPipelineTracking;
 
     // Reset flag
     std::mutex mMutexReset;
@@ -174,6 +287,15 @@ private:
     std::vector<MapPoint*> mTrackedMapPoints;
     std::vector<cv::KeyPoint> mTrackedKeyPointsUn;
     std::mutex mMutexState;
+
+    // Pipelined mode queues, both bounded by mnPipelineQueueSize
+    std::mutex mMutexPipeline;
+    std::condition_variable mcvPipeline;
+    std::deque<PipelineInput> mlPipelineInputs;
+    std::deque<PipelineFrame> mlPipelineFrames;
+    size_t mnPipelineQueueSize;
+    bool mbPipelineTracking;
+    bool mbPipelineFinish;
 };
 
 }// namespace ORB_SLAM
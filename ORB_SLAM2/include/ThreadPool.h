@@ -0,0 +1,106 @@
+/**
+* This file is part of ORB-SLAM2.
+*
+* Copyright (C) 2014-2016 Raúl Mur-Artal <raulmur at unizar dot es> (University of Zaragoza)
+* For more information see <https://github.com/raulmur/ORB_SLAM2>
+*
+* ORB-SLAM2 is free software: you can redistribute it and/or modify
+* it under the terms of the GNU General Public License as published by
+* the Free Software Foundation, either version 3 of the License, or
+* (at your option) any later version.
+*
+* ORB-SLAM2 is distributed in the hope that it will be useful,
+* but WITHOUT ANY WARRANTY; without even the implied warranty of
+* MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+* GNU General Public License for more details.
+*
+* You should have received a copy of the GNU General Public License
+* along with ORB-SLAM2. If not, see <http://www.gnu.org/licenses/>.
+*/
+
+
+#ifndef THREADPOOL_H
+#define THREADPOOL_H
+
+#include <vector>
+#include <deque>
+#include <thread>
+#include <mutex>
+#include <condition_variable>
+#include <functional>
+#include <memory>
+#include <atomic>
+#include <algorithm>
+
+namespace ORB_SLAM2
+{
+
+// Persistent workers for the data-parallel loops of the system threads, instead of spawning
+// and joining threads at every call. Run can be called from any thread, concurrently and from
+// inside a task: the caller runs the tasks of its own batch that no worker has taken, so a
+// batch always completes even if every worker is busy.
+class ThreadPool
+{
+public:
+    // Pool shared by the whole process, with one thread per core counting the caller
+    static ThreadPool& Instance();
+
+    explicit ThreadPool(const int nWorkers);
+    ~ThreadPool();
+
+    // Threads that can run a batch at once, the caller included
+    int Size() const { return mvWorkers.size()+1; }
+
+    // Runs task(0) ... task(nTasks-1) and returns when all have finished
+    void Run(const int nTasks, const std::function<void(int)> &task);
+
+    // Runs f(begin,end) over [0,n) in chunks of nChunk, handed out dynamically
+    template<class F>
+    void ParallelChunks(const int n, const int nChunk, F f)
+    {
+        if(n<=0)
+            return;
+
+        std::atomic<int> nNext(0);
+        const int nTasks = std::min(Size(),(n+nChunk-1)/nChunk);
+        Run(nTasks,[&](const int)
+        {
+            while(true)
+            {
+                const int i0 = nNext.fetch_add(nChunk);
+                if(i0>=n)
+                    break;
+                f(i0,std::min(n,i0+nChunk));
+            }
+        });
+    }
+
+protected:
+
+    struct Batch
+    {
+        std::function<void(int)> task;
+        int nTasks;
+        std::atomic<int> nNext;
+        int nDone;
+        std::mutex mMutex;
+        std::condition_variable mcvDone;
+    };
+
+    // Claims and runs one task of the batch, returns false if all were taken
+    static bool RunOne(Batch &batch);
+
+    void WorkerLoop();
+
+    std::vector<std::thread> mvWorkers;
+
+    // Batches with tasks not taken yet
+    std::deque<std::shared_ptr<Batch> > mdBatches;
+    std::mutex mMutexBatches;
+    std::condition_variable mcvBatches;
+    bool mbStop;
+};
+
+} //namespace ORB_SLAM
+
+#endif // THREADPOOL_H
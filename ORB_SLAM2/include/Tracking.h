@@ -38,7 +38,15 @@
 #include "MapDrawer.h"
 #include "System.h"
 #include "Communication.h"
+#include "ImageBuffer.h"
+#include "Rectifier.h"
+#include "TrajectoryRecorder.h"
+#include "DenseExporter.h"
+#include "Publisher.h"
 #include <mutex>
+#include <condition_variable>
+#include <map>
+#include <chrono>
 
 namespace ORB_SLAM2 {
 
@@ -55,9 +63,17 @@ class LoopClosing;
 class System;
 
 struct ImagePair {
-  long unsigned int keyFrameId;
+  KeyFrame *pKF;
   cv::Mat colorImg;
   cv::Mat depthImg;
+  // Tracking::Reset calls before the keyframe was queued, its request is dropped after a reset
+  unsigned int nReset;
+};
+
+// A keyframe sent to the segmentation server
+struct SegRequest {
+  KeyFrame *pKF;
+  std::chrono::steady_clock::time_point tSent;
 };
 
 class Tracking {
@@ -67,11 +83,30 @@ class Tracking {
            KeyFrameDatabase *pKFDB, const string &strSettingPath, const int sensor);
 
   // Preprocess the input and call Track(). Extract features and performs stereo matching.
-  cv::Mat GrabImageStereo(const cv::Mat &imRectLeft, const cv::Mat &imRectRight, const double &timestamp);
+  // The input buffers are only read during the call (see ImageBuffer).
+  cv::Mat GrabImageStereo(const ImageBuffer &imRectLeft, const ImageBuffer &imRectRight, const double &timestamp);
+
+  cv::Mat GrabImageRGBD(const ImageBuffer &imRGB, const ImageBuffer &imD, const double &timestamp);
+
+  cv::Mat GrabImageMonocular(const ImageBuffer &im, const double &timestamp);
+
+  // Color conversion and feature extraction of the input, without tracking. They only read the
+  // settings and the dynamic mask cache, so they can run on another thread while the previous
+  // frames are tracked (System pipelined mode). The initializer extractor is used if bInitializing.
+  void PreprocessStereo(const ImageBuffer &imRectLeft, const ImageBuffer &imRectRight, const double &timestamp,
+                        Frame &frame, cv::Mat &imGray);
+
+  void PreprocessRGBD(const ImageBuffer &imRGB, const ImageBuffer &imD, const double &timestamp, Frame &frame,
+                      cv::Mat &imGray);
+
+  void PreprocessMonocular(const ImageBuffer &im, const double &timestamp, const bool bInitializing, Frame &frame,
+                           cv::Mat &imGray);
 
-  cv::Mat GrabImageRGBD(const cv::Mat &imRGB, const cv::Mat &imD, const double &timestamp);
+  // Tracks a frame returned by Preprocess*, frames must be tracked in the order they were preprocessed
+  cv::Mat TrackPreprocessed(const Frame &frame, const cv::Mat &imGray);
 
-  cv::Mat GrabImageMonocular(const cv::Mat &im, const double &timestamp);
+  // Pixel format of an image given as a cv::Mat: gray, RGB or BGR (Camera.RGB) or depth
+  ImageBuffer WrapImage(const cv::Mat &im) const;
 
   void SetLocalMapper(LocalMapping *pLocalMapper);
 
@@ -79,6 +114,12 @@ class Tracking {
 
   void SetViewer(Viewer *pViewer);
 
+  void SetTrajectoryRecorder(TrajectoryRecorder *pRecorder);
+
+  void SetDenseExporter(DenseExporter *pDenseExporter);
+
+  void SetPublisher(Publisher *pPublisher);
+
   // Load new settings
   // The focal lenght should be similar or scale prediction will fail when projecting points
   // TODO: Modify MapPoint::PredictScale to take into account focal lenght
@@ -87,6 +128,9 @@ class Tracking {
   // Use this function if you have deactivated local mapping and you only want to localize the camera.
   void InformOnlyTracking(const bool &flag);
 
+  // Stops and joins the segmentation threads, the keyframes not segmented yet are dropped
+  void StopSegmentation();
+
  public:
 
   // Tracking states
@@ -115,12 +159,10 @@ class Tracking {
   std::vector<cv::Point3f> mvIniP3D;
   Frame mInitialFrame;
 
-  // Lists used to recover the full camera trajectory at the end of the execution.
-  // Basically we store the reference keyframe for each frame and its relative transformation
-  list <cv::Mat> mlRelativeFramePoses;
-  list<KeyFrame *> mlpReferences;
-  list<double> mlFrameTimes;
-  list<bool> mlbLost;
+  // Pose of the last frame relative to its reference keyframe. The pose of every frame is
+  // recorded this way (see TrajectoryRecorder) to recover the full camera trajectory.
+  cv::Mat mLastRelativePose;
+  KeyFrame *mpLastPoseReference;
 
   // True if local mapping is deactivated and we are performing only localization
   bool mbOnlyTracking;
@@ -140,6 +182,9 @@ class Tracking {
 
   void CreateInitialMapMonocular();
 
+  // Keeps the map and initializes a new sub-map (see Map) from the next frames
+  void StartNewSubmap();
+
   void CheckReplacedInLastFrame();
 
   bool TrackReferenceKeyFrame();
@@ -164,9 +209,32 @@ class Tracking {
 
   void CreateNewKeyFrame();
 
+  // Sends the queued keyframes to the segmentation server without waiting for the previous
+  // results, at most mnMaxSegInFlight requests are unanswered at a time
   void PerformSegmentation();
 
-  void SaveSegResultToMap(const Client::ClsPosPairs &clsPosPairs, long unsigned int keyFrameId);
+  // Receives the segmentation results, tagged with the request id, and saves them to the map
+  void ReceiveSegmentation();
+
+  void SaveSegResultToMap(const Client::ClsPosPairs &clsPosPairs, KeyFrame *pKF);
+
+  // Caches the masks of the dynamic objects (people, ...) segmented in a keyframe
+  void SetDynamicMask(const Client::InstanceMasks &masks, KeyFrame *pKF);
+
+  // Warps the cached dynamic mask into the frame about to be tracked, using the keyframe depth
+  // and the motion model. Returns the extraction mask (0 on dynamic objects) or an empty one.
+  cv::Mat PropagateDynamicMask();
+
+  // Last tracked pose and velocity, read by PropagateDynamicMask from the preprocessing thread
+  void PublishMotion();
+
+  // Grayscale image written directly in the first pyramid level of the extractor, rectified
+  // on the way if a rectifier is given
+  cv::Mat ConvertToGray(const ImageBuffer &im, ORBextractor *pExtractor,
+                        const Rectifier *pRectifier = static_cast<Rectifier *>(NULL));
+
+  // Depth in meters (CV_32F), in a buffer of mvDepthPool
+  cv::Mat ConvertDepth(const ImageBuffer &depth);
 
   // In case of performing only localization, this flag is true when there are no matches to
   // points in the map. Still tracking will continue if there are enough matches with temporal points.
@@ -182,6 +250,9 @@ class Tracking {
   ORBextractor *mpORBextractorLeft, *mpORBextractorRight;
   ORBextractor *mpIniORBextractor;
 
+  // Stereo rectification (Stereo.Rectify), NULL if the input is already rectified
+  Rectifier *mpRectifierLeft, *mpRectifierRight;
+
   //BoW
   ORBVocabulary *mpORBVocabulary;
   KeyFrameDatabase *mpKeyFrameDB;
@@ -202,6 +273,12 @@ class Tracking {
   FrameDrawer *mpFrameDrawer;
   MapDrawer *mpMapDrawer;
 
+  TrajectoryRecorder *mpRecorder;
+
+  // Paused while the keyframes are deleted by Reset
+  DenseExporter *mpDenseExporter;
+  Publisher *mpPublisher;
+
   //Map
   Map *mpMap;
 
@@ -222,6 +299,11 @@ class Tracking {
   // For RGB-D inputs only. For some datasets (e.g. TUM) the depthmap values are scaled.
   float mDepthMapFactor;
 
+  // Depth buffers of the RGB-D frames, reused once no frame refers to them anymore. The ones
+  // kept by keyframes are dropped from the pool when it is full.
+  std::vector<cv::Mat> mvDepthPool;
+  const size_t mcDepthPoolSize = 8;
+
   //Current matches in frame
   int mnMatchesInliers;
 
@@ -231,6 +313,13 @@ class Tracking {
   unsigned int mnLastKeyFrameId;
   unsigned int mnLastRelocFrameId;
 
+  // Map big change index seen by the last frame
+  int mnLastBigChangeIdx;
+
+  // A new sub-map is started when relocalisation fails for more than mMaxLostFrames frames
+  unsigned int mnLastTrackedFrameId;
+  int mMaxLostFrames;
+
   //Motion Model
   cv::Mat mVelocity;
 
@@ -243,7 +332,39 @@ class Tracking {
   std::mutex mMutexImagesQueue;
   const int mcQueueSize = 15;
   std::queue<ImagePair> mImagesQueue;
+  std::condition_variable mcvImagesQueue;
   std::unique_ptr<std::thread> mSegmentation;
+
+  // Keyframes sent to the segmentation server and not answered yet, by request id. Requests
+  // not answered within Segmentation.Timeout seconds are given up.
+  std::mutex mMutexSegInFlight;
+  std::condition_variable mcvSegInFlight;
+  std::map<long unsigned int, SegRequest> mmSegInFlight;
+  long unsigned int mnNextSegRequestId;
+  int mnMaxSegInFlight;
+  std::chrono::steady_clock::duration mSegTimeout;
+  // Number of resets, changed with both mMutexImagesQueue and mMutexSegInFlight locked
+  unsigned int mnSegResets;
+  std::unique_ptr<std::thread> mSegmentationResults;
+  // Held while a result is saved to its keyframe, so that Reset cannot delete it meanwhile
+  std::mutex mMutexSegResult;
+  // Set with both mMutexImagesQueue and mMutexSegInFlight locked
+  bool mbSegFinish;
+
+  // Dynamic object masking (RGB-D), Segmentation.MaskDynamic
+  bool mbMaskDynamic;
+  int mnDynMaskDilation;
+  int mnDynMaskMaxAge;
+  std::mutex mMutexDynMask;
+  KeyFrame *mpDynMaskKF;
+  cv::Mat mDynMask;
+
+  // Motion model of the last tracked frame, see PublishMotion
+  std::mutex mMutexMotion;
+  bool mbMotionOK;
+  cv::Mat mMotionTcw;
+  cv::Mat mMotionVelocity;
+  long unsigned int mnMotionFrameId;
 };
 
 } //namespace ORB_SLAM
@@ -0,0 +1,174 @@
+/**
+* This file is part of ORB-SLAM2.
+*
+* Copyright (C) 2014-2016 Raúl Mur-Artal <raulmur at unizar dot es> (University of Zaragoza)
+* For more information see <https://github.com/raulmur/ORB_SLAM2>
+*
+* ORB-SLAM2 is free software: you can redistribute it and/or modify
+* it under the terms of the GNU General Public License as published by
+* the Free Software Foundation, either version 3 of the License, or
+* (at your option) any later version.
+*
+* ORB-SLAM2 is distributed in the hope that it will be useful,
+* but WITHOUT ANY WARRANTY; without even the implied warranty of
+* MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+* GNU General Public License for more details.
+*
+* You should have received a copy of the GNU General Public License
+* along with ORB-SLAM2. If not, see <http://www.gnu.org/licenses/>.
+*/
+
+
+#ifndef TRAJECTORYRECORDER_H
+#define TRAJECTORYRECORDER_H
+
+#include <opencv2/core/core.hpp>
+#include <string>
+#include <vector>
+#include <unordered_map>
+#include <mutex>
+#include <condition_variable>
+#include <stdint.h>
+
+namespace ORB_SLAM2
+{
+
+class Map;
+class KeyFrame;
+
+// Records the camera trajectory while tracking, in a binary log that a background thread appends
+// to a memory-mapped file (Trajectory.Log, CameraTrajectory.log in the working directory if not
+// set). Memory does not grow with the length of the run, and the log of a crashed run can still be
+// converted.
+//
+// The log is a header {char magic[8] "ORBTRAJ1", uint32 record bytes, uint32 reserved,
+// uint64 records} followed by fixed-size records, all little-endian whatever the host byte order
+// (see LittleEndian.h):
+//   {uint32 type, int32 state, float64 timestamp, uint64 id, uint64 reference id, float32 T[12]}
+//   FRAME    (1): frame id, tracking state, reference keyframe id, T = Tcr (3x4 row major)
+//   KEYFRAME (2): keyframe id, state 1 if culled, parent id, T = Tcp if culled, Tcw otherwise
+//   RESET    (3): the map was reset, the keyframe ids of the previous records are reused
+// A keyframe is logged when a frame first refers to it and again after every loop closure or
+// global BA, so its last record holds its latest known pose. The record count of the header is
+// updated after the records are written: a crash only loses the records not written yet.
+class TrajectoryRecorder
+{
+public:
+    enum eFormat
+    {
+        TUM=0,
+        KITTI=1
+    };
+
+    TrajectoryRecorder(Map* pMap, const std::string &strSettingPath);
+    ~TrajectoryRecorder();
+
+    // Main thread function. Writes the queued records and logs the keyframes again after big changes.
+    void Run();
+
+    // Called after every frame with a pose, Tcr relative to the reference keyframe.
+    // When the tracking is lost the last relative pose is given again.
+    void AddFrame(const long unsigned int nFrameId, const double timestamp, KeyFrame* pRefKF,
+                  const cv::Mat &Tcr, const int state);
+
+    // Call before the map is cleared, its keyframes are not accessed anymore
+    void Reset();
+
+    // Camera poses (Twc) of the frames recorded since the last reset, resolved with the current
+    // keyframe poses and relative to the first keyframe. Lost frames are dropped if bSkipLost.
+    void GetTrajectory(std::vector<double> &vTimeStamps, std::vector<cv::Mat> &vTwc, const bool bSkipLost);
+
+    // TUM skips the lost frames, KITTI writes all of them
+    bool Save(const std::string &filename, const eFormat format);
+
+    // Converts a log written by a previous run (possibly one that crashed), with the last
+    // keyframe poses it recorded
+    static bool ConvertLog(const std::string &strLogFile, const std::string &filename, const eFormat format);
+
+    void RequestFinish();
+
+    bool isFinished();
+
+protected:
+
+    struct LogHeader
+    {
+        char mMagic[8];
+        uint32_t mnRecordSize;
+        uint32_t mnReserved;
+        uint64_t mnRecords;
+    };
+
+    struct Record
+    {
+        uint32_t mnType;
+        int32_t mnState;
+        double mTimeStamp;
+        uint64_t mnId;
+        uint64_t mnRefId;
+        float mT[12];
+    };
+
+    static Record KeyFrameRecord(KeyFrame* pKF);
+
+    // A record as stored in the log, sizeof(Record) little-endian bytes at p
+    static void EncodeRecord(const Record &record, char* p);
+    static Record DecodeRecord(const char* p);
+    static void DecodeRecords(const char* p, const size_t n, std::vector<Record> &vRecords);
+
+    // Latest pose of a registered keyframe, through the spanning tree if it was culled
+    bool KeyFramePose(const uint64_t nId, cv::Mat &Tcw);
+
+    // Logs all the registered keyframes with their current pose
+    void SnapshotKeyFrames();
+
+    // Twc of the frame records between pBegin and pEnd, relative to the keyframe of lowest id.
+    // mKeyFramePoses has the Tcw of the keyframes, frames whose reference is missing are dropped.
+    static void ResolveFrames(const Record* pBegin, const Record* pEnd,
+                              const std::unordered_map<uint64_t, cv::Mat> &mKeyFramePoses, const bool bSkipLost,
+                              std::vector<double> &vTimeStamps, std::vector<cv::Mat> &vTwc);
+
+    bool OpenLog();
+    bool GrowLog(const size_t nCapacity);
+    // Moves the queued records to the log, call with mMutexLog locked
+    void FlushQueue();
+
+    static void WriteTrajectory(const std::string &filename, const eFormat format,
+                                const std::vector<double> &vTimeStamps, const std::vector<cv::Mat> &vTwc);
+
+    bool CheckFinish();
+    void SetFinish();
+
+    Map* mpMap;
+
+    std::string mStrLogFile;
+
+    // Memory-mapped log, mnCapacity records fit in the file
+    int mFd;
+    char* mpLog;
+    size_t mnCapacity;
+    size_t mnRecords;
+    // First record after the last reset
+    size_t mnSegmentBegin;
+    bool mbLogFailed;
+    std::mutex mMutexLog;
+
+    // Records from the tracking thread, not written yet
+    std::vector<Record> mvQueue;
+    std::mutex mMutexQueue;
+    std::condition_variable mcvQueue;
+
+    // Keyframes referred to since the last reset
+    std::unordered_map<long unsigned int, KeyFrame*> mmKeyFrames;
+    std::mutex mMutexKeyFrames;
+
+    int mnLastBigChangeIdx;
+
+    bool mbFinishRequested;
+    bool mbFinished;
+    std::mutex mMutexFinish;
+};
+
+}// namespace ORB_SLAM
+
+#endif // TRAJECTORYRECORDER_H
@@ -0,0 +1,127 @@
+/**
+* This file is part of ORB-SLAM2.
+*
+* Copyright (C) 2014-2016 Raúl Mur-Artal <raulmur at unizar dot es> (University of Zaragoza)
+* For more information see <https://github.com/raulmur/ORB_SLAM2>
+*
+* ORB-SLAM2 is free software: you can redistribute it and/or modify
+* it under the terms of the GNU General Public License as published by
+* the Free Software Foundation, either version 3 of the License, or
+* (at your option) any later version.
+*
+* ORB-SLAM2 is distributed in the hope that it will be useful,
+* but WITHOUT ANY WARRANTY; without even the implied warranty of
+* MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+* GNU General Public License for more details.
+*
+* You should have received a copy of the GNU General Public License
+* along with ORB-SLAM2. If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#ifndef TSDFVOLUME_H
+#define TSDFVOLUME_H
+
+#include <opencv2/core/core.hpp>
+#include <Eigen/Core>
+#include <string>
+#include <vector>
+#include <unordered_map>
+#include <stdint.h>
+
+namespace ORB_SLAM2
+{
+
+class Map;
+class KeyFrame;
+
+// Truncated signed distance function of the RGB-D keyframes, stored in blocks of 8x8x8 voxels
+// that are only allocated near the observed surfaces and looked up by a hash of their coordinates.
+// Integration is reversible: a keyframe whose pose is corrected by the optimization is removed
+// with the pose it was integrated with and integrated again with the new one, and blocks left
+// without observations are freed. Not thread-safe, it is owned by the DenseExporter thread.
+class TsdfVolume
+{
+public:
+    struct Mesh
+    {
+        std::vector<Eigen::Vector3f> mvVertices;
+        // RGB
+        std::vector<Eigen::Matrix<unsigned char,3,1> > mvColors;
+        std::vector<Eigen::Vector3i> mvTriangles;
+    };
+
+    TsdfVolume(Map* pMap, const std::string &strSettingPath);
+    ~TsdfVolume();
+
+    // Integrates the keyframe if it is new, re-integrates it if its pose moved since it was
+    // integrated, removes it if it is bad. Returns true if the volume changed.
+    bool Update(KeyFrame* pKF);
+
+    // Removes the integrated keyframes that are not in vpKFs anymore
+    void RemoveMissing(const std::vector<KeyFrame*> &vpKFs);
+
+    // Zero crossing surface by marching cubes, with the vertices shared between triangles
+    void ExtractMesh(Mesh &mesh);
+
+    // Binary PLY with vertex colors
+    static bool SaveMesh(const Mesh &mesh, const std::string &filename);
+
+    void Clear();
+
+    size_t BlocksInVolume() const { return mmBlocks.size(); }
+    float GetVoxelSize() const { return mVoxelSize; }
+
+protected:
+
+    static const int BLOCK_SIZE = 8;
+    static const int BLOCK_VOXELS = BLOCK_SIZE*BLOCK_SIZE*BLOCK_SIZE;
+
+    struct Voxel
+    {
+        float mSdf;
+        float mWeight;
+        float mColor[3];
+    };
+
+    struct Block
+    {
+        Voxel mVoxels[BLOCK_VOXELS];
+    };
+
+    static int64_t BlockKey(const int bx, const int by, const int bz);
+    static void BlockCoords(const int64_t key, int &bx, int &by, int &bz);
+
+    // Blocks crossed by the truncation band of the keyframe depth, seen from Tcw
+    void VisibleBlocks(KeyFrame* pKF, const cv::Mat &Tcw, std::vector<int64_t> &vKeys);
+
+    // Adds (weight 1) or removes (weight -1) the keyframe observed from Tcw
+    void Integrate(KeyFrame* pKF, const cv::Mat &Tcw, const float weight);
+
+    // Blocks [nBegin,nEnd) of vpBlocks, run in parallel on the shared ThreadPool
+    void IntegrateBlocks(KeyFrame* pKF, const cv::Mat &Tcw, const float weight,
+                         const std::vector<Block*> &vpBlocks, const std::vector<int64_t> &vKeys,
+                         std::vector<char> &vbEmpty, const int nBegin, const int nEnd);
+
+    Map* mpMap;
+
+    float mVoxelSize;
+    float mTruncation;
+    float mMinDepth;
+    float mMaxDepth;
+    int mnAllocationStep;
+    bool mbRGB;
+
+    // A keyframe is re-integrated when its pose changed more than this
+    float mReintegrateDist;
+    float mReintegrateAngle;
+
+    std::unordered_map<int64_t, Block*> mmBlocks;
+
+    // Keyframes in the volume and the pose they were integrated with
+    std::unordered_map<KeyFrame*, cv::Mat> mmIntegratedPoses;
+    int mnClearIdx;
+};
+
+} //namespace ORB_SLAM
+
+#endif // TSDFVOLUME_H
@@ -28,6 +28,7 @@
 #include "System.h"
 
 #include <mutex>
+#include <condition_variable>
 
 namespace ORB_SLAM2
 {
@@ -80,6 +81,7 @@ private:
     bool mbStopped;
     bool mbStopRequested;
     std::mutex mMutexStop;
+    std::condition_variable mcvStop;
 
 };
 
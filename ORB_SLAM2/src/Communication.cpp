@@ -6,9 +6,10 @@
 #include <unistd.h>
 #include <arpa/inet.h>
 #include <utility>
+#include <stdint.h>
 
 Client::Client()
-    : mcHostname("localhost"), mcPort(7200), mcMaskClsSize(100)
+    : mcHostname("localhost"), mcPort(7200), mcMaskClsSize(100), mbShutdown(false)
 {
     mImMemSize = -1;
     setupSocket();
@@ -17,7 +18,7 @@ Client::Client()
 
 Client::Client(std::string hostname, int port)
     :
-    mcHostname(hostname), mcPort(port), mcMaskClsSize(100)
+    mcHostname(hostname), mcPort(port), mcMaskClsSize(100), mbShutdown(false)
 {
     mImMemSize = -1;
     setupSocket();
@@ -35,6 +36,15 @@ void Client::sendImages(const std::vector<cv::Mat> &images)
     sendImgMat(images);
 }
 
+void Client::sendRequest(long unsigned int id, const cv::Mat &color, const cv::Mat &depth)
+{
+    int64_t header[1] = {(int64_t) id};
+    if (!sendAll(mSockfd, header, sizeof(header)))
+        error("ERROR Sending Request Id");
+    sendImages(std::vector<cv::Mat>(1, color));
+    sendImages(std::vector<cv::Mat>(1, depth));
+}
+
 void Client::sendImgHeader(const std::vector<cv::Mat> &images)
 {
     cv::Mat image = images[0];
@@ -93,32 +103,37 @@ bool Client::sendAll(int socket, void *buffer, int length)
 }
 
 void Client::getSegResult(ClsPosPairs &pairs)
+{
+    recvClsPosPairs(pairs);
+}
+
+bool Client::recvClsPosPairs(ClsPosPairs &pairs)
 {
     pairs.clear();
     int header[1];
     bool rev_ok = recvAll(mSockfd, header, sizeof(header));
     if (!rev_ok)
-        error("ERROR Receiving Header of Segmentation Result");
+        return failed("ERROR Receiving Header of Segmentation Result");
     int numObjects = header[0];
     for (int i = 0; i < numObjects; i++) {
         int clsNameLen[1];
         rev_ok = recvAll(mSockfd, clsNameLen, sizeof(clsNameLen));
         if (!rev_ok)
-            error("ERROR Receiving Object's Name Length");
+            return failed("ERROR Receiving Object's Name Length");
         uchar className[clsNameLen[0]];
         rev_ok = recvAll(mSockfd, className, clsNameLen[0]);
         if (!rev_ok)
-            error("ERROR Receiving Object's Name");
+            return failed("ERROR Receiving Object's Name");
         int clsNum[1];
         rev_ok = recvAll(mSockfd, clsNum, sizeof(clsNum));
         if (!rev_ok)
-            error("ERROR Receiving Object's Total Number");
+            return failed("ERROR Receiving Object's Total Number");
         std::vector<std::vector<double> > poses;
         for (int j = 0; j < clsNum[0]; j++) {
             double pos[3];
             rev_ok = recvAll(mSockfd, pos, sizeof(pos));
             if (!rev_ok)
-                error("ERROR Receiving Object's Position");
+                return failed("ERROR Receiving Object's Position");
             std::vector<double> vPos(pos, pos + sizeof(pos) / sizeof(pos[0]));
             poses.push_back(vPos);
         }
@@ -126,6 +141,53 @@ void Client::getSegResult(ClsPosPairs &pairs)
         std::pair<std::string, std::vector<std::vector<double> > > clsPos(sClassName, poses);
         pairs.push_back(clsPos);
     }
+    return true;
+}
+
+bool Client::getSegResult(long unsigned int &id, ClsPosPairs &pairs, InstanceMasks &masks)
+{
+    int64_t header[1];
+    if (!recvAll(mSockfd, header, sizeof(header)))
+        return failed("ERROR Receiving Request Id of Segmentation Result");
+    id = header[0];
+    if (!recvClsPosPairs(pairs))
+        return false;
+
+    masks.clear();
+    int numMasks[1];
+    if (!recvAll(mSockfd, numMasks, sizeof(numMasks)))
+        return failed("ERROR Receiving Number of Instance Masks");
+    masks.resize(numMasks[0]);
+    for (int i = 0; i < numMasks[0]; i++) {
+        int clsNameLen[1];
+        if (!recvAll(mSockfd, clsNameLen, sizeof(clsNameLen)))
+            return failed("ERROR Receiving Instance's Name Length");
+        std::string &className = masks[i].className;
+        className.resize(clsNameLen[0]);
+        if (clsNameLen[0] > 0 && !recvAll(mSockfd, &className[0], clsNameLen[0]))
+            return failed("ERROR Receiving Instance's Name");
+        int box[4];
+        if (!recvAll(mSockfd, box, sizeof(box)))
+            return failed("ERROR Receiving Instance's Box");
+        masks[i].box = cv::Rect(box[0], box[1], box[2], box[3]);
+        masks[i].mask.create(box[3], box[2], CV_8U);
+        if (box[2] * box[3] > 0 && !recvAll(mSockfd, masks[i].mask.data, box[2] * box[3]))
+            return failed("ERROR Receiving Instance's Mask");
+    }
+    return true;
+}
+
+void Client::shutdownConnection()
+{
+    mbShutdown = true;
+    shutdown(mSockfd, SHUT_RDWR);
+}
+
+bool Client::failed(const char *msg)
+{
+    if (!mbShutdown)
+        error(msg);
+    return false;
 }
 
 void Client::closeSocket()
@@ -0,0 +1,418 @@
+/**
+* This file is part of ORB-SLAM2.
+*
+* Copyright (C) 2014-2016 Raúl Mur-Artal <raulmur at unizar dot es> (University of Zaragoza)
+* For more information see <https://github.com/raulmur/ORB_SLAM2>
+*
+* ORB-SLAM2 is free software: you can redistribute it and/or modify
+* it under the terms of the GNU General Public License as published by
+* the Free Software Foundation, either version 3 of the License, or
+* (at your option) any later version.
+*
+* ORB-SLAM2 is distributed in the hope that it will be useful,
+* but WITHOUT ANY WARRANTY; without even the implied warranty of
+* MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+* GNU General Public License for more details.
+*
+* You should have received a copy of the GNU General Public License
+* along with ORB-SLAM2. If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#include "DenseExporter.h"
+#include "Map.h"
+#include "KeyFrame.h"
+
+#include <memory>
+#include <iostream>
+#include <chrono>
+#include <boost/filesystem.hpp>
+#include <pcl/point_types.h>
+#include <pcl/point_cloud.h>
+#include <pcl/filters/voxel_grid.h>
+#include <pcl/io/pcd_io.h>
+#include <pcl/io/ply_io.h>
+#include <octomap/octomap.h>
+
+namespace ORB_SLAM2
+{
+
+DenseExporter::DenseExporter(Map *pMap, const std::string &strSettingPath):
+    mpMap(pMap), mTsdf(pMap, strSettingPath), mnKeyFramesDone(0), mnKeyFramesTotal(0), mbExporting(false),
+    mbFinishRequested(false), mbFinished(true), mbStopRequested(false), mbStopped(false)
+{
+    cv::FileStorage fSettings(strSettingPath, cv::FileStorage::READ);
+
+    mnPixelStep = fSettings["DenseMap.PixelStep"];
+    if(mnPixelStep<1)
+        mnPixelStep = 3;
+
+    mMinDepth = fSettings["DenseMap.MinDepth"];
+    if(mMinDepth<=0)
+        mMinDepth = 0.1f;
+
+    mMaxDepth = fSettings["DenseMap.MaxDepth"];
+    if(mMaxDepth<=0)
+        mMaxDepth = 12.0f;
+
+    mDefaultResolution = fSettings["DenseMap.Resolution"];
+    if(mDefaultResolution<=0)
+        mDefaultResolution = 0.05f;
+
+    mTsdfPeriod = fSettings["DenseMap.TsdfPeriod"];
+}
+
+void DenseExporter::Run()
+{
+    mbFinished = false;
+
+    while(1)
+    {
+        std::vector<Job> vJobs;
+        {
+            std::unique_lock<std::mutex> lock(mMutexJobs);
+            if(mTsdfPeriod>0)
+                mcvJobs.wait_for(lock, std::chrono::duration<float>(mTsdfPeriod), [this]{ return !mdJobs.empty() || CheckFinish() || CheckStopRequested(); });
+            else
+                mcvJobs.wait(lock, [this]{ return !mdJobs.empty() || CheckFinish() || CheckStopRequested(); });
+            // Everything queued so far shares the same pass over the keyframes
+            vJobs.assign(mdJobs.begin(), mdJobs.end());
+            mdJobs.clear();
+            mbExporting = !vJobs.empty();
+            mnKeyFramesDone = 0;
+            mnKeyFramesTotal = 0;
+        }
+
+        if(!vJobs.empty())
+        {
+            if(!Export(vJobs))
+            {
+                for(size_t j=0; j<vJobs.size(); j++)
+                    std::cerr << "Dense map export: " << vJobs[j].mFilename << " abandoned, the map was reset" << std::endl;
+            }
+        }
+        else if(mTsdfPeriod>0 && !CheckFinish())
+        {
+            // Keep the volume up to date so that mesh exports only integrate the latest changes
+            const std::vector<KeyFrame*> vpKFs = mpMap->GetSubmapKeyFrames(mpMap->GetCurrentSubmapId());
+            mTsdf.RemoveMissing(vpKFs);
+            for(size_t i=0; i<vpKFs.size() && !CheckStopRequested(); i++)
+                mTsdf.Update(vpKFs[i]);
+        }
+
+        {
+            std::unique_lock<std::mutex> lock(mMutexJobs);
+            mbExporting = false;
+        }
+
+        // Paused while the map is reset
+        if(Stop())
+        {
+            std::unique_lock<std::mutex> lock(mMutexStop);
+            while(mbStopped)
+                mcvStop.wait(lock);
+        }
+
+        {
+            std::unique_lock<std::mutex> lock(mMutexJobs);
+            if(!mdJobs.empty())
+                continue;
+        }
+
+        if(CheckFinish())
+            break;
+    }
+
+    SetFinish();
+}
+
+bool DenseExporter::RequestExport(const std::string &filename, const float resolution)
+{
+    const std::string ext = boost::filesystem::path(filename).extension().string();
+    Job job;
+    job.mFilename = filename;
+    job.mResolution = resolution>0 ? resolution : mDefaultResolution;
+    if(ext==".ot")
+        job.mFormat = OCTOMAP_FULL;
+    else if(ext==".bt")
+        job.mFormat = OCTOMAP_BINARY;
+    else if(ext==".pcd")
+        job.mFormat = PCD;
+    else if(ext==".ply")
+        job.mFormat = PLY;
+    else
+    {
+        std::cerr << "Dense map export: unknown format " << ext << " (use .ot, .bt, .pcd or .ply)" << std::endl;
+        return false;
+    }
+    return QueueJob(job);
+}
+
+bool DenseExporter::RequestMeshExport(const std::string &filename)
+{
+    Job job;
+    job.mFilename = filename;
+    job.mResolution = mTsdf.GetVoxelSize();
+    job.mFormat = MESH_PLY;
+    return QueueJob(job);
+}
+
+bool DenseExporter::QueueJob(const Job &job)
+{
+    if(isFinished() && CheckFinish())
+    {
+        std::cerr << "Dense map export: the exporter has finished, export before Shutdown()" << std::endl;
+        return false;
+    }
+
+    {
+        std::unique_lock<std::mutex> lock(mMutexJobs);
+        mdJobs.push_back(job);
+    }
+    mcvJobs.notify_one();
+    return true;
+}
+
+float DenseExporter::GetProgress()
+{
+    std::unique_lock<std::mutex> lock(mMutexJobs);
+    if(!mbExporting)
+        return mdJobs.empty() ? -1.0f : 0.0f;
+    if(mnKeyFramesTotal==0)
+        return 0.0f;
+    return (float) mnKeyFramesDone/mnKeyFramesTotal;
+}
+
+bool DenseExporter::Export(const std::vector<Job> &vJobs)
+{
+    typedef pcl::PointCloud<pcl::PointXYZ> PointCloud;
+
+    std::chrono::steady_clock::time_point t0 = std::chrono::steady_clock::now();
+
+    std::vector<std::unique_ptr<octomap::OcTree> > vpTrees(vJobs.size());
+    std::vector<PointCloud::Ptr> vpClouds(vJobs.size());
+    bool bMesh = false, bPoints = false;
+    for(size_t j=0; j<vJobs.size(); j++)
+    {
+        if(vJobs[j].mFormat==MESH_PLY)
+        {
+            bMesh = true;
+            continue;
+        }
+        if(vJobs[j].mFormat==OCTOMAP_FULL || vJobs[j].mFormat==OCTOMAP_BINARY)
+            vpTrees[j].reset(new octomap::OcTree(vJobs[j].mResolution));
+        else
+            vpClouds[j].reset(new PointCloud());
+        bPoints = true;
+    }
+
+    const std::vector<KeyFrame*> vpKFs = mpMap->GetSubmapKeyFrames(mpMap->GetCurrentSubmapId());
+    {
+        std::unique_lock<std::mutex> lock(mMutexJobs);
+        mnKeyFramesTotal = vpKFs.size();
+    }
+
+    if(bMesh)
+        mTsdf.RemoveMissing(vpKFs);
+
+    octomap::Pointcloud scan;
+    PointCloud::Ptr pKFCloud(new PointCloud());
+    PointCloud filtered;
+    pcl::VoxelGrid<pcl::PointXYZ> voxelFilter;
+
+    for(size_t i=0; i<vpKFs.size(); i++)
+    {
+        if(CheckStopRequested())
+            return false;
+
+        KeyFrame* pKF = vpKFs[i];
+        if(bMesh)
+            mTsdf.Update(pKF);
+
+        const cv::Mat &depth = pKF->mImDepth;
+        if(bPoints && !pKF->isBad() && !depth.empty())
+        {
+            const cv::Mat Twc = pKF->GetPoseInverse();
+            const float r00 = Twc.at<float>(0,0), r01 = Twc.at<float>(0,1), r02 = Twc.at<float>(0,2), tx = Twc.at<float>(0,3);
+            const float r10 = Twc.at<float>(1,0), r11 = Twc.at<float>(1,1), r12 = Twc.at<float>(1,2), ty = Twc.at<float>(1,3);
+            const float r20 = Twc.at<float>(2,0), r21 = Twc.at<float>(2,1), r22 = Twc.at<float>(2,2), tz = Twc.at<float>(2,3);
+
+            scan.clear();
+            pKFCloud->clear();
+            for(int v=0; v<depth.rows; v+=mnPixelStep)
+            {
+                const float* d = depth.ptr<float>(v);
+                const float yn = (v-pKF->cy)*pKF->invfy;
+                for(int u=0; u<depth.cols; u+=mnPixelStep)
+                {
+                    const float z = d[u];
+                    if(!(z>=mMinDepth && z<=mMaxDepth))
+                        continue;
+                    const float x = (u-pKF->cx)*pKF->invfx*z;
+                    const float y = yn*z;
+                    const float xw = r00*x+r01*y+r02*z+tx;
+                    const float yw = r10*x+r11*y+r12*z+ty;
+                    const float zw = r20*x+r21*y+r22*z+tz;
+                    scan.push_back(xw,yw,zw);
+                    pKFCloud->push_back(pcl::PointXYZ(xw,yw,zw));
+                }
+            }
+
+            const octomap::point3d origin(tx,ty,tz);
+            for(size_t j=0; j<vJobs.size(); j++)
+            {
+                if(vJobs[j].mFormat==MESH_PLY)
+                    continue;
+                if(vpTrees[j])
+                {
+                    // One ray cast per voxel of the scan, occupancy of inner nodes is updated at the end
+                    vpTrees[j]->insertPointCloud(scan, origin, -1.0, true, true);
+                }
+                else
+                {
+                    voxelFilter.setLeafSize(vJobs[j].mResolution, vJobs[j].mResolution, vJobs[j].mResolution);
+                    voxelFilter.setInputCloud(pKFCloud);
+                    voxelFilter.filter(filtered);
+                    *vpClouds[j] += filtered;
+                }
+            }
+        }
+
+        std::unique_lock<std::mutex> lock(mMutexJobs);
+        mnKeyFramesDone = i+1;
+    }
+
+    TsdfVolume::Mesh mesh;
+    if(bMesh)
+        mTsdf.ExtractMesh(mesh);
+
+    for(size_t j=0; j<vJobs.size(); j++)
+    {
+        const Job &job = vJobs[j];
+        const boost::filesystem::path parent = boost::filesystem::path(job.mFilename).parent_path();
+        if(!parent.empty())
+            boost::filesystem::create_directories(parent);
+
+        bool bOk = false;
+        size_t nSize = 0;
+        if(job.mFormat==MESH_PLY)
+        {
+            bOk = TsdfVolume::SaveMesh(mesh, job.mFilename);
+            nSize = mesh.mvTriangles.size();
+        }
+        else if(vpTrees[j])
+        {
+            vpTrees[j]->updateInnerOccupancy();
+            bOk = job.mFormat==OCTOMAP_FULL ? vpTrees[j]->write(job.mFilename) : vpTrees[j]->writeBinary(job.mFilename);
+            nSize = vpTrees[j]->size();
+        }
+        else
+        {
+            // Keyframes overlap, merge the points that fell in the same voxel
+            voxelFilter.setLeafSize(job.mResolution, job.mResolution, job.mResolution);
+            voxelFilter.setInputCloud(vpClouds[j]);
+            voxelFilter.filter(filtered);
+            if(!filtered.empty())
+            {
+                if(job.mFormat==PCD)
+                    bOk = pcl::io::savePCDFileBinary(job.mFilename, filtered)==0;
+                else
+                    bOk = pcl::io::savePLYFileBinary(job.mFilename, filtered)==0;
+            }
+            nSize = filtered.size();
+        }
+
+        if(bOk)
+            std::cout << "Dense map saved to " << job.mFilename << " (" << nSize << (job.mFormat==MESH_PLY ? " triangles" : vpTrees[j] ? " nodes" : " points")
+                      << ", resolution " << job.mResolution << " m)" << std::endl;
+        else
+            std::cerr << "Dense map export: failed to write " << job.mFilename << std::endl;
+    }
+
+    const double t = std::chrono::duration_cast<std::chrono::duration<double> >(std::chrono::steady_clock::now()-t0).count();
+    std::cout << "Dense map export of " << vpKFs.size() << " keyframes took " << t << " s" << std::endl;
+    return true;
+}
+
+void DenseExporter::RequestFinish()
+{
+    {
+        std::unique_lock<std::mutex> lock(mMutexFinish);
+        mbFinishRequested = true;
+    }
+    // Take the jobs mutex so that the worker cannot miss the notification
+    {
+        std::unique_lock<std::mutex> lock(mMutexJobs);
+    }
+    mcvJobs.notify_one();
+}
+
+bool DenseExporter::CheckFinish()
+{
+    std::unique_lock<std::mutex> lock(mMutexFinish);
+    return mbFinishRequested;
+}
+
+void DenseExporter::SetFinish()
+{
+    std::unique_lock<std::mutex> lock(mMutexFinish);
+    mbFinished = true;
+}
+
+bool DenseExporter::isFinished()
+{
+    std::unique_lock<std::mutex> lock(mMutexFinish);
+    return mbFinished;
+}
+
+void DenseExporter::RequestStop()
+{
+    {
+        std::unique_lock<std::mutex> lock(mMutexStop);
+        if(!mbStopped)
+            mbStopRequested = true;
+    }
+    // Take the jobs mutex so that the worker cannot miss the notification
+    {
+        std::unique_lock<std::mutex> lock(mMutexJobs);
+    }
+    mcvJobs.notify_one();
+}
+
+bool DenseExporter::isStopped()
+{
+    // A worker that is not running does not read the keyframes either
+    if(isFinished())
+        return true;
+    std::unique_lock<std::mutex> lock(mMutexStop);
+    return mbStopped;
+}
+
+bool DenseExporter::Stop()
+{
+    std::unique_lock<std::mutex> lock(mMutexStop);
+    if(mbStopRequested)
+    {
+        mbStopped = true;
+        mbStopRequested = false;
+        return true;
+    }
+    return false;
+}
+
+bool DenseExporter::CheckStopRequested()
+{
+    std::unique_lock<std::mutex> lock(mMutexStop);
+    return mbStopRequested;
+}
+
+void DenseExporter::Release()
+{
+    {
+        std::unique_lock<std::mutex> lock(mMutexStop);
+        mbStopRequested = false;
+        mbStopped = false;
+    }
+    mcvStop.notify_all();
+}
+
+}// namespace ORB_SLAM
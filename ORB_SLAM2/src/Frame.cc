@@ -21,6 +21,7 @@
 #include "Frame.h"
 #include "Converter.h"
 #include "ORBmatcher.h"
+#include "ThreadPool.h"
 #include <thread>
 
 namespace ORB_SLAM2
@@ -28,11 +29,14 @@ namespace ORB_SLAM2
 
 long unsigned int Frame::nNextId=0;
 bool Frame::mbInitialComputations=true;
+cv::Mat Frame::mUndistortLUT;
+cv::Mat Frame::mUndistortK;
+cv::Mat Frame::mUndistortDistCoef;
 float Frame::cx, Frame::cy, Frame::fx, Frame::fy, Frame::invfx, Frame::invfy;
 float Frame::mnMinX, Frame::mnMinY, Frame::mnMaxX, Frame::mnMaxY;
 float Frame::mfGridElementWidthInv, Frame::mfGridElementHeightInv;
 
-Frame::Frame()
+Frame::Frame():mnColorConversion(-1)
 {}
 
 //Copy Constructor
@@ -43,7 +47,7 @@ Frame::Frame(const Frame &frame)
      mvKeysRight(frame.mvKeysRight), mvKeysUn(frame.mvKeysUn),  mvuRight(frame.mvuRight),
      mvDepth(frame.mvDepth), mBowVec(frame.mBowVec), mFeatVec(frame.mFeatVec),
      mDescriptors(frame.mDescriptors.clone()), mDescriptorsRight(frame.mDescriptorsRight.clone()),
-     mvpMapPoints(frame.mvpMapPoints), mvbOutlier(frame.mvbOutlier), mnId(frame.mnId),
+     mnColorConversion(-1), mvpMapPoints(frame.mvpMapPoints), mvbOutlier(frame.mvbOutlier), mnId(frame.mnId),
      mpReferenceKF(frame.mpReferenceKF), mnScaleLevels(frame.mnScaleLevels),
      mfScaleFactor(frame.mfScaleFactor), mfLogScaleFactor(frame.mfLogScaleFactor),
      mvScaleFactors(frame.mvScaleFactors), mvInvScaleFactors(frame.mvInvScaleFactors),
@@ -60,7 +64,7 @@ Frame::Frame(const Frame &frame)
 
 Frame::Frame(const cv::Mat &imLeft, const cv::Mat &imRight, const double &timeStamp, ORBextractor* extractorLeft, ORBextractor* extractorRight, ORBVocabulary* voc, cv::Mat &K, cv::Mat &distCoef, const float &bf, const float &thDepth)
     :mpORBvocabulary(voc),mpORBextractorLeft(extractorLeft),mpORBextractorRight(extractorRight), mTimeStamp(timeStamp), mK(K.clone()),mDistCoef(distCoef.clone()), mbf(bf), mThDepth(thDepth),
-     mpReferenceKF(static_cast<KeyFrame*>(NULL))
+     mnColorConversion(-1), mpReferenceKF(static_cast<KeyFrame*>(NULL))
 {
     // Frame ID
     mnId=nNextId++;
@@ -75,8 +79,8 @@ Frame::Frame(const cv::Mat &imLeft, const cv::Mat &imRight, const double &timeSt
     mvInvLevelSigma2 = mpORBextractorLeft->GetInverseScaleSigmaSquares();
 
     // ORB extraction
-    thread threadLeft(&Frame::ExtractORB,this,0,imLeft);
-    thread threadRight(&Frame::ExtractORB,this,1,imRight);
+    thread threadLeft(&Frame::ExtractORB,this,0,imLeft,cv::Mat());
+    thread threadRight(&Frame::ExtractORB,this,1,imRight,cv::Mat());
     threadLeft.join();
     threadRight.join();
 
@@ -85,7 +89,7 @@ Frame::Frame(const cv::Mat &imLeft, const cv::Mat &imRight, const double &timeSt
     if(mvKeys.empty())
         return;
 
-    UndistortKeyPoints();
+    UndistortKeyPoints(imLeft.size());
 
     ComputeStereoMatches();
 
@@ -116,10 +120,10 @@ Frame::Frame(const cv::Mat &imLeft, const cv::Mat &imRight, const double &timeSt
     AssignFeaturesToGrid();
 }
 
-Frame::Frame(const cv::Mat &imGray, const cv::Mat &imColor, const cv::Mat &imDepth, const double &timeStamp, ORBextractor* extractor,ORBVocabulary* voc, cv::Mat &K, cv::Mat &distCoef, const float &bf, const float &thDepth)
+Frame::Frame(const cv::Mat &imGray, const cv::Mat &imColor, const cv::Mat &imDepth, const double &timeStamp, ORBextractor* extractor,ORBVocabulary* voc, cv::Mat &K, cv::Mat &distCoef, const float &bf, const float &thDepth, const cv::Mat &mask)
     :mpORBvocabulary(voc),mpORBextractorLeft(extractor),mpORBextractorRight(static_cast<ORBextractor*>(NULL)),
      mTimeStamp(timeStamp), mK(K.clone()),mDistCoef(distCoef.clone()), mbf(bf), mThDepth(thDepth),
-     mImColor(imColor), mImDepth(imDepth)
+     mImColor(imColor), mImDepth(imDepth), mnColorConversion(-1)
 {
     // Frame ID
     mnId=nNextId++;
@@ -134,14 +138,14 @@ Frame::Frame(const cv::Mat &imGray, const cv::Mat &imColor, const cv::Mat &imDep
     mvInvLevelSigma2 = mpORBextractorLeft->GetInverseScaleSigmaSquares();
 
     // ORB extraction
-    ExtractORB(0,imGray);
+    ExtractORB(0,imGray,mask);
 
     N = mvKeys.size();
 
     if(mvKeys.empty())
         return;
 
-    UndistortKeyPoints();
+    UndistortKeyPoints(imGray.size());
 
     ComputeStereoFromRGBD(imDepth);
 
@@ -174,7 +178,8 @@ Frame::Frame(const cv::Mat &imGray, const cv::Mat &imColor, const cv::Mat &imDep
 
 Frame::Frame(const cv::Mat &imGray, const double &timeStamp, ORBextractor* extractor,ORBVocabulary* voc, cv::Mat &K, cv::Mat &distCoef, const float &bf, const float &thDepth)
     :mpORBvocabulary(voc),mpORBextractorLeft(extractor),mpORBextractorRight(static_cast<ORBextractor*>(NULL)),
-     mTimeStamp(timeStamp), mK(K.clone()),mDistCoef(distCoef.clone()), mbf(bf), mThDepth(thDepth)
+     mTimeStamp(timeStamp), mK(K.clone()),mDistCoef(distCoef.clone()), mbf(bf), mThDepth(thDepth),
+     mnColorConversion(-1)
 {
     // Frame ID
     mnId=nNextId++;
@@ -189,14 +194,14 @@ Frame::Frame(const cv::Mat &imGray, const double &timeStamp, ORBextractor* extra
     mvInvLevelSigma2 = mpORBextractorLeft->GetInverseScaleSigmaSquares();
 
     // ORB extraction
-    ExtractORB(0,imGray);
+    ExtractORB(0,imGray,cv::Mat());
 
     N = mvKeys.size();
 
     if(mvKeys.empty())
         return;
 
-    UndistortKeyPoints();
+    UndistortKeyPoints(imGray.size());
 
     // Set no stereo information
     mvuRight = vector<float>(N,-1);
@@ -245,12 +250,12 @@ void Frame::AssignFeaturesToGrid()
     }
 }
 
-void Frame::ExtractORB(int flag, const cv::Mat &im)
+void Frame::ExtractORB(int flag, const cv::Mat &im, const cv::Mat &mask)
 {
     if(flag==0)
-        (*mpORBextractorLeft)(im,cv::Mat(),mvKeys,mDescriptors);
+        (*mpORBextractorLeft)(im,mask,mvKeys,mDescriptors);
     else
-        (*mpORBextractorRight)(im,cv::Mat(),mvKeysRight,mDescriptorsRight);
+        (*mpORBextractorRight)(im,mask,mvKeysRight,mDescriptorsRight);
 }
 
 void Frame::SetPose(cv::Mat Tcw)
@@ -402,7 +407,13 @@ void Frame::ComputeBoW()
     }
 }
 
-void Frame::UndistortKeyPoints()
+// Same size, type and values
+static bool SameMat(const cv::Mat &a, const cv::Mat &b)
+{
+    return a.size()==b.size() && a.type()==b.type() && (a.empty() || cv::norm(a,b,cv::NORM_INF)==0);
+}
+
+void Frame::UndistortKeyPoints(const cv::Size &imSize)
 {
     if(mDistCoef.at<float>(0)==0.0)
     {
@@ -410,30 +421,51 @@ void Frame::UndistortKeyPoints()
         return;
     }
 
-    // Fill matrix with points
-    cv::Mat mat(N,2,CV_32F);
-    for(int i=0; i<N; i++)
-    {
-        mat.at<float>(i,0)=mvKeys[i].pt.x;
-        mat.at<float>(i,1)=mvKeys[i].pt.y;
-    }
+    if(mUndistortLUT.size()!=imSize || !SameMat(mUndistortK,mK) || !SameMat(mUndistortDistCoef,mDistCoef))
+        ComputeUndistortLUT(imSize);
 
-    // Undistort points
-    mat=mat.reshape(2);
-    cv::undistortPoints(mat,mat,mK,mDistCoef,cv::Mat(),mK);
-    mat=mat.reshape(1);
+    const int maxX = mUndistortLUT.cols-2;
+    const int maxY = mUndistortLUT.rows-2;
 
     // Fill undistorted keypoint vector
     mvKeysUn.resize(N);
     for(int i=0; i<N; i++)
     {
         cv::KeyPoint kp = mvKeys[i];
-        kp.pt.x=mat.at<float>(i,0);
-        kp.pt.y=mat.at<float>(i,1);
+        const int x0 = min(max((int)kp.pt.x,0),maxX);
+        const int y0 = min(max((int)kp.pt.y,0),maxY);
+        const float ax = kp.pt.x-x0;
+        const float ay = kp.pt.y-y0;
+        const cv::Vec2f* p0 = mUndistortLUT.ptr<cv::Vec2f>(y0)+x0;
+        const cv::Vec2f* p1 = mUndistortLUT.ptr<cv::Vec2f>(y0+1)+x0;
+        const cv::Vec2f p = (1.f-ay)*((1.f-ax)*p0[0]+ax*p0[1]) + ay*((1.f-ax)*p1[0]+ax*p1[1]);
+        kp.pt.x=p[0];
+        kp.pt.y=p[1];
         mvKeysUn[i]=kp;
     }
 }
 
+void Frame::ComputeUndistortLUT(const cv::Size &imSize)
+{
+    mUndistortLUT.create(imSize,CV_32FC2);
+
+    // Rows are undistorted by cv::undistortPoints, in chunks of rows
+    ThreadPool::Instance().ParallelChunks(imSize.height, 16, [this,&imSize](const int vBegin, const int vEnd)
+    {
+        cv::Mat row(1,imSize.width,CV_32FC2);
+        for(int v=vBegin; v<vEnd; v++)
+        {
+            for(int u=0; u<imSize.width; u++)
+                row.at<cv::Vec2f>(0,u) = cv::Vec2f(u,v);
+            cv::Mat rowUn = mUndistortLUT.row(v);
+            cv::undistortPoints(row,rowUn,mK,mDistCoef,cv::Mat(),mK);
+        }
+    });
+
+    mUndistortK = mK.clone();
+    mUndistortDistCoef = mDistCoef.clone();
+}
+
 void Frame::ComputeImageBounds(const cv::Mat &imLeft)
 {
     if(mDistCoef.at<float>(0)!=0.0)
@@ -0,0 +1,130 @@
+/**
+* This file is part of ORB-SLAM2.
+*
+* Copyright (C) 2014-2016 Raúl Mur-Artal <raulmur at unizar dot es> (University of Zaragoza)
+* For more information see <https://github.com/raulmur/ORB_SLAM2>
+*
+* ORB-SLAM2 is free software: you can redistribute it and/or modify
+* it under the terms of the GNU General Public License as published by
+* the Free Software Foundation, either version 3 of the License, or
+* (at your option) any later version.
+*
+* ORB-SLAM2 is distributed in the hope that it will be useful,
+* but WITHOUT ANY WARRANTY; without even the implied warranty of
+* MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+* GNU General Public License for more details.
+*
+* You should have received a copy of the GNU General Public License
+* along with ORB-SLAM2. If not, see <http://www.gnu.org/licenses/>.
+*/
+
+
+#include "ImageBuffer.h"
+
+#include <opencv2/imgproc/imgproc.hpp>
+
+namespace ORB_SLAM2
+{
+
+int ImageBuffer::PixelType(const PixelFormat format)
+{
+    switch(format)
+    {
+    case RGB8:
+    case BGR8:
+        return CV_8UC3;
+    case RGBA8:
+    case BGRA8:
+        return CV_8UC4;
+    case YUYV:
+    case UYVY:
+        return CV_8UC2;
+    case DEPTH16:
+        return CV_16UC1;
+    case DEPTH32F:
+        return CV_32FC1;
+    default:
+        return CV_8UC1;
+    }
+}
+
+ImageBuffer::ImageBuffer():mFormat(GRAY8)
+{}
+
+ImageBuffer::ImageBuffer(const void* data, const int width, const int height, const size_t stride,
+                         const PixelFormat format):
+    mData(height, width, PixelType(format), const_cast<void*>(data), stride), mFormat(format)
+{}
+
+ImageBuffer::ImageBuffer(const cv::Mat &im, const PixelFormat format):mData(im), mFormat(format)
+{}
+
+int ImageBuffer::GrayConversion() const
+{
+    // OpenCV names the Bayer patterns after the second row
+    switch(mFormat)
+    {
+    case RGB8:
+        return CV_RGB2GRAY;
+    case BGR8:
+        return CV_BGR2GRAY;
+    case RGBA8:
+        return CV_RGBA2GRAY;
+    case BGRA8:
+        return CV_BGRA2GRAY;
+    case YUYV:
+        return CV_YUV2GRAY_YUYV;
+    case UYVY:
+        return CV_YUV2GRAY_UYVY;
+    case BAYER_RGGB8:
+        return CV_BayerBG2GRAY;
+    case BAYER_BGGR8:
+        return CV_BayerRG2GRAY;
+    case BAYER_GBRG8:
+        return CV_BayerGR2GRAY;
+    case BAYER_GRBG8:
+        return CV_BayerGB2GRAY;
+    default:
+        return -1;
+    }
+}
+
+int ImageBuffer::ColorConversion(const bool bRGB) const
+{
+    switch(mFormat)
+    {
+    case RGB8:
+        return bRGB ? -1 : CV_RGB2BGR;
+    case BGR8:
+        return bRGB ? CV_BGR2RGB : -1;
+    case RGBA8:
+        return bRGB ? -1 : CV_RGBA2BGRA;
+    case BGRA8:
+        return bRGB ? CV_BGRA2RGBA : -1;
+    case YUYV:
+        return bRGB ? CV_YUV2RGB_YUYV : CV_YUV2BGR_YUYV;
+    case UYVY:
+        return bRGB ? CV_YUV2RGB_UYVY : CV_YUV2BGR_UYVY;
+    case BAYER_RGGB8:
+        return bRGB ? CV_BayerBG2RGB : CV_BayerBG2BGR;
+    case BAYER_BGGR8:
+        return bRGB ? CV_BayerRG2RGB : CV_BayerRG2BGR;
+    case BAYER_GBRG8:
+        return bRGB ? CV_BayerGR2RGB : CV_BayerGR2BGR;
+    case BAYER_GRBG8:
+        return bRGB ? CV_BayerGB2RGB : CV_BayerGB2BGR;
+    default:
+        return -1;
+    }
+}
+
+void ImageBuffer::ToGray(cv::Mat &gray) const
+{
+    const int code = GrayConversion();
+    if(code<0)
+        mData.copyTo(gray);
+    else
+        cv::cvtColor(mData, gray, code);
+}
+
+} //namespace ORB_SLAM
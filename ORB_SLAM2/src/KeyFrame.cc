@@ -22,17 +22,31 @@
 #include "Converter.h"
 #include "ORBmatcher.h"
 #include<mutex>
+#include<opencv2/imgproc/imgproc.hpp>
 
 namespace ORB_SLAM2
 {
 
 long unsigned int KeyFrame::nNextId=0;
 
+// The color image of a frame belongs to the caller, keyframes keep their own
+static cv::Mat CopyColor(const Frame &F)
+{
+    cv::Mat im;
+    if(F.mImColor.empty())
+        return im;
+    if(F.mnColorConversion<0)
+        im = F.mImColor.clone();
+    else
+        cv::cvtColor(F.mImColor, im, F.mnColorConversion);
+    return im;
+}
+
 KeyFrame::KeyFrame(Frame &F, Map *pMap, KeyFrameDatabase *pKFDB):
     mnFrameId(F.mnId),  mTimeStamp(F.mTimeStamp), mnGridCols(FRAME_GRID_COLS), mnGridRows(FRAME_GRID_ROWS),
     mfGridElementWidthInv(F.mfGridElementWidthInv), mfGridElementHeightInv(F.mfGridElementHeightInv),
     mnTrackReferenceForFrame(0), mnFuseTargetForKF(0), mnBALocalForKF(0), mnBAFixedForKF(0),
-    mnLoopQuery(0), mnLoopWords(0), mnRelocQuery(0), mnRelocWords(0), mnBAGlobalForKF(0),
+    mnBAGlobalForKF(0),
     fx(F.fx), fy(F.fy), cx(F.cx), cy(F.cy), invfx(F.invfx), invfy(F.invfy),
     mbf(F.mbf), mb(F.mb), mThDepth(F.mThDepth), N(F.N), mvKeys(F.mvKeys), mvKeysUn(F.mvKeysUn),
     mvuRight(F.mvuRight), mvDepth(F.mvDepth), mDescriptors(F.mDescriptors.clone()),
@@ -41,9 +55,12 @@ KeyFrame::KeyFrame(Frame &F, Map *pMap, KeyFrameDatabase *pKFDB):
     mvInvLevelSigma2(F.mvInvLevelSigma2), mnMinX(F.mnMinX), mnMinY(F.mnMinY), mnMaxX(F.mnMaxX),
     mnMaxY(F.mnMaxY), mK(F.mK), mvpMapPoints(F.mvpMapPoints), mpKeyFrameDB(pKFDB),
     mpORBvocabulary(F.mpORBvocabulary), mbFirstConnection(true), mpParent(NULL), mbNotErase(false),
-    mbToBeErased(false), mbBad(false), mHalfBaseline(F.mb/2), mpMap(pMap),mImDepth(F.mImDepth)
+    mbToBeErased(false), mbBad(false), mHalfBaseline(F.mb/2), mpMap(pMap),mImDepth(F.mImDepth),
+    mImColor(CopyColor(F))
 {
     mnId=nNextId++;
+    mnSubmapId=pMap->GetCurrentSubmapId();
+    mbOrigin=false;
 
     mGrid.resize(mnGridCols);
     for(int i=0; i<mnGridCols;i++)
@@ -69,6 +86,7 @@ void KeyFrame::ComputeBoW()
 
 void KeyFrame::SetPose(const cv::Mat &Tcw_)
 {
+    {
     unique_lock<mutex> lock(mMutexPose);
     Tcw_.copyTo(Tcw);
     cv::Mat Rcw = Tcw.rowRange(0,3).colRange(0,3);
@@ -81,6 +99,8 @@ void KeyFrame::SetPose(const cv::Mat &Tcw_)
     Ow.copyTo(Twc.rowRange(0,3).col(3));
     cv::Mat center = (cv::Mat_<float>(4,1) << mHalfBaseline, 0 , 0, 1);
     Cw = Twc*center;
+    }
+    mpMap->InformKeyFrameChanged(this);
 }
 
 cv::Mat KeyFrame::GetPose()
@@ -207,6 +227,50 @@ int KeyFrame::GetWeight(KeyFrame *pKF)
         return 0;
 }
 
+void KeyFrame::CountCovisibility(const vector<MapPoint*> &vpMPs, vector<pair<KeyFrame*,int> > &vKFCounts, KeyFrame* pSkip)
+{
+    // Slot of each keyframe in vKFCounts (+1), indexed by keyframe id. Entries are reset
+    // before returning so the buffer can be reused without clearing it whole.
+    static thread_local vector<int> vSlot;
+
+    vKFCounts.clear();
+
+    for(vector<MapPoint*>::const_iterator vit=vpMPs.begin(), vend=vpMPs.end(); vit!=vend; vit++)
+    {
+        MapPoint* pMP = *vit;
+
+        if(!pMP)
+            continue;
+
+        if(pMP->isBad())
+            continue;
+
+        const MapPoint::ObsVector observations = pMP->GetObservations();
+
+        for(MapPoint::ObsVector::const_iterator mit=observations.begin(), mend=observations.end(); mit!=mend; mit++)
+        {
+            KeyFrame* pKFi = mit->first;
+            if(pKFi==pSkip)
+                continue;
+
+            const size_t id = pKFi->mnId;
+            if(id>=vSlot.size())
+                vSlot.resize(max<size_t>(id+1,2*vSlot.size()),0);
+
+            int &slot = vSlot[id];
+            if(slot==0)
+            {
+                vKFCounts.push_back(make_pair(pKFi,0));
+                slot = vKFCounts.size();
+            }
+            vKFCounts[slot-1].second++;
+        }
+    }
+
+    for(size_t i=0, iend=vKFCounts.size(); i<iend; i++)
+        vSlot[vKFCounts[i].first->mnId] = 0;
+}
+
 void KeyFrame::AddMapPoint(MapPoint *pMP, const size_t &idx)
 {
     unique_lock<mutex> lock(mMutexFeatures);
@@ -288,7 +352,7 @@ MapPoint* KeyFrame::GetMapPoint(const size_t &idx)
 
 void KeyFrame::UpdateConnections()
 {
-    map<KeyFrame*,int> KFcounter;
+    vector<pair<KeyFrame*,int> > KFcounter;
 
     vector<MapPoint*> vpMP;
 
@@ -299,25 +363,7 @@ void KeyFrame::UpdateConnections()
 
     //For all map points in keyframe check in which other keyframes are they seen
     //Increase counter for those keyframes
-    for(vector<MapPoint*>::iterator vit=vpMP.begin(), vend=vpMP.end(); vit!=vend; vit++)
-    {
-        MapPoint* pMP = *vit;
-
-        if(!pMP)
-            continue;
-
-        if(pMP->isBad())
-            continue;
-
-        map<KeyFrame*,size_t> observations = pMP->GetObservations();
-
-        for(map<KeyFrame*,size_t>::iterator mit=observations.begin(), mend=observations.end(); mit!=mend; mit++)
-        {
-            if(mit->first->mnId==mnId)
-                continue;
-            KFcounter[mit->first]++;
-        }
-    }
+    CountCovisibility(vpMP,KFcounter,this);
 
     // This should not happen
     if(KFcounter.empty())
@@ -331,7 +377,7 @@ void KeyFrame::UpdateConnections()
 
     vector<pair<int,KeyFrame*> > vPairs;
     vPairs.reserve(KFcounter.size());
-    for(map<KeyFrame*,int>::iterator mit=KFcounter.begin(), mend=KFcounter.end(); mit!=mend; mit++)
+    for(vector<pair<KeyFrame*,int> >::iterator mit=KFcounter.begin(), mend=KFcounter.end(); mit!=mend; mit++)
     {
         if(mit->second>nmax)
         {
@@ -364,11 +410,11 @@ void KeyFrame::UpdateConnections()
         unique_lock<mutex> lockCon(mMutexConnections);
 
         // mspConnectedKeyFrames = spConnectedKeyFrames;
-        mConnectedKeyFrameWeights = KFcounter;
+        mConnectedKeyFrameWeights = map<KeyFrame*,int>(KFcounter.begin(),KFcounter.end());
         mvpOrderedConnectedKeyFrames = vector<KeyFrame*>(lKFs.begin(),lKFs.end());
         mvOrderedWeights = vector<int>(lWs.begin(), lWs.end());
 
-        if(mbFirstConnection && mnId!=0)
+        if(mbFirstConnection && !mbOrigin)
         {
             mpParent = mvpOrderedConnectedKeyFrames.front();
             mpParent->AddChild(this);
@@ -454,7 +500,7 @@ void KeyFrame::SetBadFlag()
 {   
     {
         unique_lock<mutex> lock(mMutexConnections);
-        if(mnId==0)
+        if(mbOrigin)
             return;
         else if(mbNotErase)
         {
@@ -534,8 +580,12 @@ void KeyFrame::SetBadFlag()
                 (*sit)->ChangeParent(mpParent);
             }
 
-        mpParent->EraseChild(this);
-        mTcp = Tcw*mpParent->GetPoseInverse();
+        // The origin of a discarded map has no parent
+        if(mpParent)
+        {
+            mpParent->EraseChild(this);
+            mTcp = Tcw*mpParent->GetPoseInverse();
+        }
         mbBad = true;
     }
 
@@ -31,8 +31,9 @@ namespace ORB_SLAM2
 {
 
 KeyFrameDatabase::KeyFrameDatabase (const ORBVocabulary &voc):
-    mpVoc(&voc)
+    mpVoc(&voc), mnPostings(0), mnTombstones(0)
 {
+    mbAccumulateScore = voc.getScoringType()==DBoW2::L1_NORM;
     mvInvertedFile.resize(voc.size());
 }
 
@@ -41,111 +42,176 @@ void KeyFrameDatabase::add(KeyFrame *pKF)
 {
     unique_lock<mutex> lock(mMutex);
 
+    if(pKF->mnId>=mvpKeyFrames.size())
+        mvpKeyFrames.resize(max<size_t>(pKF->mnId+1,2*mvpKeyFrames.size()),static_cast<KeyFrame*>(NULL));
+    mvpKeyFrames[pKF->mnId] = pKF;
+
     for(DBoW2::BowVector::const_iterator vit= pKF->mBowVec.begin(), vend=pKF->mBowVec.end(); vit!=vend; vit++)
-        mvInvertedFile[vit->first].push_back(pKF);
+    {
+        Posting posting;
+        posting.nKFId = pKF->mnId;
+        posting.weight = vit->second;
+        mvInvertedFile[vit->first].push_back(posting);
+    }
+    mnPostings += pKF->mBowVec.size();
 }
 
 void KeyFrameDatabase::erase(KeyFrame* pKF)
 {
     unique_lock<mutex> lock(mMutex);
 
-    // Erase elements in the Inverse File for the entry
-    for(DBoW2::BowVector::const_iterator vit=pKF->mBowVec.begin(), vend=pKF->mBowVec.end(); vit!=vend; vit++)
+    if(pKF->mnId>=mvpKeyFrames.size() || mvpKeyFrames[pKF->mnId]!=pKF)
+        return;
+
+    // Postings are left in place and skipped by the queries until enough accumulate
+    mvpKeyFrames[pKF->mnId] = static_cast<KeyFrame*>(NULL);
+    mnTombstones += pKF->mBowVec.size();
+
+    if(2*mnTombstones>mnPostings)
+        Compact();
+}
+
+void KeyFrameDatabase::Compact()
+{
+    for(size_t i=0, iend=mvInvertedFile.size(); i<iend; i++)
     {
-        // List of keyframes that share the word
-        list<KeyFrame*> &lKFs =   mvInvertedFile[vit->first];
+        vector<Posting> &vPostings = mvInvertedFile[i];
 
-        for(list<KeyFrame*>::iterator lit=lKFs.begin(), lend= lKFs.end(); lit!=lend; lit++)
+        size_t nAlive = 0;
+        for(size_t j=0, jend=vPostings.size(); j<jend; j++)
         {
-            if(pKF==*lit)
-            {
-                lKFs.erase(lit);
-                break;
-            }
+            if(mvpKeyFrames[vPostings[j].nKFId])
+                vPostings[nAlive++] = vPostings[j];
         }
+        vPostings.resize(nAlive);
     }
+
+    mnPostings -= mnTombstones;
+    mnTombstones = 0;
 }
 
 void KeyFrameDatabase::clear()
 {
+    unique_lock<mutex> lock(mMutex);
     mvInvertedFile.clear();
     mvInvertedFile.resize(mpVoc->size());
+    mvpKeyFrames.clear();
+    mnPostings = 0;
+    mnTombstones = 0;
+}
+
+void KeyFrameDatabase::SearchSharingWords(const DBoW2::BowVector &BowVec, QueryScratch &scratch, vector<KeyFrame*> &vpKFsSharingWords)
+{
+    unique_lock<mutex> lock(mMutex);
+
+    const size_t nIds = mvpKeyFrames.size();
+    if(scratch.vnWords.size()<nIds)
+    {
+        scratch.vnWords.resize(nIds,0);
+        scratch.vScore.resize(nIds,0.f);
+    }
+    if(scratch.vbExcluded.size()<nIds)
+        scratch.vbExcluded.resize(nIds,0);
+
+    for(DBoW2::BowVector::const_iterator vit=BowVec.begin(), vend=BowVec.end(); vit != vend; vit++)
+    {
+        const vector<Posting> &vPostings = mvInvertedFile[vit->first];
+        const float qWeight = vit->second;
+
+        for(vector<Posting>::const_iterator pit=vPostings.begin(), pend=vPostings.end(); pit!=pend; pit++)
+        {
+            const unsigned int id = pit->nKFId;
+            if(!mvpKeyFrames[id] || scratch.vbExcluded[id])
+                continue;
+
+            if(scratch.vnWords[id]==0)
+                scratch.vTouched.push_back(id);
+            scratch.vnWords[id]++;
+
+            // L1 score (see DBoW2::L1Scoring) summed word by word
+            if(mbAccumulateScore)
+                scratch.vScore[id] += 0.5f*(fabs(qWeight)+fabs(pit->weight)-fabs(qWeight-pit->weight));
+        }
+    }
+
+    vpKFsSharingWords.reserve(scratch.vTouched.size());
+    for(size_t i=0, iend=scratch.vTouched.size(); i<iend; i++)
+        vpKFsSharingWords.push_back(mvpKeyFrames[scratch.vTouched[i]]);
+}
+
+static void ResetScratch(vector<int> &vnWords, vector<float> &vScore, vector<unsigned int> &vTouched)
+{
+    for(size_t i=0, iend=vTouched.size(); i<iend; i++)
+    {
+        vnWords[vTouched[i]] = 0;
+        vScore[vTouched[i]] = 0.f;
+    }
+    vTouched.clear();
 }
 
 
 vector<KeyFrame*> KeyFrameDatabase::DetectLoopCandidates(KeyFrame* pKF, float minScore)
 {
+    // Scratch counters of the loop queries run by this thread
+    static thread_local QueryScratch scratch;
+
     set<KeyFrame*> spConnectedKeyFrames = pKF->GetConnectedKeyFrames();
-    list<KeyFrame*> lKFsSharingWords;
+    vector<KeyFrame*> vpKFsSharingWords;
 
     // Search all keyframes that share a word with current keyframes
     // Discard keyframes connected to the query keyframe
+    for(set<KeyFrame*>::iterator sit=spConnectedKeyFrames.begin(), send=spConnectedKeyFrames.end(); sit!=send; sit++)
     {
-        unique_lock<mutex> lock(mMutex);
+        const size_t id = (*sit)->mnId;
+        if(id>=scratch.vbExcluded.size())
+            scratch.vbExcluded.resize(id+1,0);
+        scratch.vbExcluded[id] = 1;
+    }
 
-        for(DBoW2::BowVector::const_iterator vit=pKF->mBowVec.begin(), vend=pKF->mBowVec.end(); vit != vend; vit++)
-        {
-            list<KeyFrame*> &lKFs =   mvInvertedFile[vit->first];
+    SearchSharingWords(pKF->mBowVec,scratch,vpKFsSharingWords);
 
-            for(list<KeyFrame*>::iterator lit=lKFs.begin(), lend= lKFs.end(); lit!=lend; lit++)
-            {
-                KeyFrame* pKFi=*lit;
-                if(pKFi->mnLoopQuery!=pKF->mnId)
-                {
-                    pKFi->mnLoopWords=0;
-                    if(!spConnectedKeyFrames.count(pKFi))
-                    {
-                        pKFi->mnLoopQuery=pKF->mnId;
-                        lKFsSharingWords.push_back(pKFi);
-                    }
-                }
-                pKFi->mnLoopWords++;
-            }
-        }
-    }
+    for(set<KeyFrame*>::iterator sit=spConnectedKeyFrames.begin(), send=spConnectedKeyFrames.end(); sit!=send; sit++)
+        scratch.vbExcluded[(*sit)->mnId] = 0;
+
+    vector<KeyFrame*> vpLoopCandidates;
 
-    if(lKFsSharingWords.empty())
-        return vector<KeyFrame*>();
+    if(vpKFsSharingWords.empty())
+        return vpLoopCandidates;
 
-    list<pair<float,KeyFrame*> > lScoreAndMatch;
+    vector<pair<float,KeyFrame*> > vScoreAndMatch;
 
     // Only compare against those keyframes that share enough words
     int maxCommonWords=0;
-    for(list<KeyFrame*>::iterator lit=lKFsSharingWords.begin(), lend= lKFsSharingWords.end(); lit!=lend; lit++)
+    for(vector<KeyFrame*>::iterator vit=vpKFsSharingWords.begin(), vend=vpKFsSharingWords.end(); vit!=vend; vit++)
     {
-        if((*lit)->mnLoopWords>maxCommonWords)
-            maxCommonWords=(*lit)->mnLoopWords;
+        if(scratch.vnWords[(*vit)->mnId]>maxCommonWords)
+            maxCommonWords=scratch.vnWords[(*vit)->mnId];
     }
 
     int minCommonWords = maxCommonWords*0.8f;
 
-    int nscores=0;
-
     // Compute similarity score. Retain the matches whose score is higher than minScore
-    for(list<KeyFrame*>::iterator lit=lKFsSharingWords.begin(), lend= lKFsSharingWords.end(); lit!=lend; lit++)
+    for(vector<KeyFrame*>::iterator vit=vpKFsSharingWords.begin(), vend=vpKFsSharingWords.end(); vit!=vend; vit++)
     {
-        KeyFrame* pKFi = *lit;
+        KeyFrame* pKFi = *vit;
 
-        if(pKFi->mnLoopWords>minCommonWords)
+        if(scratch.vnWords[pKFi->mnId]>minCommonWords)
         {
-            nscores++;
-
-            float si = mpVoc->score(pKF->mBowVec,pKFi->mBowVec);
+            if(!mbAccumulateScore)
+                scratch.vScore[pKFi->mnId] = mpVoc->score(pKF->mBowVec,pKFi->mBowVec);
 
-            pKFi->mLoopScore = si;
+            const float si = scratch.vScore[pKFi->mnId];
             if(si>=minScore)
-                lScoreAndMatch.push_back(make_pair(si,pKFi));
+                vScoreAndMatch.push_back(make_pair(si,pKFi));
         }
     }
 
-    if(lScoreAndMatch.empty())
-        return vector<KeyFrame*>();
-
-    list<pair<float,KeyFrame*> > lAccScoreAndMatch;
+    vector<pair<float,KeyFrame*> > vAccScoreAndMatch;
+    vAccScoreAndMatch.reserve(vScoreAndMatch.size());
     float bestAccScore = minScore;
 
     // Lets now accumulate score by covisibility
-    for(list<pair<float,KeyFrame*> >::iterator it=lScoreAndMatch.begin(), itend=lScoreAndMatch.end(); it!=itend; it++)
+    for(vector<pair<float,KeyFrame*> >::iterator it=vScoreAndMatch.begin(), itend=vScoreAndMatch.end(); it!=itend; it++)
     {
         KeyFrame* pKFi = it->second;
         vector<KeyFrame*> vpNeighs = pKFi->GetBestCovisibilityKeyFrames(10);
@@ -156,30 +222,34 @@ vector<KeyFrame*> KeyFrameDatabase::DetectLoopCandidates(KeyFrame* pKF, float mi
         for(vector<KeyFrame*>::iterator vit=vpNeighs.begin(), vend=vpNeighs.end(); vit!=vend; vit++)
         {
             KeyFrame* pKF2 = *vit;
-            if(pKF2->mnLoopQuery==pKF->mnId && pKF2->mnLoopWords>minCommonWords)
+            if(pKF2->mnId>=scratch.vnWords.size())
+                continue;
+            if(scratch.vnWords[pKF2->mnId]>minCommonWords)
             {
-                accScore+=pKF2->mLoopScore;
-                if(pKF2->mLoopScore>bestScore)
+                const float score2 = scratch.vScore[pKF2->mnId];
+                accScore+=score2;
+                if(score2>bestScore)
                 {
                     pBestKF=pKF2;
-                    bestScore = pKF2->mLoopScore;
+                    bestScore = score2;
                 }
             }
         }
 
-        lAccScoreAndMatch.push_back(make_pair(accScore,pBestKF));
+        vAccScoreAndMatch.push_back(make_pair(accScore,pBestKF));
         if(accScore>bestAccScore)
             bestAccScore=accScore;
     }
 
+    ResetScratch(scratch.vnWords,scratch.vScore,scratch.vTouched);
+
     // Return all those keyframes with a score higher than 0.75*bestScore
     float minScoreToRetain = 0.75f*bestAccScore;
 
     set<KeyFrame*> spAlreadyAddedKF;
-    vector<KeyFrame*> vpLoopCandidates;
-    vpLoopCandidates.reserve(lAccScoreAndMatch.size());
+    vpLoopCandidates.reserve(vAccScoreAndMatch.size());
 
-    for(list<pair<float,KeyFrame*> >::iterator it=lAccScoreAndMatch.begin(), itend=lAccScoreAndMatch.end(); it!=itend; it++)
+    for(vector<pair<float,KeyFrame*> >::iterator it=vAccScoreAndMatch.begin(), itend=vAccScoreAndMatch.end(); it!=itend; it++)
     {
         if(it->first>minScoreToRetain)
         {
@@ -198,68 +268,50 @@ vector<KeyFrame*> KeyFrameDatabase::DetectLoopCandidates(KeyFrame* pKF, float mi
 
 vector<KeyFrame*> KeyFrameDatabase::DetectRelocalizationCandidates(Frame *F)
 {
-    list<KeyFrame*> lKFsSharingWords;
+    // Scratch counters of the relocalization queries run by this thread
+    static thread_local QueryScratch scratch;
+
+    vector<KeyFrame*> vpKFsSharingWords;
 
     // Search all keyframes that share a word with current frame
-    {
-        unique_lock<mutex> lock(mMutex);
+    SearchSharingWords(F->mBowVec,scratch,vpKFsSharingWords);
 
-        for(DBoW2::BowVector::const_iterator vit=F->mBowVec.begin(), vend=F->mBowVec.end(); vit != vend; vit++)
-        {
-            list<KeyFrame*> &lKFs =   mvInvertedFile[vit->first];
+    vector<KeyFrame*> vpRelocCandidates;
 
-            for(list<KeyFrame*>::iterator lit=lKFs.begin(), lend= lKFs.end(); lit!=lend; lit++)
-            {
-                KeyFrame* pKFi=*lit;
-                if(pKFi->mnRelocQuery!=F->mnId)
-                {
-                    pKFi->mnRelocWords=0;
-                    pKFi->mnRelocQuery=F->mnId;
-                    lKFsSharingWords.push_back(pKFi);
-                }
-                pKFi->mnRelocWords++;
-            }
-        }
-    }
-    if(lKFsSharingWords.empty())
-        return vector<KeyFrame*>();
+    if(vpKFsSharingWords.empty())
+        return vpRelocCandidates;
 
     // Only compare against those keyframes that share enough words
     int maxCommonWords=0;
-    for(list<KeyFrame*>::iterator lit=lKFsSharingWords.begin(), lend= lKFsSharingWords.end(); lit!=lend; lit++)
+    for(vector<KeyFrame*>::iterator vit=vpKFsSharingWords.begin(), vend=vpKFsSharingWords.end(); vit!=vend; vit++)
     {
-        if((*lit)->mnRelocWords>maxCommonWords)
-            maxCommonWords=(*lit)->mnRelocWords;
+        if(scratch.vnWords[(*vit)->mnId]>maxCommonWords)
+            maxCommonWords=scratch.vnWords[(*vit)->mnId];
     }
 
     int minCommonWords = maxCommonWords*0.8f;
 
-    list<pair<float,KeyFrame*> > lScoreAndMatch;
-
-    int nscores=0;
+    vector<pair<float,KeyFrame*> > vScoreAndMatch;
 
     // Compute similarity score.
-    for(list<KeyFrame*>::iterator lit=lKFsSharingWords.begin(), lend= lKFsSharingWords.end(); lit!=lend; lit++)
+    for(vector<KeyFrame*>::iterator vit=vpKFsSharingWords.begin(), vend=vpKFsSharingWords.end(); vit!=vend; vit++)
     {
-        KeyFrame* pKFi = *lit;
+        KeyFrame* pKFi = *vit;
 
-        if(pKFi->mnRelocWords>minCommonWords)
+        if(scratch.vnWords[pKFi->mnId]>minCommonWords)
         {
-            nscores++;
-            float si = mpVoc->score(F->mBowVec,pKFi->mBowVec);
-            pKFi->mRelocScore=si;
-            lScoreAndMatch.push_back(make_pair(si,pKFi));
+            if(!mbAccumulateScore)
+                scratch.vScore[pKFi->mnId] = mpVoc->score(F->mBowVec,pKFi->mBowVec);
+            vScoreAndMatch.push_back(make_pair(scratch.vScore[pKFi->mnId],pKFi));
         }
     }
 
-    if(lScoreAndMatch.empty())
-        return vector<KeyFrame*>();
-
-    list<pair<float,KeyFrame*> > lAccScoreAndMatch;
+    vector<pair<float,KeyFrame*> > vAccScoreAndMatch;
+    vAccScoreAndMatch.reserve(vScoreAndMatch.size());
     float bestAccScore = 0;
 
     // Lets now accumulate score by covisibility
-    for(list<pair<float,KeyFrame*> >::iterator it=lScoreAndMatch.begin(), itend=lScoreAndMatch.end(); it!=itend; it++)
+    for(vector<pair<float,KeyFrame*> >::iterator it=vScoreAndMatch.begin(), itend=vScoreAndMatch.end(); it!=itend; it++)
     {
         KeyFrame* pKFi = it->second;
         vector<KeyFrame*> vpNeighs = pKFi->GetBestCovisibilityKeyFrames(10);
@@ -270,28 +322,32 @@ vector<KeyFrame*> KeyFrameDatabase::DetectRelocalizationCandidates(Frame *F)
         for(vector<KeyFrame*>::iterator vit=vpNeighs.begin(), vend=vpNeighs.end(); vit!=vend; vit++)
         {
             KeyFrame* pKF2 = *vit;
-            if(pKF2->mnRelocQuery!=F->mnId)
+            // Only the keyframes scored above contribute, the accumulated L1 score of the
+            // others is partial
+            if(pKF2->mnId>=scratch.vnWords.size() || scratch.vnWords[pKF2->mnId]<=minCommonWords)
                 continue;
 
-            accScore+=pKF2->mRelocScore;
-            if(pKF2->mRelocScore>bestScore)
+            const float score2 = scratch.vScore[pKF2->mnId];
+            accScore+=score2;
+            if(score2>bestScore)
             {
                 pBestKF=pKF2;
-                bestScore = pKF2->mRelocScore;
+                bestScore = score2;
             }
 
         }
-        lAccScoreAndMatch.push_back(make_pair(accScore,pBestKF));
+        vAccScoreAndMatch.push_back(make_pair(accScore,pBestKF));
         if(accScore>bestAccScore)
             bestAccScore=accScore;
     }
 
+    ResetScratch(scratch.vnWords,scratch.vScore,scratch.vTouched);
+
     // Return all those keyframes with a score higher than 0.75*bestScore
     float minScoreToRetain = 0.75f*bestAccScore;
     set<KeyFrame*> spAlreadyAddedKF;
-    vector<KeyFrame*> vpRelocCandidates;
-    vpRelocCandidates.reserve(lAccScoreAndMatch.size());
-    for(list<pair<float,KeyFrame*> >::iterator it=lAccScoreAndMatch.begin(), itend=lAccScoreAndMatch.end(); it!=itend; it++)
+    vpRelocCandidates.reserve(vAccScoreAndMatch.size());
+    for(vector<pair<float,KeyFrame*> >::iterator it=vAccScoreAndMatch.begin(), itend=vAccScoreAndMatch.end(); it!=itend; it++)
     {
         const float &si = it->first;
         if(si>minScoreToRetain)
@@ -22,16 +22,28 @@
 #include "LoopClosing.h"
 #include "ORBmatcher.h"
 #include "Optimizer.h"
+#include "ThreadPool.h"
 
 #include<mutex>
+#include<thread>
+#include<atomic>
 
 namespace ORB_SLAM2
 {
 
 LocalMapping::LocalMapping(Map *pMap, const float bMonocular):
     mbMonocular(bMonocular), mbResetRequested(false), mbFinishRequested(false), mbFinished(true), mpMap(pMap),
-    mbAbortBA(false), mbStopped(false), mbStopRequested(false), mbNotStop(false), mbAcceptKeyFrames(true)
+    mnSignals(0), mnSignalsSeen(0), mdTotalWaitMs(0), mnAbortBADepth(2), mnMaxKFsPerLocalBA(3), mnMaxQueuedKFs(3),
+    mnKFsSinceLocalBA(0), mbAbortBA(false), mbStopped(false), mbStopRequested(false), mbNotStop(false),
+    mbAcceptKeyFrames(true)
 {
+    mQueueStats.nInserted = 0;
+    mQueueStats.nProcessed = 0;
+    mQueueStats.nLocalBA = 0;
+    mQueueStats.nLocalBAAborted = 0;
+    mQueueStats.nCurrentDepth = 0;
+    mQueueStats.nMaxDepth = 0;
+    mQueueStats.dMeanWaitMs = 0;
 }
 
 void LocalMapping::SetLoopCloser(LoopClosing* pLoopCloser)
@@ -73,15 +85,35 @@ void LocalMapping::Run()
             }
 
             mbAbortBA = false;
+            mnKFsSinceLocalBA++;
 
-            if(!CheckNewKeyFrames() && !stopRequested())
+            // Pending keyframes are processed first and share the next local BA,
+            // unless too many have already been batched
+            const bool bRunLocalBA = !CheckNewKeyFrames() || mnKFsSinceLocalBA>=mnMaxKFsPerLocalBA;
+
+            if(bRunLocalBA && !stopRequested())
             {
                 // Local BA
                 if(mpMap->KeyFramesInMap()>2)
+                {
+                    {
+                        unique_lock<mutex> lock(mMutexNewKFs);
+                        mQueueStats.nLocalBA++;
+                    }
+
                     Optimizer::LocalBundleAdjustment(mpCurrentKeyFrame,&mbAbortBA, mpMap);
 
+                    if(mbAbortBA)
+                    {
+                        unique_lock<mutex> lock(mMutexNewKFs);
+                        mQueueStats.nLocalBAAborted++;
+                    }
+                }
+
                 // Check redundant local Keyframes
                 KeyFrameCulling();
+
+                mnKFsSinceLocalBA = 0;
             }
 
             mpLoopCloser->InsertKeyFrame(mpCurrentKeyFrame);
@@ -91,7 +123,7 @@ void LocalMapping::Run()
             // Safe area to stop
             while(isStopped() && !CheckFinish())
             {
-                usleep(3000);
+                WaitForSignal();
             }
             if(CheckFinish())
                 break;
@@ -105,17 +137,62 @@ void LocalMapping::Run()
         if(CheckFinish())
             break;
 
-        usleep(3000);
+        WaitForWork();
     }
 
     SetFinish();
 }
 
 void LocalMapping::InsertKeyFrame(KeyFrame *pKF)
+{
+    {
+        unique_lock<mutex> lock(mMutexNewKFs);
+        mlNewKeyFrames.push_back(pKF);
+        mlNewKeyFrameTimes.push_back(chrono::steady_clock::now());
+
+        mQueueStats.nInserted++;
+        mQueueStats.nMaxDepth = max(mQueueStats.nMaxDepth,mlNewKeyFrames.size());
+
+        // A single waiting keyframe lets the running local BA finish, it will be
+        // processed right after. A backlog interrupts it.
+        if((int)mlNewKeyFrames.size()>=mnAbortBADepth)
+            mbAbortBA=true;
+    }
+    mcvNewKFs.notify_one();
+}
+
+void LocalMapping::WaitForWork()
 {
     unique_lock<mutex> lock(mMutexNewKFs);
-    mlNewKeyFrames.push_back(pKF);
-    mbAbortBA=true;
+    while(mlNewKeyFrames.empty() && mnSignals==mnSignalsSeen)
+        mcvNewKFs.wait(lock);
+    mnSignalsSeen = mnSignals;
+}
+
+void LocalMapping::WaitForSignal()
+{
+    unique_lock<mutex> lock(mMutexNewKFs);
+    while(mnSignals==mnSignalsSeen)
+        mcvNewKFs.wait(lock);
+    mnSignalsSeen = mnSignals;
+}
+
+void LocalMapping::Signal()
+{
+    {
+        unique_lock<mutex> lock(mMutexNewKFs);
+        mnSignals++;
+    }
+    mcvNewKFs.notify_all();
+}
+
+LocalMapping::QueueStats LocalMapping::GetQueueStats()
+{
+    unique_lock<mutex> lock(mMutexNewKFs);
+    QueueStats stats = mQueueStats;
+    stats.nCurrentDepth = mlNewKeyFrames.size();
+    stats.dMeanWaitMs = mQueueStats.nProcessed>0 ? mdTotalWaitMs/mQueueStats.nProcessed : 0;
+    return stats;
 }
 
 
@@ -131,6 +208,11 @@ void LocalMapping::ProcessNewKeyFrame()
         unique_lock<mutex> lock(mMutexNewKFs);
         mpCurrentKeyFrame = mlNewKeyFrames.front();
         mlNewKeyFrames.pop_front();
+
+        const chrono::steady_clock::time_point tInserted = mlNewKeyFrameTimes.front();
+        mlNewKeyFrameTimes.pop_front();
+        mdTotalWaitMs += chrono::duration_cast<chrono::duration<double,milli> >(chrono::steady_clock::now()-tInserted).count();
+        mQueueStats.nProcessed++;
     }
 
     // Compute Bags of Words structures
@@ -212,243 +294,328 @@ void LocalMapping::CreateNewMapPoints()
         nn=20;
     const vector<KeyFrame*> vpNeighKFs = mpCurrentKeyFrame->GetBestCovisibilityKeyFrames(nn);
 
-    ORBmatcher matcher(0.6,false);
-
-    cv::Mat Rcw1 = mpCurrentKeyFrame->GetRotation();
-    cv::Mat Rwc1 = Rcw1.t();
-    cv::Mat tcw1 = mpCurrentKeyFrame->GetTranslation();
-    cv::Mat Tcw1(3,4,CV_32F);
-    Rcw1.copyTo(Tcw1.colRange(0,3));
-    tcw1.copyTo(Tcw1.col(3));
-    cv::Mat Ow1 = mpCurrentKeyFrame->GetCameraCenter();
+    const int nNeighs = vpNeighKFs.size();
+    if(nNeighs==0)
+        return;
 
-    const float &fx1 = mpCurrentKeyFrame->fx;
-    const float &fy1 = mpCurrentKeyFrame->fy;
-    const float &cx1 = mpCurrentKeyFrame->cx;
-    const float &cy1 = mpCurrentKeyFrame->cy;
-    const float &invfx1 = mpCurrentKeyFrame->invfx;
-    const float &invfy1 = mpCurrentKeyFrame->invfy;
+    // Each neighbor pair is matched and triangulated independently into its own buffer.
+    // Neighbors are handed out to the workers in covisibility order.
+    vector<vector<NewPointCandidate> > vvCandidates(nNeighs);
+    vector<char> vbProcessed(nNeighs,false);
+    atomic<int> nNextNeigh(0);
 
-    const float ratioFactor = 1.5f*mpCurrentKeyFrame->mfScaleFactor;
+    ThreadPool &pool = ThreadPool::Instance();
+    pool.Run(min(pool.Size(),nNeighs),[&](const int)
+    {
+        TriangulateNeighbors(vpNeighKFs,nNextNeigh,vvCandidates,vbProcessed);
+    });
 
+    // Merge in covisibility order, so the result does not depend on thread scheduling.
+    // A keypoint matched with several neighbors keeps the match of the best covisible one.
     int nnew=0;
-
-    // Search matches with epipolar restriction and triangulate
-    for(size_t i=0; i<vpNeighKFs.size(); i++)
+    for(int i=0; i<nNeighs; i++)
     {
-        if(i>0 && CheckNewKeyFrames())
-            return;
+        // Processing was interrupted by a new keyframe
+        if(!vbProcessed[i])
+            break;
 
         KeyFrame* pKF2 = vpNeighKFs[i];
+        const vector<NewPointCandidate> &vCandidates = vvCandidates[i];
 
-        // Check first that baseline is not too short
-        cv::Mat Ow2 = pKF2->GetCameraCenter();
-        cv::Mat vBaseline = Ow2-Ow1;
-        const float baseline = cv::norm(vBaseline);
-
-        if(!mbMonocular)
-        {
-            if(baseline<pKF2->mb)
-            continue;
-        }
-        else
+        for(size_t j=0, jend=vCandidates.size(); j<jend; j++)
         {
-            const float medianDepthKF2 = pKF2->ComputeSceneMedianDepth(2);
-            const float ratioBaselineDepth = baseline/medianDepthKF2;
+            const NewPointCandidate &candidate = vCandidates[j];
 
-            if(ratioBaselineDepth<0.01)
+            if(mpCurrentKeyFrame->GetMapPoint(candidate.idx1) || pKF2->GetMapPoint(candidate.idx2))
                 continue;
+
+            // Triangulation is succesfull
+            cv::Mat x3D(candidate.x3D);
+            MapPoint* pMP = new MapPoint(x3D,mpCurrentKeyFrame,mpMap);
+
+            pMP->AddObservation(mpCurrentKeyFrame,candidate.idx1);
+            pMP->AddObservation(pKF2,candidate.idx2);
+
+            mpCurrentKeyFrame->AddMapPoint(pMP,candidate.idx1);
+            pKF2->AddMapPoint(pMP,candidate.idx2);
+
+            pMP->ComputeDistinctiveDescriptors();
+
+            pMP->UpdateNormalAndDepth();
+
+            mpMap->AddMapPoint(pMP);
+            mlpRecentAddedMapPoints.push_back(pMP);
+
+            nnew++;
         }
+    }
+}
 
-        // Compute Fundamental Matrix
-        cv::Mat F12 = ComputeF12(mpCurrentKeyFrame,pKF2);
-
-        // Search matches that fullfil epipolar constraint
-        vector<pair<size_t,size_t> > vMatchedIndices;
-        matcher.SearchForTriangulation(mpCurrentKeyFrame,pKF2,F12,vMatchedIndices,false);
-
-        cv::Mat Rcw2 = pKF2->GetRotation();
-        cv::Mat Rwc2 = Rcw2.t();
-        cv::Mat tcw2 = pKF2->GetTranslation();
-        cv::Mat Tcw2(3,4,CV_32F);
-        Rcw2.copyTo(Tcw2.colRange(0,3));
-        tcw2.copyTo(Tcw2.col(3));
-
-        const float &fx2 = pKF2->fx;
-        const float &fy2 = pKF2->fy;
-        const float &cx2 = pKF2->cx;
-        const float &cy2 = pKF2->cy;
-        const float &invfx2 = pKF2->invfx;
-        const float &invfy2 = pKF2->invfy;
-
-        // Triangulate each match
-        const int nmatches = vMatchedIndices.size();
-        for(int ikp=0; ikp<nmatches; ikp++)
-        {
-            const int &idx1 = vMatchedIndices[ikp].first;
-            const int &idx2 = vMatchedIndices[ikp].second;
+void LocalMapping::TriangulateNeighbors(const vector<KeyFrame*> &vpNeighKFs, atomic<int> &nNextNeigh,
+                                        vector<vector<NewPointCandidate> > &vvCandidates, vector<char> &vbProcessed)
+{
+    ORBmatcher matcher(0.6,false);
 
-            const cv::KeyPoint &kp1 = mpCurrentKeyFrame->mvKeysUn[idx1];
-            const float kp1_ur=mpCurrentKeyFrame->mvuRight[idx1];
-            bool bStereo1 = kp1_ur>=0;
+    while(true)
+    {
+        const int i = nNextNeigh++;
+        if(i>=(int)vpNeighKFs.size())
+            break;
 
-            const cv::KeyPoint &kp2 = pKF2->mvKeysUn[idx2];
-            const float kp2_ur = pKF2->mvuRight[idx2];
-            bool bStereo2 = kp2_ur>=0;
+        if(i>0 && CheckNewKeyFrames())
+            break;
 
-            // Check parallax between rays
-            cv::Mat xn1 = (cv::Mat_<float>(3,1) << (kp1.pt.x-cx1)*invfx1, (kp1.pt.y-cy1)*invfy1, 1.0);
-            cv::Mat xn2 = (cv::Mat_<float>(3,1) << (kp2.pt.x-cx2)*invfx2, (kp2.pt.y-cy2)*invfy2, 1.0);
+        TriangulateWithNeighbor(matcher,vpNeighKFs[i],vvCandidates[i]);
 
-            cv::Mat ray1 = Rwc1*xn1;
-            cv::Mat ray2 = Rwc2*xn2;
-            const float cosParallaxRays = ray1.dot(ray2)/(cv::norm(ray1)*cv::norm(ray2));
+        // Each worker writes only the slots of the neighbors it took
+        vbProcessed[i] = true;
+    }
+}
 
-            float cosParallaxStereo = cosParallaxRays+1;
-            float cosParallaxStereo1 = cosParallaxStereo;
-            float cosParallaxStereo2 = cosParallaxStereo;
+void LocalMapping::TriangulateWithNeighbor(ORBmatcher &matcher, KeyFrame* pKF2, vector<NewPointCandidate> &vCandidates)
+{
+    KeyFrame* pKF1 = mpCurrentKeyFrame;
 
-            if(bStereo1)
-                cosParallaxStereo1 = cos(2*atan2(mpCurrentKeyFrame->mb/2,mpCurrentKeyFrame->mvDepth[idx1]));
-            else if(bStereo2)
-                cosParallaxStereo2 = cos(2*atan2(pKF2->mb/2,pKF2->mvDepth[idx2]));
+    const cv::Matx33f Rcw1 = pKF1->GetRotation();
+    const cv::Matx33f Rwc1 = Rcw1.t();
+    const cv::Vec3f tcw1 = pKF1->GetTranslation();
+    const cv::Vec3f Ow1 = pKF1->GetCameraCenter();
 
-            cosParallaxStereo = min(cosParallaxStereo1,cosParallaxStereo2);
+    const float &fx1 = pKF1->fx;
+    const float &fy1 = pKF1->fy;
+    const float &cx1 = pKF1->cx;
+    const float &cy1 = pKF1->cy;
+    const float &invfx1 = pKF1->invfx;
+    const float &invfy1 = pKF1->invfy;
 
-            cv::Mat x3D;
-            if(cosParallaxRays<cosParallaxStereo && cosParallaxRays>0 && (bStereo1 || bStereo2 || cosParallaxRays<0.9998))
-            {
-                // Linear Triangulation Method
-                cv::Mat A(4,4,CV_32F);
-                A.row(0) = xn1.at<float>(0)*Tcw1.row(2)-Tcw1.row(0);
-                A.row(1) = xn1.at<float>(1)*Tcw1.row(2)-Tcw1.row(1);
-                A.row(2) = xn2.at<float>(0)*Tcw2.row(2)-Tcw2.row(0);
-                A.row(3) = xn2.at<float>(1)*Tcw2.row(2)-Tcw2.row(1);
+    const float ratioFactor = 1.5f*pKF1->mfScaleFactor;
 
-                cv::Mat w,u,vt;
-                cv::SVD::compute(A,w,u,vt,cv::SVD::MODIFY_A| cv::SVD::FULL_UV);
+    // Check first that baseline is not too short
+    const cv::Vec3f Ow2 = pKF2->GetCameraCenter();
+    const float baseline = cv::norm(Ow2-Ow1);
 
-                x3D = vt.row(3).t();
+    if(!mbMonocular)
+    {
+        if(baseline<pKF2->mb)
+            return;
+    }
+    else
+    {
+        const float medianDepthKF2 = pKF2->ComputeSceneMedianDepth(2);
+        const float ratioBaselineDepth = baseline/medianDepthKF2;
 
-                if(x3D.at<float>(3)==0)
-                    continue;
+        if(ratioBaselineDepth<0.01)
+            return;
+    }
 
-                // Euclidean coordinates
-                x3D = x3D.rowRange(0,3)/x3D.at<float>(3);
+    // Compute Fundamental Matrix
+    cv::Mat F12 = ComputeF12(pKF1,pKF2);
 
-            }
-            else if(bStereo1 && cosParallaxStereo1<cosParallaxStereo2)
-            {
-                x3D = mpCurrentKeyFrame->UnprojectStereo(idx1);                
-            }
-            else if(bStereo2 && cosParallaxStereo2<cosParallaxStereo1)
-            {
-                x3D = pKF2->UnprojectStereo(idx2);
-            }
-            else
-                continue; //No stereo and very low parallax
+    // Search matches that fullfil epipolar constraint
+    vector<pair<size_t,size_t> > vMatchedIndices;
+    matcher.SearchForTriangulation(pKF1,pKF2,F12,vMatchedIndices,false);
 
-            cv::Mat x3Dt = x3D.t();
+    const cv::Matx33f Rcw2 = pKF2->GetRotation();
+    const cv::Matx33f Rwc2 = Rcw2.t();
+    const cv::Vec3f tcw2 = pKF2->GetTranslation();
 
-            //Check triangulation in front of cameras
-            float z1 = Rcw1.row(2).dot(x3Dt)+tcw1.at<float>(2);
-            if(z1<=0)
-                continue;
+    const float &fx2 = pKF2->fx;
+    const float &fy2 = pKF2->fy;
+    const float &cx2 = pKF2->cx;
+    const float &cy2 = pKF2->cy;
+    const float &invfx2 = pKF2->invfx;
+    const float &invfy2 = pKF2->invfy;
 
-            float z2 = Rcw2.row(2).dot(x3Dt)+tcw2.at<float>(2);
-            if(z2<=0)
-                continue;
+    // Triangulate each match
+    const int nmatches = vMatchedIndices.size();
+    vCandidates.reserve(nmatches);
+    for(int ikp=0; ikp<nmatches; ikp++)
+    {
+        const int &idx1 = vMatchedIndices[ikp].first;
+        const int &idx2 = vMatchedIndices[ikp].second;
 
-            //Check reprojection error in first keyframe
-            const float &sigmaSquare1 = mpCurrentKeyFrame->mvLevelSigma2[kp1.octave];
-            const float x1 = Rcw1.row(0).dot(x3Dt)+tcw1.at<float>(0);
-            const float y1 = Rcw1.row(1).dot(x3Dt)+tcw1.at<float>(1);
-            const float invz1 = 1.0/z1;
+        const cv::KeyPoint &kp1 = pKF1->mvKeysUn[idx1];
+        const float kp1_ur=pKF1->mvuRight[idx1];
+        bool bStereo1 = kp1_ur>=0;
 
-            if(!bStereo1)
-            {
-                float u1 = fx1*x1*invz1+cx1;
-                float v1 = fy1*y1*invz1+cy1;
-                float errX1 = u1 - kp1.pt.x;
-                float errY1 = v1 - kp1.pt.y;
-                if((errX1*errX1+errY1*errY1)>5.991*sigmaSquare1)
-                    continue;
-            }
-            else
-            {
-                float u1 = fx1*x1*invz1+cx1;
-                float u1_r = u1 - mpCurrentKeyFrame->mbf*invz1;
-                float v1 = fy1*y1*invz1+cy1;
-                float errX1 = u1 - kp1.pt.x;
-                float errY1 = v1 - kp1.pt.y;
-                float errX1_r = u1_r - kp1_ur;
-                if((errX1*errX1+errY1*errY1+errX1_r*errX1_r)>7.8*sigmaSquare1)
-                    continue;
-            }
+        const cv::KeyPoint &kp2 = pKF2->mvKeysUn[idx2];
+        const float kp2_ur = pKF2->mvuRight[idx2];
+        bool bStereo2 = kp2_ur>=0;
 
-            //Check reprojection error in second keyframe
-            const float sigmaSquare2 = pKF2->mvLevelSigma2[kp2.octave];
-            const float x2 = Rcw2.row(0).dot(x3Dt)+tcw2.at<float>(0);
-            const float y2 = Rcw2.row(1).dot(x3Dt)+tcw2.at<float>(1);
-            const float invz2 = 1.0/z2;
-            if(!bStereo2)
-            {
-                float u2 = fx2*x2*invz2+cx2;
-                float v2 = fy2*y2*invz2+cy2;
-                float errX2 = u2 - kp2.pt.x;
-                float errY2 = v2 - kp2.pt.y;
-                if((errX2*errX2+errY2*errY2)>5.991*sigmaSquare2)
-                    continue;
-            }
-            else
-            {
-                float u2 = fx2*x2*invz2+cx2;
-                float u2_r = u2 - mpCurrentKeyFrame->mbf*invz2;
-                float v2 = fy2*y2*invz2+cy2;
-                float errX2 = u2 - kp2.pt.x;
-                float errY2 = v2 - kp2.pt.y;
-                float errX2_r = u2_r - kp2_ur;
-                if((errX2*errX2+errY2*errY2+errX2_r*errX2_r)>7.8*sigmaSquare2)
-                    continue;
-            }
+        // Check parallax between rays
+        const cv::Vec3f xn1((kp1.pt.x-cx1)*invfx1, (kp1.pt.y-cy1)*invfy1, 1.0);
+        const cv::Vec3f xn2((kp2.pt.x-cx2)*invfx2, (kp2.pt.y-cy2)*invfy2, 1.0);
+
+        const cv::Vec3f ray1 = Rwc1*xn1;
+        const cv::Vec3f ray2 = Rwc2*xn2;
+        const float cosParallaxRays = ray1.dot(ray2)/(cv::norm(ray1)*cv::norm(ray2));
 
-            //Check scale consistency
-            cv::Mat normal1 = x3D-Ow1;
-            float dist1 = cv::norm(normal1);
+        float cosParallaxStereo = cosParallaxRays+1;
+        float cosParallaxStereo1 = cosParallaxStereo;
+        float cosParallaxStereo2 = cosParallaxStereo;
 
-            cv::Mat normal2 = x3D-Ow2;
-            float dist2 = cv::norm(normal2);
+        if(bStereo1)
+            cosParallaxStereo1 = cos(2*atan2(pKF1->mb/2,pKF1->mvDepth[idx1]));
+        else if(bStereo2)
+            cosParallaxStereo2 = cos(2*atan2(pKF2->mb/2,pKF2->mvDepth[idx2]));
 
-            if(dist1==0 || dist2==0)
+        cosParallaxStereo = min(cosParallaxStereo1,cosParallaxStereo2);
+
+        cv::Vec3f x3D;
+        if(cosParallaxRays<cosParallaxStereo && cosParallaxRays>0 && (bStereo1 || bStereo2 || cosParallaxRays<0.9998))
+        {
+            if(!Triangulate(xn1,Rcw1,tcw1,xn2,Rcw2,tcw2,x3D))
                 continue;
+        }
+        else if(bStereo1 && cosParallaxStereo1<cosParallaxStereo2)
+        {
+            x3D = pKF1->UnprojectStereo(idx1);
+        }
+        else if(bStereo2 && cosParallaxStereo2<cosParallaxStereo1)
+        {
+            x3D = pKF2->UnprojectStereo(idx2);
+        }
+        else
+            continue; //No stereo and very low parallax
 
-            const float ratioDist = dist2/dist1;
-            const float ratioOctave = mpCurrentKeyFrame->mvScaleFactors[kp1.octave]/pKF2->mvScaleFactors[kp2.octave];
+        const cv::Vec3f x3Dc1 = Rcw1*x3D+tcw1;
+        const cv::Vec3f x3Dc2 = Rcw2*x3D+tcw2;
 
-            /*if(fabs(ratioDist-ratioOctave)>ratioFactor)
-                continue;*/
-            if(ratioDist*ratioFactor<ratioOctave || ratioDist>ratioOctave*ratioFactor)
+        //Check triangulation in front of cameras
+        float z1 = x3Dc1(2);
+        if(z1<=0)
+            continue;
+
+        float z2 = x3Dc2(2);
+        if(z2<=0)
+            continue;
+
+        //Check reprojection error in first keyframe
+        const float &sigmaSquare1 = pKF1->mvLevelSigma2[kp1.octave];
+        const float x1 = x3Dc1(0);
+        const float y1 = x3Dc1(1);
+        const float invz1 = 1.0/z1;
+
+        if(!bStereo1)
+        {
+            float u1 = fx1*x1*invz1+cx1;
+            float v1 = fy1*y1*invz1+cy1;
+            float errX1 = u1 - kp1.pt.x;
+            float errY1 = v1 - kp1.pt.y;
+            if((errX1*errX1+errY1*errY1)>5.991*sigmaSquare1)
                 continue;
+        }
+        else
+        {
+            float u1 = fx1*x1*invz1+cx1;
+            float u1_r = u1 - pKF1->mbf*invz1;
+            float v1 = fy1*y1*invz1+cy1;
+            float errX1 = u1 - kp1.pt.x;
+            float errY1 = v1 - kp1.pt.y;
+            float errX1_r = u1_r - kp1_ur;
+            if((errX1*errX1+errY1*errY1+errX1_r*errX1_r)>7.8*sigmaSquare1)
+                continue;
+        }
 
-            // Triangulation is succesfull
-            MapPoint* pMP = new MapPoint(x3D,mpCurrentKeyFrame,mpMap);
+        //Check reprojection error in second keyframe
+        const float sigmaSquare2 = pKF2->mvLevelSigma2[kp2.octave];
+        const float x2 = x3Dc2(0);
+        const float y2 = x3Dc2(1);
+        const float invz2 = 1.0/z2;
+        if(!bStereo2)
+        {
+            float u2 = fx2*x2*invz2+cx2;
+            float v2 = fy2*y2*invz2+cy2;
+            float errX2 = u2 - kp2.pt.x;
+            float errY2 = v2 - kp2.pt.y;
+            if((errX2*errX2+errY2*errY2)>5.991*sigmaSquare2)
+                continue;
+        }
+        else
+        {
+            float u2 = fx2*x2*invz2+cx2;
+            float u2_r = u2 - pKF1->mbf*invz2;
+            float v2 = fy2*y2*invz2+cy2;
+            float errX2 = u2 - kp2.pt.x;
+            float errY2 = v2 - kp2.pt.y;
+            float errX2_r = u2_r - kp2_ur;
+            if((errX2*errX2+errY2*errY2+errX2_r*errX2_r)>7.8*sigmaSquare2)
+                continue;
+        }
 
-            pMP->AddObservation(mpCurrentKeyFrame,idx1);            
-            pMP->AddObservation(pKF2,idx2);
+        //Check scale consistency
+        float dist1 = cv::norm(x3D-Ow1);
+        float dist2 = cv::norm(x3D-Ow2);
 
-            mpCurrentKeyFrame->AddMapPoint(pMP,idx1);
-            pKF2->AddMapPoint(pMP,idx2);
+        if(dist1==0 || dist2==0)
+            continue;
 
-            pMP->ComputeDistinctiveDescriptors();
+        const float ratioDist = dist2/dist1;
+        const float ratioOctave = pKF1->mvScaleFactors[kp1.octave]/pKF2->mvScaleFactors[kp2.octave];
 
-            pMP->UpdateNormalAndDepth();
+        if(ratioDist*ratioFactor<ratioOctave || ratioDist>ratioOctave*ratioFactor)
+            continue;
 
-            mpMap->AddMapPoint(pMP);
-            mlpRecentAddedMapPoints.push_back(pMP);
+        NewPointCandidate candidate;
+        candidate.idx1 = idx1;
+        candidate.idx2 = idx2;
+        candidate.x3D = x3D;
+        vCandidates.push_back(candidate);
+    }
+}
 
-            nnew++;
+bool LocalMapping::Triangulate(const cv::Vec3f &xn1, const cv::Matx33f &Rcw1, const cv::Vec3f &tcw1,
+                               const cv::Vec3f &xn2, const cv::Matx33f &Rcw2, const cv::Vec3f &tcw2, cv::Vec3f &x3D)
+{
+    // Linear triangulation with the homogeneous coordinate fixed to 1. Each view gives the
+    // rows (x*r3-r1 | x*t3-t1) and (y*r3-r2 | y*t3-t2) of A. Instead of the SVD of A we solve
+    // the 3x3 normal equations M*X = -b in closed form (Cramer's rule, double precision).
+    double M[3][3] = {{0,0,0},{0,0,0},{0,0,0}};
+    double b[3] = {0,0,0};
+
+    const cv::Vec3f *pxn[2] = {&xn1, &xn2};
+    const cv::Matx33f *pR[2] = {&Rcw1, &Rcw2};
+    const cv::Vec3f *pt[2] = {&tcw1, &tcw2};
+
+    for(int v=0; v<2; v++)
+    {
+        const cv::Vec3f &xn = *pxn[v];
+        const cv::Matx33f &R = *pR[v];
+        const cv::Vec3f &t = *pt[v];
+        for(int r=0; r<2; r++)
+        {
+            const double a0 = xn(r)*R(2,0)-R(r,0);
+            const double a1 = xn(r)*R(2,1)-R(r,1);
+            const double a2 = xn(r)*R(2,2)-R(r,2);
+            const double a3 = xn(r)*t(2)-t(r);
+
+            M[0][0]+=a0*a0; M[0][1]+=a0*a1; M[0][2]+=a0*a2;
+            M[1][1]+=a1*a1; M[1][2]+=a1*a2;
+            M[2][2]+=a2*a2;
+            b[0]+=a0*a3; b[1]+=a1*a3; b[2]+=a2*a3;
         }
     }
+    M[1][0]=M[0][1]; M[2][0]=M[0][2]; M[2][1]=M[1][2];
+
+    const double c00 = M[1][1]*M[2][2]-M[1][2]*M[2][1];
+    const double c01 = M[1][2]*M[2][0]-M[1][0]*M[2][2];
+    const double c02 = M[1][0]*M[2][1]-M[1][1]*M[2][0];
+    const double det = M[0][0]*c00+M[0][1]*c01+M[0][2]*c02;
+
+    if(fabs(det)<1e-12)
+        return false;
+
+    const double c11 = M[0][0]*M[2][2]-M[0][2]*M[2][0];
+    const double c12 = M[0][1]*M[2][0]-M[0][0]*M[2][1];
+    const double c22 = M[0][0]*M[1][1]-M[0][1]*M[1][0];
+
+    // M is symmetric, so is its adjugate
+    const double invDet = -1.0/det;
+    x3D(0) = (c00*b[0]+c01*b[1]+c02*b[2])*invDet;
+    x3D(1) = (c01*b[0]+c11*b[1]+c12*b[2])*invDet;
+    x3D(2) = (c02*b[0]+c12*b[1]+c22*b[2])*invDet;
+
+    return true;
 }
 
 void LocalMapping::SearchInNeighbors()
@@ -554,10 +721,13 @@ cv::Mat LocalMapping::ComputeF12(KeyFrame *&pKF1, KeyFrame *&pKF2)
 
 void LocalMapping::RequestStop()
 {
-    unique_lock<mutex> lock(mMutexStop);
-    mbStopRequested = true;
-    unique_lock<mutex> lock2(mMutexNewKFs);
-    mbAbortBA = true;
+    {
+        unique_lock<mutex> lock(mMutexStop);
+        mbStopRequested = true;
+        unique_lock<mutex> lock2(mMutexNewKFs);
+        mbAbortBA = true;
+    }
+    Signal();
 }
 
 bool LocalMapping::Stop()
@@ -587,15 +757,20 @@ bool LocalMapping::stopRequested()
 
 void LocalMapping::Release()
 {
-    unique_lock<mutex> lock(mMutexStop);
-    unique_lock<mutex> lock2(mMutexFinish);
-    if(mbFinished)
-        return;
-    mbStopped = false;
-    mbStopRequested = false;
-    for(list<KeyFrame*>::iterator lit = mlNewKeyFrames.begin(), lend=mlNewKeyFrames.end(); lit!=lend; lit++)
-        delete *lit;
-    mlNewKeyFrames.clear();
+    {
+        unique_lock<mutex> lock(mMutexStop);
+        unique_lock<mutex> lock2(mMutexFinish);
+        if(mbFinished)
+            return;
+        mbStopped = false;
+        mbStopRequested = false;
+        unique_lock<mutex> lock3(mMutexNewKFs);
+        for(list<KeyFrame*>::iterator lit = mlNewKeyFrames.begin(), lend=mlNewKeyFrames.end(); lit!=lend; lit++)
+            delete *lit;
+        mlNewKeyFrames.clear();
+        mlNewKeyFrameTimes.clear();
+    }
+    Signal();
 
     cout << "Local Mapping RELEASE" << endl;
 }
@@ -640,7 +815,8 @@ void LocalMapping::KeyFrameCulling()
     for(vector<KeyFrame*>::iterator vit=vpLocalKeyFrames.begin(), vend=vpLocalKeyFrames.end(); vit!=vend; vit++)
     {
         KeyFrame* pKF = *vit;
-        if(pKF->mnId==0)
+        // Origins of the sub-maps, also after merging them, and keyframes not in the spanning tree yet
+        if(pKF->mbOrigin || !pKF->GetParent())
             continue;
         const vector<MapPoint*> vpMapPoints = pKF->GetMapPointMatches();
 
@@ -665,9 +841,9 @@ void LocalMapping::KeyFrameCulling()
                     if(pMP->Observations()>thObs)
                     {
                         const int &scaleLevel = pKF->mvKeysUn[i].octave;
-                        const map<KeyFrame*, size_t> observations = pMP->GetObservations();
+                        const MapPoint::ObsVector observations = pMP->GetObservations();
                         int nObs=0;
-                        for(map<KeyFrame*, size_t>::const_iterator mit=observations.begin(), mend=observations.end(); mit!=mend; mit++)
+                        for(MapPoint::ObsVector::const_iterator mit=observations.begin(), mend=observations.end(); mit!=mend; mit++)
                         {
                             KeyFrame* pKFi = mit->first;
                             if(pKFi==pKF)
@@ -708,33 +884,39 @@ void LocalMapping::RequestReset()
         unique_lock<mutex> lock(mMutexReset);
         mbResetRequested = true;
     }
+    Signal();
 
-    while(1)
-    {
-        {
-            unique_lock<mutex> lock2(mMutexReset);
-            if(!mbResetRequested)
-                break;
-        }
-        usleep(3000);
-    }
+    unique_lock<mutex> lock2(mMutexReset);
+    while(mbResetRequested)
+        mcvReset.wait(lock2);
 }
 
 void LocalMapping::ResetIfRequested()
 {
-    unique_lock<mutex> lock(mMutexReset);
-    if(mbResetRequested)
     {
-        mlNewKeyFrames.clear();
+        unique_lock<mutex> lock(mMutexReset);
+        if(!mbResetRequested)
+            return;
+
+        {
+            unique_lock<mutex> lock2(mMutexNewKFs);
+            mlNewKeyFrames.clear();
+            mlNewKeyFrameTimes.clear();
+        }
         mlpRecentAddedMapPoints.clear();
+        mnKFsSinceLocalBA = 0;
         mbResetRequested=false;
     }
+    mcvReset.notify_all();
 }
 
 void LocalMapping::RequestFinish()
 {
-    unique_lock<mutex> lock(mMutexFinish);
-    mbFinishRequested = true;
+    {
+        unique_lock<mutex> lock(mMutexFinish);
+        mbFinishRequested = true;
+    }
+    Signal();
 }
 
 bool LocalMapping::CheckFinish()
@@ -28,6 +28,8 @@
 
 #include "ORBmatcher.h"
 
+#include "ThreadPool.h"
+
 #include<mutex>
 #include<thread>
 
@@ -37,7 +39,7 @@ namespace ORB_SLAM2
 
 LoopClosing::LoopClosing(Map *pMap, KeyFrameDatabase *pDB, ORBVocabulary *pVoc, const bool bFixScale):
     mbResetRequested(false), mbFinishRequested(false), mbFinished(true), mpMap(pMap),
-    mpKeyFrameDB(pDB), mpORBVocabulary(pVoc), mpMatchedKF(NULL), mLastLoopKFid(0), mbRunningGBA(false), mbFinishedGBA(true),
+    mpKeyFrameDB(pDB), mpORBVocabulary(pVoc), mnSignals(0), mnSignalsSeen(0), mpMatchedKF(NULL), mLastLoopKFid(0), mbRunningGBA(false), mbFinishedGBA(true),
     mbStopGBA(false), mpThreadGBA(NULL), mbFixScale(bFixScale), mnFullBAIdx(0)
 {
     mnCovisibilityConsistencyTh = 3;
@@ -81,7 +83,7 @@ void LoopClosing::Run()
         if(CheckFinish())
             break;
 
-        usleep(5000);
+        WaitForWork();
     }
 
     SetFinish();
@@ -89,9 +91,30 @@ void LoopClosing::Run()
 
 void LoopClosing::InsertKeyFrame(KeyFrame *pKF)
 {
-    unique_lock<mutex> lock(mMutexLoopQueue);
-    if(pKF->mnId!=0)
+    {
+        unique_lock<mutex> lock(mMutexLoopQueue);
+        if(pKF->mnId==0)
+            return;
         mlpLoopKeyFrameQueue.push_back(pKF);
+    }
+    mcvLoopQueue.notify_one();
+}
+
+void LoopClosing::WaitForWork()
+{
+    unique_lock<mutex> lock(mMutexLoopQueue);
+    while(mlpLoopKeyFrameQueue.empty() && mnSignals==mnSignalsSeen)
+        mcvLoopQueue.wait(lock);
+    mnSignalsSeen = mnSignals;
+}
+
+void LoopClosing::Signal()
+{
+    {
+        unique_lock<mutex> lock(mMutexLoopQueue);
+        mnSignals++;
+    }
+    mcvLoopQueue.notify_all();
 }
 
 bool LoopClosing::CheckNewKeyFrames()
@@ -234,114 +257,26 @@ bool LoopClosing::ComputeSim3()
 
     const int nInitialCandidates = mvpEnoughConsistentCandidates.size();
 
-    // We compute first ORB matches for each candidate
-    // If enough matches are found, we setup a Sim3Solver
-    ORBmatcher matcher(0.75,true);
-
-    vector<Sim3Solver*> vpSim3Solvers;
-    vpSim3Solvers.resize(nInitialCandidates);
-
-    vector<vector<MapPoint*> > vvpMapPointMatches;
-    vvpMapPointMatches.resize(nInitialCandidates);
-
-    vector<bool> vbDiscarded;
-    vbDiscarded.resize(nInitialCandidates);
-
-    int nCandidates=0; //candidates with enough matches
-
+    // avoid that local mapping erase them while they are being processed in this thread
     for(int i=0; i<nInitialCandidates; i++)
-    {
-        KeyFrame* pKF = mvpEnoughConsistentCandidates[i];
+        mvpEnoughConsistentCandidates[i]->SetNotErase();
 
-        // avoid that local mapping erase it while it is being processed in this thread
-        pKF->SetNotErase();
+    // Each candidate is verified independently (ORB matches, Sim3 RANSAC, guided matching
+    // and optimization) by a pool of workers. The accepted candidate is the first one in
+    // the original order that passes, so the result does not depend on thread timing.
+    Sim3CandidateVector vCandidates(nInitialCandidates);
+    std::atomic<int> nNext(0);
+    std::atomic<int> nBestAccepted(nInitialCandidates);
 
-        if(pKF->isBad())
-        {
-            vbDiscarded[i] = true;
-            continue;
-        }
-
-        int nmatches = matcher.SearchByBoW(mpCurrentKF,pKF,vvpMapPointMatches[i]);
-
-        if(nmatches<20)
-        {
-            vbDiscarded[i] = true;
-            continue;
-        }
-        else
-        {
-            Sim3Solver* pSolver = new Sim3Solver(mpCurrentKF,pKF,vvpMapPointMatches[i],mbFixScale);
-            pSolver->SetRansacParameters(0.99,20,300);
-            vpSim3Solvers[i] = pSolver;
-        }
-
-        nCandidates++;
-    }
-
-    bool bMatch = false;
-
-    // Perform alternatively RANSAC iterations for each candidate
-    // until one is succesful or all fail
-    while(nCandidates>0 && !bMatch)
+    ThreadPool &pool = ThreadPool::Instance();
+    pool.Run(min(pool.Size(),nInitialCandidates),[&](const int)
     {
-        for(int i=0; i<nInitialCandidates; i++)
-        {
-            if(vbDiscarded[i])
-                continue;
-
-            KeyFrame* pKF = mvpEnoughConsistentCandidates[i];
-
-            // Perform 5 Ransac Iterations
-            vector<bool> vbInliers;
-            int nInliers;
-            bool bNoMore;
-
-            Sim3Solver* pSolver = vpSim3Solvers[i];
-            cv::Mat Scm  = pSolver->iterate(5,bNoMore,vbInliers,nInliers);
-
-            // If Ransac reachs max. iterations discard keyframe
-            if(bNoMore)
-            {
-                vbDiscarded[i]=true;
-                nCandidates--;
-            }
-
-            // If RANSAC returns a Sim3, perform a guided matching and optimize with all correspondences
-            if(!Scm.empty())
-            {
-                vector<MapPoint*> vpMapPointMatches(vvpMapPointMatches[i].size(), static_cast<MapPoint*>(NULL));
-                for(size_t j=0, jend=vbInliers.size(); j<jend; j++)
-                {
-                    if(vbInliers[j])
-                       vpMapPointMatches[j]=vvpMapPointMatches[i][j];
-                }
-
-                cv::Mat R = pSolver->GetEstimatedRotation();
-                cv::Mat t = pSolver->GetEstimatedTranslation();
-                const float s = pSolver->GetEstimatedScale();
-                matcher.SearchBySim3(mpCurrentKF,pKF,vpMapPointMatches,s,R,t,7.5);
-
-                g2o::Sim3 gScm(Converter::toMatrix3d(R),Converter::toVector3d(t),s);
-                const int nInliers = Optimizer::OptimizeSim3(mpCurrentKF, pKF, vpMapPointMatches, gScm, 10, mbFixScale);
+        VerifyCandidates(nNext,nBestAccepted,vCandidates);
+    });
 
-                // If optimization is succesful stop ransacs and continue
-                if(nInliers>=20)
-                {
-                    bMatch = true;
-                    mpMatchedKF = pKF;
-                    g2o::Sim3 gSmw(Converter::toMatrix3d(pKF->GetRotation()),Converter::toVector3d(pKF->GetTranslation()),1.0);
-                    mg2oScw = gScm*gSmw;
-                    mScw = Converter::toCvMat(mg2oScw);
-
-                    mvpCurrentMatchedPoints = vpMapPointMatches;
-                    break;
-                }
-            }
-        }
-    }
+    const int nBest = nBestAccepted;
 
-    if(!bMatch)
+    if(nBest>=nInitialCandidates)
     {
         for(int i=0; i<nInitialCandidates; i++)
              mvpEnoughConsistentCandidates[i]->SetErase();
@@ -349,6 +284,14 @@ bool LoopClosing::ComputeSim3()
         return false;
     }
 
+    mpMatchedKF = mvpEnoughConsistentCandidates[nBest];
+    g2o::Sim3 gSmw(Converter::toMatrix3d(mpMatchedKF->GetRotation()),Converter::toVector3d(mpMatchedKF->GetTranslation()),1.0);
+    mg2oScw = vCandidates[nBest].gScm*gSmw;
+    mScw = Converter::toCvMat(mg2oScw);
+    mvpCurrentMatchedPoints.swap(vCandidates[nBest].vpMatchedPoints);
+
+    ORBmatcher matcher(0.75,true);
+
     // Retrieve MapPoints seen in Loop Keyframe and neighbors
     vector<KeyFrame*> vpLoopConnectedKFs = mpMatchedKF->GetVectorCovisibleKeyFrames();
     vpLoopConnectedKFs.push_back(mpMatchedKF);
@@ -428,6 +371,11 @@ void LoopClosing::CorrectLoop()
         usleep(1000);
     }
 
+    // The loop is with another sub-map. Bring the current one into its world frame first,
+    // the loop correction below only distributes the residual error.
+    if(mpMatchedKF->mnSubmapId!=mpCurrentKF->mnSubmapId)
+        MergeSubmap();
+
     // Ensure current keyframe is updated
     mpCurrentKF->UpdateConnections();
 
@@ -468,14 +416,22 @@ void LoopClosing::CorrectLoop()
             NonCorrectedSim3[pKFi]=g2oSiw;
         }
 
-        // Correct all MapPoints obsrved by current keyframe and neighbors, so that they align with the other side of the loop
+        // Correct all MapPoints obsrved by current keyframe and neighbors, so that they align with the other side of the loop.
+        // Each MapPoint is corrected with the first keyframe observing it, the points are then moved in parallel.
+        vector<MapPoint*> vpCorrectedMPs;
+        vector<int> vnCorrectedRef;
+        vector<g2o::Sim3,Eigen::aligned_allocator<g2o::Sim3> > vSiw, vCorrectedSwi;
+        vSiw.reserve(CorrectedSim3.size());
+        vCorrectedSwi.reserve(CorrectedSim3.size());
+
         for(KeyFrameAndPose::iterator mit=CorrectedSim3.begin(), mend=CorrectedSim3.end(); mit!=mend; mit++)
         {
             KeyFrame* pKFi = mit->first;
             g2o::Sim3 g2oCorrectedSiw = mit->second;
-            g2o::Sim3 g2oCorrectedSwi = g2oCorrectedSiw.inverse();
 
-            g2o::Sim3 g2oSiw =NonCorrectedSim3[pKFi];
+            const int nRef = vSiw.size();
+            vSiw.push_back(NonCorrectedSim3[pKFi]);
+            vCorrectedSwi.push_back(g2oCorrectedSiw.inverse());
 
             vector<MapPoint*> vpMPsi = pKFi->GetMapPointMatches();
             for(size_t iMP=0, endMPi = vpMPsi.size(); iMP<endMPi; iMP++)
@@ -488,16 +444,10 @@ void LoopClosing::CorrectLoop()
                 if(pMPi->mnCorrectedByKF==mpCurrentKF->mnId)
                     continue;
 
-                // Project with non-corrected pose and project back with corrected pose
-                cv::Mat P3Dw = pMPi->GetWorldPos();
-                Eigen::Matrix<double,3,1> eigP3Dw = Converter::toVector3d(P3Dw);
-                Eigen::Matrix<double,3,1> eigCorrectedP3Dw = g2oCorrectedSwi.map(g2oSiw.map(eigP3Dw));
-
-                cv::Mat cvCorrectedP3Dw = Converter::toCvMat(eigCorrectedP3Dw);
-                pMPi->SetWorldPos(cvCorrectedP3Dw);
                 pMPi->mnCorrectedByKF = mpCurrentKF->mnId;
                 pMPi->mnCorrectedReference = pKFi->mnId;
-                pMPi->UpdateNormalAndDepth();
+                vpCorrectedMPs.push_back(pMPi);
+                vnCorrectedRef.push_back(nRef);
             }
 
             // Update keyframe pose with corrected Sim3. First transform Sim3 to SE3 (scale translation)
@@ -510,11 +460,15 @@ void LoopClosing::CorrectLoop()
             cv::Mat correctedTiw = Converter::toCvSE3(eigR,eigt);
 
             pKFi->SetPose(correctedTiw);
-
-            // Make sure connections are updated
-            pKFi->UpdateConnections();
         }
 
+        // Project with non-corrected pose and project back with corrected pose
+        Optimizer::CorrectMapPoints(vpCorrectedMPs,vnCorrectedRef,vSiw,vCorrectedSwi);
+
+        // Make sure connections are updated
+        for(KeyFrameAndPose::iterator mit=CorrectedSim3.begin(), mend=CorrectedSim3.end(); mit!=mend; mit++)
+            mit->first->UpdateConnections();
+
         // Start Loop Fusion
         // Update matched map points and replace if duplicated
         for(size_t i=0; i<mvpCurrentMatchedPoints.size(); i++)
@@ -584,6 +538,153 @@ void LoopClosing::CorrectLoop()
     mLastLoopKFid = mpCurrentKF->mnId;   
 }
 
+void LoopClosing::VerifyCandidates(std::atomic<int> &nNext, std::atomic<int> &nBestAccepted, Sim3CandidateVector &vCandidates)
+{
+    ORBmatcher matcher(0.75,true);
+
+    const int nCandidates = vCandidates.size();
+
+    while(true)
+    {
+        const int i = nNext++;
+        if(i>=nCandidates)
+            break;
+
+        // A better ranked candidate was already accepted
+        if(i>nBestAccepted)
+            continue;
+
+        if(!VerifyCandidate(matcher,i,nBestAccepted,vCandidates[i]))
+            continue;
+
+        int nBest = nBestAccepted;
+        while(i<nBest && !nBestAccepted.compare_exchange_weak(nBest,i))
+            ;
+    }
+}
+
+bool LoopClosing::VerifyCandidate(ORBmatcher &matcher, const int idx, const std::atomic<int> &nBestAccepted, Sim3Candidate &candidate)
+{
+    KeyFrame* pKF = mvpEnoughConsistentCandidates[idx];
+
+    if(pKF->isBad())
+        return false;
+
+    // We compute first ORB matches, if enough matches are found we setup a Sim3Solver
+    vector<MapPoint*> vpBoWMatches;
+    const int nmatches = matcher.SearchByBoW(mpCurrentKF,pKF,vpBoWMatches);
+
+    if(nmatches<20)
+        return false;
+
+    Sim3Solver solver(mpCurrentKF,pKF,vpBoWMatches,mbFixScale);
+    solver.SetRansacParameters(0.99,20,300);
+
+    // Perform 5 Ransac Iterations at a time, checking in between whether
+    // another worker has already accepted a better ranked candidate
+    bool bNoMore = false;
+    while(!bNoMore && idx<=nBestAccepted)
+    {
+        vector<bool> vbInliers;
+        int nInliers;
+
+        cv::Mat Scm  = solver.iterate(5,bNoMore,vbInliers,nInliers);
+
+        // If RANSAC returns a Sim3, perform a guided matching and optimize with all correspondences
+        if(!Scm.empty())
+        {
+            vector<MapPoint*> vpMapPointMatches(vpBoWMatches.size(), static_cast<MapPoint*>(NULL));
+            for(size_t j=0, jend=vbInliers.size(); j<jend; j++)
+            {
+                if(vbInliers[j])
+                   vpMapPointMatches[j]=vpBoWMatches[j];
+            }
+
+            cv::Mat R = solver.GetEstimatedRotation();
+            cv::Mat t = solver.GetEstimatedTranslation();
+            const float s = solver.GetEstimatedScale();
+            matcher.SearchBySim3(mpCurrentKF,pKF,vpMapPointMatches,s,R,t,7.5);
+
+            g2o::Sim3 gScm(Converter::toMatrix3d(R),Converter::toVector3d(t),s);
+            const int nInliers = Optimizer::OptimizeSim3(mpCurrentKF, pKF, vpMapPointMatches, gScm, 10, mbFixScale);
+
+            // If optimization is succesful stop ransacs and continue
+            if(nInliers>=20)
+            {
+                candidate.gScm = gScm;
+                candidate.vpMatchedPoints.swap(vpMapPointMatches);
+                return true;
+            }
+        }
+    }
+
+    return false;
+}
+
+void LoopClosing::MergeSubmap()
+{
+    const long unsigned int nSubmapId = mpCurrentKF->mnSubmapId;
+    const long unsigned int nTargetId = mpMatchedKF->mnSubmapId;
+
+    cout << "Merging map " << nSubmapId << " into map " << nTargetId << endl;
+
+    {
+        // Get Map Mutex
+        unique_lock<mutex> lock(mpMap->mMutexMapUpdate);
+
+        // Similarity from the world of the current sub-map to the world of the matched one
+        cv::Mat Tcw = mpCurrentKF->GetPose();
+        g2o::Sim3 g2oScw(Converter::toMatrix3d(Tcw.rowRange(0,3).colRange(0,3)),Converter::toVector3d(Tcw.rowRange(0,3).col(3)),1.0);
+        g2o::Sim3 g2oSmc = mg2oScw.inverse()*g2oScw;
+        g2o::Sim3 g2oScm = g2oSmc.inverse();
+
+        // Points first, they are found through their reference keyframe
+        const vector<MapPoint*> vpMPs = mpMap->GetSubmapMapPoints(nSubmapId);
+        const vector<KeyFrame*> vpKFs = mpMap->GetSubmapKeyFrames(nSubmapId);
+
+        for(size_t i=0; i<vpMPs.size(); i++)
+        {
+            MapPoint* pMP = vpMPs[i];
+            if(pMP->isBad())
+                continue;
+
+            Eigen::Matrix<double,3,1> eigP3Dw = Converter::toVector3d(pMP->GetWorldPos());
+            pMP->SetWorldPos(Converter::toCvMat(g2oSmc.map(eigP3Dw)));
+        }
+
+        for(size_t i=0; i<vpKFs.size(); i++)
+        {
+            KeyFrame* pKFi = vpKFs[i];
+
+            cv::Mat Tiw = pKFi->GetPose();
+            g2o::Sim3 g2oSiw(Converter::toMatrix3d(Tiw.rowRange(0,3).colRange(0,3)),Converter::toVector3d(Tiw.rowRange(0,3).col(3)),1.0);
+            g2o::Sim3 g2oCorrectedSiw = g2oSiw*g2oScm;
+
+            // Sim3 to SE3 (scale translation)
+            Eigen::Matrix3d eigR = g2oCorrectedSiw.rotation().toRotationMatrix();
+            Eigen::Vector3d eigt = g2oCorrectedSiw.translation();
+            double s = g2oCorrectedSiw.scale();
+
+            eigt *=(1./s); //[R t/s;0 1]
+
+            pKFi->SetPose(Converter::toCvSE3(eigR,eigt));
+        }
+
+        // Normals and depths are scaled as well
+        for(size_t i=0; i<vpMPs.size(); i++)
+            if(!vpMPs[i]->isBad())
+                vpMPs[i]->UpdateNormalAndDepth();
+
+        mpMap->MergeSubmap(nSubmapId,nTargetId);
+    }
+
+    mpMap->InformNewBigChange();
+
+    // The current keyframe is now where the loop says, the correction is the identity for it
+    cv::Mat Tcw = mpCurrentKF->GetPose();
+    mg2oScw = g2o::Sim3(Converter::toMatrix3d(Tcw.rowRange(0,3).colRange(0,3)),Converter::toVector3d(Tcw.rowRange(0,3).col(3)),1.0);
+}
+
 void LoopClosing::SearchAndFuse(const KeyFrameAndPose &CorrectedPosesMap)
 {
     ORBmatcher matcher(0.8);
@@ -619,27 +720,28 @@ void LoopClosing::RequestReset()
         unique_lock<mutex> lock(mMutexReset);
         mbResetRequested = true;
     }
+    Signal();
 
-    while(1)
-    {
-        {
-        unique_lock<mutex> lock2(mMutexReset);
-        if(!mbResetRequested)
-            break;
-        }
-        usleep(5000);
-    }
+    unique_lock<mutex> lock2(mMutexReset);
+    while(mbResetRequested)
+        mcvReset.wait(lock2);
 }
 
 void LoopClosing::ResetIfRequested()
 {
-    unique_lock<mutex> lock(mMutexReset);
-    if(mbResetRequested)
     {
-        mlpLoopKeyFrameQueue.clear();
+        unique_lock<mutex> lock(mMutexReset);
+        if(!mbResetRequested)
+            return;
+
+        {
+            unique_lock<mutex> lock2(mMutexLoopQueue);
+            mlpLoopKeyFrameQueue.clear();
+        }
         mLastLoopKFid=0;
         mbResetRequested=false;
     }
+    mcvReset.notify_all();
 }
 
 void LoopClosing::RunGlobalBundleAdjustment(unsigned long nLoopKF)
@@ -662,83 +764,19 @@ void LoopClosing::RunGlobalBundleAdjustment(unsigned long nLoopKF)
         {
             cout << "Global Bundle Adjustment finished" << endl;
             cout << "Updating map ..." << endl;
-            mpLocalMapper->RequestStop();
-            // Wait until Local Mapping has effectively stopped
-
-            while(!mpLocalMapper->isStopped() && !mpLocalMapper->isFinished())
-            {
-                usleep(1000);
-            }
 
-            // Get Map Mutex
-            unique_lock<mutex> lock(mpMap->mMutexMapUpdate);
+            // Local Mapping keeps running, its local BA results computed before the
+            // update are discarded (see Optimizer::LocalBundleAdjustment)
+            StageGlobalBundleAdjustment(nLoopKF);
 
-            // Correct keyframes starting at map first keyframe
-            list<KeyFrame*> lpKFtoCheck(mpMap->mvpKeyFrameOrigins.begin(),mpMap->mvpKeyFrameOrigins.end());
-
-            while(!lpKFtoCheck.empty())
             {
-                KeyFrame* pKF = lpKFtoCheck.front();
-                const set<KeyFrame*> sChilds = pKF->GetChilds();
-                cv::Mat Twc = pKF->GetPoseInverse();
-                for(set<KeyFrame*>::const_iterator sit=sChilds.begin();sit!=sChilds.end();sit++)
-                {
-                    KeyFrame* pChild = *sit;
-                    if(pChild->mnBAGlobalForKF!=nLoopKF)
-                    {
-                        cv::Mat Tchildc = pChild->GetPose()*Twc;
-                        pChild->mTcwGBA = Tchildc*pKF->mTcwGBA;//*Tcorc*pKF->mTcwGBA;
-                        pChild->mnBAGlobalForKF=nLoopKF;
-
-                    }
-                    lpKFtoCheck.push_back(pChild);
-                }
-
-                pKF->mTcwBefGBA = pKF->GetPose();
-                pKF->SetPose(pKF->mTcwGBA);
-                lpKFtoCheck.pop_front();
-            }
-
-            // Correct MapPoints
-            const vector<MapPoint*> vpMPs = mpMap->GetAllMapPoints();
-
-            for(size_t i=0; i<vpMPs.size(); i++)
-            {
-                MapPoint* pMP = vpMPs[i];
-
-                if(pMP->isBad())
-                    continue;
-
-                if(pMP->mnBAGlobalForKF==nLoopKF)
-                {
-                    // If optimized by Global BA, just update
-                    pMP->SetWorldPos(pMP->mPosGBA);
-                }
-                else
-                {
-                    // Update according to the correction of its reference keyframe
-                    KeyFrame* pRefKF = pMP->GetReferenceKeyFrame();
-
-                    if(pRefKF->mnBAGlobalForKF!=nLoopKF)
-                        continue;
-
-                    // Map to non-corrected camera
-                    cv::Mat Rcw = pRefKF->mTcwBefGBA.rowRange(0,3).colRange(0,3);
-                    cv::Mat tcw = pRefKF->mTcwBefGBA.rowRange(0,3).col(3);
-                    cv::Mat Xc = Rcw*pMP->GetWorldPos()+tcw;
+                // Get Map Mutex. Tracking is between two frames.
+                unique_lock<mutex> lock(mpMap->mMutexMapUpdate);
 
-                    // Backproject using corrected camera
-                    cv::Mat Twc = pRefKF->GetPoseInverse();
-                    cv::Mat Rwc = Twc.rowRange(0,3).colRange(0,3);
-                    cv::Mat twc = Twc.rowRange(0,3).col(3);
+                PublishGlobalBundleAdjustment(nLoopKF);
 
-                    pMP->SetWorldPos(Rwc*Xc+twc);
-                }
-            }            
-
-            mpMap->InformNewBigChange();
-
-            mpLocalMapper->Release();
+                mpMap->InformNewBigChange();
+            }
 
             cout << "Map updated!" << endl;
         }
@@ -750,8 +788,11 @@ void LoopClosing::RunGlobalBundleAdjustment(unsigned long nLoopKF)
 
 void LoopClosing::RequestFinish()
 {
-    unique_lock<mutex> lock(mMutexFinish);
-    mbFinishRequested = true;
+    {
+        unique_lock<mutex> lock(mMutexFinish);
+        mbFinishRequested = true;
+    }
+    Signal();
 }
 
 bool LoopClosing::CheckFinish()
@@ -772,5 +813,149 @@ bool LoopClosing::isFinished()
     return mbFinished;
 }
 
+void LoopClosing::StageGlobalBundleAdjustment(unsigned long nLoopKF)
+{
+    // Pose before the correction of the keyframes optimized by the Global BA. Taken before the
+    // traversal: Local Mapping keeps culling, and a culled keyframe can move one of them under a
+    // node of the spanning tree that was already visited.
+    const vector<KeyFrame*> vpKFs = mpMap->GetAllKeyFrames();
+    for(size_t i=0; i<vpKFs.size(); i++)
+    {
+        if(vpKFs[i]->mnBAGlobalForKF==nLoopKF)
+            vpKFs[i]->mTcwBefGBA = vpKFs[i]->GetPose();
+    }
+
+    // Correct keyframes starting at map first keyframe
+    const vector<KeyFrame*> vpOrigins = mpMap->GetKeyFrameOrigins();
+    list<KeyFrame*> lpKFtoCheck(vpOrigins.begin(),vpOrigins.end());
+
+    // The origin of a sub-map started during the Global BA is not corrected
+    for(size_t i=0; i<vpOrigins.size(); i++)
+    {
+        KeyFrame* pKF = vpOrigins[i];
+        if(pKF->mnBAGlobalForKF!=nLoopKF)
+        {
+            pKF->mTcwBefGBA = pKF->GetPose();
+            pKF->mTcwGBA = pKF->mTcwBefGBA.clone();
+            pKF->mnBAGlobalForKF = nLoopKF;
+        }
+    }
+
+    while(!lpKFtoCheck.empty())
+    {
+        KeyFrame* pKF = lpKFtoCheck.front();
+        const set<KeyFrame*> sChilds = pKF->GetChilds();
+        cv::Mat Twc = pKF->mTcwBefGBA.inv();
+        for(set<KeyFrame*>::const_iterator sit=sChilds.begin();sit!=sChilds.end();sit++)
+        {
+            KeyFrame* pChild = *sit;
+            if(pChild->mnBAGlobalForKF!=nLoopKF)
+            {
+                pChild->mTcwBefGBA = pChild->GetPose();
+                cv::Mat Tchildc = pChild->mTcwBefGBA*Twc;
+                pChild->mTcwGBA = Tchildc*pKF->mTcwGBA;
+                pChild->mnBAGlobalForKF=nLoopKF;
+            }
+            lpKFtoCheck.push_back(pChild);
+        }
+
+        lpKFtoCheck.pop_front();
+    }
+
+    // Correct MapPoints. Once staged, mnBAGlobalForKF==nLoopKF and mPosGBA is the corrected position.
+    const vector<MapPoint*> vpMPs = mpMap->GetAllMapPoints();
+
+    for(size_t i=0; i<vpMPs.size(); i++)
+    {
+        MapPoint* pMP = vpMPs[i];
+
+        if(pMP->isBad())
+            continue;
+
+        // Optimized by Global BA
+        if(pMP->mnBAGlobalForKF==nLoopKF)
+            continue;
+
+        // Update according to the correction of its reference keyframe
+        KeyFrame* pRefKF = pMP->GetReferenceKeyFrame();
+
+        if(pRefKF->mnBAGlobalForKF!=nLoopKF)
+            continue;
+
+        // Map to non-corrected camera
+        cv::Mat Rcw = pRefKF->mTcwBefGBA.rowRange(0,3).colRange(0,3);
+        cv::Mat tcw = pRefKF->mTcwBefGBA.rowRange(0,3).col(3);
+        cv::Mat Xc = Rcw*pMP->GetWorldPos()+tcw;
+
+        // Backproject using corrected camera
+        cv::Mat Rwc = pRefKF->mTcwGBA.rowRange(0,3).colRange(0,3).t();
+        cv::Mat tcwGBA = pRefKF->mTcwGBA.rowRange(0,3).col(3);
+
+        pMP->mPosGBA = Rwc*(Xc-tcwGBA);
+        pMP->mnBAGlobalForKF = nLoopKF;
+    }
+}
+
+void LoopClosing::PublishGlobalBundleAdjustment(unsigned long nLoopKF)
+{
+    const vector<KeyFrame*> vpOrigins = mpMap->GetKeyFrameOrigins();
+    list<KeyFrame*> lpKFtoCheck(vpOrigins.begin(),vpOrigins.end());
+
+    while(!lpKFtoCheck.empty())
+    {
+        KeyFrame* pKF = lpKFtoCheck.front();
+        const set<KeyFrame*> sChilds = pKF->GetChilds();
+        for(set<KeyFrame*>::const_iterator sit=sChilds.begin();sit!=sChilds.end();sit++)
+        {
+            KeyFrame* pChild = *sit;
+            if(pChild->mnBAGlobalForKF!=nLoopKF)
+            {
+                // Inserted after the staging
+                pChild->mTcwBefGBA = pChild->GetPose();
+                cv::Mat Tchildc = pChild->mTcwBefGBA*pKF->mTcwBefGBA.inv();
+                pChild->mTcwGBA = Tchildc*pKF->mTcwGBA;
+                pChild->mnBAGlobalForKF=nLoopKF;
+            }
+            lpKFtoCheck.push_back(pChild);
+        }
+
+        pKF->SetPose(pKF->mTcwGBA);
+        lpKFtoCheck.pop_front();
+    }
+
+    const vector<MapPoint*> vpMPs = mpMap->GetAllMapPoints();
+
+    for(size_t i=0; i<vpMPs.size(); i++)
+    {
+        MapPoint* pMP = vpMPs[i];
+
+        if(pMP->isBad())
+            continue;
+
+        if(pMP->mnBAGlobalForKF==nLoopKF)
+        {
+            pMP->SetWorldPos(pMP->mPosGBA);
+        }
+        else
+        {
+            // Created after the staging
+            KeyFrame* pRefKF = pMP->GetReferenceKeyFrame();
+
+            if(pRefKF->mnBAGlobalForKF!=nLoopKF)
+                continue;
+
+            cv::Mat Rcw = pRefKF->mTcwBefGBA.rowRange(0,3).colRange(0,3);
+            cv::Mat tcw = pRefKF->mTcwBefGBA.rowRange(0,3).col(3);
+            cv::Mat Xc = Rcw*pMP->GetWorldPos()+tcw;
+
+            cv::Mat Twc = pRefKF->GetPoseInverse();
+            cv::Mat Rwc = Twc.rowRange(0,3).colRange(0,3);
+            cv::Mat twc = Twc.rowRange(0,3).col(3);
+
+            pMP->SetWorldPos(Rwc*Xc+twc);
+        }
+    }
+}
+
 
 } //namespace ORB_SLAM
@@ -21,11 +21,13 @@
 #include "Map.h"
 
 #include <mutex>
+#include <algorithm>
 #include <boost/filesystem.hpp>
 namespace ORB_SLAM2
 {
 
-Map::Map(cv::FileStorage& fsSettings):mnMaxKFid(0),mnBigChangeIdx(0)
+Map::Map(cv::FileStorage& fsSettings):mObjectMap(this,fsSettings),mnMaxKFid(0),mnCurrentSubmapId(0),mnBigChangeIdx(0),
+    mbRecordChanges(false),mnClearIdx(0)
 {
     CreateLookup(fsSettings);
 }
@@ -36,18 +38,21 @@ void Map::AddKeyFrame(KeyFrame *pKF)
     mspKeyFrames.insert(pKF);
     if(pKF->mnId>mnMaxKFid)
         mnMaxKFid=pKF->mnId;
+    InformKeyFrameChanged(pKF);
 }
 
 void Map::AddMapPoint(MapPoint *pMP)
 {
     unique_lock<mutex> lock(mMutexMap);
     mspMapPoints.insert(pMP);
+    InformMapPointChanged(pMP);
 }
 
 void Map::EraseMapPoint(MapPoint *pMP)
 {
     unique_lock<mutex> lock(mMutexMap);
     mspMapPoints.erase(pMP);
+    InformMapPointChanged(pMP);
 
     // TODO: This only erase the pointer.
     // Delete the MapPoint
@@ -57,6 +62,7 @@ void Map::EraseKeyFrame(KeyFrame *pKF)
 {
     unique_lock<mutex> lock(mMutexMap);
     mspKeyFrames.erase(pKF);
+    InformKeyFrameChanged(pKF);
 
     // TODO: This only erase the pointer.
     // Delete the MapPoint
@@ -70,16 +76,47 @@ void Map::SetReferenceMapPoints(const vector<MapPoint *> &vpMPs)
 
 void Map::InformNewBigChange()
 {
-    unique_lock<mutex> lock(mMutexMap);
     mnBigChangeIdx++;
 }
 
 int Map::GetLastBigChangeIdx()
 {
-    unique_lock<mutex> lock(mMutexMap);
     return mnBigChangeIdx;
 }
 
+void Map::InformMapPointChanged(MapPoint *pMP)
+{
+    unique_lock<mutex> lock(mMutexChanges);
+    if(mbRecordChanges)
+        mvpChangedMapPoints.push_back(pMP);
+}
+
+void Map::InformKeyFrameChanged(KeyFrame *pKF)
+{
+    mObjectMap.InformKeyFrameMoved(pKF);
+
+    unique_lock<mutex> lock(mMutexChanges);
+    if(mbRecordChanges)
+        mvpChangedKeyFrames.push_back(pKF);
+}
+
+int Map::GetChanges(vector<MapPoint*> &vpMPs, vector<KeyFrame*> &vpKFs)
+{
+    unique_lock<mutex> lock(mMutexChanges);
+    mbRecordChanges = true;
+    vpMPs.clear();
+    vpKFs.clear();
+    vpMPs.swap(mvpChangedMapPoints);
+    vpKFs.swap(mvpChangedKeyFrames);
+    return mnClearIdx;
+}
+
+int Map::GetClearIdx()
+{
+    unique_lock<mutex> lock(mMutexChanges);
+    return mnClearIdx;
+}
+
 vector<KeyFrame*> Map::GetAllKeyFrames()
 {
     unique_lock<mutex> lock(mMutexMap);
@@ -92,6 +129,85 @@ vector<MapPoint*> Map::GetAllMapPoints()
     return vector<MapPoint*>(mspMapPoints.begin(),mspMapPoints.end());
 }
 
+void Map::AddOrigin(KeyFrame *pKF)
+{
+    unique_lock<mutex> lock(mMutexMap);
+    pKF->mnSubmapId = pKF->mnId;
+    pKF->mbOrigin = true;
+    mnCurrentSubmapId = pKF->mnId;
+    mvpKeyFrameOrigins.push_back(pKF);
+}
+
+void Map::EraseOrigin(KeyFrame *pKF)
+{
+    unique_lock<mutex> lock(mMutexMap);
+    pKF->mbOrigin = false;
+    vector<KeyFrame*>::iterator vit = find(mvpKeyFrameOrigins.begin(),mvpKeyFrameOrigins.end(),pKF);
+    if(vit!=mvpKeyFrameOrigins.end())
+        mvpKeyFrameOrigins.erase(vit);
+}
+
+vector<KeyFrame*> Map::GetKeyFrameOrigins()
+{
+    unique_lock<mutex> lock(mMutexMap);
+    return mvpKeyFrameOrigins;
+}
+
+long unsigned int Map::GetCurrentSubmapId()
+{
+    unique_lock<mutex> lock(mMutexMap);
+    return mnCurrentSubmapId;
+}
+
+void Map::SetCurrentSubmapId(const long unsigned int nSubmapId)
+{
+    unique_lock<mutex> lock(mMutexMap);
+    mnCurrentSubmapId = nSubmapId;
+}
+
+vector<KeyFrame*> Map::GetSubmapKeyFrames(const long unsigned int nSubmapId)
+{
+    unique_lock<mutex> lock(mMutexMap);
+    vector<KeyFrame*> vpKFs;
+    for(set<KeyFrame*>::iterator sit=mspKeyFrames.begin(), send=mspKeyFrames.end(); sit!=send; sit++)
+        if((*sit)->mnSubmapId==nSubmapId)
+            vpKFs.push_back(*sit);
+    return vpKFs;
+}
+
+vector<MapPoint*> Map::GetSubmapMapPoints(const long unsigned int nSubmapId)
+{
+    unique_lock<mutex> lock(mMutexMap);
+    vector<MapPoint*> vpMPs;
+    for(set<MapPoint*>::iterator sit=mspMapPoints.begin(), send=mspMapPoints.end(); sit!=send; sit++)
+    {
+        KeyFrame* pRefKF = (*sit)->GetReferenceKeyFrame();
+        if(pRefKF && pRefKF->mnSubmapId==nSubmapId)
+            vpMPs.push_back(*sit);
+    }
+    return vpMPs;
+}
+
+long unsigned int Map::KeyFramesInSubmap(const long unsigned int nSubmapId)
+{
+    unique_lock<mutex> lock(mMutexMap);
+    long unsigned int n = 0;
+    for(set<KeyFrame*>::iterator sit=mspKeyFrames.begin(), send=mspKeyFrames.end(); sit!=send; sit++)
+        if((*sit)->mnSubmapId==nSubmapId)
+            n++;
+    return n;
+}
+
+void Map::MergeSubmap(const long unsigned int nSubmapId, const long unsigned int nTargetId)
+{
+    unique_lock<mutex> lock(mMutexMap);
+    for(set<KeyFrame*>::iterator sit=mspKeyFrames.begin(), send=mspKeyFrames.end(); sit!=send; sit++)
+        if((*sit)->mnSubmapId==nSubmapId)
+            (*sit)->mnSubmapId = nTargetId;
+    if(mnCurrentSubmapId==nSubmapId)
+        mnCurrentSubmapId = nTargetId;
+}
+
 long unsigned int Map::MapPointsInMap()
 {
     unique_lock<mutex> lock(mMutexMap);
@@ -127,9 +243,15 @@ void Map::clear()
     mspMapPoints.clear();
     mspKeyFrames.clear();
     mnMaxKFid = 0;
+    mnCurrentSubmapId = 0;
     mvpReferenceMapPoints.clear();
     mvpKeyFrameOrigins.clear();
     mObjectMap.clear();
+
+    unique_lock<mutex> lock(mMutexChanges);
+    mvpChangedMapPoints.clear();
+    mvpChangedKeyFrames.clear();
+    mnClearIdx++;
 }
     void Map::CreateLookup(cv::FileStorage& fsSettings)
     {
@@ -158,25 +280,10 @@ void Map::clear()
     }
 
     void Map::showSegResult() {
-        unique_lock<mutex> lock(mMutexObjectMap);
         boost::filesystem::path path{"./results"};
         boost::filesystem::create_directories(path);
         std::string segfile("./results/seg.txt");
-        ofstream segFileOut (segfile,  ios::out|ios::binary);
-        if (segFileOut.is_open())
-        {
-            std::cout << "\x1B[35mPrinting the Hash Maps\x1B[0m" << std::endl;
-            for (auto &x:mObjectMap) {
-                std::cout << "============================" << std::endl;
-                std::cout << "\x1B[36m" << x.first << "\x1B[0m" << ": " << std::endl;
-                segFileOut  << x.first << ": " << std::endl;
-                for (auto &y: x.second) {
-                    std::cout << "    " << "KeyFrame " << y.first << ": " << std::endl;
-                    std::cout << y.second << std::endl;
-                    segFileOut << "    " << "KeyFrame " << y.first << ": " << std::endl;
-                    segFileOut << y.second << std::endl;
-                }
-            }
-        }
+        std::cout << "\x1B[35mSaving " << mObjectMap.ObjectsInMap() << " semantic objects to " << segfile << "\x1B[0m" << std::endl;
+        mObjectMap.Save(segfile);
     }
 } //namespace ORB_SLAM
@@ -23,20 +23,17 @@
 #include "KeyFrame.h"
 #include <pangolin/pangolin.h>
 #include <mutex>
-#include <boost/filesystem.hpp>
+#include <algorithm>
+#include <cmath>
 #include <pcl/point_types.h>
 #include <pcl/point_cloud.h>
-#include <pcl/filters/statistical_outlier_removal.h>
-#include <pcl/filters/voxel_grid.h>
-#include <octomap/octomap.h>
-#include <octomap/ColorOcTree.h>
-#include <pcl/filters/random_sample.h>
 
 namespace ORB_SLAM2 {
 
 MapDrawer::MapDrawer(Map *pMap, const string &strSettingPath) : mpMap(pMap),
                                                                 mCloud(new pcl::PointCloud<pcl::PointXYZ>),
-                                                                mpThreadOctomap(nullptr){
+                                                                mnClearIdx(0), mbBuffersLoaded(false),
+                                                                mbPointsChanged(false), mbGraphChanged(false) {
   cv::FileStorage fSettings(strSettingPath, cv::FileStorage::READ);
 
   mKeyFrameSize = fSettings["Viewer.KeyFrameSize"];
@@ -46,6 +43,13 @@ MapDrawer::MapDrawer(Map *pMap, const string &strSettingPath) : mpMap(pMap),
   mCameraSize = fSettings["Viewer.CameraSize"];
   mCameraLineWidth = fSettings["Viewer.CameraLineWidth"];
   mbCalPointCloud = true;
+
+  mLodDistance = fSettings["Viewer.LodDistance"];
+  if (mLodDistance == 0)
+    mLodDistance = 8.0f;
+  mLodMaxStride = fSettings["Viewer.LodMaxStride"];
+  if (mLodMaxStride < 1)
+    mLodMaxStride = 8;
 }
 
 void MapDrawer::DrawPointCloud() {
@@ -76,11 +80,6 @@ void MapDrawer::DrawPointCloud() {
       unique_lock<mutex> lock(mMutexMCloud);
       mCloud = cloud;
     }
-    if (mpThreadOctomap)
-    {
-      mpThreadOctomap->join();
-    }
-    mpThreadOctomap.reset(new thread(&MapDrawer::BuildOctomap, this, cloud));
     mbCalPointCloud = false;
 
     end = std::chrono::system_clock::now();
@@ -89,13 +88,15 @@ void MapDrawer::DrawPointCloud() {
     std::cout << "Elapsed time: " << elapsed_seconds.count() << "s\n";
   }
 
+  if (mCloud->points.empty())
+    return;
+
   glPointSize(mPointSize);
-  glBegin(GL_POINTS);
   glColor3f(1.0, 0.0, 1.0);
-  for (auto p : mCloud->points) {
-    glVertex3f(p.x, p.y, p.z);
-  }
-  glEnd();
+  glEnableClientState(GL_VERTEX_ARRAY);
+  glVertexPointer(3, GL_FLOAT, sizeof(pcl::PointXYZ), &mCloud->points[0].x);
+  glDrawArrays(GL_POINTS, 0, mCloud->points.size());
+  glDisableClientState(GL_VERTEX_ARRAY);
 }
 
 void MapDrawer::GeneratePointCloud(const vector<KeyFrame *> &vpKFs, pcl::PointCloud<pcl::PointXYZ>::Ptr cloud,
@@ -134,178 +135,257 @@ void MapDrawer::GeneratePointCloud(const vector<KeyFrame *> &vpKFs, pcl::PointCl
   }
 }
 
-void MapDrawer::BuildOctomap(pcl::PointCloud<pcl::PointXYZ>::Ptr cloud) {
-  pcl::PointCloud<pcl::PointXYZ>::Ptr output(new pcl::PointCloud<pcl::PointXYZ>);
-  {
-    unique_lock<mutex> lock(mMutexMCloud);
-    if (cloud->points.size() > 0)
-      FilterPointCloud(cloud, output);
-    else
-      return;
+void MapDrawer::UpdateBuffers() {
+  vector<MapPoint *> vpChangedMPs;
+  vector<KeyFrame *> vpChangedKFs;
+  const int nClearIdx = mpMap->GetChanges(vpChangedMPs, vpChangedKFs);
+
+  if (nClearIdx != mnClearIdx) {
+    // The map was reset, the objects in the buffers are gone
+    ClearBuffers();
+    mnClearIdx = nClearIdx;
   }
-  // Generate octomap
-  octomap::OcTree tree(0.05);
-  for (auto p:output->points) {
-    tree.updateNode(octomap::point3d(p.x, p.y, p.z), true);
+
+  if (!mbBuffersLoaded) {
+    // Changes are recorded from the first GetChanges, load what was there before
+    vpChangedMPs = mpMap->GetAllMapPoints();
+    vpChangedKFs = mpMap->GetAllKeyFrames();
+    mbBuffersLoaded = true;
   }
-  tree.updateInnerOccupancy();
-  boost::filesystem::path path{"./results"};
-  boost::filesystem::create_directories(path);
-  tree.write("./results/octomap_office.ot");
-  return;
+
+  for (size_t i = 0; i < vpChangedMPs.size(); i++)
+    UpdateMapPoint(vpChangedMPs[i]);
+  for (size_t i = 0; i < vpChangedKFs.size(); i++)
+    UpdateKeyFrame(vpChangedKFs[i]);
+
+  if (!vpChangedMPs.empty())
+    mbPointsChanged = true;
+  if (!vpChangedKFs.empty())
+    mbGraphChanged = true;
+}
+
+void MapDrawer::ClearBuffers() {
+  mvPointVertices.clear();
+  mvPointIds.clear();
+  mvpPointSlots.clear();
+  mmPointSlots.clear();
+  mvLodIndices.clear();
+  mvKeyFrameVertices.clear();
+  mvpKeyFrameSlots.clear();
+  mmKeyFrameSlots.clear();
+  mvGraphVertices.clear();
+  mbBuffersLoaded = false;
+  mbPointsChanged = true;
+  mbGraphChanged = true;
 }
 
-void
-MapDrawer::FilterPointCloud(pcl::PointCloud<pcl::PointXYZ>::Ptr cloud, pcl::PointCloud<pcl::PointXYZ>::Ptr output) {
-  pcl::PointCloud<pcl::PointXYZ>::Ptr cloudRandomFilter(new pcl::PointCloud<pcl::PointXYZ>);
-  cout << "Original Cloud Size:" << cloud->points.size() << endl;
-
-  int n_points = cloud->points.size() * 0.25;
-  pcl::RandomSample<pcl::PointXYZ> randomFilter;
-  randomFilter.setSample(n_points);
-  randomFilter.setInputCloud(cloud);
-  randomFilter.filter(*cloudRandomFilter);
-  cout << "Cloud Size After Random Sample Filter:" << cloudRandomFilter->points.size() << endl;
-
-//        // voxel filter
-//        pcl::VoxelGrid<pcl::PointXYZ> voxelFilter;
-//        voxelFilter.setLeafSize(0.03f, 0.03f, 0.03f);       // resolution
-//        voxelFilter.setInputCloud(cloud);
-//        voxelFilter.filter(*cloudVoxel);
-
-  // statistical removal
-  pcl::StatisticalOutlierRemoval<pcl::PointXYZ> sor;
-  sor.setMeanK(50);
-  sor.setStddevMulThresh(1.0);
-  sor.setInputCloud(cloudRandomFilter);
-  sor.filter(*output);
-
-  cout << "Cloud Size After Statistical Filter:" << output->points.size() << endl;
+void MapDrawer::UpdateMapPoint(MapPoint *pMP) {
+  std::unordered_map<MapPoint *, size_t>::iterator it = mmPointSlots.find(pMP);
 
+  if (pMP->isBad()) {
+    if (it == mmPointSlots.end())
+      return;
+    const size_t slot = it->second;
+    const size_t last = mvpPointSlots.size() - 1;
+    if (slot != last) {
+      std::copy(mvPointVertices.begin() + 3 * last, mvPointVertices.end(), mvPointVertices.begin() + 3 * slot);
+      mvPointIds[slot] = mvPointIds[last];
+      mvpPointSlots[slot] = mvpPointSlots[last];
+      mmPointSlots[mvpPointSlots[slot]] = slot;
+    }
+    mvPointVertices.resize(3 * last);
+    mvPointIds.pop_back();
+    mvpPointSlots.pop_back();
+    mmPointSlots.erase(pMP);
+    return;
+  }
+
+  if (it == mmPointSlots.end()) {
+    it = mmPointSlots.insert(std::make_pair(pMP, mvpPointSlots.size())).first;
+    mvpPointSlots.push_back(pMP);
+    mvPointIds.push_back(pMP->mnId);
+    mvPointVertices.resize(mvPointVertices.size() + 3);
+  }
+
+  const cv::Mat pos = pMP->GetWorldPos();
+  float *v = &mvPointVertices[3 * it->second];
+  v[0] = pos.at<float>(0);
+  v[1] = pos.at<float>(1);
+  v[2] = pos.at<float>(2);
 }
 
-void MapDrawer::DrawMapPoints() {
-  const vector<MapPoint *> &vpMPs = mpMap->GetAllMapPoints();
-  const vector<MapPoint *> &vpRefMPs = mpMap->GetReferenceMapPoints();
+void MapDrawer::UpdateKeyFrame(KeyFrame *pKF) {
+  // Camera frustum as 8 lines in the camera frame
+  static const int nFrustumVertices = 16;
+  const float w = mKeyFrameSize;
+  const float h = w * 0.75;
+  const float z = w * 0.6;
+  const float frustum[nFrustumVertices][3] = {
+      {0, 0, 0}, {w, h, z}, {0, 0, 0}, {w, -h, z}, {0, 0, 0}, {-w, -h, z}, {0, 0, 0}, {-w, h, z},
+      {w, h, z}, {w, -h, z}, {-w, h, z}, {-w, -h, z}, {-w, h, z}, {w, h, z}, {-w, -h, z}, {w, -h, z}};
+  const size_t nFloats = 3 * nFrustumVertices;
 
-  set<MapPoint *> spRefMPs(vpRefMPs.begin(), vpRefMPs.end());
+  std::unordered_map<KeyFrame *, size_t>::iterator it = mmKeyFrameSlots.find(pKF);
 
-  if (vpMPs.empty())
+  if (pKF->isBad()) {
+    if (it == mmKeyFrameSlots.end())
+      return;
+    const size_t slot = it->second;
+    const size_t last = mvpKeyFrameSlots.size() - 1;
+    if (slot != last) {
+      std::copy(mvKeyFrameVertices.begin() + nFloats * last, mvKeyFrameVertices.end(),
+                mvKeyFrameVertices.begin() + nFloats * slot);
+      mvpKeyFrameSlots[slot] = mvpKeyFrameSlots[last];
+      mmKeyFrameSlots[mvpKeyFrameSlots[slot]] = slot;
+    }
+    mvKeyFrameVertices.resize(nFloats * last);
+    mvpKeyFrameSlots.pop_back();
+    mmKeyFrameSlots.erase(pKF);
     return;
+  }
 
-  glPointSize(mPointSize);
-  glBegin(GL_POINTS);
-  glColor3f(0.0, 0.0, 0.0);
+  if (it == mmKeyFrameSlots.end()) {
+    it = mmKeyFrameSlots.insert(std::make_pair(pKF, mvpKeyFrameSlots.size())).first;
+    mvpKeyFrameSlots.push_back(pKF);
+    mvKeyFrameVertices.resize(mvKeyFrameVertices.size() + nFloats);
+  }
 
-  for (size_t i = 0, iend = vpMPs.size(); i < iend; i++) {
-    if (vpMPs[i]->isBad() || spRefMPs.count(vpMPs[i]))
-      continue;
-    cv::Mat pos = vpMPs[i]->GetWorldPos();
-    glVertex3f(pos.at<float>(0), pos.at<float>(1), pos.at<float>(2));
+  const cv::Mat Twc = pKF->GetPoseInverse();
+  float *v = &mvKeyFrameVertices[nFloats * it->second];
+  for (int i = 0; i < nFrustumVertices; i++, v += 3) {
+    for (int r = 0; r < 3; r++) {
+      v[r] = Twc.at<float>(r, 0) * frustum[i][0] + Twc.at<float>(r, 1) * frustum[i][1] +
+             Twc.at<float>(r, 2) * frustum[i][2] + Twc.at<float>(r, 3);
+    }
   }
-  glEnd();
+}
 
-  glPointSize(mPointSize);
-  glBegin(GL_POINTS);
-  glColor3f(1.0, 0.0, 0.0);
+void MapDrawer::UpdateGraph() {
+  mvGraphVertices.clear();
+
+  for (size_t i = 0; i < mvpKeyFrameSlots.size(); i++) {
+    KeyFrame *pKF = mvpKeyFrameSlots[i];
+    const cv::Mat Ow = pKF->GetCameraCenter();
+
+    // Covisibility Graph
+    const vector<KeyFrame *> vCovKFs = pKF->GetCovisiblesByWeight(100);
+    for (vector<KeyFrame *>::const_iterator vit = vCovKFs.begin(), vend = vCovKFs.end(); vit != vend; vit++) {
+      if ((*vit)->mnId < pKF->mnId)
+        continue;
+      const cv::Mat Ow2 = (*vit)->GetCameraCenter();
+      mvGraphVertices.insert(mvGraphVertices.end(), Ow.ptr<float>(), Ow.ptr<float>() + 3);
+      mvGraphVertices.insert(mvGraphVertices.end(), Ow2.ptr<float>(), Ow2.ptr<float>() + 3);
+    }
 
-  for (set<MapPoint *>::iterator sit = spRefMPs.begin(), send = spRefMPs.end(); sit != send; sit++) {
-    if ((*sit)->isBad())
-      continue;
-    cv::Mat pos = (*sit)->GetWorldPos();
-    glVertex3f(pos.at<float>(0), pos.at<float>(1), pos.at<float>(2));
+    // Spanning tree
+    KeyFrame *pParent = pKF->GetParent();
+    if (pParent) {
+      const cv::Mat Owp = pParent->GetCameraCenter();
+      mvGraphVertices.insert(mvGraphVertices.end(), Ow.ptr<float>(), Ow.ptr<float>() + 3);
+      mvGraphVertices.insert(mvGraphVertices.end(), Owp.ptr<float>(), Owp.ptr<float>() + 3);
+    }
 
+    // Loops
+    const set<KeyFrame *> sLoopKFs = pKF->GetLoopEdges();
+    for (set<KeyFrame *>::const_iterator sit = sLoopKFs.begin(), send = sLoopKFs.end(); sit != send; sit++) {
+      if ((*sit)->mnId < pKF->mnId)
+        continue;
+      const cv::Mat Owl = (*sit)->GetCameraCenter();
+      mvGraphVertices.insert(mvGraphVertices.end(), Ow.ptr<float>(), Ow.ptr<float>() + 3);
+      mvGraphVertices.insert(mvGraphVertices.end(), Owl.ptr<float>(), Owl.ptr<float>() + 3);
+    }
   }
 
-  glEnd();
+  mbGraphChanged = false;
 }
 
-void MapDrawer::DrawKeyFrames(const bool bDrawKF, const bool bDrawGraph) {
-  const float &w = mKeyFrameSize;
-  const float h = w * 0.75;
-  const float z = w * 0.6;
+void MapDrawer::UpdateLodIndices(const cv::Mat &Ow) {
+  const float cx = Ow.at<float>(0);
+  const float cy = Ow.at<float>(1);
+  const float cz = Ow.at<float>(2);
+  const float invLod = 1.0f / mLodDistance;
+
+  mvLodIndices.clear();
+  mvLodIndices.reserve(mvpPointSlots.size());
+  const float *v = mvPointVertices.data();
+  for (size_t i = 0; i < mvpPointSlots.size(); i++, v += 3) {
+    const float dx = v[0] - cx, dy = v[1] - cy, dz = v[2] - cz;
+    const int stride = std::min(mLodMaxStride, (int) (std::sqrt(dx * dx + dy * dy + dz * dz) * invLod));
+    // Decimate by id so that the kept points do not change while the camera moves
+    if (stride <= 1 || mvPointIds[i] % stride == 0)
+      mvLodIndices.push_back(i);
+  }
 
-  const vector<KeyFrame *> vpKFs = mpMap->GetAllKeyFrames();
+  mLodCenter = Ow.clone();
+  mbPointsChanged = false;
+}
 
-  if (bDrawKF) {
-    for (size_t i = 0; i < vpKFs.size(); i++) {
-      KeyFrame *pKF = vpKFs[i];
-      cv::Mat Twc = pKF->GetPoseInverse().t();
+void MapDrawer::DrawMapPoints() {
+  if (mvpPointSlots.empty())
+    return;
 
-      glPushMatrix();
+  const vector<MapPoint *> vpRefMPs = mpMap->GetReferenceMapPoints();
+  mvReferenceVertices.clear();
+  for (size_t i = 0; i < vpRefMPs.size(); i++) {
+    if (vpRefMPs[i]->isBad())
+      continue;
+    const cv::Mat pos = vpRefMPs[i]->GetWorldPos();
+    mvReferenceVertices.insert(mvReferenceVertices.end(), pos.ptr<float>(), pos.ptr<float>() + 3);
+  }
 
-      glMultMatrixf(Twc.ptr<GLfloat>(0));
+  glPointSize(mPointSize);
+  glEnableClientState(GL_VERTEX_ARRAY);
 
-      glLineWidth(mKeyFrameLineWidth);
-      glColor3f(0.0f, 0.0f, 1.0f);
-      glBegin(GL_LINES);
-      glVertex3f(0, 0, 0);
-      glVertex3f(w, h, z);
-      glVertex3f(0, 0, 0);
-      glVertex3f(w, -h, z);
-      glVertex3f(0, 0, 0);
-      glVertex3f(-w, -h, z);
-      glVertex3f(0, 0, 0);
-      glVertex3f(-w, h, z);
+  // Reference points first: the same points of the black layer then fail the depth test
+  if (!mvReferenceVertices.empty()) {
+    glColor3f(1.0, 0.0, 0.0);
+    glVertexPointer(3, GL_FLOAT, 0, mvReferenceVertices.data());
+    glDrawArrays(GL_POINTS, 0, mvReferenceVertices.size() / 3);
+  }
+
+  glColor3f(0.0, 0.0, 0.0);
+  glVertexPointer(3, GL_FLOAT, 0, mvPointVertices.data());
 
-      glVertex3f(w, h, z);
-      glVertex3f(w, -h, z);
+  cv::Mat Ow;
+  if (mLodDistance > 0) {
+    unique_lock<mutex> lock(mMutexCamera);
+    if (!mCameraPose.empty())
+      Ow = -mCameraPose.rowRange(0, 3).colRange(0, 3).t() * mCameraPose.rowRange(0, 3).col(3);
+  }
 
-      glVertex3f(-w, h, z);
-      glVertex3f(-w, -h, z);
+  if (Ow.empty()) {
+    glDrawArrays(GL_POINTS, 0, mvpPointSlots.size());
+  } else {
+    if (mbPointsChanged || mLodCenter.empty() || cv::norm(Ow - mLodCenter) > 0.25f * mLodDistance)
+      UpdateLodIndices(Ow);
+    glDrawElements(GL_POINTS, mvLodIndices.size(), GL_UNSIGNED_INT, mvLodIndices.data());
+  }
 
-      glVertex3f(-w, h, z);
-      glVertex3f(w, h, z);
+  glDisableClientState(GL_VERTEX_ARRAY);
+}
 
-      glVertex3f(-w, -h, z);
-      glVertex3f(w, -h, z);
-      glEnd();
+void MapDrawer::DrawKeyFrames(const bool bDrawKF, const bool bDrawGraph) {
+  glEnableClientState(GL_VERTEX_ARRAY);
 
-      glPopMatrix();
-    }
+  if (bDrawKF && !mvKeyFrameVertices.empty()) {
+    glLineWidth(mKeyFrameLineWidth);
+    glColor3f(0.0f, 0.0f, 1.0f);
+    glVertexPointer(3, GL_FLOAT, 0, mvKeyFrameVertices.data());
+    glDrawArrays(GL_LINES, 0, mvKeyFrameVertices.size() / 3);
   }
 
   if (bDrawGraph) {
-    glLineWidth(mGraphLineWidth);
-    glColor4f(0.0f, 1.0f, 0.0f, 0.6f);
-    glBegin(GL_LINES);
-
-    for (size_t i = 0; i < vpKFs.size(); i++) {
-      // Covisibility Graph
-      const vector<KeyFrame *> vCovKFs = vpKFs[i]->GetCovisiblesByWeight(100);
-      cv::Mat Ow = vpKFs[i]->GetCameraCenter();
-      if (!vCovKFs.empty()) {
-        for (vector<KeyFrame *>::const_iterator vit = vCovKFs.begin(), vend = vCovKFs.end();
-             vit != vend; vit++) {
-          if ((*vit)->mnId < vpKFs[i]->mnId)
-            continue;
-          cv::Mat Ow2 = (*vit)->GetCameraCenter();
-          glVertex3f(Ow.at<float>(0), Ow.at<float>(1), Ow.at<float>(2));
-          glVertex3f(Ow2.at<float>(0), Ow2.at<float>(1), Ow2.at<float>(2));
-        }
-      }
-
-      // Spanning tree
-      KeyFrame *pParent = vpKFs[i]->GetParent();
-      if (pParent) {
-        cv::Mat Owp = pParent->GetCameraCenter();
-        glVertex3f(Ow.at<float>(0), Ow.at<float>(1), Ow.at<float>(2));
-        glVertex3f(Owp.at<float>(0), Owp.at<float>(1), Owp.at<float>(2));
-      }
-
-      // Loops
-      set<KeyFrame *> sLoopKFs = vpKFs[i]->GetLoopEdges();
-      for (set<KeyFrame *>::iterator sit = sLoopKFs.begin(), send = sLoopKFs.end(); sit != send; sit++) {
-        if ((*sit)->mnId < vpKFs[i]->mnId)
-          continue;
-        cv::Mat Owl = (*sit)->GetCameraCenter();
-        glVertex3f(Ow.at<float>(0), Ow.at<float>(1), Ow.at<float>(2));
-        glVertex3f(Owl.at<float>(0), Owl.at<float>(1), Owl.at<float>(2));
-      }
+    if (mbGraphChanged)
+      UpdateGraph();
+    if (!mvGraphVertices.empty()) {
+      glLineWidth(mGraphLineWidth);
+      glColor4f(0.0f, 1.0f, 0.0f, 0.6f);
+      glVertexPointer(3, GL_FLOAT, 0, mvGraphVertices.data());
+      glDrawArrays(GL_LINES, 0, mvGraphVertices.size() / 3);
     }
-
-    glEnd();
   }
+
+  glDisableClientState(GL_VERTEX_ARRAY);
 }
 
 void MapDrawer::DrawCurrentCamera(pangolin::OpenGlMatrix &Twc) {
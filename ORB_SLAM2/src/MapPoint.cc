@@ -37,6 +37,7 @@ MapPoint::MapPoint(const cv::Mat &Pos, KeyFrame *pRefKF, Map* pMap):
 {
     Pos.copyTo(mWorldPos);
     mNormalVector = cv::Mat::zeros(3,1,CV_32F);
+    mObservations.reserve(8);
 
     // MapPoints can be created from Tracking and Local Mapping. This mutex avoid conflicts with id.
     unique_lock<mutex> lock(mpMap->mMutexPointCreation);
@@ -50,6 +51,7 @@ MapPoint::MapPoint(const cv::Mat &Pos, Map* pMap, Frame* pFrame, const int &idxF
     mnFound(1), mbBad(false), mpReplaced(NULL), mpMap(pMap)
 {
     Pos.copyTo(mWorldPos);
+    mObservations.reserve(8);
     cv::Mat Ow = pFrame->GetCameraCenter();
     mNormalVector = mWorldPos - Ow;
     mNormalVector = mNormalVector/cv::norm(mNormalVector);
@@ -72,9 +74,12 @@ MapPoint::MapPoint(const cv::Mat &Pos, Map* pMap, Frame* pFrame, const int &idxF
 
 void MapPoint::SetWorldPos(const cv::Mat &Pos)
 {
-    unique_lock<mutex> lock2(mGlobalMutex);
-    unique_lock<mutex> lock(mMutexPos);
-    Pos.copyTo(mWorldPos);
+    {
+        unique_lock<mutex> lock2(mGlobalMutex);
+        unique_lock<mutex> lock(mMutexPos);
+        Pos.copyTo(mWorldPos);
+    }
+    mpMap->InformMapPointChanged(this);
 }
 
 cv::Mat MapPoint::GetWorldPos()
@@ -95,12 +100,20 @@ KeyFrame* MapPoint::GetReferenceKeyFrame()
     return mpRefKF;
 }
 
+int MapPoint::FindObservation(KeyFrame* pKF) const
+{
+    for(size_t i=0, iend=mObservations.size(); i<iend; i++)
+        if(mObservations[i].first==pKF)
+            return i;
+    return -1;
+}
+
 void MapPoint::AddObservation(KeyFrame* pKF, size_t idx)
 {
     unique_lock<mutex> lock(mMutexFeatures);
-    if(mObservations.count(pKF))
+    if(FindObservation(pKF)>=0)
         return;
-    mObservations[pKF]=idx;
+    mObservations.push_back(make_pair(pKF,idx));
 
     if(pKF->mvuRight[idx]>=0)
         nObs+=2;
@@ -113,18 +126,19 @@ void MapPoint::EraseObservation(KeyFrame* pKF)
     bool bBad=false;
     {
         unique_lock<mutex> lock(mMutexFeatures);
-        if(mObservations.count(pKF))
+        const int pos = FindObservation(pKF);
+        if(pos>=0)
         {
-            int idx = mObservations[pKF];
+            const size_t idx = mObservations[pos].second;
             if(pKF->mvuRight[idx]>=0)
                 nObs-=2;
             else
                 nObs--;
 
-            mObservations.erase(pKF);
+            mObservations.erase(mObservations.begin()+pos);
 
-            if(mpRefKF==pKF)
-                mpRefKF=mObservations.begin()->first;
+            if(mpRefKF==pKF && !mObservations.empty())
+                mpRefKF=mObservations.front().first;
 
             // If only 2 observations or less, discard point
             if(nObs<=2)
@@ -136,7 +150,7 @@ void MapPoint::EraseObservation(KeyFrame* pKF)
         SetBadFlag();
 }
 
-map<KeyFrame*, size_t> MapPoint::GetObservations()
+MapPoint::ObsVector MapPoint::GetObservations()
 {
     unique_lock<mutex> lock(mMutexFeatures);
     return mObservations;
@@ -150,15 +164,14 @@ int MapPoint::Observations()
 
 void MapPoint::SetBadFlag()
 {
-    map<KeyFrame*,size_t> obs;
+    ObsVector obs;
     {
         unique_lock<mutex> lock1(mMutexFeatures);
         unique_lock<mutex> lock2(mMutexPos);
         mbBad=true;
-        obs = mObservations;
-        mObservations.clear();
+        obs.swap(mObservations);
     }
-    for(map<KeyFrame*,size_t>::iterator mit=obs.begin(), mend=obs.end(); mit!=mend; mit++)
+    for(ObsVector::iterator mit=obs.begin(), mend=obs.end(); mit!=mend; mit++)
     {
         KeyFrame* pKF = mit->first;
         pKF->EraseMapPointMatch(mit->second);
@@ -180,19 +193,18 @@ void MapPoint::Replace(MapPoint* pMP)
         return;
 
     int nvisible, nfound;
-    map<KeyFrame*,size_t> obs;
+    ObsVector obs;
     {
         unique_lock<mutex> lock1(mMutexFeatures);
         unique_lock<mutex> lock2(mMutexPos);
-        obs=mObservations;
-        mObservations.clear();
+        obs.swap(mObservations);
         mbBad=true;
         nvisible = mnVisible;
         nfound = mnFound;
         mpReplaced = pMP;
     }
 
-    for(map<KeyFrame*,size_t>::iterator mit=obs.begin(), mend=obs.end(); mit!=mend; mit++)
+    for(ObsVector::iterator mit=obs.begin(), mend=obs.end(); mit!=mend; mit++)
     {
         // Replace measurement in keyframe
         KeyFrame* pKF = mit->first;
@@ -244,7 +256,7 @@ void MapPoint::ComputeDistinctiveDescriptors()
     // Retrieve all observed descriptors
     vector<cv::Mat> vDescriptors;
 
-    map<KeyFrame*,size_t> observations;
+    ObsVector observations;
 
     {
         unique_lock<mutex> lock1(mMutexFeatures);
@@ -258,7 +270,7 @@ void MapPoint::ComputeDistinctiveDescriptors()
 
     vDescriptors.reserve(observations.size());
 
-    for(map<KeyFrame*,size_t>::iterator mit=observations.begin(), mend=observations.end(); mit!=mend; mit++)
+    for(ObsVector::iterator mit=observations.begin(), mend=observations.end(); mit!=mend; mit++)
     {
         KeyFrame* pKF = mit->first;
 
@@ -315,8 +327,9 @@ cv::Mat MapPoint::GetDescriptor()
 int MapPoint::GetIndexInKeyFrame(KeyFrame *pKF)
 {
     unique_lock<mutex> lock(mMutexFeatures);
-    if(mObservations.count(pKF))
-        return mObservations[pKF];
+    const int pos = FindObservation(pKF);
+    if(pos>=0)
+        return mObservations[pos].second;
     else
         return -1;
 }
@@ -324,13 +337,14 @@ int MapPoint::GetIndexInKeyFrame(KeyFrame *pKF)
 bool MapPoint::IsInKeyFrame(KeyFrame *pKF)
 {
     unique_lock<mutex> lock(mMutexFeatures);
-    return (mObservations.count(pKF));
+    return FindObservation(pKF)>=0;
 }
 
 void MapPoint::UpdateNormalAndDepth()
 {
-    map<KeyFrame*,size_t> observations;
+    ObsVector observations;
     KeyFrame* pRefKF;
+    size_t idxRef = 0;
     cv::Mat Pos;
     {
         unique_lock<mutex> lock1(mMutexFeatures);
@@ -339,6 +353,10 @@ void MapPoint::UpdateNormalAndDepth()
             return;
         observations=mObservations;
         pRefKF=mpRefKF;
+        const int pos = FindObservation(pRefKF);
+        if(pos<0)
+            return;
+        idxRef = mObservations[pos].second;
         Pos = mWorldPos.clone();
     }
 
@@ -347,7 +365,7 @@ void MapPoint::UpdateNormalAndDepth()
 
     cv::Mat normal = cv::Mat::zeros(3,1,CV_32F);
     int n=0;
-    for(map<KeyFrame*,size_t>::iterator mit=observations.begin(), mend=observations.end(); mit!=mend; mit++)
+    for(ObsVector::iterator mit=observations.begin(), mend=observations.end(); mit!=mend; mit++)
     {
         KeyFrame* pKF = mit->first;
         cv::Mat Owi = pKF->GetCameraCenter();
@@ -358,7 +376,7 @@ void MapPoint::UpdateNormalAndDepth()
 
     cv::Mat PC = Pos - pRefKF->GetCameraCenter();
     const float dist = cv::norm(PC);
-    const int level = pRefKF->mvKeysUn[observations[pRefKF]].octave;
+    const int level = pRefKF->mvKeysUn[idxRef].octave;
     const float levelScaleFactor =  pRefKF->mvScaleFactors[level];
     const int nLevels = pRefKF->mnScaleLevels;
 
@@ -59,6 +59,7 @@
 #include <opencv2/features2d/features2d.hpp>
 #include <opencv2/imgproc/imgproc.hpp>
 #include <vector>
+#include <cstring>
 
 #include "ORBextractor.h"
 
@@ -767,6 +768,7 @@ void ORBextractor::ComputeKeyPointsOctTree(vector<vector<KeyPoint> >& allKeypoin
     allKeypoints.resize(nlevels);
 
     const float W = 30;
+    const bool bMask = !mvMaskPyramid.empty();
 
     for (int level = 0; level < nlevels; ++level)
     {
@@ -805,6 +807,15 @@ void ORBextractor::ComputeKeyPointsOctTree(vector<vector<KeyPoint> >& allKeypoin
                 if(maxX>maxBorderX)
                     maxX = maxBorderX;
 
+                // Cells fully covered by the mask are not searched
+                cv::Mat cellMask;
+                if(bMask)
+                {
+                    cellMask = mvMaskPyramid[level].rowRange(iniY,maxY).colRange(iniX,maxX);
+                    if(cv::countNonZero(cellMask)==0)
+                        continue;
+                }
+
                 vector<cv::KeyPoint> vKeysCell;
                 FAST(mvImagePyramid[level].rowRange(iniY,maxY).colRange(iniX,maxX),
                      vKeysCell,iniThFAST,true);
@@ -819,6 +830,8 @@ void ORBextractor::ComputeKeyPointsOctTree(vector<vector<KeyPoint> >& allKeypoin
                 {
                     for(vector<cv::KeyPoint>::iterator vit=vKeysCell.begin(); vit!=vKeysCell.end();vit++)
                     {
+                        if(bMask && !cellMask.at<uchar>(cvRound((*vit).pt.y),cvRound((*vit).pt.x)))
+                            continue;
                         (*vit).pt.x+=j*wCell;
                         (*vit).pt.y+=i*hCell;
                         vToDistributeKeys.push_back(*vit);
@@ -1051,6 +1064,7 @@ void ORBextractor::operator()( InputArray _image, InputArray _mask, vector<KeyPo
 
     // Pre-compute the scale pyramid
     ComputePyramid(image);
+    ComputeMaskPyramid(_mask.getMat());
 
     vector < vector<KeyPoint> > allKeypoints;
     ComputeKeyPointsOctTree(allKeypoints);
@@ -1104,6 +1118,46 @@ void ORBextractor::operator()( InputArray _image, InputArray _mask, vector<KeyPo
     }
 }
 
+void ORBextractor::ComputeMaskPyramid(const cv::Mat &mask)
+{
+    mvMaskPyramid.clear();
+    if(mask.empty())
+        return;
+
+    assert(mask.type() == CV_8UC1 && mask.size() == mvImagePyramid[0].size());
+    mvMaskPyramid.resize(nlevels);
+    mvMaskPyramid[0] = mask;
+    for (int level = 1; level < nlevels; ++level)
+        resize(mask, mvMaskPyramid[level], mvImagePyramid[level].size(), 0, 0, INTER_NEAREST);
+}
+
+cv::Mat ORBextractor::CreateInputImage(const cv::Size &size)
+{
+    Mat temp(size.height + EDGE_THRESHOLD*2, size.width + EDGE_THRESHOLD*2, CV_8U);
+    return temp(Rect(EDGE_THRESHOLD, EDGE_THRESHOLD, size.width, size.height));
+}
+
+// Fills the border of an image in place, as copyMakeBorder with BORDER_REFLECT_101
+static void FillBorder(Mat &whole, const int border)
+{
+    const int w = whole.cols - 2*border;
+    const int h = whole.rows - 2*border;
+    for(int y=border; y<border+h; y++)
+    {
+        uchar* row = whole.ptr<uchar>(y);
+        for(int i=1; i<=border; i++)
+        {
+            row[border-i] = row[border+i];
+            row[border+w-1+i] = row[border+w-1-i];
+        }
+    }
+    for(int i=1; i<=border; i++)
+    {
+        memcpy(whole.ptr<uchar>(border-i), whole.ptr<uchar>(border+i), whole.cols);
+        memcpy(whole.ptr<uchar>(border+h-1+i), whole.ptr<uchar>(border+h-1-i), whole.cols);
+    }
+}
+
 void ORBextractor::ComputePyramid(cv::Mat image)
 {
     for (int level = 0; level < nlevels; ++level)
@@ -1111,6 +1165,23 @@ void ORBextractor::ComputePyramid(cv::Mat image)
         float scale = mvInvScaleFactor[level];
         Size sz(cvRound((float)image.cols*scale), cvRound((float)image.rows*scale));
         Size wholeSize(sz.width + EDGE_THRESHOLD*2, sz.height + EDGE_THRESHOLD*2);
+
+        if(level == 0)
+        {
+            // The image is in a buffer from CreateInputImage, only the border is missing
+            Size imageWholeSize;
+            Point imageOfs;
+            image.locateROI(imageWholeSize, imageOfs);
+            if(imageWholeSize == wholeSize && imageOfs == Point(EDGE_THRESHOLD, EDGE_THRESHOLD))
+            {
+                mvImagePyramid[0] = image;
+                Mat whole = image;
+                whole.adjustROI(EDGE_THRESHOLD, EDGE_THRESHOLD, EDGE_THRESHOLD, EDGE_THRESHOLD);
+                FillBorder(whole, EDGE_THRESHOLD);
+                continue;
+            }
+        }
+
         Mat temp(wholeSize, image.type()), masktemp;
         mvImagePyramid[level] = temp(Rect(EDGE_THRESHOLD, EDGE_THRESHOLD, sz.width, sz.height));
 
@@ -0,0 +1,482 @@
+/**
+* This file is part of ORB-SLAM2.
+*
+* Copyright (C) 2014-2016 Raúl Mur-Artal <raulmur at unizar dot es> (University of Zaragoza)
+* For more information see <https://github.com/raulmur/ORB_SLAM2>
+*
+* ORB-SLAM2 is free software: you can redistribute it and/or modify
+* it under the terms of the GNU General Public License as published by
+* the Free Software Foundation, either version 3 of the License, or
+* (at your option) any later version.
+*
+* ORB-SLAM2 is distributed in the hope that it will be useful,
+* but WITHOUT ANY WARRANTY; without even the implied warranty of
+* MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+* GNU General Public License for more details.
+*
+* You should have received a copy of the GNU General Public License
+* along with ORB-SLAM2. If not, see <http://www.gnu.org/licenses/>.
+*/
+
+
+#include "ObjectMap.h"
+#include "Map.h"
+#include "KeyFrame.h"
+#include "Converter.h"
+
+#include <algorithm>
+#include <fstream>
+#include <iomanip>
+#include <limits>
+#include <cmath>
+#include <cstdlib>
+
+namespace ORB_SLAM2
+{
+
+// Classes with fewer objects than this are scanned instead of searched in the grid
+const size_t OBJECTS_GRID_SEARCH_MIN = 32;
+
+// Keep in vBest (max-heap on distance) the k closest candidates
+static void OfferCandidate(vector<pair<double,size_t> > &vBest, const size_t k, const double dist, const size_t idx)
+{
+    if(vBest.size()<k)
+    {
+        vBest.push_back(make_pair(dist,idx));
+        push_heap(vBest.begin(),vBest.end());
+    }
+    else if(dist<vBest.front().first)
+    {
+        pop_heap(vBest.begin(),vBest.end());
+        vBest.back() = make_pair(dist,idx);
+        push_heap(vBest.begin(),vBest.end());
+    }
+}
+
+ObjectMap::ObjectMap(Map* pMap, cv::FileStorage &fsSettings):mpMap(pMap)
+{
+    float fuseRadius = fsSettings["ObjectMap.FuseRadius"];
+    float voxelSize = fsSettings["ObjectMap.VoxelSize"];
+    mfFuseRadius = fuseRadius>0 ? fuseRadius : 0.5;
+    mfVoxelSize = voxelSize>0 ? voxelSize : 1.0;
+}
+
+void ObjectMap::AddDetections(KeyFrame* pKF, const string &className, const vector<Eigen::Vector3d> &vPc)
+{
+    if(vPc.empty())
+        return;
+
+    const cv::Mat Twc = pKF->GetPoseInverse();
+    const Eigen::Matrix3d Rwc = Converter::toMatrix3d(Twc.rowRange(0,3).colRange(0,3));
+    const Eigen::Vector3d twc = Converter::toVector3d(Twc.rowRange(0,3).col(3));
+
+    unique_lock<mutex> lock(mMutexObjectMap);
+
+    UpdateIfPosesChanged();
+
+    unordered_map<string,ClassIndex>::iterator cit = mClasses.find(className);
+    if(cit==mClasses.end())
+    {
+        ClassIndex index;
+        for(int a=0; a<3; a++)
+        {
+            index.minVoxel[a] = numeric_limits<int>::max();
+            index.maxVoxel[a] = numeric_limits<int>::min();
+        }
+        cit = mClasses.insert(make_pair(className,index)).first;
+    }
+    ClassIndex &index = cit->second;
+
+    vector<pair<double,size_t> > vNear;
+
+    for(size_t i=0; i<vPc.size(); i++)
+    {
+        Observation obs;
+        obs.pKF = pKF;
+        obs.Pc = vPc[i];
+
+        const Eigen::Vector3d Pw = Rwc*vPc[i]+twc;
+
+        // Fuse with the closest object of the same class not already seen in this keyframe
+        vNear.clear();
+        Search(index,Pw,numeric_limits<size_t>::max(),mfFuseRadius,pKF->mnSubmapId,vNear);
+        sort_heap(vNear.begin(),vNear.end());
+
+        size_t bestIdx = mvLandmarks.size();
+        for(size_t j=0; j<vNear.size() && bestIdx==mvLandmarks.size(); j++)
+        {
+            const vector<Observation> &vObs = mvLandmarks[vNear[j].second].mvObservations;
+            bool bSeen = false;
+            for(size_t o=0; o<vObs.size(); o++)
+            {
+                if(vObs[o].pKF==pKF)
+                {
+                    bSeen = true;
+                    break;
+                }
+            }
+            if(!bSeen)
+                bestIdx = vNear[j].second;
+        }
+
+        if(bestIdx<mvLandmarks.size())
+        {
+            Landmark &landmark = mvLandmarks[bestIdx];
+            landmark.mvObservations.push_back(obs);
+            landmark.mPw = ComputeWorldPos(landmark);
+            EraseFromIndex(index,bestIdx);
+            InsertInIndex(index,bestIdx);
+            mmKeyFrameObjects[pKF].push_back(bestIdx);
+        }
+        else
+        {
+            Landmark landmark;
+            landmark.mClassName = className;
+            landmark.mvObservations.push_back(obs);
+            landmark.mPw = Pw;
+            mvLandmarks.push_back(landmark);
+            index.vLandmarks.push_back(mvLandmarks.size()-1);
+            InsertInIndex(index,mvLandmarks.size()-1);
+            mmKeyFrameObjects[pKF].push_back(mvLandmarks.size()-1);
+        }
+    }
+}
+
+vector<SemanticObject> ObjectMap::GetObjects(const string &className)
+{
+    unique_lock<mutex> lock(mMutexObjectMap);
+
+    UpdateIfPosesChanged();
+
+    vector<SemanticObject> vObjects;
+
+    if(className.empty())
+    {
+        vObjects.reserve(mvLandmarks.size());
+        for(size_t i=0; i<mvLandmarks.size(); i++)
+            vObjects.push_back(MakeObject(i,0));
+    }
+    else
+    {
+        unordered_map<string,ClassIndex>::const_iterator cit = mClasses.find(className);
+        if(cit!=mClasses.end())
+        {
+            const vector<size_t> &vIndices = cit->second.vLandmarks;
+            vObjects.reserve(vIndices.size());
+            for(size_t i=0; i<vIndices.size(); i++)
+                vObjects.push_back(MakeObject(vIndices[i],0));
+        }
+    }
+
+    return vObjects;
+}
+
+vector<SemanticObject> ObjectMap::SearchRadius(const Eigen::Vector3d &Pw, const double radius, const string &className)
+{
+    return Query(Pw,numeric_limits<size_t>::max(),radius,className);
+}
+
+vector<SemanticObject> ObjectMap::SearchKNN(const Eigen::Vector3d &Pw, const size_t k, const string &className)
+{
+    return Query(Pw,k,numeric_limits<double>::infinity(),className);
+}
+
+bool ObjectMap::SearchNearest(const Eigen::Vector3d &Pw, const string &className, SemanticObject &object)
+{
+    vector<SemanticObject> vObjects = Query(Pw,1,numeric_limits<double>::infinity(),className);
+    if(vObjects.empty())
+        return false;
+
+    object = vObjects[0];
+    return true;
+}
+
+vector<SemanticObject> ObjectMap::Query(const Eigen::Vector3d &Pw, const size_t k, const double maxDist, const string &className)
+{
+    unique_lock<mutex> lock(mMutexObjectMap);
+
+    UpdateIfPosesChanged();
+
+    vector<pair<double,size_t> > vBest;
+    const long unsigned int nSubmapId = mpMap->GetCurrentSubmapId();
+
+    if(className.empty())
+    {
+        for(unordered_map<string,ClassIndex>::const_iterator cit=mClasses.begin(); cit!=mClasses.end(); cit++)
+            Search(cit->second,Pw,k,maxDist,nSubmapId,vBest);
+    }
+    else
+    {
+        unordered_map<string,ClassIndex>::const_iterator cit = mClasses.find(className);
+        if(cit!=mClasses.end())
+            Search(cit->second,Pw,k,maxDist,nSubmapId,vBest);
+    }
+
+    sort_heap(vBest.begin(),vBest.end());
+
+    vector<SemanticObject> vObjects;
+    vObjects.reserve(vBest.size());
+    for(size_t i=0; i<vBest.size(); i++)
+        vObjects.push_back(MakeObject(vBest[i].second,vBest[i].first));
+
+    return vObjects;
+}
+
+size_t ObjectMap::ObjectsInMap()
+{
+    unique_lock<mutex> lock(mMutexObjectMap);
+    return mvLandmarks.size();
+}
+
+void ObjectMap::Save(const string &filename)
+{
+    unique_lock<mutex> lock(mMutexObjectMap);
+
+    UpdateIfPosesChanged();
+
+    ofstream f;
+    f.open(filename.c_str());
+    f << fixed;
+
+    for(unordered_map<string,ClassIndex>::const_iterator cit=mClasses.begin(); cit!=mClasses.end(); cit++)
+    {
+        f << cit->first << ": " << endl;
+        const vector<size_t> &vIndices = cit->second.vLandmarks;
+        for(size_t i=0; i<vIndices.size(); i++)
+        {
+            const Landmark &landmark = mvLandmarks[vIndices[i]];
+            f << "    Object " << vIndices[i] << ": " << setprecision(3)
+              << "[" << landmark.mPw[0] << " " << landmark.mPw[1] << " " << landmark.mPw[2] << "]"
+              << " Map: " << SubmapOf(landmark) << " KeyFrames:";
+            for(size_t o=0; o<landmark.mvObservations.size(); o++)
+                f << " " << landmark.mvObservations[o].pKF->mnId;
+            f << endl;
+        }
+    }
+
+    f.close();
+}
+
+void ObjectMap::clear()
+{
+    unique_lock<mutex> lock(mMutexObjectMap);
+    mvLandmarks.clear();
+    mClasses.clear();
+    mmKeyFrameObjects.clear();
+
+    unique_lock<mutex> lockMoved(mMutexMoved);
+    msMovedKeyFrames.clear();
+}
+
+void ObjectMap::InformKeyFrameMoved(KeyFrame* pKF)
+{
+    unique_lock<mutex> lock(mMutexMoved);
+    msMovedKeyFrames.insert(pKF);
+}
+
+void ObjectMap::UpdateIfPosesChanged()
+{
+    unordered_set<KeyFrame*> sMoved;
+    {
+        unique_lock<mutex> lock(mMutexMoved);
+        sMoved.swap(msMovedKeyFrames);
+    }
+
+    // Objects seen by the moved keyframes, each once
+    vector<size_t> vUpdate;
+    for(unordered_set<KeyFrame*>::const_iterator it=sMoved.begin(); it!=sMoved.end(); it++)
+    {
+        unordered_map<KeyFrame*, vector<size_t> >::const_iterator kit = mmKeyFrameObjects.find(*it);
+        if(kit!=mmKeyFrameObjects.end())
+            vUpdate.insert(vUpdate.end(),kit->second.begin(),kit->second.end());
+    }
+    if(vUpdate.empty())
+        return;
+
+    sort(vUpdate.begin(),vUpdate.end());
+    vUpdate.erase(unique(vUpdate.begin(),vUpdate.end()),vUpdate.end());
+
+    // After a loop closure most objects move, rebuild so that the voxel bounds are tight again
+    if(2*vUpdate.size()>mvLandmarks.size())
+    {
+        Rebuild();
+        return;
+    }
+
+    for(size_t i=0; i<vUpdate.size(); i++)
+    {
+        Landmark &landmark = mvLandmarks[vUpdate[i]];
+        ClassIndex &index = mClasses[landmark.mClassName];
+        EraseFromIndex(index,vUpdate[i]);
+        landmark.mPw = ComputeWorldPos(landmark);
+        InsertInIndex(index,vUpdate[i]);
+    }
+}
+
+void ObjectMap::Rebuild()
+{
+    for(unordered_map<string,ClassIndex>::iterator cit=mClasses.begin(); cit!=mClasses.end(); cit++)
+    {
+        ClassIndex &index = cit->second;
+        index.mGrid.clear();
+        for(int a=0; a<3; a++)
+        {
+            index.minVoxel[a] = numeric_limits<int>::max();
+            index.maxVoxel[a] = numeric_limits<int>::min();
+        }
+
+        for(size_t i=0; i<index.vLandmarks.size(); i++)
+        {
+            Landmark &landmark = mvLandmarks[index.vLandmarks[i]];
+            landmark.mPw = ComputeWorldPos(landmark);
+            InsertInIndex(index,index.vLandmarks[i]);
+        }
+    }
+}
+
+Eigen::Vector3d ObjectMap::ComputeWorldPos(const Landmark &landmark) const
+{
+    Eigen::Vector3d Pw = Eigen::Vector3d::Zero();
+
+    for(size_t i=0; i<landmark.mvObservations.size(); i++)
+    {
+        const Observation &obs = landmark.mvObservations[i];
+        const cv::Mat Twc = obs.pKF->GetPoseInverse();
+        Pw += Converter::toMatrix3d(Twc.rowRange(0,3).colRange(0,3))*obs.Pc + Converter::toVector3d(Twc.rowRange(0,3).col(3));
+    }
+
+    return Pw/landmark.mvObservations.size();
+}
+
+void ObjectMap::InsertInIndex(ClassIndex &index, const size_t idx)
+{
+    Landmark &landmark = mvLandmarks[idx];
+
+    int c[3];
+    VoxelCoords(landmark.mPw,c);
+    for(int a=0; a<3; a++)
+    {
+        index.minVoxel[a] = min(index.minVoxel[a],c[a]);
+        index.maxVoxel[a] = max(index.maxVoxel[a],c[a]);
+    }
+
+    landmark.mnVoxel = VoxelKey(c[0],c[1],c[2]);
+    index.mGrid[landmark.mnVoxel].push_back(idx);
+}
+
+void ObjectMap::EraseFromIndex(ClassIndex &index, const size_t idx)
+{
+    unordered_map<long long, vector<size_t> >::iterator it = index.mGrid.find(mvLandmarks[idx].mnVoxel);
+    if(it==index.mGrid.end())
+        return;
+
+    vector<size_t> &vCell = it->second;
+    for(size_t i=0; i<vCell.size(); i++)
+    {
+        if(vCell[i]==idx)
+        {
+            vCell[i] = vCell.back();
+            vCell.pop_back();
+            break;
+        }
+    }
+
+    if(vCell.empty())
+        index.mGrid.erase(it);
+}
+
+void ObjectMap::Search(const ClassIndex &index, const Eigen::Vector3d &Pw, const size_t k, const double maxDist,
+                       const long unsigned int nSubmapId, vector<pair<double,size_t> > &vBest) const
+{
+    if(k==0 || index.vLandmarks.empty())
+        return;
+
+    if(index.vLandmarks.size()<OBJECTS_GRID_SEARCH_MIN)
+    {
+        for(size_t i=0; i<index.vLandmarks.size(); i++)
+        {
+            const size_t idx = index.vLandmarks[i];
+            const double dist = (mvLandmarks[idx].mPw-Pw).norm();
+            if(dist<=maxDist && SubmapOf(mvLandmarks[idx])==nSubmapId)
+                OfferCandidate(vBest,k,dist,idx);
+        }
+        return;
+    }
+
+    // Visit the grid in rings of growing Chebyshev distance around the voxel of Pw,
+    // up to the bounds of the class or the voxels that can hold a point within maxDist
+    int c[3];
+    VoxelCoords(Pw,c);
+
+    long long maxRing = 0;
+    for(int a=0; a<3; a++)
+        maxRing = max(maxRing,max(llabs((long long)index.minVoxel[a]-c[a]),llabs((long long)index.maxVoxel[a]-c[a])));
+    if(maxDist<numeric_limits<double>::infinity())
+        maxRing = min(maxRing,(long long)ceil(maxDist/mfVoxelSize));
+
+    for(int r=0; r<=maxRing; r++)
+    {
+        // Landmarks out of the rings visited so far are farther than (r-1) voxels
+        if(vBest.size()>=k && vBest.front().first<=(r-1)*mfVoxelSize)
+            break;
+
+        for(int dx=-r; dx<=r; dx++)
+        {
+            for(int dy=-r; dy<=r; dy++)
+            {
+                // Inside the ring only the two faces along z are visited
+                const bool bSide = abs(dx)==r || abs(dy)==r;
+                const int stepz = bSide ? 1 : 2*r;
+
+                for(int dz=-r; dz<=r; dz+=stepz)
+                {
+                    unordered_map<long long, vector<size_t> >::const_iterator it = index.mGrid.find(VoxelKey(c[0]+dx,c[1]+dy,c[2]+dz));
+                    if(it==index.mGrid.end())
+                        continue;
+
+                    const vector<size_t> &vCell = it->second;
+                    for(size_t i=0; i<vCell.size(); i++)
+                    {
+                        const double dist = (mvLandmarks[vCell[i]].mPw-Pw).norm();
+                        if(dist<=maxDist && SubmapOf(mvLandmarks[vCell[i]])==nSubmapId)
+                            OfferCandidate(vBest,k,dist,vCell[i]);
+                    }
+                }
+            }
+        }
+    }
+}
+
+void ObjectMap::VoxelCoords(const Eigen::Vector3d &Pw, int coords[3]) const
+{
+    for(int a=0; a<3; a++)
+        coords[a] = floor(Pw[a]/mfVoxelSize);
+}
+
+long long ObjectMap::VoxelKey(const int x, const int y, const int z)
+{
+    // 21 bits per axis
+    const long long mask = (1LL<<21)-1;
+    return (((long long)x & mask)<<42) | (((long long)y & mask)<<21) | ((long long)z & mask);
+}
+
+SemanticObject ObjectMap::MakeObject(const size_t idx, const double dist) const
+{
+    const Landmark &landmark = mvLandmarks[idx];
+
+    SemanticObject object;
+    object.mnId = idx;
+    object.mClassName = landmark.mClassName;
+    object.mPw = landmark.mPw;
+    object.mnObservations = landmark.mvObservations.size();
+    object.mDistance = dist;
+    object.mnSubmapId = SubmapOf(landmark);
+    return object;
+}
+
+long unsigned int ObjectMap::SubmapOf(const Landmark &landmark)
+{
+    return landmark.mvObservations.front().pKF->mnSubmapId;
+}
+
+} //namespace ORB_SLAM
@@ -31,6 +31,8 @@
 #include<Eigen/StdVector>
 
 #include "Converter.h"
+#include "PoseSolver.h"
+#include "ThreadPool.h"
 
 #include<mutex>
 
@@ -76,7 +78,8 @@ void Optimizer::BundleAdjustment(const vector<KeyFrame *> &vpKFs, const vector<M
         g2o::VertexSE3Expmap * vSE3 = new g2o::VertexSE3Expmap();
         vSE3->setEstimate(Converter::toSE3Quat(pKF->GetPose()));
         vSE3->setId(pKF->mnId);
-        vSE3->setFixed(pKF->mnId==0);
+        // The origin of each sub-map is fixed
+        vSE3->setFixed(pKF->mnId==pKF->mnSubmapId);
         optimizer.addVertex(vSE3);
         if(pKF->mnId>maxKFid)
             maxKFid=pKF->mnId;
@@ -98,11 +101,11 @@ void Optimizer::BundleAdjustment(const vector<KeyFrame *> &vpKFs, const vector<M
         vPoint->setMarginalized(true);
         optimizer.addVertex(vPoint);
 
-       const map<KeyFrame*,size_t> observations = pMP->GetObservations();
+       const MapPoint::ObsVector observations = pMP->GetObservations();
 
         int nEdges = 0;
         //SET EDGES
-        for(map<KeyFrame*,size_t>::const_iterator mit=observations.begin(); mit!=observations.end(); mit++)
+        for(MapPoint::ObsVector::const_iterator mit=observations.begin(); mit!=observations.end(); mit++)
         {
 
             KeyFrame* pKF = mit->first;
@@ -238,38 +241,18 @@ void Optimizer::BundleAdjustment(const vector<KeyFrame *> &vpKFs, const vector<M
 
 int Optimizer::PoseOptimization(Frame *pFrame)
 {
-    g2o::SparseOptimizer optimizer;
-    g2o::BlockSolver_6_3::LinearSolverType * linearSolver;
-
-    linearSolver = new g2o::LinearSolverDense<g2o::BlockSolver_6_3::PoseMatrixType>();
-
-    g2o::BlockSolver_6_3 * solver_ptr = new g2o::BlockSolver_6_3(linearSolver);
+    // Motion-only BA with PoseSolver, which runs the same iterations as the g2o graph with a
+    // VertexSE3Expmap and one edge per correspondence. Buffers are reused by the next frames.
+    static thread_local PoseSolver solver;
+    static thread_local vector<size_t> vnIndexCorrespondence;
 
-    g2o::OptimizationAlgorithmLevenberg* solver = new g2o::OptimizationAlgorithmLevenberg(solver_ptr);
-    optimizer.setAlgorithm(solver);
+    solver.Reset(pFrame->fx,pFrame->fy,pFrame->cx,pFrame->cy,pFrame->mbf);
+    vnIndexCorrespondence.clear();
 
     int nInitialCorrespondences=0;
 
-    // Set Frame vertex
-    g2o::VertexSE3Expmap * vSE3 = new g2o::VertexSE3Expmap();
-    vSE3->setEstimate(Converter::toSE3Quat(pFrame->mTcw));
-    vSE3->setId(0);
-    vSE3->setFixed(false);
-    optimizer.addVertex(vSE3);
-
-    // Set MapPoint vertices
     const int N = pFrame->N;
 
-    vector<g2o::EdgeSE3ProjectXYZOnlyPose*> vpEdgesMono;
-    vector<size_t> vnIndexEdgeMono;
-    vpEdgesMono.reserve(N);
-    vnIndexEdgeMono.reserve(N);
-
-    vector<g2o::EdgeStereoSE3ProjectXYZOnlyPose*> vpEdgesStereo;
-    vector<size_t> vnIndexEdgeStereo;
-    vpEdgesStereo.reserve(N);
-    vnIndexEdgeStereo.reserve(N);
-
     const float deltaMono = sqrt(5.991);
     const float deltaStereo = sqrt(7.815);
 
@@ -282,79 +265,20 @@ int Optimizer::PoseOptimization(Frame *pFrame)
         MapPoint* pMP = pFrame->mvpMapPoints[i];
         if(pMP)
         {
-            // Monocular observation
-            if(pFrame->mvuRight[i]<0)
-            {
-                nInitialCorrespondences++;
-                pFrame->mvbOutlier[i] = false;
-
-                Eigen::Matrix<double,2,1> obs;
-                const cv::KeyPoint &kpUn = pFrame->mvKeysUn[i];
-                obs << kpUn.pt.x, kpUn.pt.y;
-
-                g2o::EdgeSE3ProjectXYZOnlyPose* e = new g2o::EdgeSE3ProjectXYZOnlyPose();
-
-                e->setVertex(0, dynamic_cast<g2o::OptimizableGraph::Vertex*>(optimizer.vertex(0)));
-                e->setMeasurement(obs);
-                const float invSigma2 = pFrame->mvInvLevelSigma2[kpUn.octave];
-                e->setInformation(Eigen::Matrix2d::Identity()*invSigma2);
-
-                g2o::RobustKernelHuber* rk = new g2o::RobustKernelHuber;
-                e->setRobustKernel(rk);
-                rk->setDelta(deltaMono);
+            nInitialCorrespondences++;
+            pFrame->mvbOutlier[i] = false;
 
-                e->fx = pFrame->fx;
-                e->fy = pFrame->fy;
-                e->cx = pFrame->cx;
-                e->cy = pFrame->cy;
-                cv::Mat Xw = pMP->GetWorldPos();
-                e->Xw[0] = Xw.at<float>(0);
-                e->Xw[1] = Xw.at<float>(1);
-                e->Xw[2] = Xw.at<float>(2);
+            const cv::KeyPoint &kpUn = pFrame->mvKeysUn[i];
+            const float invSigma2 = pFrame->mvInvLevelSigma2[kpUn.octave];
+            cv::Mat Xw = pMP->GetWorldPos();
 
-                optimizer.addEdge(e);
-
-                vpEdgesMono.push_back(e);
-                vnIndexEdgeMono.push_back(i);
-            }
+            // Monocular observation
+            if(pFrame->mvuRight[i]<0)
+                solver.AddMonocular(Xw,kpUn.pt.x,kpUn.pt.y,invSigma2,deltaMono);
             else  // Stereo observation
-            {
-                nInitialCorrespondences++;
-                pFrame->mvbOutlier[i] = false;
-
-                //SET EDGE
-                Eigen::Matrix<double,3,1> obs;
-                const cv::KeyPoint &kpUn = pFrame->mvKeysUn[i];
-                const float &kp_ur = pFrame->mvuRight[i];
-                obs << kpUn.pt.x, kpUn.pt.y, kp_ur;
-
-                g2o::EdgeStereoSE3ProjectXYZOnlyPose* e = new g2o::EdgeStereoSE3ProjectXYZOnlyPose();
-
-                e->setVertex(0, dynamic_cast<g2o::OptimizableGraph::Vertex*>(optimizer.vertex(0)));
-                e->setMeasurement(obs);
-                const float invSigma2 = pFrame->mvInvLevelSigma2[kpUn.octave];
-                Eigen::Matrix3d Info = Eigen::Matrix3d::Identity()*invSigma2;
-                e->setInformation(Info);
-
-                g2o::RobustKernelHuber* rk = new g2o::RobustKernelHuber;
-                e->setRobustKernel(rk);
-                rk->setDelta(deltaStereo);
-
-                e->fx = pFrame->fx;
-                e->fy = pFrame->fy;
-                e->cx = pFrame->cx;
-                e->cy = pFrame->cy;
-                e->bf = pFrame->mbf;
-                cv::Mat Xw = pMP->GetWorldPos();
-                e->Xw[0] = Xw.at<float>(0);
-                e->Xw[1] = Xw.at<float>(1);
-                e->Xw[2] = Xw.at<float>(2);
-
-                optimizer.addEdge(e);
+                solver.AddStereo(Xw,kpUn.pt.x,kpUn.pt.y,pFrame->mvuRight[i],invSigma2,deltaStereo);
 
-                vpEdgesStereo.push_back(e);
-                vnIndexEdgeStereo.push_back(i);
-            }
+            vnIndexCorrespondence.push_back(i);
         }
 
     }
@@ -374,77 +298,41 @@ int Optimizer::PoseOptimization(Frame *pFrame)
     for(size_t it=0; it<4; it++)
     {
 
-        vSE3->setEstimate(Converter::toSE3Quat(pFrame->mTcw));
-        optimizer.initializeOptimization(0);
-        optimizer.optimize(its[it]);
+        solver.SetPose(Converter::toSE3Quat(pFrame->mTcw));
+        solver.Optimize(its[it]);
+        solver.ComputeChi2();
 
         nBad=0;
-        for(size_t i=0, iend=vpEdgesMono.size(); i<iend; i++)
+        for(int i=0, iend=solver.Size(); i<iend; i++)
         {
-            g2o::EdgeSE3ProjectXYZOnlyPose* e = vpEdgesMono[i];
+            const size_t idx = vnIndexCorrespondence[i];
 
-            const size_t idx = vnIndexEdgeMono[i];
+            const float chi2 = solver.GetChi2(i);
+            const float th = pFrame->mvuRight[idx]<0 ? chi2Mono[it] : chi2Stereo[it];
 
-            if(pFrame->mvbOutlier[idx])
+            if(chi2>th)
             {
-                e->computeError();
-            }
-
-            const float chi2 = e->chi2();
-
-            if(chi2>chi2Mono[it])
-            {                
                 pFrame->mvbOutlier[idx]=true;
-                e->setLevel(1);
+                solver.SetActive(i,false);
                 nBad++;
             }
             else
             {
                 pFrame->mvbOutlier[idx]=false;
-                e->setLevel(0);
+                solver.SetActive(i,true);
             }
-
-            if(it==2)
-                e->setRobustKernel(0);
         }
 
-        for(size_t i=0, iend=vpEdgesStereo.size(); i<iend; i++)
-        {
-            g2o::EdgeStereoSE3ProjectXYZOnlyPose* e = vpEdgesStereo[i];
-
-            const size_t idx = vnIndexEdgeStereo[i];
-
-            if(pFrame->mvbOutlier[idx])
-            {
-                e->computeError();
-            }
-
-            const float chi2 = e->chi2();
-
-            if(chi2>chi2Stereo[it])
-            {
-                pFrame->mvbOutlier[idx]=true;
-                e->setLevel(1);
-                nBad++;
-            }
-            else
-            {                
-                e->setLevel(0);
-                pFrame->mvbOutlier[idx]=false;
-            }
-
-            if(it==2)
-                e->setRobustKernel(0);
-        }
+        if(it==2)
+            solver.SetRobust(false);
 
-        if(optimizer.edges().size()<10)
+        // Outliers are counted too, as the edges of all levels were in the g2o version
+        if(solver.Size()<10)
             break;
     }    
 
     // Recover optimized pose and return number of inliers
-    g2o::VertexSE3Expmap* vSE3_recov = static_cast<g2o::VertexSE3Expmap*>(optimizer.vertex(0));
-    g2o::SE3Quat SE3quat_recov = vSE3_recov->estimate();
-    cv::Mat pose = Converter::toCvMat(SE3quat_recov);
+    cv::Mat pose = Converter::toCvMat(solver.GetPose());
     pFrame->SetPose(pose);
 
     return nInitialCorrespondences-nBad;
@@ -452,6 +340,9 @@ int Optimizer::PoseOptimization(Frame *pFrame)
 
 void Optimizer::LocalBundleAdjustment(KeyFrame *pKF, bool* pbStopFlag, Map* pMap)
 {    
+    // A global BA result published meanwhile makes this one obsolete
+    const int nBigChangeIdx = pMap->GetLastBigChangeIdx();
+
     // Local KeyFrames: First Breath Search from Current Keyframe
     list<KeyFrame*> lLocalKeyFrames;
 
@@ -489,8 +380,8 @@ void Optimizer::LocalBundleAdjustment(KeyFrame *pKF, bool* pbStopFlag, Map* pMap
     list<KeyFrame*> lFixedCameras;
     for(list<MapPoint*>::iterator lit=lLocalMapPoints.begin(), lend=lLocalMapPoints.end(); lit!=lend; lit++)
     {
-        map<KeyFrame*,size_t> observations = (*lit)->GetObservations();
-        for(map<KeyFrame*,size_t>::iterator mit=observations.begin(), mend=observations.end(); mit!=mend; mit++)
+        const MapPoint::ObsVector observations = (*lit)->GetObservations();
+        for(MapPoint::ObsVector::const_iterator mit=observations.begin(), mend=observations.end(); mit!=mend; mit++)
         {
             KeyFrame* pKFi = mit->first;
 
@@ -526,7 +417,7 @@ void Optimizer::LocalBundleAdjustment(KeyFrame *pKF, bool* pbStopFlag, Map* pMap
         g2o::VertexSE3Expmap * vSE3 = new g2o::VertexSE3Expmap();
         vSE3->setEstimate(Converter::toSE3Quat(pKFi->GetPose()));
         vSE3->setId(pKFi->mnId);
-        vSE3->setFixed(pKFi->mnId==0);
+        vSE3->setFixed(pKFi->mnId==pKFi->mnSubmapId);
         optimizer.addVertex(vSE3);
         if(pKFi->mnId>maxKFid)
             maxKFid=pKFi->mnId;
@@ -579,10 +470,10 @@ void Optimizer::LocalBundleAdjustment(KeyFrame *pKF, bool* pbStopFlag, Map* pMap
         vPoint->setMarginalized(true);
         optimizer.addVertex(vPoint);
 
-        const map<KeyFrame*,size_t> observations = pMP->GetObservations();
+        const MapPoint::ObsVector observations = pMP->GetObservations();
 
         //Set edges
-        for(map<KeyFrame*,size_t>::const_iterator mit=observations.begin(), mend=observations.end(); mit!=mend; mit++)
+        for(MapPoint::ObsVector::const_iterator mit=observations.begin(), mend=observations.end(); mit!=mend; mit++)
         {
             KeyFrame* pKFi = mit->first;
 
@@ -745,6 +636,9 @@ void Optimizer::LocalBundleAdjustment(KeyFrame *pKF, bool* pbStopFlag, Map* pMap
     // Get Map Mutex
     unique_lock<mutex> lock(pMap->mMutexMapUpdate);
 
+    if(pMap->GetLastBigChangeIdx()!=nBigChangeIdx)
+        return;
+
     if(!vToErase.empty())
     {
         for(size_t i=0;i<vToErase.size();i++)
@@ -778,6 +672,32 @@ void Optimizer::LocalBundleAdjustment(KeyFrame *pKF, bool* pbStopFlag, Map* pMap
 }
 
 
+void Optimizer::CorrectMapPoints(const vector<MapPoint*> &vpMPs, const vector<int> &vnRef,
+                                 const vector<g2o::Sim3,Eigen::aligned_allocator<g2o::Sim3> > &vSrw,
+                                 const vector<g2o::Sim3,Eigen::aligned_allocator<g2o::Sim3> > &vCorrectedSwr)
+{
+    ThreadPool::Instance().ParallelChunks(vpMPs.size(),256,[&](const int i0, const int i1)
+    {
+        for(int i=i0; i<i1; i++)
+        {
+            MapPoint* pMP = vpMPs[i];
+            const int nIDr = vnRef[i];
+            if(nIDr<0)
+                continue;
+
+            // Transform to "non-optimized" reference keyframe pose and transform back with optimized pose
+            cv::Mat P3Dw = pMP->GetWorldPos();
+            Eigen::Matrix<double,3,1> eigP3Dw = Converter::toVector3d(P3Dw);
+            Eigen::Matrix<double,3,1> eigCorrectedP3Dw = vCorrectedSwr[nIDr].map(vSrw[nIDr].map(eigP3Dw));
+
+            cv::Mat cvCorrectedP3Dw = Converter::toCvMat(eigCorrectedP3Dw);
+            pMP->SetWorldPos(cvCorrectedP3Dw);
+
+            pMP->UpdateNormalAndDepth();
+        }
+    });
+}
+
 void Optimizer::OptimizeEssentialGraph(Map* pMap, KeyFrame* pLoopKF, KeyFrame* pCurKF,
                                        const LoopClosing::KeyFrameAndPose &NonCorrectedSim3,
                                        const LoopClosing::KeyFrameAndPose &CorrectedSim3,
@@ -786,27 +706,60 @@ void Optimizer::OptimizeEssentialGraph(Map* pMap, KeyFrame* pLoopKF, KeyFrame* p
     // Setup optimizer
     g2o::SparseOptimizer optimizer;
     optimizer.setVerbose(false);
-    g2o::BlockSolver_7_3::LinearSolverType * linearSolver =
+    g2o::LinearSolverEigen<g2o::BlockSolver_7_3::PoseMatrixType> * linearSolver =
            new g2o::LinearSolverEigen<g2o::BlockSolver_7_3::PoseMatrixType>();
+    // Fill-reducing ordering computed on the keyframe graph instead of the 7x7 scalar entries.
+    // It is done once per optimization and reused by all the iterations.
+    linearSolver->setBlockOrdering(true);
     g2o::BlockSolver_7_3 * solver_ptr= new g2o::BlockSolver_7_3(linearSolver);
     g2o::OptimizationAlgorithmLevenberg* solver = new g2o::OptimizationAlgorithmLevenberg(solver_ptr);
 
     solver->setUserLambdaInit(1e-16);
     optimizer.setAlgorithm(solver);
 
-    const vector<KeyFrame*> vpKFs = pMap->GetAllKeyFrames();
+    // Only the sub-map of the loop, the others have nothing fixed
+    const long unsigned int nSubmapId = pLoopKF->mnSubmapId;
+    const vector<KeyFrame*> vpKFs = pMap->GetSubmapKeyFrames(nSubmapId);
     const vector<MapPoint*> vpMPs = pMap->GetAllMapPoints();
 
     const unsigned int nMaxKFid = pMap->GetMaxKFid();
+    const int nKFs = vpKFs.size();
 
+    // Poses indexed by keyframe id: vScw is corrected for the keyframes around the current one,
+    // vNonCorrectedScw is the pose before the loop correction for all of them
     vector<g2o::Sim3,Eigen::aligned_allocator<g2o::Sim3> > vScw(nMaxKFid+1);
+    vector<g2o::Sim3,Eigen::aligned_allocator<g2o::Sim3> > vNonCorrectedScw(nMaxKFid+1);
     vector<g2o::Sim3,Eigen::aligned_allocator<g2o::Sim3> > vCorrectedSwc(nMaxKFid+1);
-    vector<g2o::VertexSim3Expmap*> vpVertices(nMaxKFid+1);
+    vector<g2o::VertexSim3Expmap*> vpVertices(nMaxKFid+1,static_cast<g2o::VertexSim3Expmap*>(NULL));
 
     const int minFeat = 100;
 
+    ThreadPool::Instance().ParallelChunks(nKFs,64,[&](const int i0, const int i1)
+    {
+        for(int i=i0; i<i1; i++)
+        {
+            KeyFrame* pKF = vpKFs[i];
+            const int nIDi = pKF->mnId;
+
+            LoopClosing::KeyFrameAndPose::const_iterator it = CorrectedSim3.find(pKF);
+            if(it!=CorrectedSim3.end())
+            {
+                vScw[nIDi] = it->second;
+                vNonCorrectedScw[nIDi] = NonCorrectedSim3.find(pKF)->second;
+            }
+            else
+            {
+                Eigen::Matrix<double,3,3> Rcw = Converter::toMatrix3d(pKF->GetRotation());
+                Eigen::Matrix<double,3,1> tcw = Converter::toVector3d(pKF->GetTranslation());
+                g2o::Sim3 Siw(Rcw,tcw,1.0);
+                vScw[nIDi] = Siw;
+                vNonCorrectedScw[nIDi] = Siw;
+            }
+        }
+    });
+
     // Set KeyFrame vertices
-    for(size_t i=0, iend=vpKFs.size(); i<iend;i++)
+    for(int i=0; i<nKFs; i++)
     {
         KeyFrame* pKF = vpKFs[i];
         if(pKF->isBad())
@@ -815,21 +768,7 @@ void Optimizer::OptimizeEssentialGraph(Map* pMap, KeyFrame* pLoopKF, KeyFrame* p
 
         const int nIDi = pKF->mnId;
 
-        LoopClosing::KeyFrameAndPose::const_iterator it = CorrectedSim3.find(pKF);
-
-        if(it!=CorrectedSim3.end())
-        {
-            vScw[nIDi] = it->second;
-            VSim3->setEstimate(it->second);
-        }
-        else
-        {
-            Eigen::Matrix<double,3,3> Rcw = Converter::toMatrix3d(pKF->GetRotation());
-            Eigen::Matrix<double,3,1> tcw = Converter::toVector3d(pKF->GetTranslation());
-            g2o::Sim3 Siw(Rcw,tcw,1.0);
-            vScw[nIDi] = Siw;
-            VSim3->setEstimate(Siw);
-        }
+        VSim3->setEstimate(vScw[nIDi]);
 
         if(pKF==pLoopKF)
             VSim3->setFixed(true);
@@ -844,7 +783,8 @@ void Optimizer::OptimizeEssentialGraph(Map* pMap, KeyFrame* pLoopKF, KeyFrame* p
     }
 
 
-    set<pair<long unsigned int,long unsigned int> > sInsertedEdges;
+    // Pairs (min id, max id) of the loop edges, sorted for binary search
+    vector<pair<long unsigned int,long unsigned int> > vInsertedEdges;
 
     const Eigen::Matrix<double,7,7> matLambda = Eigen::Matrix<double,7,7>::Identity();
 
@@ -875,111 +815,73 @@ void Optimizer::OptimizeEssentialGraph(Map* pMap, KeyFrame* pLoopKF, KeyFrame* p
 
             optimizer.addEdge(e);
 
-            sInsertedEdges.insert(make_pair(min(nIDi,nIDj),max(nIDi,nIDj)));
+            vInsertedEdges.push_back(make_pair(min(nIDi,nIDj),max(nIDi,nIDj)));
         }
     }
+    sort(vInsertedEdges.begin(),vInsertedEdges.end());
 
-    // Set normal edges
-    for(size_t i=0, iend=vpKFs.size(); i<iend; i++)
+    // Adjacency of the essential graph: spanning tree, loop and strong covisibility edges of each
+    // keyframe, to keyframes with a lower id. Gathered in parallel, the keyframe queries lock.
+    vector<vector<int> > vvnEdges(nKFs);
+    ThreadPool::Instance().ParallelChunks(nKFs,16,[&](const int i0, const int i1)
     {
-        KeyFrame* pKF = vpKFs[i];
+        for(int i=i0; i<i1; i++)
+        {
+            KeyFrame* pKF = vpKFs[i];
+            vector<int> &vnEdges = vvnEdges[i];
 
-        const int nIDi = pKF->mnId;
+            // Spanning tree edge
+            KeyFrame* pParentKF = pKF->GetParent();
+            if(pParentKF)
+                vnEdges.push_back(pParentKF->mnId);
 
-        g2o::Sim3 Swi;
+            // Loop edges
+            const set<KeyFrame*> sLoopEdges = pKF->GetLoopEdges();
+            for(set<KeyFrame*>::const_iterator sit=sLoopEdges.begin(), send=sLoopEdges.end(); sit!=send; sit++)
+            {
+                KeyFrame* pLKF = *sit;
+                if(pLKF->mnId<pKF->mnId)
+                    vnEdges.push_back(pLKF->mnId);
+            }
 
-        LoopClosing::KeyFrameAndPose::const_iterator iti = NonCorrectedSim3.find(pKF);
+            // Covisibility graph edges
+            const vector<KeyFrame*> vpConnectedKFs = pKF->GetCovisiblesByWeight(minFeat);
+            for(vector<KeyFrame*>::const_iterator vit=vpConnectedKFs.begin(); vit!=vpConnectedKFs.end(); vit++)
+            {
+                KeyFrame* pKFn = *vit;
+                if(pKFn && pKFn!=pParentKF && !pKF->hasChild(pKFn) && !sLoopEdges.count(pKFn))
+                {
+                    if(!pKFn->isBad() && pKFn->mnId<pKF->mnId)
+                    {
+                        if(binary_search(vInsertedEdges.begin(),vInsertedEdges.end(),make_pair(min(pKF->mnId,pKFn->mnId),max(pKF->mnId,pKFn->mnId))))
+                            continue;
 
-        if(iti!=NonCorrectedSim3.end())
-            Swi = (iti->second).inverse();
-        else
-            Swi = vScw[nIDi].inverse();
+                        vnEdges.push_back(pKFn->mnId);
+                    }
+                }
+            }
+        }
+    });
 
-        KeyFrame* pParentKF = pKF->GetParent();
+    // Set normal edges, measured with the poses before the loop correction
+    for(int i=0; i<nKFs; i++)
+    {
+        const int nIDi = vpKFs[i]->mnId;
+        const g2o::Sim3 Swi = vNonCorrectedScw[nIDi].inverse();
 
-        // Spanning tree edge
-        if(pParentKF)
+        const vector<int> &vnEdges = vvnEdges[i];
+        for(size_t k=0; k<vnEdges.size(); k++)
         {
-            int nIDj = pParentKF->mnId;
-
-            g2o::Sim3 Sjw;
-
-            LoopClosing::KeyFrameAndPose::const_iterator itj = NonCorrectedSim3.find(pParentKF);
-
-            if(itj!=NonCorrectedSim3.end())
-                Sjw = itj->second;
-            else
-                Sjw = vScw[nIDj];
-
-            g2o::Sim3 Sji = Sjw * Swi;
+            const int nIDj = vnEdges[k];
+            const g2o::Sim3 Sji = vNonCorrectedScw[nIDj] * Swi;
 
             g2o::EdgeSim3* e = new g2o::EdgeSim3();
             e->setVertex(1, dynamic_cast<g2o::OptimizableGraph::Vertex*>(optimizer.vertex(nIDj)));
             e->setVertex(0, dynamic_cast<g2o::OptimizableGraph::Vertex*>(optimizer.vertex(nIDi)));
             e->setMeasurement(Sji);
-
             e->information() = matLambda;
             optimizer.addEdge(e);
         }
-
-        // Loop edges
-        const set<KeyFrame*> sLoopEdges = pKF->GetLoopEdges();
-        for(set<KeyFrame*>::const_iterator sit=sLoopEdges.begin(), send=sLoopEdges.end(); sit!=send; sit++)
-        {
-            KeyFrame* pLKF = *sit;
-            if(pLKF->mnId<pKF->mnId)
-            {
-                g2o::Sim3 Slw;
-
-                LoopClosing::KeyFrameAndPose::const_iterator itl = NonCorrectedSim3.find(pLKF);
-
-                if(itl!=NonCorrectedSim3.end())
-                    Slw = itl->second;
-                else
-                    Slw = vScw[pLKF->mnId];
-
-                g2o::Sim3 Sli = Slw * Swi;
-                g2o::EdgeSim3* el = new g2o::EdgeSim3();
-                el->setVertex(1, dynamic_cast<g2o::OptimizableGraph::Vertex*>(optimizer.vertex(pLKF->mnId)));
-                el->setVertex(0, dynamic_cast<g2o::OptimizableGraph::Vertex*>(optimizer.vertex(nIDi)));
-                el->setMeasurement(Sli);
-                el->information() = matLambda;
-                optimizer.addEdge(el);
-            }
-        }
-
-        // Covisibility graph edges
-        const vector<KeyFrame*> vpConnectedKFs = pKF->GetCovisiblesByWeight(minFeat);
-        for(vector<KeyFrame*>::const_iterator vit=vpConnectedKFs.begin(); vit!=vpConnectedKFs.end(); vit++)
-        {
-            KeyFrame* pKFn = *vit;
-            if(pKFn && pKFn!=pParentKF && !pKF->hasChild(pKFn) && !sLoopEdges.count(pKFn))
-            {
-                if(!pKFn->isBad() && pKFn->mnId<pKF->mnId)
-                {
-                    if(sInsertedEdges.count(make_pair(min(pKF->mnId,pKFn->mnId),max(pKF->mnId,pKFn->mnId))))
-                        continue;
-
-                    g2o::Sim3 Snw;
-
-                    LoopClosing::KeyFrameAndPose::const_iterator itn = NonCorrectedSim3.find(pKFn);
-
-                    if(itn!=NonCorrectedSim3.end())
-                        Snw = itn->second;
-                    else
-                        Snw = vScw[pKFn->mnId];
-
-                    g2o::Sim3 Sni = Snw * Swi;
-
-                    g2o::EdgeSim3* en = new g2o::EdgeSim3();
-                    en->setVertex(1, dynamic_cast<g2o::OptimizableGraph::Vertex*>(optimizer.vertex(pKFn->mnId)));
-                    en->setVertex(0, dynamic_cast<g2o::OptimizableGraph::Vertex*>(optimizer.vertex(nIDi)));
-                    en->setMeasurement(Sni);
-                    en->information() = matLambda;
-                    optimizer.addEdge(en);
-                }
-            }
-        }
     }
 
     // Optimize!
@@ -988,59 +890,60 @@ void Optimizer::OptimizeEssentialGraph(Map* pMap, KeyFrame* pLoopKF, KeyFrame* p
 
     unique_lock<mutex> lock(pMap->mMutexMapUpdate);
 
-    // SE3 Pose Recovering. Sim3:[sR t;0 1] -> SE3:[R t/s;0 1]
-    for(size_t i=0;i<vpKFs.size();i++)
+    // Reference keyframe of each map point, the one it was corrected with in the loop correction
+    vector<int> vnRef(vpMPs.size());
+    ThreadPool::Instance().ParallelChunks(vpMPs.size(),256,[&](const int i0, const int i1)
     {
-        KeyFrame* pKFi = vpKFs[i];
-
-        const int nIDi = pKFi->mnId;
-
-        g2o::VertexSim3Expmap* VSim3 = static_cast<g2o::VertexSim3Expmap*>(optimizer.vertex(nIDi));
-        g2o::Sim3 CorrectedSiw =  VSim3->estimate();
-        vCorrectedSwc[nIDi]=CorrectedSiw.inverse();
-        Eigen::Matrix3d eigR = CorrectedSiw.rotation().toRotationMatrix();
-        Eigen::Vector3d eigt = CorrectedSiw.translation();
-        double s = CorrectedSiw.scale();
-
-        eigt *=(1./s); //[R t/s;0 1]
+        for(int i=i0; i<i1; i++)
+        {
+            MapPoint* pMP = vpMPs[i];
 
-        cv::Mat Tiw = Converter::toCvSE3(eigR,eigt);
+            if(pMP->isBad())
+            {
+                vnRef[i] = -1;
+                continue;
+            }
 
-        pKFi->SetPose(Tiw);
-    }
+            if(pMP->mnCorrectedByKF==pCurKF->mnId)
+            {
+                vnRef[i] = pMP->mnCorrectedReference;
+            }
+            else
+            {
+                KeyFrame* pRefKF = pMP->GetReferenceKeyFrame();
+                vnRef[i] = pRefKF->mnSubmapId==nSubmapId ? (int)pRefKF->mnId : -1;
+            }
+        }
+    });
 
-    // Correct points. Transform to "non-optimized" reference keyframe pose and transform back with optimized pose
-    for(size_t i=0, iend=vpMPs.size(); i<iend; i++)
+    // SE3 Pose Recovering. Sim3:[sR t;0 1] -> SE3:[R t/s;0 1]
+    ThreadPool::Instance().ParallelChunks(nKFs,64,[&](const int i0, const int i1)
     {
-        MapPoint* pMP = vpMPs[i];
-
-        if(pMP->isBad())
-            continue;
-
-        int nIDr;
-        if(pMP->mnCorrectedByKF==pCurKF->mnId)
+        for(int i=i0; i<i1; i++)
         {
-            nIDr = pMP->mnCorrectedReference;
-        }
-        else
-        {
-            KeyFrame* pRefKF = pMP->GetReferenceKeyFrame();
-            nIDr = pRefKF->mnId;
-        }
+            KeyFrame* pKFi = vpKFs[i];
+
+            const int nIDi = pKFi->mnId;
 
+            g2o::VertexSim3Expmap* VSim3 = vpVertices[nIDi];
+            if(!VSim3)
+                continue;
+            g2o::Sim3 CorrectedSiw =  VSim3->estimate();
+            vCorrectedSwc[nIDi]=CorrectedSiw.inverse();
+            Eigen::Matrix3d eigR = CorrectedSiw.rotation().toRotationMatrix();
+            Eigen::Vector3d eigt = CorrectedSiw.translation();
+            double s = CorrectedSiw.scale();
 
-        g2o::Sim3 Srw = vScw[nIDr];
-        g2o::Sim3 correctedSwr = vCorrectedSwc[nIDr];
+            eigt *=(1./s); //[R t/s;0 1]
 
-        cv::Mat P3Dw = pMP->GetWorldPos();
-        Eigen::Matrix<double,3,1> eigP3Dw = Converter::toVector3d(P3Dw);
-        Eigen::Matrix<double,3,1> eigCorrectedP3Dw = correctedSwr.map(Srw.map(eigP3Dw));
+            cv::Mat Tiw = Converter::toCvSE3(eigR,eigt);
 
-        cv::Mat cvCorrectedP3Dw = Converter::toCvMat(eigCorrectedP3Dw);
-        pMP->SetWorldPos(cvCorrectedP3Dw);
+            pKFi->SetPose(Tiw);
+        }
+    });
 
-        pMP->UpdateNormalAndDepth();
-    }
+    // Correct points. Transform to "non-optimized" reference keyframe pose and transform back with optimized pose
+    CorrectMapPoints(vpMPs,vnRef,vScw,vCorrectedSwc);
 }
 
 int Optimizer::OptimizeSim3(KeyFrame *pKF1, KeyFrame *pKF2, vector<MapPoint *> &vpMatches1, g2o::Sim3 &g2oS12, const float th2, const bool bFixScale)
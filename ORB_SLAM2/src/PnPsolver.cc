@@ -51,10 +51,13 @@
 #include <iostream>
 
 #include "PnPsolver.h"
+#include "ORBmatcher.h"
 
 #include <vector>
 #include <cmath>
+#include <cfloat>
 #include <opencv2/core/core.hpp>
+#include <Eigen/Dense>
 #include "Thirdparty/DBoW2/DUtils/Random.h"
 #include <algorithm>
 
@@ -69,13 +72,10 @@ PnPsolver::PnPsolver(const Frame &F, const vector<MapPoint*> &vpMapPointMatches)
     mnIterations(0), mnBestInliers(0), N(0)
 {
     mvpMapPointMatches = vpMapPointMatches;
-    mvP2D.reserve(F.mvpMapPoints.size());
-    mvSigma2.reserve(F.mvpMapPoints.size());
-    mvP3Dw.reserve(F.mvpMapPoints.size());
-    mvKeyPointIndices.reserve(F.mvpMapPoints.size());
-    mvAllIndices.reserve(F.mvpMapPoints.size());
 
-    int idx=0;
+    // Matches are sorted by descriptor distance, so that PROSAC samples the best ones first
+    vector<pair<int,size_t> > vDistIdx;
+    vDistIdx.reserve(vpMapPointMatches.size());
     for(size_t i=0, iend=vpMapPointMatches.size(); i<iend; i++)
     {
         MapPoint* pMP = vpMapPointMatches[i];
@@ -84,20 +84,38 @@ PnPsolver::PnPsolver(const Frame &F, const vector<MapPoint*> &vpMapPointMatches)
         {
             if(!pMP->isBad())
             {
-                const cv::KeyPoint &kp = F.mvKeysUn[i];
-
-                mvP2D.push_back(kp.pt);
-                mvSigma2.push_back(F.mvLevelSigma2[kp.octave]);
+                const int dist = ORBmatcher::DescriptorDistance(pMP->GetDescriptor(),F.mDescriptors.row(i));
+                vDistIdx.push_back(make_pair(dist,i));
+            }
+        }
+    }
+    stable_sort(vDistIdx.begin(),vDistIdx.end());
+
+    const size_t nMatches = vDistIdx.size();
+    mvU.reserve(nMatches);
+    mvV.reserve(nMatches);
+    mvSigma2.reserve(nMatches);
+    mvXw.reserve(nMatches);
+    mvYw.reserve(nMatches);
+    mvZw.reserve(nMatches);
+    mvKeyPointIndices.reserve(nMatches);
+
+    for(size_t j=0; j<nMatches; j++)
+    {
+        const size_t i = vDistIdx[j].second;
+        MapPoint* pMP = vpMapPointMatches[i];
+        const cv::KeyPoint &kp = F.mvKeysUn[i];
 
-                cv::Mat Pos = pMP->GetWorldPos();
-                mvP3Dw.push_back(cv::Point3f(Pos.at<float>(0),Pos.at<float>(1), Pos.at<float>(2)));
+        mvU.push_back(kp.pt.x);
+        mvV.push_back(kp.pt.y);
+        mvSigma2.push_back(F.mvLevelSigma2[kp.octave]);
 
-                mvKeyPointIndices.push_back(i);
-                mvAllIndices.push_back(idx);               
+        cv::Mat Pos = pMP->GetWorldPos();
+        mvXw.push_back(Pos.at<float>(0));
+        mvYw.push_back(Pos.at<float>(1));
+        mvZw.push_back(Pos.at<float>(2));
 
-                idx++;
-            }
-        }
+        mvKeyPointIndices.push_back(i);
     }
 
     // Set camera calibration parameters
@@ -126,7 +144,7 @@ void PnPsolver::SetRansacParameters(double probability, int minInliers, int maxI
     mRansacEpsilon = epsilon;
     mRansacMinSet = minSet;
 
-    N = mvP2D.size(); // number of correspondences
+    N = mvU.size(); // number of correspondences
 
     mvbInliersi.resize(N);
 
@@ -154,6 +172,15 @@ void PnPsolver::SetRansacParameters(double probability, int minInliers, int maxI
     mvMaxError.resize(mvSigma2.size());
     for(size_t i=0; i<mvSigma2.size(); i++)
         mvMaxError[i] = mvSigma2[i]*th2;
+
+    // PROSAC starts from the minimal set of best matches and has grown to all of them (plain
+    // RANSAC) when the RANSAC iterations are exhausted
+    mvSampleIndices.resize(mRansacMinSet);
+    mnProsacN = min(mRansacMinSet,N);
+    mProsacTn = mRansacMaxIts;
+    for(int i=0; i<mnProsacN; i++)
+        mProsacTn *= double(mnProsacN-i)/(N-i);
+    mnProsacTnPrime = 1;
 }
 
 cv::Mat PnPsolver::find(vector<bool> &vbInliers, int &nInliers)
@@ -176,8 +203,6 @@ cv::Mat PnPsolver::iterate(int nIterations, bool &bNoMore, vector<bool> &vbInlie
         return cv::Mat();
     }
 
-    vector<size_t> vAvailableIndices;
-
     int nCurrentIterations = 0;
     while(mnIterations<mRansacMaxIts || nCurrentIterations<nIterations)
     {
@@ -185,26 +210,21 @@ cv::Mat PnPsolver::iterate(int nIterations, bool &bNoMore, vector<bool> &vbInlie
         mnIterations++;
         reset_correspondences();
 
-        vAvailableIndices = mvAllIndices;
-
         // Get min set of points
+        SampleMinimalSet();
         for(short i = 0; i < mRansacMinSet; ++i)
         {
-            int randi = DUtils::Random::RandomInt(0, vAvailableIndices.size()-1);
-
-            int idx = vAvailableIndices[randi];
-
-            add_correspondence(mvP3Dw[idx].x,mvP3Dw[idx].y,mvP3Dw[idx].z,mvP2D[idx].x,mvP2D[idx].y);
-
-            vAvailableIndices[randi] = vAvailableIndices.back();
-            vAvailableIndices.pop_back();
+            const int idx = mvSampleIndices[i];
+            add_correspondence(mvXw[idx],mvYw[idx],mvZw[idx],mvU[idx],mvV[idx]);
         }
 
         // Compute camera pose
         compute_pose(mRi, mti);
 
-        // Check inliers
-        CheckInliers();
+        // Check inliers. A hypothesis that can not beat the best one would refine the same
+        // inliers again, it is dropped as soon as it has too many outliers.
+        if(!CheckInliers(max(mnBestInliers+1,mRansacMinInliers)))
+            continue;
 
         if(mnInliersi>=mRansacMinInliers)
         {
@@ -257,6 +277,52 @@ cv::Mat PnPsolver::iterate(int nIterations, bool &bNoMore, vector<bool> &vbInlie
     return cv::Mat();
 }
 
+void PnPsolver::SampleMinimalSet()
+{
+    // PROSAC growth function (Chum and Matas, 2005): the pool of matches sampled at iteration t
+    // are the n best ones, n grows as the number of samples that plain RANSAC would have drawn
+    // only from them
+    const int t = mnIterations;
+    if(t>=mnProsacTnPrime && mnProsacN<N)
+    {
+        const double Tn1 = mProsacTn*(mnProsacN+1)/(mnProsacN+1-mRansacMinSet);
+        mnProsacTnPrime += ceil(Tn1-mProsacTn);
+        mProsacTn = Tn1;
+        mnProsacN++;
+    }
+
+    int nRandom = mRansacMinSet;
+    int nPool = mnProsacN;
+    if(mnProsacTnPrime>t)
+    {
+        // The last match of the pool is sampled with matches drawn from the previous ones
+        nRandom--;
+        nPool--;
+        mvSampleIndices[nRandom] = nPool;
+    }
+
+    for(int i=0; i<nRandom; i++)
+    {
+        int idx;
+        bool bRepeated;
+        do
+        {
+            idx = DUtils::Random::RandomInt(0,nPool-1);
+            bRepeated = false;
+            for(int j=0; j<i; j++)
+            {
+                if(mvSampleIndices[j]==idx)
+                {
+                    bRepeated = true;
+                    break;
+                }
+            }
+        } while(bRepeated);
+
+        mvSampleIndices[i] = idx;
+    }
+}
+
 bool PnPsolver::Refine()
 {
     vector<int> vIndices;
@@ -277,14 +343,14 @@ bool PnPsolver::Refine()
     for(size_t i=0; i<vIndices.size(); i++)
     {
         int idx = vIndices[i];
-        add_correspondence(mvP3Dw[idx].x,mvP3Dw[idx].y,mvP3Dw[idx].z,mvP2D[idx].x,mvP2D[idx].y);
+        add_correspondence(mvXw[idx],mvYw[idx],mvZw[idx],mvU[idx],mvV[idx]);
     }
 
     // Compute camera pose
     compute_pose(mRi, mti);
 
     // Check inliers
-    CheckInliers();
+    CheckInliers(0);
 
     mnRefinedInliers =mnInliersi;
     mvbRefinedInliers = mvbInliersi;
@@ -305,37 +371,54 @@ bool PnPsolver::Refine()
 }
 
 
-void PnPsolver::CheckInliers()
+bool PnPsolver::CheckInliers(const int nMinInliers)
 {
     mnInliersi=0;
 
-    for(int i=0; i<N; i++)
-    {
-        cv::Point3f P3Dw = mvP3Dw[i];
-        cv::Point2f P2D = mvP2D[i];
-
-        float Xc = mRi[0][0]*P3Dw.x+mRi[0][1]*P3Dw.y+mRi[0][2]*P3Dw.z+mti[0];
-        float Yc = mRi[1][0]*P3Dw.x+mRi[1][1]*P3Dw.y+mRi[1][2]*P3Dw.z+mti[1];
-        float invZc = 1/(mRi[2][0]*P3Dw.x+mRi[2][1]*P3Dw.y+mRi[2][2]*P3Dw.z+mti[2]);
+    const float r00=mRi[0][0], r01=mRi[0][1], r02=mRi[0][2], t0=mti[0];
+    const float r10=mRi[1][0], r11=mRi[1][1], r12=mRi[1][2], t1=mti[1];
+    const float r20=mRi[2][0], r21=mRi[2][1], r22=mRi[2][2], t2=mti[2];
+    const float fuf=fu, fvf=fv, ucf=uc, vcf=vc;
 
-        double ue = uc + fu * Xc * invZc;
-        double ve = vc + fv * Yc * invZc;
+    // Points are reprojected by blocks in a vectorized loop. After each block the hypothesis is
+    // abandoned if it can not reach nMinInliers anymore.
+    const int BLOCK = 32;
+    float vError2[BLOCK];
 
-        float distX = P2D.x-ue;
-        float distY = P2D.y-ve;
+    for(int i0=0; i0<N; i0+=BLOCK)
+    {
+        const int n = min(BLOCK,N-i0);
+        const float* X = &mvXw[i0];
+        const float* Y = &mvYw[i0];
+        const float* Z = &mvZw[i0];
+        const float* U = &mvU[i0];
+        const float* V = &mvV[i0];
+
+        for(int k=0; k<n; k++)
+        {
+            const float Xc = r00*X[k]+r01*Y[k]+r02*Z[k]+t0;
+            const float Yc = r10*X[k]+r11*Y[k]+r12*Z[k]+t1;
+            const float invZc = 1.0f/(r20*X[k]+r21*Y[k]+r22*Z[k]+t2);
 
-        float error2 = distX*distX+distY*distY;
+            const float distX = U[k]-(ucf+fuf*Xc*invZc);
+            const float distY = V[k]-(vcf+fvf*Yc*invZc);
 
-        if(error2<mvMaxError[i])
-        {
-            mvbInliersi[i]=true;
-            mnInliersi++;
+            vError2[k] = distX*distX+distY*distY;
         }
-        else
+
+        for(int k=0; k<n; k++)
         {
-            mvbInliersi[i]=false;
+            const bool bInlier = vError2[k]<mvMaxError[i0+k];
+            mvbInliersi[i0+k] = bInlier;
+            if(bInlier)
+                mnInliersi++;
         }
+
+        if(mnInliersi+(N-i0-n)<nMinInliers)
+            return false;
     }
+
+    return true;
 }
 
 
@@ -385,41 +468,41 @@ void PnPsolver::choose_control_points(void)
 
 
   // Take C1, C2, and C3 from PCA on the reference points:
-  CvMat * PW0 = cvCreateMat(number_of_correspondences, 3, CV_64F);
-
-  double pw0tpw0[3 * 3], dc[3], uct[3 * 3];
-  CvMat PW0tPW0 = cvMat(3, 3, CV_64F, pw0tpw0);
-  CvMat DC      = cvMat(3, 1, CV_64F, dc);
-  CvMat UCt     = cvMat(3, 3, CV_64F, uct);
-
-  for(int i = 0; i < number_of_correspondences; i++)
-    for(int j = 0; j < 3; j++)
-      PW0->data.db[3 * i + j] = pws[3 * i + j] - cws[0][j];
-
-  cvMulTransposed(PW0, &PW0tPW0, 1);
-  cvSVD(&PW0tPW0, &DC, &UCt, 0, CV_SVD_MODIFY_A | CV_SVD_U_T);
+  Eigen::Matrix3d PW0tPW0 = Eigen::Matrix3d::Zero();
+  for(int i = 0; i < number_of_correspondences; i++) {
+    const Eigen::Vector3d pw0(pws[3 * i] - cws[0][0], pws[3 * i + 1] - cws[0][1], pws[3 * i + 2] - cws[0][2]);
+    PW0tPW0.noalias() += pw0 * pw0.transpose();
+  }
 
-  cvReleaseMat(&PW0);
+  Eigen::JacobiSVD<Eigen::Matrix3d> svd(PW0tPW0, Eigen::ComputeFullU);
+  const Eigen::Vector3d & dc = svd.singularValues();
+  const Eigen::Matrix3d & U = svd.matrixU();
 
   for(int i = 1; i < 4; i++) {
     double k = sqrt(dc[i - 1] / number_of_correspondences);
     for(int j = 0; j < 3; j++)
-      cws[i][j] = cws[0][j] + k * uct[3 * (i - 1) + j];
+      cws[i][j] = cws[0][j] + k * U(j, i - 1);
   }
 }
 
 void PnPsolver::compute_barycentric_coordinates(void)
 {
-  double cc[3 * 3], cc_inv[3 * 3];
-  CvMat CC     = cvMat(3, 3, CV_64F, cc);
-  CvMat CC_inv = cvMat(3, 3, CV_64F, cc_inv);
+  Eigen::Matrix3d CC;
 
   for(int i = 0; i < 3; i++)
     for(int j = 1; j < 4; j++)
-      cc[3 * i + j - 1] = cws[j][i] - cws[0][i];
+      CC(i, j - 1) = cws[j][i] - cws[0][i];
+
+  // Pseudo-inverse, the control points are degenerate when the reference points are coplanar
+  Eigen::JacobiSVD<Eigen::Matrix3d> svd(CC, Eigen::ComputeFullU | Eigen::ComputeFullV);
+  const Eigen::Vector3d & sv = svd.singularValues();
+  Eigen::Vector3d sv_inv;
+  for(int i = 0; i < 3; i++)
+    sv_inv[i] = sv[i] > sv[0] * 2 * DBL_EPSILON ? 1.0 / sv[i] : 0.0;
+  const Eigen::Matrix<double, 3, 3, Eigen::RowMajor> CC_inv =
+    svd.matrixV() * sv_inv.asDiagonal() * svd.matrixU().transpose();
 
-  cvInvert(&CC, &CC_inv, CV_SVD);
-  double * ci = cc_inv;
+  const double * ci = CC_inv.data();
   for(int i = 0; i < number_of_correspondences; i++) {
     double * pi = pws + 3 * i;
     double * a = alphas + 4 * i;
@@ -433,12 +516,9 @@ void PnPsolver::compute_barycentric_coordinates(void)
   }
 }
 
-void PnPsolver::fill_M(CvMat * M,
-		  const int row, const double * as, const double u, const double v)
+void PnPsolver::fill_M(double * M1, double * M2,
+		  const double * as, const double u, const double v)
 {
-  double * M1 = M->data.db + row * 12;
-  double * M2 = M1 + 12;
-
   for(int i = 0; i < 4; i++) {
     M1[3 * i    ] = as[i] * fu;
     M1[3 * i + 1] = 0.0;
@@ -479,23 +559,27 @@ double PnPsolver::compute_pose(double R[3][3], double t[3])
   choose_control_points();
   compute_barycentric_coordinates();
 
-  CvMat * M = cvCreateMat(2 * number_of_correspondences, 12, CV_64F);
+  // M'M is accumulated directly, M has two rows per correspondence
+  Eigen::Matrix<double, 12, 12> MtM = Eigen::Matrix<double, 12, 12>::Zero();
+  Eigen::Matrix<double, 12, 1> M1, M2;
 
-  for(int i = 0; i < number_of_correspondences; i++)
-    fill_M(M, 2 * i, alphas + 4 * i, us[2 * i], us[2 * i + 1]);
-
-  double mtm[12 * 12], d[12], ut[12 * 12];
-  CvMat MtM = cvMat(12, 12, CV_64F, mtm);
-  CvMat D   = cvMat(12,  1, CV_64F, d);
-  CvMat Ut  = cvMat(12, 12, CV_64F, ut);
+  for(int i = 0; i < number_of_correspondences; i++) {
+    fill_M(M1.data(), M2.data(), alphas + 4 * i, us[2 * i], us[2 * i + 1]);
+    MtM.selfadjointView<Eigen::Lower>().rankUpdate(M1);
+    MtM.selfadjointView<Eigen::Lower>().rankUpdate(M2);
+  }
 
-  cvMulTransposed(M, &MtM, 1);
-  cvSVD(&MtM, &D, &Ut, 0, CV_SVD_MODIFY_A | CV_SVD_U_T);
-  cvReleaseMat(&M);
+  // Rows of ut are the eigenvectors of M'M by decreasing eigenvalue (U' of its SVD)
+  Eigen::SelfAdjointEigenSolver<Eigen::Matrix<double, 12, 12> > eig(MtM);
+  double ut[12 * 12];
+  for(int i = 0; i < 12; i++)
+    for(int j = 0; j < 12; j++)
+      ut[12 * i + j] = eig.eigenvectors()(j, 11 - i);
 
-  double l_6x10[6 * 10], rho[6];
-  CvMat L_6x10 = cvMat(6, 10, CV_64F, l_6x10);
-  CvMat Rho    = cvMat(6,  1, CV_64F, rho);
+  Matrix6x10 L_6x10;
+  Vector6 Rho;
+  double * l_6x10 = L_6x10.data();
+  double * rho = Rho.data();
 
   compute_L_6x10(ut, l_6x10);
   compute_rho(rho);
@@ -503,16 +587,16 @@ double PnPsolver::compute_pose(double R[3][3], double t[3])
   double Betas[4][4], rep_errors[4];
   double Rs[4][3][3], ts[4][3];
 
-  find_betas_approx_1(&L_6x10, &Rho, Betas[1]);
-  gauss_newton(&L_6x10, &Rho, Betas[1]);
+  find_betas_approx_1(L_6x10, Rho, Betas[1]);
+  gauss_newton(L_6x10, Rho, Betas[1]);
   rep_errors[1] = compute_R_and_t(ut, Betas[1], Rs[1], ts[1]);
 
-  find_betas_approx_2(&L_6x10, &Rho, Betas[2]);
-  gauss_newton(&L_6x10, &Rho, Betas[2]);
+  find_betas_approx_2(L_6x10, Rho, Betas[2]);
+  gauss_newton(L_6x10, Rho, Betas[2]);
   rep_errors[2] = compute_R_and_t(ut, Betas[2], Rs[2], ts[2]);
 
-  find_betas_approx_3(&L_6x10, &Rho, Betas[3]);
-  gauss_newton(&L_6x10, &Rho, Betas[3]);
+  find_betas_approx_3(L_6x10, Rho, Betas[3]);
+  gauss_newton(L_6x10, Rho, Betas[3]);
   rep_errors[3] = compute_R_and_t(ut, Betas[3], Rs[3], ts[3]);
 
   int N = 1;
@@ -587,29 +671,24 @@ void PnPsolver::estimate_R_and_t(double R[3][3], double t[3])
     pw0[j] /= number_of_correspondences;
   }
 
-  double abt[3 * 3], abt_d[3], abt_u[3 * 3], abt_v[3 * 3];
-  CvMat ABt   = cvMat(3, 3, CV_64F, abt);
-  CvMat ABt_D = cvMat(3, 1, CV_64F, abt_d);
-  CvMat ABt_U = cvMat(3, 3, CV_64F, abt_u);
-  CvMat ABt_V = cvMat(3, 3, CV_64F, abt_v);
-
-  cvSetZero(&ABt);
+  Eigen::Matrix3d ABt = Eigen::Matrix3d::Zero();
   for(int i = 0; i < number_of_correspondences; i++) {
     double * pc = pcs + 3 * i;
     double * pw = pws + 3 * i;
 
     for(int j = 0; j < 3; j++) {
-      abt[3 * j    ] += (pc[j] - pc0[j]) * (pw[0] - pw0[0]);
-      abt[3 * j + 1] += (pc[j] - pc0[j]) * (pw[1] - pw0[1]);
-      abt[3 * j + 2] += (pc[j] - pc0[j]) * (pw[2] - pw0[2]);
+      ABt(j, 0) += (pc[j] - pc0[j]) * (pw[0] - pw0[0]);
+      ABt(j, 1) += (pc[j] - pc0[j]) * (pw[1] - pw0[1]);
+      ABt(j, 2) += (pc[j] - pc0[j]) * (pw[2] - pw0[2]);
     }
   }
 
-  cvSVD(&ABt, &ABt_D, &ABt_U, &ABt_V, CV_SVD_MODIFY_A);
+  Eigen::JacobiSVD<Eigen::Matrix3d> svd(ABt, Eigen::ComputeFullU | Eigen::ComputeFullV);
+  const Eigen::Matrix3d UVt = svd.matrixU() * svd.matrixV().transpose();
 
   for(int i = 0; i < 3; i++)
     for(int j = 0; j < 3; j++)
-      R[i][j] = dot(abt_u + 3 * i, abt_v + 3 * j);
+      R[i][j] = UVt(i, j);
 
   const double det =
     R[0][0] * R[1][1] * R[2][2] + R[0][1] * R[1][2] * R[2][0] + R[0][2] * R[1][0] * R[2][1] -
@@ -664,21 +743,13 @@ double PnPsolver::compute_R_and_t(const double * ut, const double * betas,
 // betas10        = [B11 B12 B22 B13 B23 B33 B14 B24 B34 B44]
 // betas_approx_1 = [B11 B12     B13         B14]
 
-void PnPsolver::find_betas_approx_1(const CvMat * L_6x10, const CvMat * Rho,
+void PnPsolver::find_betas_approx_1(const Matrix6x10 & L_6x10, const Vector6 & Rho,
 			       double * betas)
 {
-  double l_6x4[6 * 4], b4[4];
-  CvMat L_6x4 = cvMat(6, 4, CV_64F, l_6x4);
-  CvMat B4    = cvMat(4, 1, CV_64F, b4);
-
-  for(int i = 0; i < 6; i++) {
-    cvmSet(&L_6x4, i, 0, cvmGet(L_6x10, i, 0));
-    cvmSet(&L_6x4, i, 1, cvmGet(L_6x10, i, 1));
-    cvmSet(&L_6x4, i, 2, cvmGet(L_6x10, i, 3));
-    cvmSet(&L_6x4, i, 3, cvmGet(L_6x10, i, 6));
-  }
+  Eigen::Matrix<double, 6, 4> L_6x4;
+  L_6x4 << L_6x10.col(0), L_6x10.col(1), L_6x10.col(3), L_6x10.col(6);
 
-  cvSolve(&L_6x4, Rho, &B4, CV_SVD);
+  Eigen::Vector4d b4 = L_6x4.jacobiSvd(Eigen::ComputeFullU | Eigen::ComputeFullV).solve(Rho);
 
   if (b4[0] < 0) {
     betas[0] = sqrt(-b4[0]);
@@ -696,20 +767,12 @@ void PnPsolver::find_betas_approx_1(const CvMat * L_6x10, const CvMat * Rho,
 // betas10        = [B11 B12 B22 B13 B23 B33 B14 B24 B34 B44]
 // betas_approx_2 = [B11 B12 B22                            ]
 
-void PnPsolver::find_betas_approx_2(const CvMat * L_6x10, const CvMat * Rho,
+void PnPsolver::find_betas_approx_2(const Matrix6x10 & L_6x10, const Vector6 & Rho,
 			       double * betas)
 {
-  double l_6x3[6 * 3], b3[3];
-  CvMat L_6x3  = cvMat(6, 3, CV_64F, l_6x3);
-  CvMat B3     = cvMat(3, 1, CV_64F, b3);
-
-  for(int i = 0; i < 6; i++) {
-    cvmSet(&L_6x3, i, 0, cvmGet(L_6x10, i, 0));
-    cvmSet(&L_6x3, i, 1, cvmGet(L_6x10, i, 1));
-    cvmSet(&L_6x3, i, 2, cvmGet(L_6x10, i, 2));
-  }
+  Eigen::Matrix<double, 6, 3> L_6x3 = L_6x10.leftCols<3>();
 
-  cvSolve(&L_6x3, Rho, &B3, CV_SVD);
+  Eigen::Vector3d b3 = L_6x3.jacobiSvd(Eigen::ComputeFullU | Eigen::ComputeFullV).solve(Rho);
 
   if (b3[0] < 0) {
     betas[0] = sqrt(-b3[0]);
@@ -728,22 +791,12 @@ void PnPsolver::find_betas_approx_2(const CvMat * L_6x10, const CvMat * Rho,
 // betas10        = [B11 B12 B22 B13 B23 B33 B14 B24 B34 B44]
 // betas_approx_3 = [B11 B12 B22 B13 B23                    ]
 
-void PnPsolver::find_betas_approx_3(const CvMat * L_6x10, const CvMat * Rho,
+void PnPsolver::find_betas_approx_3(const Matrix6x10 & L_6x10, const Vector6 & Rho,
 			       double * betas)
 {
-  double l_6x5[6 * 5], b5[5];
-  CvMat L_6x5 = cvMat(6, 5, CV_64F, l_6x5);
-  CvMat B5    = cvMat(5, 1, CV_64F, b5);
+  Eigen::Matrix<double, 6, 5> L_6x5 = L_6x10.leftCols<5>();
 
-  for(int i = 0; i < 6; i++) {
-    cvmSet(&L_6x5, i, 0, cvmGet(L_6x10, i, 0));
-    cvmSet(&L_6x5, i, 1, cvmGet(L_6x10, i, 1));
-    cvmSet(&L_6x5, i, 2, cvmGet(L_6x10, i, 2));
-    cvmSet(&L_6x5, i, 3, cvmGet(L_6x10, i, 3));
-    cvmSet(&L_6x5, i, 4, cvmGet(L_6x10, i, 4));
-  }
-
-  cvSolve(&L_6x5, Rho, &B5, CV_SVD);
+  Eigen::Matrix<double, 5, 1> b5 = L_6x5.jacobiSvd(Eigen::ComputeFullU | Eigen::ComputeFullV).solve(Rho);
 
   if (b5[0] < 0) {
     betas[0] = sqrt(-b5[0]);
@@ -810,18 +863,18 @@ void PnPsolver::compute_rho(double * rho)
 }
 
 void PnPsolver::compute_A_and_b_gauss_newton(const double * l_6x10, const double * rho,
-					double betas[4], CvMat * A, CvMat * b)
+					double betas[4], Matrix6x4 & A, Vector6 & b)
 {
   for(int i = 0; i < 6; i++) {
     const double * rowL = l_6x10 + i * 10;
-    double * rowA = A->data.db + i * 4;
+    double * rowA = A.data() + i * 4;
 
     rowA[0] = 2 * rowL[0] * betas[0] +     rowL[1] * betas[1] +     rowL[3] * betas[2] +     rowL[6] * betas[3];
     rowA[1] =     rowL[1] * betas[0] + 2 * rowL[2] * betas[1] +     rowL[4] * betas[2] +     rowL[7] * betas[3];
     rowA[2] =     rowL[3] * betas[0] +     rowL[4] * betas[1] + 2 * rowL[5] * betas[2] +     rowL[8] * betas[3];
     rowA[3] =     rowL[6] * betas[0] +     rowL[7] * betas[1] +     rowL[8] * betas[2] + 2 * rowL[9] * betas[3];
 
-    cvmSet(b, i, 0, rho[i] -
+    b[i] = rho[i] -
 	   (
 	    rowL[0] * betas[0] * betas[0] +
 	    rowL[1] * betas[0] * betas[1] +
@@ -833,124 +886,28 @@ void PnPsolver::compute_A_and_b_gauss_newton(const double * l_6x10, const double
 	    rowL[7] * betas[1] * betas[3] +
 	    rowL[8] * betas[2] * betas[3] +
 	    rowL[9] * betas[3] * betas[3]
-	    ));
+	    );
   }
 }
 
-void PnPsolver::gauss_newton(const CvMat * L_6x10, const CvMat * Rho,
+void PnPsolver::gauss_newton(const Matrix6x10 & L_6x10, const Vector6 & Rho,
 			double betas[4])
 {
   const int iterations_number = 5;
 
-  double a[6*4], b[6], x[4];
-  CvMat A = cvMat(6, 4, CV_64F, a);
-  CvMat B = cvMat(6, 1, CV_64F, b);
-  CvMat X = cvMat(4, 1, CV_64F, x);
+  Matrix6x4 A;
+  Vector6 B;
 
   for(int k = 0; k < iterations_number; k++) {
-    compute_A_and_b_gauss_newton(L_6x10->data.db, Rho->data.db,
-				 betas, &A, &B);
-    qr_solve(&A, &B, &X);
+    compute_A_and_b_gauss_newton(L_6x10.data(), Rho.data(),
+				 betas, A, B);
+    const Eigen::Vector4d x = A.householderQr().solve(B);
 
     for(int i = 0; i < 4; i++)
       betas[i] += x[i];
   }
 }
 
-void PnPsolver::qr_solve(CvMat * A, CvMat * b, CvMat * X)
-{
-  static int max_nr = 0;
-  static double * A1, * A2;
-
-  const int nr = A->rows;
-  const int nc = A->cols;
-
-  if (max_nr != 0 && max_nr < nr) {
-    delete [] A1;
-    delete [] A2;
-  }
-  if (max_nr < nr) {
-    max_nr = nr;
-    A1 = new double[nr];
-    A2 = new double[nr];
-  }
-
-  double * pA = A->data.db, * ppAkk = pA;
-  for(int k = 0; k < nc; k++) {
-    double * ppAik = ppAkk, eta = fabs(*ppAik);
-    for(int i = k + 1; i < nr; i++) {
-      double elt = fabs(*ppAik);
-      if (eta < elt) eta = elt;
-      ppAik += nc;
-    }
-
-    if (eta == 0) {
-      A1[k] = A2[k] = 0.0;
-      cerr << "God damnit, A is singular, this shouldn't happen." << endl;
-      return;
-    } else {
-      double * ppAik = ppAkk, sum = 0.0, inv_eta = 1. / eta;
-      for(int i = k; i < nr; i++) {
-	*ppAik *= inv_eta;
-	sum += *ppAik * *ppAik;
-	ppAik += nc;
-      }
-      double sigma = sqrt(sum);
-      if (*ppAkk < 0)
-	sigma = -sigma;
-      *ppAkk += sigma;
-      A1[k] = sigma * *ppAkk;
-      A2[k] = -eta * sigma;
-      for(int j = k + 1; j < nc; j++) {
-	double * ppAik = ppAkk, sum = 0;
-	for(int i = k; i < nr; i++) {
-	  sum += *ppAik * ppAik[j - k];
-	  ppAik += nc;
-	}
-	double tau = sum / A1[k];
-	ppAik = ppAkk;
-	for(int i = k; i < nr; i++) {
-	  ppAik[j - k] -= tau * *ppAik;
-	  ppAik += nc;
-	}
-      }
-    }
-    ppAkk += nc + 1;
-  }
-
-  // b <- Qt b
-  double * ppAjj = pA, * pb = b->data.db;
-  for(int j = 0; j < nc; j++) {
-    double * ppAij = ppAjj, tau = 0;
-    for(int i = j; i < nr; i++)	{
-      tau += *ppAij * pb[i];
-      ppAij += nc;
-    }
-    tau /= A1[j];
-    ppAij = ppAjj;
-    for(int i = j; i < nr; i++) {
-      pb[i] -= tau * *ppAij;
-      ppAij += nc;
-    }
-    ppAjj += nc + 1;
-  }
-
-  // X = R-1 b
-  double * pX = X->data.db;
-  pX[nc - 1] = pb[nc - 1] / A2[nc - 1];
-  for(int i = nc - 2; i >= 0; i--) {
-    double * ppAij = pA + i * nc + (i + 1), sum = 0;
-
-    for(int j = i + 1; j < nc; j++) {
-      sum += *ppAij * pX[j];
-      ppAij++;
-    }
-    pX[i] = (pb[i] - sum) / A2[i];
-  }
-}
-
-
-
 void PnPsolver::relative_error(double & rot_err, double & transl_err,
 			  const double Rtrue[3][3], const double ttrue[3],
 			  const double Rest[3][3],  const double test[3])
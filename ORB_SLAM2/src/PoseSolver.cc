@@ -0,0 +1,363 @@
+/**
+* This file is part of ORB-SLAM2.
+*
+* Copyright (C) 2014-2016 Raúl Mur-Artal <raulmur at unizar dot es> (University of Zaragoza)
+* For more information see <https://github.com/raulmur/ORB_SLAM2>
+*
+* ORB-SLAM2 is free software: you can redistribute it and/or modify
+* it under the terms of the GNU General Public License as published by
+* the Free Software Foundation, either version 3 of the License, or
+* (at your option) any later version.
+*
+* ORB-SLAM2 is distributed in the hope that it will be useful,
+* but WITHOUT ANY WARRANTY; without even the implied warranty of
+* MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+* GNU General Public License for more details.
+*
+* You should have received a copy of the GNU General Public License
+* along with ORB-SLAM2. If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#include "PoseSolver.h"
+
+#include <Eigen/Cholesky>
+#include <algorithm>
+#include <cmath>
+#include <limits>
+
+namespace ORB_SLAM2
+{
+
+PoseSolver::PoseSolver():
+    mfx(0), mfy(0), mcx(0), mcy(0), mbf(0), mN(0), mbRobust(true)
+{
+}
+
+void PoseSolver::Reset(const float fx, const float fy, const float cx, const float cy, const float bf)
+{
+    mfx = fx;
+    mfy = fy;
+    mcx = cx;
+    mcy = cy;
+    mbf = bf;
+    mN = 0;
+    mbRobust = true;
+}
+
+void PoseSolver::Grow()
+{
+    const size_t n = std::max<size_t>(2*mvX.size(), 64*LANES);
+
+    std::vector<double>* vBuffers[] = {&mvX, &mvY, &mvZ, &mvU, &mvV, &mvUr, &mvInfo, &mvDelta, &mvStereo,
+                                       &mvActive, &mvXc, &mvYc, &mvInvZ, &mvE0, &mvE1, &mvE2, &mvChi2,
+                                       &mvRobustChi2, &mvWeight};
+    for(size_t i=0; i<sizeof(vBuffers)/sizeof(vBuffers[0]); i++)
+        vBuffers[i]->resize(n,0.0);
+}
+
+int PoseSolver::AddMonocular(const cv::Mat &Xw, const float u, const float v, const float invSigma2,
+                             const float delta)
+{
+    if(mN==(int)mvX.size())
+        Grow();
+
+    const int i = mN++;
+    mvX[i] = Xw.at<float>(0);
+    mvY[i] = Xw.at<float>(1);
+    mvZ[i] = Xw.at<float>(2);
+    mvU[i] = u;
+    mvV[i] = v;
+    mvUr[i] = 0;
+    mvInfo[i] = invSigma2;
+    mvDelta[i] = delta;
+    mvStereo[i] = 0;
+    mvActive[i] = 1;
+
+    return i;
+}
+
+int PoseSolver::AddStereo(const cv::Mat &Xw, const float u, const float v, const float ur,
+                          const float invSigma2, const float delta)
+{
+    const int i = AddMonocular(Xw,u,v,invSigma2,delta);
+    mvUr[i] = ur;
+    mvStereo[i] = 1;
+
+    return i;
+}
+
+int PoseSolver::ActiveSize() const
+{
+    int n=0;
+    for(int i=0; i<mN; i++)
+        if(mvActive[i]>0)
+            n++;
+    return n;
+}
+
+void PoseSolver::ClearPadding()
+{
+    const int nPadded = ((mN+LANES-1)/LANES)*LANES;
+    for(int i=mN; i<nPadded; i++)
+        mvActive[i] = 0;
+}
+
+double PoseSolver::Evaluate(const g2o::SE3Quat &Tcw)
+{
+    ClearPadding();
+
+    const Eigen::Matrix3d R = Tcw.rotation().toRotationMatrix();
+    const Eigen::Vector3d t = Tcw.translation();
+    const double r00=R(0,0), r01=R(0,1), r02=R(0,2);
+    const double r10=R(1,0), r11=R(1,1), r12=R(1,2);
+    const double r20=R(2,0), r21=R(2,1), r22=R(2,2);
+    const double t0=t[0], t1=t[1], t2=t[2];
+    const double fx=mfx, fy=mfy, cx=mcx, cy=mcy, bf=mbf;
+    const double robust = mbRobust ? 1.0 : 0.0;
+
+    const double* X = mvX.data();
+    const double* Y = mvY.data();
+    const double* Z = mvZ.data();
+    const double* U = mvU.data();
+    const double* V = mvV.data();
+    const double* Ur = mvUr.data();
+    const double* info = mvInfo.data();
+    const double* delta = mvDelta.data();
+    const double* stereo = mvStereo.data();
+    const double* active = mvActive.data();
+    double* xc = mvXc.data();
+    double* yc = mvYc.data();
+    double* invz = mvInvZ.data();
+    double* e0 = mvE0.data();
+    double* e1 = mvE1.data();
+    double* e2 = mvE2.data();
+    double* chi2 = mvChi2.data();
+    double* robustChi2 = mvRobustChi2.data();
+    double* w = mvWeight.data();
+
+    // Branchless so that it is vectorized (the buffers never alias, and sqrt needs -fno-math-errno).
+    // Inactive correspondences keep their chi2 but get neutral coordinates and errors, a point
+    // behind the camera would otherwise spread NaNs in the system.
+    const int nPadded = ((mN+LANES-1)/LANES)*LANES;
+#pragma GCC ivdep
+    for(int i=0; i<nPadded; i++)
+    {
+        const double x = r00*X[i]+r01*Y[i]+r02*Z[i]+t0;
+        const double y = r10*X[i]+r11*Y[i]+r12*Z[i]+t1;
+        const double z = r20*X[i]+r21*Y[i]+r22*Z[i]+t2;
+        const double iz = 1.0/z;
+
+        const double u = fx*x*iz+cx;
+        const double v = fy*y*iz+cy;
+        const double eu = U[i]-u;
+        const double ev = V[i]-v;
+        const double er = stereo[i]*(Ur[i]-(u-bf*iz));
+
+        const double c = info[i]*(eu*eu+ev*ev+er*er);
+        chi2[i] = c;
+
+        // Huber kernel on the chi2: rho(s) = s inside, 2*delta*sqrt(s)-delta^2 outside, and the
+        // normal equations are weighted with rho'(s)
+        const double d = delta[i];
+        const double d2 = d*d;
+        const bool bOut = robust*c>d2;
+        const double sq = std::sqrt(std::max(c,d2));
+        const double rc = bOut ? 2*sq*d-d2 : c;
+        const double rw = bOut ? d/sq : 1.0;
+
+        const bool bActive = active[i]>0;
+        robustChi2[i] = bActive ? rc : 0.0;
+        w[i] = bActive ? info[i]*rw : 0.0;
+        xc[i] = bActive ? x : 0.0;
+        yc[i] = bActive ? y : 0.0;
+        invz[i] = bActive ? iz : 0.0;
+        e0[i] = bActive ? eu : 0.0;
+        e1[i] = bActive ? ev : 0.0;
+        e2[i] = bActive ? er : 0.0;
+    }
+
+    double sum = 0;
+    for(int i=0; i<mN; i++)
+        sum += robustChi2[i];
+
+    return sum;
+}
+
+void PoseSolver::BuildSystem(Matrix6d &H, Vector6d &b)
+{
+    // Partial sums of each lane, added together at the end
+    double HL[21][LANES];
+    double bL[6][LANES];
+    for(int l=0; l<LANES; l++)
+    {
+        for(int n=0; n<21; n++)
+            HL[n][l] = 0;
+        for(int r=0; r<6; r++)
+            bL[r][l] = 0;
+    }
+
+    const double fx=mfx, fy=mfy, bf=mbf;
+
+    const int nPadded = ((mN+LANES-1)/LANES)*LANES;
+    for(int i=0; i<nPadded; i+=LANES)
+    {
+        // Jacobians of EdgeSE3ProjectXYZOnlyPose (rows 0,1) and EdgeStereoSE3ProjectXYZOnlyPose (row 2)
+        // for the update exp(dx)*Tcw, dx = (omega,upsilon)
+        double J0[6][LANES], J1[6][LANES], J2[6][LANES];
+        double w[LANES], ws[LANES], e0[LANES], e1[LANES], e2[LANES];
+        for(int l=0; l<LANES; l++)
+        {
+            const int k = i+l;
+            const double x = mvXc[k];
+            const double y = mvYc[k];
+            const double iz = mvInvZ[k];
+            const double iz2 = iz*iz;
+
+            J0[0][l] = x*y*iz2*fx;
+            J0[1][l] = -(1+x*x*iz2)*fx;
+            J0[2][l] = y*iz*fx;
+            J0[3][l] = -iz*fx;
+            J0[4][l] = 0;
+            J0[5][l] = x*iz2*fx;
+
+            J1[0][l] = (1+y*y*iz2)*fy;
+            J1[1][l] = -x*y*iz2*fy;
+            J1[2][l] = -x*iz*fy;
+            J1[3][l] = 0;
+            J1[4][l] = -iz*fy;
+            J1[5][l] = y*iz2*fy;
+
+            J2[0][l] = J0[0][l]-bf*y*iz2;
+            J2[1][l] = J0[1][l]+bf*x*iz2;
+            J2[2][l] = J0[2][l];
+            J2[3][l] = J0[3][l];
+            J2[4][l] = 0;
+            J2[5][l] = J0[5][l]-bf*iz2;
+
+            w[l] = mvWeight[k];
+            ws[l] = w[l]*mvStereo[k];
+            e0[l] = mvE0[k];
+            e1[l] = mvE1[k];
+            e2[l] = mvE2[k];
+        }
+
+        // Upper triangle of H += J'*W*J
+        int n=0;
+        for(int r=0; r<6; r++)
+        {
+            for(int c=r; c<6; c++, n++)
+            {
+                for(int l=0; l<LANES; l++)
+                    HL[n][l] += w[l]*(J0[r][l]*J0[c][l]+J1[r][l]*J1[c][l]) + ws[l]*J2[r][l]*J2[c][l];
+            }
+        }
+
+        // b -= J'*W*e
+        for(int r=0; r<6; r++)
+        {
+            for(int l=0; l<LANES; l++)
+                bL[r][l] -= w[l]*(J0[r][l]*e0[l]+J1[r][l]*e1[l]) + ws[l]*J2[r][l]*e2[l];
+        }
+    }
+
+    int n=0;
+    for(int r=0; r<6; r++)
+    {
+        for(int c=r; c<6; c++, n++)
+        {
+            double s = 0;
+            for(int l=0; l<LANES; l++)
+                s += HL[n][l];
+            H(r,c) = s;
+            H(c,r) = s;
+        }
+
+        double s = 0;
+        for(int l=0; l<LANES; l++)
+            s += bL[r][l];
+        b[r] = s;
+    }
+}
+
+void PoseSolver::Optimize(const int nIterations)
+{
+    if(ActiveSize()==0)
+        return;
+
+    // Same steps and termination as g2o::OptimizationAlgorithmLevenberg with its default parameters
+    const double tau = 1e-5;
+    const int maxTrialsAfterFailure = 10;
+
+    double lambda = 0;
+    double ni = 2;
+    int nBad = 0;
+
+    Matrix6d H;
+    Vector6d b;
+
+    for(int it=0; it<nIterations; it++)
+    {
+        double currentChi = Evaluate(mTcw);
+        const double iniChi = currentChi;
+
+        BuildSystem(H,b);
+
+        if(it==0)
+        {
+            lambda = tau*H.diagonal().cwiseAbs().maxCoeff();
+            ni = 2;
+            nBad = 0;
+        }
+
+        double rho = 0;
+        int nTrials = 0;
+        do
+        {
+            Matrix6d Hl = H;
+            Hl.diagonal().array() += lambda;
+
+            Eigen::LDLT<Matrix6d> ldlt(Hl);
+            const bool bSolved = ldlt.isPositive();
+            const Vector6d dx = bSolved ? Vector6d(ldlt.solve(b)) : Vector6d(Vector6d::Zero());
+
+            const g2o::SE3Quat Tcw = g2o::SE3Quat::exp(dx)*mTcw;
+            const double tempChi = bSolved ? Evaluate(Tcw) : std::numeric_limits<double>::max();
+
+            const double scale = dx.dot(lambda*dx+b) + 1e-3;
+            rho = (currentChi-tempChi)/scale;
+
+            if(rho>0 && std::isfinite(tempChi))
+            {
+                const double alpha = std::min(1.0-std::pow(2*rho-1,3), 2.0/3.0);
+                lambda *= std::max(1.0/3.0, alpha);
+                ni = 2;
+                currentChi = tempChi;
+                mTcw = Tcw;
+            }
+            else
+            {
+                lambda *= ni;
+                ni *= 2;
+            }
+            nTrials++;
+        } while(rho<0 && nTrials<maxTrialsAfterFailure);
+
+        if(nTrials==maxTrialsAfterFailure || rho==0)
+            break;
+
+        if((iniChi-currentChi)*1e3<iniChi)
+            nBad++;
+        else
+            nBad=0;
+
+        if(nBad>=3)
+            break;
+    }
+}
+
+void PoseSolver::ComputeChi2()
+{
+    Evaluate(mTcw);
+}
+
+} //namespace ORB_SLAM
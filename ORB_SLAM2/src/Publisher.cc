@@ -0,0 +1,673 @@
+/**
+* This file is part of ORB-SLAM2.
+*
+* Copyright (C) 2014-2016 Raúl Mur-Artal <raulmur at unizar dot es> (University of Zaragoza)
+* For more information see <https://github.com/raulmur/ORB_SLAM2>
+*
+* ORB-SLAM2 is free software: you can redistribute it and/or modify
+* it under the terms of the GNU General Public License as published by
+* the Free Software Foundation, either version 3 of the License, or
+* (at your option) any later version.
+*
+* ORB-SLAM2 is distributed in the hope that it will be useful,
+* but WITHOUT ANY WARRANTY; without even the implied warranty of
+* MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+* GNU General Public License for more details.
+*
+* You should have received a copy of the GNU General Public License
+* along with ORB-SLAM2. If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#include "Publisher.h"
+#include "Map.h"
+#include "KeyFrame.h"
+#include "MapPoint.h"
+#include "LittleEndian.h"
+
+#include <chrono>
+#include <cstring>
+#include <cmath>
+#include <iostream>
+#include <stdint.h>
+#include <unistd.h>
+#include <fcntl.h>
+#include <errno.h>
+#include <sys/socket.h>
+#include <sys/un.h>
+#include <netinet/in.h>
+
+namespace ORB_SLAM2
+{
+
+namespace
+{
+
+enum MessageType
+{
+    MSG_POSE = 1,
+    MSG_MAP = 2
+};
+
+enum MapFlags
+{
+    MAP_SNAPSHOT = 1,
+    MAP_BIG_CHANGE = 2
+};
+
+// Positions and poses that moved less than this are not sent again
+const float kfMinChange = 1e-4f;
+
+// Builds a message: header {type, payload size} then the payload
+class MessageWriter
+{
+public:
+    explicit MessageWriter(const uint32_t type)
+    {
+        Put(type);
+        Put<uint32_t>(0);
+    }
+
+    template<typename T>
+    void Put(const T &value)
+    {
+        char bytes[sizeof(T)];
+        EncodeLittleEndian(value, bytes);
+        mBuffer.append(bytes, sizeof(T));
+    }
+
+    template<typename T, size_t N>
+    void PutArray(const T (&values)[N])
+    {
+        for(size_t i=0; i<N; i++)
+            Put(values[i]);
+    }
+
+    void PutBytes(const void* data, const size_t n)
+    {
+        mBuffer.append(static_cast<const char*>(data), n);
+    }
+
+    // Reserves the count of an array, to be filled by EndArray
+    size_t BeginArray()
+    {
+        Put<uint32_t>(0);
+        return mBuffer.size() - sizeof(uint32_t);
+    }
+
+    void EndArray(const size_t pos, const uint32_t n)
+    {
+        EncodeLittleEndian(n, &mBuffer[pos]);
+    }
+
+    std::string &Finish()
+    {
+        const uint32_t size = mBuffer.size() - 2*sizeof(uint32_t);
+        EncodeLittleEndian(size, &mBuffer[sizeof(uint32_t)]);
+        return mBuffer;
+    }
+
+private:
+    std::string mBuffer;
+};
+
+// First three rows of a 4x4 CV_32F transformation, row major
+void ToRows(const cv::Mat &T, float* rows)
+{
+    for(int i=0; i<3; i++)
+        for(int j=0; j<4; j++)
+            rows[4*i+j] = T.at<float>(i,j);
+}
+
+bool Moved(const float* a, const float* b, const int n)
+{
+    for(int i=0; i<n; i++)
+        if(std::fabs(a[i]-b[i])>kfMinChange)
+            return true;
+    return false;
+}
+
+}
+
+Publisher::Publisher(Map *pMap, const std::string &strSettingPath):
+    mpMap(pMap), mListenFd(-1), mnSweep(0), mnLastBigChangeIdx(0),
+    mbFinishRequested(false), mbFinished(true), mbStopRequested(false), mbStopped(false)
+{
+    cv::FileStorage fSettings(strSettingPath, cv::FileStorage::READ);
+
+    mStrSocketPath = (std::string) fSettings["Publisher.Socket"];
+    mnPort = fSettings["Publisher.Port"];
+
+    mnPeriod = fSettings["Publisher.Period"];
+    if(mnPeriod<1)
+        mnPeriod = 100;
+
+    int nMaxQueueKB = fSettings["Publisher.MaxQueueKB"];
+    if(nMaxQueueKB<1)
+        nMaxQueueKB = 4096;
+    mnMaxQueueBytes = (size_t) nMaxQueueKB*1024;
+}
+
+void Publisher::Run()
+{
+    mbFinished = false;
+
+    if(!SetupSocket())
+    {
+        SetFinish();
+        return;
+    }
+
+    typedef std::chrono::steady_clock Clock;
+    Clock::time_point tNextMap = Clock::now();
+
+    while(1)
+    {
+        std::deque<std::string> dPoses;
+        {
+            // Wake up for new poses, the next map diff, or to keep sending a backlog
+            Clock::time_point tWake = tNextMap;
+            if(HasBacklog())
+                tWake = std::min(tWake, Clock::now() + std::chrono::milliseconds(5));
+            std::unique_lock<std::mutex> lock(mMutexPoses);
+            mcvPoses.wait_until(lock, tWake, [this]{ return !mdPoses.empty() || CheckFinish() || CheckStopRequested(); });
+            dPoses.swap(mdPoses);
+        }
+
+        AcceptSubscribers();
+
+        for(std::deque<std::string>::const_iterator it=dPoses.begin(); it!=dPoses.end(); it++)
+            Broadcast(*it, false);
+
+        if(Clock::now()>=tNextMap)
+        {
+            const std::string delta = UpdateMap();
+            if(!delta.empty())
+                Broadcast(delta, true);
+            tNextMap = Clock::now() + std::chrono::milliseconds(mnPeriod);
+        }
+
+        Flush();
+
+        // Paused while the map is reset
+        if(Stop())
+        {
+            std::unique_lock<std::mutex> lock(mMutexStop);
+            while(mbStopped)
+                mcvStop.wait(lock);
+        }
+
+        if(CheckFinish())
+            break;
+    }
+
+    CloseAll();
+    SetFinish();
+}
+
+void Publisher::PublishPose(const long unsigned int nFrameId, const double timestamp, const int state, const cv::Mat &Tcw)
+{
+    MessageWriter msg(MSG_POSE);
+    msg.Put<uint64_t>(nFrameId);
+    msg.Put<double>(timestamp);
+    msg.Put<int32_t>(state);
+    float rows[12] = {0};
+    if(!Tcw.empty())
+        ToRows(Tcw, rows);
+    msg.PutArray(rows);
+
+    {
+        std::unique_lock<std::mutex> lock(mMutexPoses);
+        // The publisher is late, old poses are worth less than the new ones
+        if(mdPoses.size()>=256)
+            mdPoses.pop_front();
+        mdPoses.push_back(msg.Finish());
+    }
+    mcvPoses.notify_one();
+}
+
+bool Publisher::SetupSocket()
+{
+    if(!mStrSocketPath.empty())
+    {
+        mListenFd = socket(AF_UNIX, SOCK_STREAM, 0);
+        sockaddr_un addr;
+        memset(&addr, 0, sizeof(addr));
+        addr.sun_family = AF_UNIX;
+        strncpy(addr.sun_path, mStrSocketPath.c_str(), sizeof(addr.sun_path)-1);
+        unlink(mStrSocketPath.c_str());
+        if(mListenFd<0 || bind(mListenFd, (sockaddr*) &addr, sizeof(addr))<0)
+        {
+            perror("Publisher: cannot bind socket");
+            if(mListenFd>=0)
+                close(mListenFd);
+            mListenFd = -1;
+            return false;
+        }
+    }
+    else
+    {
+        mListenFd = socket(AF_INET, SOCK_STREAM, 0);
+        int option = 1;
+        setsockopt(mListenFd, SOL_SOCKET, SO_REUSEADDR, &option, sizeof(option));
+        sockaddr_in addr;
+        memset(&addr, 0, sizeof(addr));
+        addr.sin_family = AF_INET;
+        addr.sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+        addr.sin_port = htons(mnPort);
+        if(mListenFd<0 || bind(mListenFd, (sockaddr*) &addr, sizeof(addr))<0)
+        {
+            perror("Publisher: cannot bind port");
+            if(mListenFd>=0)
+                close(mListenFd);
+            mListenFd = -1;
+            return false;
+        }
+    }
+
+    if(listen(mListenFd, 8)<0)
+    {
+        perror("Publisher: cannot listen");
+        close(mListenFd);
+        mListenFd = -1;
+        return false;
+    }
+    fcntl(mListenFd, F_SETFL, fcntl(mListenFd, F_GETFL, 0) | O_NONBLOCK);
+
+    std::cout << "Publishing poses and map on " << (mStrSocketPath.empty() ? "localhost port " : "")
+              << (mStrSocketPath.empty() ? std::to_string(mnPort) : mStrSocketPath) << std::endl;
+    return true;
+}
+
+void Publisher::AcceptSubscribers()
+{
+    while(1)
+    {
+        const int fd = accept(mListenFd, NULL, NULL);
+        if(fd<0)
+            return;
+        fcntl(fd, F_SETFL, fcntl(fd, F_GETFL, 0) | O_NONBLOCK);
+
+        Subscriber sub;
+        sub.mFd = fd;
+        sub.mnQueuedBytes = 0;
+        sub.mnFrontSent = 0;
+        mvSubscribers.push_back(sub);
+        Enqueue(mvSubscribers.back(), Snapshot());
+    }
+}
+
+std::string Publisher::UpdateMap()
+{
+    mnSweep++;
+
+    const int nBigChangeIdx = mpMap->GetLastBigChangeIdx();
+    const bool bBigChange = nBigChangeIdx!=mnLastBigChangeIdx;
+    mnLastBigChangeIdx = nBigChangeIdx;
+
+    MessageWriter msg(MSG_MAP);
+    msg.Put<uint8_t>(bBigChange ? MAP_BIG_CHANGE : 0);
+    msg.Put<int32_t>(nBigChangeIdx);
+    uint32_t nChanges = 0;
+
+    // KeyFrames
+    {
+        const std::vector<KeyFrame*> vpKFs = mpMap->GetAllKeyFrames();
+        size_t pos = msg.BeginArray();
+        uint32_t n = 0;
+        for(size_t i=0; i<vpKFs.size(); i++)
+        {
+            KeyFrame* pKF = vpKFs[i];
+            if(pKF->isBad())
+                continue;
+            float Twc[12];
+            ToRows(pKF->GetPoseInverse(), Twc);
+
+            std::unordered_map<long unsigned int, KeyFrameState>::iterator it = mmKeyFrames.find(pKF->mnId);
+            bool bSend = true;
+            if(it==mmKeyFrames.end())
+            {
+                it = mmKeyFrames.insert(std::make_pair(pKF->mnId, KeyFrameState())).first;
+                it->second.mTimeStamp = pKF->mTimeStamp;
+            }
+            else
+                bSend = Moved(it->second.mTwc, Twc, 12);
+            it->second.mnSweep = mnSweep;
+
+            if(bSend)
+            {
+                memcpy(it->second.mTwc, Twc, sizeof(Twc));
+                msg.Put<uint64_t>(pKF->mnId);
+                msg.Put<double>(pKF->mTimeStamp);
+                msg.PutArray(Twc);
+                n++;
+            }
+        }
+        msg.EndArray(pos, n);
+        nChanges += n;
+
+        pos = msg.BeginArray();
+        n = 0;
+        for(std::unordered_map<long unsigned int, KeyFrameState>::iterator it=mmKeyFrames.begin(); it!=mmKeyFrames.end(); )
+        {
+            if(it->second.mnSweep==mnSweep)
+            {
+                it++;
+                continue;
+            }
+            msg.Put<uint64_t>(it->first);
+            n++;
+            it = mmKeyFrames.erase(it);
+        }
+        msg.EndArray(pos, n);
+        nChanges += n;
+    }
+
+    // MapPoints
+    {
+        const std::vector<MapPoint*> vpMPs = mpMap->GetAllMapPoints();
+        size_t pos = msg.BeginArray();
+        uint32_t n = 0;
+        for(size_t i=0; i<vpMPs.size(); i++)
+        {
+            MapPoint* pMP = vpMPs[i];
+            if(pMP->isBad())
+                continue;
+            const cv::Mat Pw = pMP->GetWorldPos();
+            const float pos3[3] = {Pw.at<float>(0), Pw.at<float>(1), Pw.at<float>(2)};
+
+            std::unordered_map<long unsigned int, MapPointState>::iterator it = mmMapPoints.find(pMP->mnId);
+            bool bSend = true;
+            if(it==mmMapPoints.end())
+                it = mmMapPoints.insert(std::make_pair(pMP->mnId, MapPointState())).first;
+            else
+                bSend = Moved(it->second.mPw, pos3, 3);
+            it->second.mnSweep = mnSweep;
+
+            if(bSend)
+            {
+                memcpy(it->second.mPw, pos3, sizeof(pos3));
+                msg.Put<uint64_t>(pMP->mnId);
+                msg.PutArray(pos3);
+                n++;
+            }
+        }
+        msg.EndArray(pos, n);
+        nChanges += n;
+
+        pos = msg.BeginArray();
+        n = 0;
+        for(std::unordered_map<long unsigned int, MapPointState>::iterator it=mmMapPoints.begin(); it!=mmMapPoints.end(); )
+        {
+            if(it->second.mnSweep==mnSweep)
+            {
+                it++;
+                continue;
+            }
+            msg.Put<uint64_t>(it->first);
+            n++;
+            it = mmMapPoints.erase(it);
+        }
+        msg.EndArray(pos, n);
+        nChanges += n;
+    }
+
+    // Semantic objects
+    {
+        const std::vector<SemanticObject> vObjects = mpMap->mObjectMap.GetObjects();
+        size_t pos = msg.BeginArray();
+        uint32_t n = 0;
+        for(size_t i=0; i<vObjects.size(); i++)
+        {
+            const SemanticObject &obj = vObjects[i];
+            std::unordered_map<long unsigned int, ObjectState>::iterator it = mmObjects.find(obj.mnId);
+            bool bSend = true;
+            if(it==mmObjects.end())
+            {
+                it = mmObjects.insert(std::make_pair(obj.mnId, ObjectState())).first;
+                it->second.mClassName = obj.mClassName;
+            }
+            else
+            {
+                bSend = it->second.mnObservations!=obj.mnObservations ||
+                        (obj.mPw - Eigen::Map<const Eigen::Vector3d>(it->second.mPw)).cwiseAbs().maxCoeff()>kfMinChange;
+            }
+            it->second.mnSweep = mnSweep;
+
+            if(bSend)
+            {
+                Eigen::Map<Eigen::Vector3d>(it->second.mPw) = obj.mPw;
+                it->second.mnObservations = obj.mnObservations;
+                msg.Put<uint64_t>(obj.mnId);
+                msg.Put<uint16_t>(obj.mClassName.size());
+                msg.PutBytes(obj.mClassName.data(), obj.mClassName.size());
+                msg.PutArray(it->second.mPw);
+                msg.Put<int32_t>(obj.mnObservations);
+                n++;
+            }
+        }
+        msg.EndArray(pos, n);
+        nChanges += n;
+
+        pos = msg.BeginArray();
+        n = 0;
+        for(std::unordered_map<long unsigned int, ObjectState>::iterator it=mmObjects.begin(); it!=mmObjects.end(); )
+        {
+            if(it->second.mnSweep==mnSweep)
+            {
+                it++;
+                continue;
+            }
+            msg.Put<uint64_t>(it->first);
+            n++;
+            it = mmObjects.erase(it);
+        }
+        msg.EndArray(pos, n);
+        nChanges += n;
+    }
+
+    if(nChanges==0 && !bBigChange)
+        return std::string();
+    return msg.Finish();
+}
+
+std::string Publisher::Snapshot()
+{
+    MessageWriter msg(MSG_MAP);
+    msg.Put<uint8_t>(MAP_SNAPSHOT);
+    msg.Put<int32_t>(mnLastBigChangeIdx);
+
+    msg.Put<uint32_t>(mmKeyFrames.size());
+    for(std::unordered_map<long unsigned int, KeyFrameState>::const_iterator it=mmKeyFrames.begin(); it!=mmKeyFrames.end(); it++)
+    {
+        msg.Put<uint64_t>(it->first);
+        msg.Put<double>(it->second.mTimeStamp);
+        msg.PutArray(it->second.mTwc);
+    }
+    msg.Put<uint32_t>(0);
+
+    msg.Put<uint32_t>(mmMapPoints.size());
+    for(std::unordered_map<long unsigned int, MapPointState>::const_iterator it=mmMapPoints.begin(); it!=mmMapPoints.end(); it++)
+    {
+        msg.Put<uint64_t>(it->first);
+        msg.PutArray(it->second.mPw);
+    }
+    msg.Put<uint32_t>(0);
+
+    msg.Put<uint32_t>(mmObjects.size());
+    for(std::unordered_map<long unsigned int, ObjectState>::const_iterator it=mmObjects.begin(); it!=mmObjects.end(); it++)
+    {
+        msg.Put<uint64_t>(it->first);
+        msg.Put<uint16_t>(it->second.mClassName.size());
+        msg.PutBytes(it->second.mClassName.data(), it->second.mClassName.size());
+        msg.PutArray(it->second.mPw);
+        msg.Put<int32_t>(it->second.mnObservations);
+    }
+    msg.Put<uint32_t>(0);
+
+    return msg.Finish();
+}
+
+void Publisher::Broadcast(const std::string &msg, const bool bMapDelta)
+{
+    for(size_t i=0; i<mvSubscribers.size(); i++)
+    {
+        Subscriber &sub = mvSubscribers[i];
+        if(sub.mnQueuedBytes+msg.size()<=mnMaxQueueBytes)
+            Enqueue(sub, msg);
+        else if(bMapDelta)
+            Resync(sub);
+        // else the pose is dropped for this subscriber
+    }
+}
+
+void Publisher::Enqueue(Subscriber &sub, const std::string &msg)
+{
+    sub.mdQueue.push_back(msg);
+    sub.mnQueuedBytes += msg.size();
+}
+
+void Publisher::Resync(Subscriber &sub)
+{
+    // A partially sent message must be completed to keep the stream framed
+    while(sub.mdQueue.size()>(sub.mnFrontSent>0 ? 1u : 0u))
+    {
+        sub.mnQueuedBytes -= sub.mdQueue.back().size();
+        sub.mdQueue.pop_back();
+    }
+    // The published state already includes the delta that did not fit
+    Enqueue(sub, Snapshot());
+}
+
+void Publisher::Flush()
+{
+    for(std::vector<Subscriber>::iterator it=mvSubscribers.begin(); it!=mvSubscribers.end(); )
+    {
+        Subscriber &sub = *it;
+        bool bClosed = false;
+        while(!sub.mdQueue.empty())
+        {
+            const std::string &msg = sub.mdQueue.front();
+            const ssize_t nSent = send(sub.mFd, msg.data()+sub.mnFrontSent, msg.size()-sub.mnFrontSent, MSG_NOSIGNAL);
+            if(nSent<0)
+            {
+                if(errno!=EAGAIN && errno!=EWOULDBLOCK && errno!=EINTR)
+                    bClosed = true;
+                break;
+            }
+            sub.mnFrontSent += nSent;
+            if(sub.mnFrontSent<msg.size())
+                break;
+            sub.mnQueuedBytes -= msg.size();
+            sub.mnFrontSent = 0;
+            sub.mdQueue.pop_front();
+        }
+
+        if(bClosed)
+        {
+            close(sub.mFd);
+            it = mvSubscribers.erase(it);
+        }
+        else
+            it++;
+    }
+}
+
+bool Publisher::HasBacklog()
+{
+    for(size_t i=0; i<mvSubscribers.size(); i++)
+        if(!mvSubscribers[i].mdQueue.empty())
+            return true;
+    return false;
+}
+
+void Publisher::CloseAll()
+{
+    for(size_t i=0; i<mvSubscribers.size(); i++)
+        close(mvSubscribers[i].mFd);
+    mvSubscribers.clear();
+    if(mListenFd>=0)
+        close(mListenFd);
+    mListenFd = -1;
+    if(!mStrSocketPath.empty())
+        unlink(mStrSocketPath.c_str());
+}
+
+void Publisher::RequestFinish()
+{
+    {
+        std::unique_lock<std::mutex> lock(mMutexFinish);
+        mbFinishRequested = true;
+    }
+    mcvPoses.notify_one();
+}
+
+bool Publisher::CheckFinish()
+{
+    std::unique_lock<std::mutex> lock(mMutexFinish);
+    return mbFinishRequested;
+}
+
+void Publisher::SetFinish()
+{
+    std::unique_lock<std::mutex> lock(mMutexFinish);
+    mbFinished = true;
+}
+
+bool Publisher::isFinished()
+{
+    std::unique_lock<std::mutex> lock(mMutexFinish);
+    return mbFinished;
+}
+
+void Publisher::RequestStop()
+{
+    {
+        std::unique_lock<std::mutex> lock(mMutexStop);
+        if(!mbStopped)
+            mbStopRequested = true;
+    }
+    // Take the poses mutex so that the worker cannot miss the notification
+    {
+        std::unique_lock<std::mutex> lock(mMutexPoses);
+    }
+    mcvPoses.notify_one();
+}
+
+bool Publisher::isStopped()
+{
+    // A worker that is not running does not read the map either
+    if(isFinished())
+        return true;
+    std::unique_lock<std::mutex> lock(mMutexStop);
+    return mbStopped;
+}
+
+bool Publisher::Stop()
+{
+    std::unique_lock<std::mutex> lock(mMutexStop);
+    if(mbStopRequested)
+    {
+        mbStopped = true;
+        mbStopRequested = false;
+        return true;
+    }
+    return false;
+}
+
+bool Publisher::CheckStopRequested()
+{
+    std::unique_lock<std::mutex> lock(mMutexStop);
+    return mbStopRequested;
+}
+
+void Publisher::Release()
+{
+    {
+        std::unique_lock<std::mutex> lock(mMutexStop);
+        mbStopRequested = false;
+        mbStopped = false;
+    }
+    mcvStop.notify_all();
+}
+
+}// namespace ORB_SLAM
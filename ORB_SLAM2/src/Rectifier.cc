@@ -0,0 +1,162 @@
+/**
+* This file is part of ORB-SLAM2.
+*
+* Copyright (C) 2014-2016 Raúl Mur-Artal <raulmur at unizar dot es> (University of Zaragoza)
+* For more information see <https://github.com/raulmur/ORB_SLAM2>
+*
+* ORB-SLAM2 is free software: you can redistribute it and/or modify
+* it under the terms of the GNU General Public License as published by
+* the Free Software Foundation, either version 3 of the License, or
+* (at your option) any later version.
+*
+* ORB-SLAM2 is distributed in the hope that it will be useful,
+* but WITHOUT ANY WARRANTY; without even the implied warranty of
+* MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+* GNU General Public License for more details.
+*
+* You should have received a copy of the GNU General Public License
+* along with ORB-SLAM2. If not, see <http://www.gnu.org/licenses/>.
+*/
+
+
+#include "Rectifier.h"
+#include "ThreadPool.h"
+
+#include <opencv2/imgproc/imgproc.hpp>
+#include <iostream>
+
+using namespace std;
+
+namespace ORB_SLAM2
+{
+
+// Luma of a pixel, with the coefficients and rounding of cvtColor
+template<int CN, int RI, int BI>
+static inline int Luma(const uchar* p)
+{
+    if(CN==1)
+        return p[0];
+    return (p[RI]*4899 + p[1]*9617 + p[BI]*1868 + (1<<13)) >> 14;
+}
+
+// Pixels out of the image are black, as cv::remap with BORDER_CONSTANT
+template<int CN, int RI, int BI>
+static inline int LumaAt(const cv::Mat &src, const int x, const int y)
+{
+    if(x<0 || y<0 || x>=src.cols || y>=src.rows)
+        return 0;
+    return Luma<CN,RI,BI>(src.ptr<uchar>(y)+x*CN);
+}
+
+template<int CN, int RI, int BI>
+static void RemapRows(const cv::Mat &src, const cv::Mat &mapXY, const cv::Mat &mapFrac, cv::Mat &dst,
+                      const int nRowBegin, const int nRowEnd)
+{
+    const int S = cv::INTER_TAB_SIZE;
+    const int maxX = src.cols-1;
+    const int maxY = src.rows-1;
+    const size_t step = src.step;
+
+    for(int v=nRowBegin; v<nRowEnd; v++)
+    {
+        const short* xy = mapXY.ptr<short>(v);
+        const ushort* frac = mapFrac.ptr<ushort>(v);
+        uchar* out = dst.ptr<uchar>(v);
+        for(int u=0; u<dst.cols; u++)
+        {
+            const int x = xy[2*u];
+            const int y = xy[2*u+1];
+            const int a = frac[u] & (S*S-1);
+            const int ax = a & (S-1);
+            const int ay = a >> cv::INTER_BITS;
+
+            int l00, l01, l10, l11;
+            if(x>=0 && y>=0 && x<maxX && y<maxY)
+            {
+                const uchar* p = src.ptr<uchar>(y)+x*CN;
+                l00 = Luma<CN,RI,BI>(p);
+                l01 = Luma<CN,RI,BI>(p+CN);
+                l10 = Luma<CN,RI,BI>(p+step);
+                l11 = Luma<CN,RI,BI>(p+step+CN);
+            }
+            else
+            {
+                l00 = LumaAt<CN,RI,BI>(src,x,y);
+                l01 = LumaAt<CN,RI,BI>(src,x+1,y);
+                l10 = LumaAt<CN,RI,BI>(src,x,y+1);
+                l11 = LumaAt<CN,RI,BI>(src,x+1,y+1);
+            }
+
+            const int sum = l00*(S-ax)*(S-ay) + l01*ax*(S-ay) + l10*(S-ax)*ay + l11*ax*ay;
+            out[u] = (uchar)((sum + S*S/2) >> (2*cv::INTER_BITS));
+        }
+    }
+}
+
+Rectifier::Rectifier(const cv::FileStorage &fSettings, const std::string &prefix)
+{
+    cv::Mat K, D, R, P;
+    fSettings[prefix+".K"] >> K;
+    fSettings[prefix+".D"] >> D;
+    fSettings[prefix+".R"] >> R;
+    fSettings[prefix+".P"] >> P;
+    const int rows = fSettings[prefix+".height"];
+    const int cols = fSettings[prefix+".width"];
+
+    if(K.empty() || D.empty() || R.empty() || P.empty() || rows<=0 || cols<=0)
+        return;
+
+    mSize = cv::Size(cols,rows);
+    cv::initUndistortRectifyMap(K,D,R,P.rowRange(0,3).colRange(0,3),mSize,CV_16SC2,mMapXY,mMapFrac);
+}
+
+void Rectifier::Rectify(const ImageBuffer &im, cv::Mat &gray) const
+{
+    if(im.mData.size()!=mSize)
+    {
+        cerr << "ERROR: the image size does not match the rectification settings." << endl;
+        exit(-1);
+    }
+
+    // The other formats are converted first
+    cv::Mat src = im.mData;
+    ImageBuffer::PixelFormat format = im.mFormat;
+    if(format!=ImageBuffer::GRAY8 && format!=ImageBuffer::RGB8 && format!=ImageBuffer::BGR8 &&
+       format!=ImageBuffer::RGBA8 && format!=ImageBuffer::BGRA8)
+    {
+        src = cv::Mat();
+        im.ToGray(src);
+        format = ImageBuffer::GRAY8;
+    }
+
+    // Rows are split in chunks of 64 on the shared pool, the caller takes a share
+    ThreadPool::Instance().ParallelChunks(mSize.height, 64, [&](const int nRowBegin, const int nRowEnd)
+    {
+        RectifyRows(src,format,gray,nRowBegin,nRowEnd);
+    });
+}
+
+void Rectifier::RectifyRows(const cv::Mat &src, const ImageBuffer::PixelFormat format, cv::Mat &gray,
+                            const int nRowBegin, const int nRowEnd) const
+{
+    switch(format)
+    {
+    case ImageBuffer::RGB8:
+        RemapRows<3,0,2>(src,mMapXY,mMapFrac,gray,nRowBegin,nRowEnd);
+        break;
+    case ImageBuffer::BGR8:
+        RemapRows<3,2,0>(src,mMapXY,mMapFrac,gray,nRowBegin,nRowEnd);
+        break;
+    case ImageBuffer::RGBA8:
+        RemapRows<4,0,2>(src,mMapXY,mMapFrac,gray,nRowBegin,nRowEnd);
+        break;
+    case ImageBuffer::BGRA8:
+        RemapRows<4,2,0>(src,mMapXY,mMapFrac,gray,nRowBegin,nRowEnd);
+        break;
+    default:
+        RemapRows<1,0,0>(src,mMapXY,mMapFrac,gray,nRowBegin,nRowEnd);
+        break;
+    }
+}
+
+} //namespace ORB_SLAM
@@ -0,0 +1,248 @@
+/**
+* This file is part of ORB-SLAM2.
+*
+* Copyright (C) 2014-2016 Raúl Mur-Artal <raulmur at unizar dot es> (University of Zaragoza)
+* For more information see <https://github.com/raulmur/ORB_SLAM2>
+*
+* ORB-SLAM2 is free software: you can redistribute it and/or modify
+* it under the terms of the GNU General Public License as published by
+* the Free Software Foundation, either version 3 of the License, or
+* (at your option) any later version.
+*
+* ORB-SLAM2 is distributed in the hope that it will be useful,
+* but WITHOUT ANY WARRANTY; without even the implied warranty of
+* MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+* GNU General Public License for more details.
+*
+* You should have received a copy of the GNU General Public License
+* along with ORB-SLAM2. If not, see <http://www.gnu.org/licenses/>.
+*/
+
+
+#include "SensorPlayer.h"
+#include "LittleEndian.h"
+
+#include <opencv2/highgui/highgui.hpp>
+
+#include <cstring>
+#include <iostream>
+
+namespace ORB_SLAM2
+{
+
+SensorPlayer::SensorPlayer(): mnSensor(-1), mnFrames(0), mnChunk(0), mnPos(0), mnFrameInChunk(0)
+{
+}
+
+template<typename T>
+bool SensorPlayer::ReadHeader(T &header)
+{
+    char bytes[sizeof(T)];
+    if(!mFile.read(bytes, sizeof(bytes)))
+        return false;
+    SensorRecorder::Decode(bytes, header);
+    return true;
+}
+
+bool SensorPlayer::Open(const std::string &filename)
+{
+    mFile.open(filename.c_str(), std::ios::binary);
+    if(!mFile.is_open())
+        return false;
+
+    SensorRecorder::FileHeader header;
+    if(!ReadHeader(header) || memcmp(header.mMagic, SensorRecorder::kFileMagic, sizeof(header.mMagic))!=0)
+    {
+        std::cerr << "Not a sensor log: " << filename << std::endl;
+        return false;
+    }
+    mnSensor = header.mnSensor;
+
+    mFile.seekg(0, std::ios::end);
+    const uint64_t nFileSize = mFile.tellg();
+
+    if(!ReadIndex(nFileSize))
+    {
+        std::cerr << "The sensor log was not closed, indexing it..." << std::endl;
+        ScanChunks(nFileSize);
+    }
+
+    mnFrames = 0;
+    for(size_t i=0; i<mvIndex.size(); i++)
+        mnFrames += mvIndex[i].mnFrames;
+
+    return Seek(FirstTimeStamp());
+}
+
+bool SensorPlayer::ReadIndex(const uint64_t nFileSize)
+{
+    SensorRecorder::Trailer trailer;
+    if(nFileSize<sizeof(SensorRecorder::FileHeader)+sizeof(trailer))
+        return false;
+
+    mFile.clear();
+    mFile.seekg(nFileSize-sizeof(trailer));
+    if(!ReadHeader(trailer) || memcmp(trailer.mMagic, SensorRecorder::kIndexMagic, sizeof(trailer.mMagic))!=0)
+        return false;
+
+    SensorRecorder::ChunkHeader header;
+    mFile.seekg(trailer.mnIndexOffset);
+    if(!ReadHeader(header) || header.mnType!=SensorRecorder::CHUNK_INDEX ||
+       header.mnBytes!=header.mnCount*sizeof(SensorRecorder::IndexEntry))
+        return false;
+
+    std::string bytes(header.mnBytes, 0);
+    if(!bytes.empty() && !mFile.read(&bytes[0], bytes.size()))
+        return false;
+
+    mvIndex.resize(header.mnCount);
+    for(size_t i=0; i<mvIndex.size(); i++)
+        SensorRecorder::Decode(&bytes[i*sizeof(SensorRecorder::IndexEntry)], mvIndex[i]);
+    return true;
+}
+
+void SensorPlayer::ScanChunks(const uint64_t nFileSize)
+{
+    mvIndex.clear();
+
+    uint64_t nOffset = sizeof(SensorRecorder::FileHeader);
+    SensorRecorder::ChunkHeader header;
+    while(nOffset+sizeof(header)<=nFileSize)
+    {
+        mFile.clear();
+        mFile.seekg(nOffset);
+        if(!ReadHeader(header) || header.mnType!=SensorRecorder::CHUNK_FRAMES ||
+           nOffset+sizeof(header)+header.mnBytes>nFileSize)
+            break;
+
+        SensorRecorder::IndexEntry entry;
+        entry.mFirstTimeStamp = header.mFirstTimeStamp;
+        entry.mLastTimeStamp = header.mLastTimeStamp;
+        entry.mnOffset = nOffset;
+        entry.mnFrames = header.mnCount;
+        entry.mnReserved = 0;
+        mvIndex.push_back(entry);
+
+        nOffset += sizeof(header)+header.mnBytes;
+    }
+}
+
+double SensorPlayer::FirstTimeStamp() const
+{
+    return mvIndex.empty() ? 0 : mvIndex.front().mFirstTimeStamp;
+}
+
+double SensorPlayer::LastTimeStamp() const
+{
+    return mvIndex.empty() ? 0 : mvIndex.back().mLastTimeStamp;
+}
+
+bool SensorPlayer::LoadChunk(const size_t nChunk)
+{
+    mnChunk = nChunk;
+    mnPos = 0;
+    mnFrameInChunk = 0;
+    mChunk.clear();
+    if(nChunk>=mvIndex.size())
+        return false;
+
+    SensorRecorder::ChunkHeader header;
+    mFile.clear();
+    mFile.seekg(mvIndex[nChunk].mnOffset);
+    if(!ReadHeader(header) || header.mnType!=SensorRecorder::CHUNK_FRAMES)
+        return false;
+
+    mChunk.resize(header.mnBytes);
+    return !mChunk.empty() && mFile.read(&mChunk[0], mChunk.size());
+}
+
+bool SensorPlayer::Seek(const double timestamp)
+{
+    // Chunks are in time order, the first one that ends at or after timestamp
+    size_t nChunk = 0;
+    while(nChunk<mvIndex.size() && mvIndex[nChunk].mLastTimeStamp<timestamp)
+        nChunk++;
+
+    if(!LoadChunk(nChunk))
+        return false;
+
+    // Skip the frames before timestamp in the chunk
+    while(mnFrameInChunk<mvIndex[mnChunk].mnFrames)
+    {
+        double t = DecodeLittleEndian<double>(&mChunk[mnPos]);
+        if(t>=timestamp)
+            break;
+
+        std::vector<ImageBuffer> vImages;
+        if(!ReadFrame(t, vImages))
+            return false;
+    }
+    return true;
+}
+
+bool SensorPlayer::Next(double &timestamp, std::vector<ImageBuffer> &vImages)
+{
+    while(mnChunk<mvIndex.size() && mnFrameInChunk>=mvIndex[mnChunk].mnFrames)
+    {
+        if(!LoadChunk(mnChunk+1))
+            return false;
+    }
+
+    if(mnChunk>=mvIndex.size())
+        return false;
+
+    return ReadFrame(timestamp, vImages);
+}
+
+bool SensorPlayer::ReadFrame(double &timestamp, std::vector<ImageBuffer> &vImages)
+{
+    const size_t nFrameHeader = sizeof(double)+sizeof(uint32_t);
+    const size_t nImageHeader = 4*sizeof(uint32_t)+sizeof(uint64_t);
+    if(mnPos+nFrameHeader>mChunk.size())
+        return false;
+
+    timestamp = DecodeLittleEndian<double>(&mChunk[mnPos]);
+    const uint32_t nImages = DecodeLittleEndian<uint32_t>(&mChunk[mnPos+sizeof(double)]);
+    mnPos += nFrameHeader;
+
+    vImages.clear();
+    for(uint32_t i=0; i<nImages; i++)
+    {
+        if(mnPos+nImageHeader>mChunk.size())
+            return false;
+
+        const uint32_t format = DecodeLittleEndian<uint32_t>(&mChunk[mnPos]);
+        const uint32_t codec = DecodeLittleEndian<uint32_t>(&mChunk[mnPos+4]);
+        const int32_t cols = DecodeLittleEndian<int32_t>(&mChunk[mnPos+8]);
+        const int32_t rows = DecodeLittleEndian<int32_t>(&mChunk[mnPos+12]);
+        const uint64_t nBytes = DecodeLittleEndian<uint64_t>(&mChunk[mnPos+16]);
+        mnPos += nImageHeader;
+        if(mnPos+nBytes>mChunk.size())
+            return false;
+
+        cv::Mat data(1, nBytes, CV_8U, &mChunk[mnPos]);
+        cv::Mat im;
+        if(codec==SensorRecorder::CODEC_PNG)
+            im = cv::imdecode(data, cv::IMREAD_UNCHANGED);
+        else
+        {
+            // The pixel format gives the type of the packed rows
+            const int type = ImageBuffer::PixelType(static_cast<ImageBuffer::PixelFormat>(format));
+            if(rows>0 && cols>0 && nBytes==(uint64_t)rows*cols*CV_ELEM_SIZE(type))
+            {
+                im = cv::Mat(rows, cols, type, data.data).clone();
+                SwapLittleEndianArray(im.data, im.total()*im.channels(), im.elemSize1());
+            }
+        }
+        mnPos += nBytes;
+
+        if(im.empty() || im.cols!=cols || im.rows!=rows)
+            return false;
+        vImages.push_back(ImageBuffer(im, static_cast<ImageBuffer::PixelFormat>(format)));
+    }
+
+    mnFrameInChunk++;
+    return true;
+}
+
+}// namespace ORB_SLAM
@@ -0,0 +1,370 @@
+/**
+* This file is part of ORB-SLAM2.
+*
+* Copyright (C) 2014-2016 Raúl Mur-Artal <raulmur at unizar dot es> (University of Zaragoza)
+* For more information see <https://github.com/raulmur/ORB_SLAM2>
+*
+* ORB-SLAM2 is free software: you can redistribute it and/or modify
+* it under the terms of the GNU General Public License as published by
+* the Free Software Foundation, either version 3 of the License, or
+* (at your option) any later version.
+*
+* ORB-SLAM2 is distributed in the hope that it will be useful,
+* but WITHOUT ANY WARRANTY; without even the implied warranty of
+* MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+* GNU General Public License for more details.
+*
+* You should have received a copy of the GNU General Public License
+* along with ORB-SLAM2. If not, see <http://www.gnu.org/licenses/>.
+*/
+
+
+#include "SensorRecorder.h"
+#include "LittleEndian.h"
+
+#include <opencv2/highgui/highgui.hpp>
+
+#include <cstddef>
+#include <cstring>
+#include <iostream>
+#include <utility>
+
+namespace ORB_SLAM2
+{
+
+const char* const SensorRecorder::kFileMagic = "ORBSENS1";
+const char* const SensorRecorder::kIndexMagic = "ORBSIDX1";
+
+namespace
+{
+
+template<typename T>
+void Put(std::string &buffer, const T &value)
+{
+    char bytes[sizeof(T)];
+    EncodeLittleEndian(value, bytes);
+    buffer.append(bytes, sizeof(T));
+}
+
+// PNG is lossless for 8 and 16 bit images of 1, 3 or 4 channels
+bool PngEncodable(const cv::Mat &im)
+{
+    const int depth = im.depth();
+    const int channels = im.channels();
+    return (depth==CV_8U || depth==CV_16U) && (channels==1 || channels==3 || channels==4);
+}
+
+}
+
+void SensorRecorder::Encode(const FileHeader &header, char* p)
+{
+    memcpy(p+offsetof(FileHeader,mMagic), header.mMagic, sizeof(header.mMagic));
+    EncodeLittleEndian(header.mnSensor, p+offsetof(FileHeader,mnSensor));
+    EncodeLittleEndian(header.mnReserved, p+offsetof(FileHeader,mnReserved));
+}
+
+void SensorRecorder::Encode(const ChunkHeader &header, char* p)
+{
+    EncodeLittleEndian(header.mnType, p+offsetof(ChunkHeader,mnType));
+    EncodeLittleEndian(header.mnCount, p+offsetof(ChunkHeader,mnCount));
+    EncodeLittleEndian(header.mnBytes, p+offsetof(ChunkHeader,mnBytes));
+    EncodeLittleEndian(header.mFirstTimeStamp, p+offsetof(ChunkHeader,mFirstTimeStamp));
+    EncodeLittleEndian(header.mLastTimeStamp, p+offsetof(ChunkHeader,mLastTimeStamp));
+}
+
+void SensorRecorder::Encode(const IndexEntry &entry, char* p)
+{
+    EncodeLittleEndian(entry.mFirstTimeStamp, p+offsetof(IndexEntry,mFirstTimeStamp));
+    EncodeLittleEndian(entry.mLastTimeStamp, p+offsetof(IndexEntry,mLastTimeStamp));
+    EncodeLittleEndian(entry.mnOffset, p+offsetof(IndexEntry,mnOffset));
+    EncodeLittleEndian(entry.mnFrames, p+offsetof(IndexEntry,mnFrames));
+    EncodeLittleEndian(entry.mnReserved, p+offsetof(IndexEntry,mnReserved));
+}
+
+void SensorRecorder::Encode(const Trailer &trailer, char* p)
+{
+    EncodeLittleEndian(trailer.mnIndexOffset, p+offsetof(Trailer,mnIndexOffset));
+    memcpy(p+offsetof(Trailer,mMagic), trailer.mMagic, sizeof(trailer.mMagic));
+}
+
+void SensorRecorder::Decode(const char* p, FileHeader &header)
+{
+    memcpy(header.mMagic, p+offsetof(FileHeader,mMagic), sizeof(header.mMagic));
+    header.mnSensor = DecodeLittleEndian<uint32_t>(p+offsetof(FileHeader,mnSensor));
+    header.mnReserved = DecodeLittleEndian<uint32_t>(p+offsetof(FileHeader,mnReserved));
+}
+
+void SensorRecorder::Decode(const char* p, ChunkHeader &header)
+{
+    header.mnType = DecodeLittleEndian<uint32_t>(p+offsetof(ChunkHeader,mnType));
+    header.mnCount = DecodeLittleEndian<uint32_t>(p+offsetof(ChunkHeader,mnCount));
+    header.mnBytes = DecodeLittleEndian<uint64_t>(p+offsetof(ChunkHeader,mnBytes));
+    header.mFirstTimeStamp = DecodeLittleEndian<double>(p+offsetof(ChunkHeader,mFirstTimeStamp));
+    header.mLastTimeStamp = DecodeLittleEndian<double>(p+offsetof(ChunkHeader,mLastTimeStamp));
+}
+
+void SensorRecorder::Decode(const char* p, IndexEntry &entry)
+{
+    entry.mFirstTimeStamp = DecodeLittleEndian<double>(p+offsetof(IndexEntry,mFirstTimeStamp));
+    entry.mLastTimeStamp = DecodeLittleEndian<double>(p+offsetof(IndexEntry,mLastTimeStamp));
+    entry.mnOffset = DecodeLittleEndian<uint64_t>(p+offsetof(IndexEntry,mnOffset));
+    entry.mnFrames = DecodeLittleEndian<uint32_t>(p+offsetof(IndexEntry,mnFrames));
+    entry.mnReserved = DecodeLittleEndian<uint32_t>(p+offsetof(IndexEntry,mnReserved));
+}
+
+void SensorRecorder::Decode(const char* p, Trailer &trailer)
+{
+    trailer.mnIndexOffset = DecodeLittleEndian<uint64_t>(p+offsetof(Trailer,mnIndexOffset));
+    memcpy(trailer.mMagic, p+offsetof(Trailer,mMagic), sizeof(trailer.mMagic));
+}
+
+SensorRecorder::SensorRecorder(const std::string &strSettingPath, const int sensor):
+    mnSensor(sensor), mbLogFailed(false), mnDropped(0), mbFinishRequested(false), mbFinished(true)
+{
+    static_assert(sizeof(FileHeader)==16 && sizeof(ChunkHeader)==32 && sizeof(IndexEntry)==32 &&
+                  sizeof(Trailer)==16, "Unexpected padding in the log headers");
+
+    cv::FileStorage fSettings(strSettingPath, cv::FileStorage::READ);
+
+    mStrLogFile = (std::string) fSettings["Recorder.File"];
+
+    mnChunkFrames = fSettings["Recorder.ChunkFrames"];
+    if(mnChunkFrames<1)
+        mnChunkFrames = 30;
+
+    int nQueueSize = fSettings["Recorder.QueueSize"];
+    if(nQueueSize<1)
+        nQueueSize = 60;
+    mnQueueSize = nQueueSize;
+
+    // zlib level of the PNG images, higher is smaller and slower
+    mnPngCompression = fSettings["Recorder.Compression"];
+    if(mnPngCompression<1 || mnPngCompression>9)
+        mnPngCompression = 1;
+
+    memset(&mChunkHeader, 0, sizeof(mChunkHeader));
+
+    if(!OpenLog())
+    {
+        std::cerr << "Failed to create the sensor log " << mStrLogFile << std::endl;
+        exit(-1);
+    }
+}
+
+bool SensorRecorder::OpenLog()
+{
+    mFile.open(mStrLogFile.c_str(), std::ios::binary | std::ios::trunc);
+    if(!mFile.is_open())
+        return false;
+
+    FileHeader header;
+    memcpy(header.mMagic, kFileMagic, sizeof(header.mMagic));
+    header.mnSensor = mnSensor;
+    header.mnReserved = 0;
+    char bytes[sizeof(header)];
+    Encode(header, bytes);
+    mFile.write(bytes, sizeof(bytes));
+    return mFile.good();
+}
+
+void SensorRecorder::AddFrame(const double timestamp, const ImageBuffer &im, const ImageBuffer &im2)
+{
+    {
+        std::unique_lock<std::mutex> lock(mMutexQueue);
+        if(mdQueue.size()>=mnQueueSize)
+        {
+            mnDropped++;
+            return;
+        }
+    }
+
+    // Copy outside the lock, the writer keeps running
+    QueuedFrame frame;
+    frame.mTimeStamp = timestamp;
+    frame.mvImages.push_back(ImageBuffer(im.mData.clone(), im.mFormat));
+    if(!im2.empty())
+        frame.mvImages.push_back(ImageBuffer(im2.mData.clone(), im2.mFormat));
+
+    {
+        std::unique_lock<std::mutex> lock(mMutexQueue);
+        mdQueue.push_back(std::move(frame));
+    }
+    mcvQueue.notify_one();
+}
+
+void SensorRecorder::Run()
+{
+    mbFinished = false;
+
+    while(1)
+    {
+        QueuedFrame frame;
+        bool bFrame = false;
+        {
+            std::unique_lock<std::mutex> lock(mMutexQueue);
+            mcvQueue.wait(lock, [this]{ return !mdQueue.empty() || CheckFinish(); });
+            if(!mdQueue.empty())
+            {
+                frame = std::move(mdQueue.front());
+                mdQueue.pop_front();
+                bFrame = true;
+            }
+        }
+
+        if(bFrame)
+        {
+            EncodeFrame(frame);
+            if(mChunkHeader.mnCount>=(uint32_t)mnChunkFrames)
+                WriteChunk();
+        }
+        else if(CheckFinish())
+            break;
+    }
+
+    WriteChunk();
+    WriteIndex();
+    mFile.close();
+
+    if(mnDropped>0)
+        std::cerr << "Sensor log: " << mnDropped << " frames dropped, increase Recorder.QueueSize" << std::endl;
+
+    SetFinish();
+}
+
+void SensorRecorder::EncodeFrame(const QueuedFrame &frame)
+{
+    if(mChunkHeader.mnCount==0)
+        mChunkHeader.mFirstTimeStamp = frame.mTimeStamp;
+    mChunkHeader.mLastTimeStamp = frame.mTimeStamp;
+    mChunkHeader.mnCount++;
+
+    Put<double>(mChunk, frame.mTimeStamp);
+    Put<uint32_t>(mChunk, frame.mvImages.size());
+
+    std::vector<int> vParams;
+    vParams.push_back(cv::IMWRITE_PNG_COMPRESSION);
+    vParams.push_back(mnPngCompression);
+
+    std::vector<uchar> vEncoded;
+    for(size_t i=0; i<frame.mvImages.size(); i++)
+    {
+        const cv::Mat &im = frame.mvImages[i].mData;
+        uint32_t codec = CODEC_RAW;
+        if(PngEncodable(im) && cv::imencode(".png", im, vEncoded, vParams))
+            codec = CODEC_PNG;
+
+        Put<uint32_t>(mChunk, frame.mvImages[i].mFormat);
+        Put<uint32_t>(mChunk, codec);
+        Put<int32_t>(mChunk, im.cols);
+        Put<int32_t>(mChunk, im.rows);
+
+        if(codec==CODEC_PNG)
+        {
+            Put<uint64_t>(mChunk, vEncoded.size());
+            mChunk.append(reinterpret_cast<const char*>(&vEncoded[0]), vEncoded.size());
+        }
+        else
+        {
+            // The clone is continuous
+            const size_t nBytes = im.total()*im.elemSize();
+            Put<uint64_t>(mChunk, nBytes);
+            const size_t nPos = mChunk.size();
+            mChunk.append(reinterpret_cast<const char*>(im.data), nBytes);
+            SwapLittleEndianArray(&mChunk[nPos], im.total()*im.channels(), im.elemSize1());
+        }
+    }
+}
+
+void SensorRecorder::WriteChunk()
+{
+    if(mChunkHeader.mnCount==0)
+        return;
+
+    if(!mbLogFailed)
+    {
+        IndexEntry entry;
+        entry.mFirstTimeStamp = mChunkHeader.mFirstTimeStamp;
+        entry.mLastTimeStamp = mChunkHeader.mLastTimeStamp;
+        entry.mnOffset = mFile.tellp();
+        entry.mnFrames = mChunkHeader.mnCount;
+        entry.mnReserved = 0;
+
+        mChunkHeader.mnType = CHUNK_FRAMES;
+        mChunkHeader.mnBytes = mChunk.size();
+        char bytes[sizeof(ChunkHeader)];
+        Encode(mChunkHeader, bytes);
+        mFile.write(bytes, sizeof(bytes));
+        mFile.write(mChunk.data(), mChunk.size());
+        // Whole chunks reach the file, a crash loses at most the chunk being filled
+        mFile.flush();
+
+        if(mFile.good())
+            mvIndex.push_back(entry);
+        else
+        {
+            std::cerr << "Failed to write the sensor log, no more frames are recorded" << std::endl;
+            mbLogFailed = true;
+        }
+    }
+
+    mChunk.clear();
+    memset(&mChunkHeader, 0, sizeof(mChunkHeader));
+}
+
+void SensorRecorder::WriteIndex()
+{
+    if(mbLogFailed)
+        return;
+
+    Trailer trailer;
+    trailer.mnIndexOffset = mFile.tellp();
+    memcpy(trailer.mMagic, kIndexMagic, sizeof(trailer.mMagic));
+
+    ChunkHeader header;
+    header.mnType = CHUNK_INDEX;
+    header.mnCount = mvIndex.size();
+    header.mnBytes = mvIndex.size()*sizeof(IndexEntry);
+    header.mFirstTimeStamp = mvIndex.empty() ? 0 : mvIndex.front().mFirstTimeStamp;
+    header.mLastTimeStamp = mvIndex.empty() ? 0 : mvIndex.back().mLastTimeStamp;
+
+    std::string buffer(sizeof(header)+header.mnBytes+sizeof(trailer), 0);
+    Encode(header, &buffer[0]);
+    for(size_t i=0; i<mvIndex.size(); i++)
+        Encode(mvIndex[i], &buffer[sizeof(header)+i*sizeof(IndexEntry)]);
+    Encode(trailer, &buffer[sizeof(header)+header.mnBytes]);
+    mFile.write(buffer.data(), buffer.size());
+    mFile.flush();
+}
+
+void SensorRecorder::RequestFinish()
+{
+    {
+        std::unique_lock<std::mutex> lock(mMutexFinish);
+        mbFinishRequested = true;
+    }
+    // Take the queue mutex so that the writer cannot miss the notification
+    {
+        std::unique_lock<std::mutex> lock(mMutexQueue);
+    }
+    mcvQueue.notify_one();
+}
+
+bool SensorRecorder::CheckFinish()
+{
+    std::unique_lock<std::mutex> lock(mMutexFinish);
+    return mbFinishRequested;
+}
+
+void SensorRecorder::SetFinish()
+{
+    std::unique_lock<std::mutex> lock(mMutexFinish);
+    mbFinished = true;
+}
+
+bool SensorRecorder::isFinished()
+{
+    std::unique_lock<std::mutex> lock(mMutexFinish);
+    return mbFinished;
+}
+
+}// namespace ORB_SLAM
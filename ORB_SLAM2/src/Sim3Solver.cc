@@ -24,18 +24,20 @@
 #include <vector>
 #include <cmath>
 #include <opencv2/core/core.hpp>
+#include <Eigen/Eigenvalues>
+#include <Eigen/Geometry>
 
 #include "KeyFrame.h"
 #include "ORBmatcher.h"
-
-#include "Thirdparty/DBoW2/DUtils/Random.h"
+#include "Converter.h"
 
 namespace ORB_SLAM2
 {
 
 
 Sim3Solver::Sim3Solver(KeyFrame *pKF1, KeyFrame *pKF2, const vector<MapPoint *> &vpMatched12, const bool bFixScale):
-    mnIterations(0), mnBestInliers(0), mbFixScale(bFixScale)
+    mnIterations(0), mnBestInliers(0), mbFixScale(bFixScale),
+    mRandom(static_cast<unsigned int>(pKF1->mnId*73856093u ^ pKF2->mnId*19349663u))
 {
     mpKF1 = pKF1;
     mpKF2 = pKF2;
@@ -51,10 +53,10 @@ Sim3Solver::Sim3Solver(KeyFrame *pKF1, KeyFrame *pKF2, const vector<MapPoint *>
     mvX3Dc1.reserve(mN1);
     mvX3Dc2.reserve(mN1);
 
-    cv::Mat Rcw1 = pKF1->GetRotation();
-    cv::Mat tcw1 = pKF1->GetTranslation();
-    cv::Mat Rcw2 = pKF2->GetRotation();
-    cv::Mat tcw2 = pKF2->GetTranslation();
+    const Eigen::Matrix3f Rcw1 = Converter::toMatrix3d(pKF1->GetRotation()).cast<float>();
+    const Eigen::Vector3f tcw1 = Converter::toVector3d(pKF1->GetTranslation()).cast<float>();
+    const Eigen::Matrix3f Rcw2 = Converter::toMatrix3d(pKF2->GetRotation()).cast<float>();
+    const Eigen::Vector3f tcw2 = Converter::toVector3d(pKF2->GetTranslation()).cast<float>();
 
     mvAllIndices.reserve(mN1);
 
@@ -91,22 +93,22 @@ Sim3Solver::Sim3Solver(KeyFrame *pKF1, KeyFrame *pKF2, const vector<MapPoint *>
             mvpMapPoints2.push_back(pMP2);
             mvnIndices1.push_back(i1);
 
-            cv::Mat X3D1w = pMP1->GetWorldPos();
-            mvX3Dc1.push_back(Rcw1*X3D1w+tcw1);
+            const cv::Mat X3D1w = pMP1->GetWorldPos();
+            mvX3Dc1.push_back(Rcw1*Eigen::Vector3f(X3D1w.at<float>(0),X3D1w.at<float>(1),X3D1w.at<float>(2))+tcw1);
 
-            cv::Mat X3D2w = pMP2->GetWorldPos();
-            mvX3Dc2.push_back(Rcw2*X3D2w+tcw2);
+            const cv::Mat X3D2w = pMP2->GetWorldPos();
+            mvX3Dc2.push_back(Rcw2*Eigen::Vector3f(X3D2w.at<float>(0),X3D2w.at<float>(1),X3D2w.at<float>(2))+tcw2);
 
             mvAllIndices.push_back(idx);
             idx++;
         }
     }
 
-    mK1 = pKF1->mK;
-    mK2 = pKF2->mK;
+    fx1 = pKF1->fx; fy1 = pKF1->fy; cx1 = pKF1->cx; cy1 = pKF1->cy;
+    fx2 = pKF2->fx; fy2 = pKF2->fy; cx2 = pKF2->cx; cy2 = pKF2->cy;
 
-    FromCameraToImage(mvX3Dc1,mvP1im1,mK1);
-    FromCameraToImage(mvX3Dc2,mvP2im2,mK2);
+    FromCameraToImage(mvX3Dc1,mvP1im1,fx1,fy1,cx1,cy1);
+    FromCameraToImage(mvX3Dc2,mvP2im2,fx2,fy2,cx2,cy2);
 
     SetRansacParameters();
 }
@@ -149,10 +151,8 @@ cv::Mat Sim3Solver::iterate(int nIterations, bool &bNoMore, vector<bool> &vbInli
         return cv::Mat();
     }
 
-    vector<size_t> vAvailableIndices;
-
-    cv::Mat P3Dc1i(3,3,CV_32F);
-    cv::Mat P3Dc2i(3,3,CV_32F);
+    Eigen::Matrix3f P3Dc1i;
+    Eigen::Matrix3f P3Dc2i;
 
     int nCurrentIterations = 0;
     while(mnIterations<mRansacMaxIts && nCurrentIterations<nIterations)
@@ -160,20 +160,18 @@ cv::Mat Sim3Solver::iterate(int nIterations, bool &bNoMore, vector<bool> &vbInli
         nCurrentIterations++;
         mnIterations++;
 
-        vAvailableIndices = mvAllIndices;
-
-        // Get min set of points
+        // Get min set of points. The chosen indices are swapped to the front,
+        // so the index vector is never copied and always stays a permutation.
         for(short i = 0; i < 3; ++i)
         {
-            int randi = DUtils::Random::RandomInt(0, vAvailableIndices.size()-1);
+            std::uniform_int_distribution<int> distribution(i,N-1);
+            const int randi = distribution(mRandom);
+            std::swap(mvAllIndices[i],mvAllIndices[randi]);
 
-            int idx = vAvailableIndices[randi];
+            const size_t idx = mvAllIndices[i];
 
-            mvX3Dc1[idx].copyTo(P3Dc1i.col(i));
-            mvX3Dc2[idx].copyTo(P3Dc2i.col(i));
-
-            vAvailableIndices[randi] = vAvailableIndices.back();
-            vAvailableIndices.pop_back();
+            P3Dc1i.col(i) = mvX3Dc1[idx];
+            P3Dc2i.col(i) = mvX3Dc2[idx];
         }
 
         ComputeSim3(P3Dc1i,P3Dc2i);
@@ -184,9 +182,8 @@ cv::Mat Sim3Solver::iterate(int nIterations, bool &bNoMore, vector<bool> &vbInli
         {
             mvbBestInliers = mvbInliersi;
             mnBestInliers = mnInliersi;
-            mBestT12 = mT12i.clone();
-            mBestRotation = mR12i.clone();
-            mBestTranslation = mt12i.clone();
+            mBestRotation = mR12i;
+            mBestTranslation = mt12i;
             mBestScale = ms12i;
 
             if(mnInliersi>mRansacMinInliers)
@@ -195,6 +192,7 @@ cv::Mat Sim3Solver::iterate(int nIterations, bool &bNoMore, vector<bool> &vbInli
                 for(int i=0; i<N; i++)
                     if(mvbInliersi[i])
                         vbInliers[mvnIndices1[i]] = true;
+                mBestT12 = Converter::toCvSE3((mBestScale*mBestRotation).cast<double>(),mBestTranslation.cast<double>());
                 return mBestT12;
             }
         }
@@ -212,99 +210,62 @@ cv::Mat Sim3Solver::find(vector<bool> &vbInliers12, int &nInliers)
     return iterate(mRansacMaxIts,bFlag,vbInliers12,nInliers);
 }
 
-void Sim3Solver::ComputeCentroid(cv::Mat &P, cv::Mat &Pr, cv::Mat &C)
-{
-    cv::reduce(P,C,1,CV_REDUCE_SUM);
-    C = C/P.cols;
-
-    for(int i=0; i<P.cols; i++)
-    {
-        Pr.col(i)=P.col(i)-C;
-    }
-}
-
-void Sim3Solver::ComputeSim3(cv::Mat &P1, cv::Mat &P2)
+void Sim3Solver::ComputeSim3(const Eigen::Matrix3f &P1, const Eigen::Matrix3f &P2)
 {
     // Custom implementation of:
     // Horn 1987, Closed-form solution of absolute orientataion using unit quaternions
 
     // Step 1: Centroid and relative coordinates
 
-    cv::Mat Pr1(P1.size(),P1.type()); // Relative coordinates to centroid (set 1)
-    cv::Mat Pr2(P2.size(),P2.type()); // Relative coordinates to centroid (set 2)
-    cv::Mat O1(3,1,Pr1.type()); // Centroid of P1
-    cv::Mat O2(3,1,Pr2.type()); // Centroid of P2
+    const Eigen::Vector3f O1 = P1.rowwise().mean(); // Centroid of P1
+    const Eigen::Vector3f O2 = P2.rowwise().mean(); // Centroid of P2
 
-    ComputeCentroid(P1,Pr1,O1);
-    ComputeCentroid(P2,Pr2,O2);
+    const Eigen::Matrix3f Pr1 = P1.colwise()-O1; // Relative coordinates to centroid (set 1)
+    const Eigen::Matrix3f Pr2 = P2.colwise()-O2; // Relative coordinates to centroid (set 2)
 
     // Step 2: Compute M matrix
 
-    cv::Mat M = Pr2*Pr1.t();
+    const Eigen::Matrix3f M = Pr2*Pr1.transpose();
 
     // Step 3: Compute N matrix
 
-    double N11, N12, N13, N14, N22, N23, N24, N33, N34, N44;
-
-    cv::Mat N(4,4,P1.type());
-
-    N11 = M.at<float>(0,0)+M.at<float>(1,1)+M.at<float>(2,2);
-    N12 = M.at<float>(1,2)-M.at<float>(2,1);
-    N13 = M.at<float>(2,0)-M.at<float>(0,2);
-    N14 = M.at<float>(0,1)-M.at<float>(1,0);
-    N22 = M.at<float>(0,0)-M.at<float>(1,1)-M.at<float>(2,2);
-    N23 = M.at<float>(0,1)+M.at<float>(1,0);
-    N24 = M.at<float>(2,0)+M.at<float>(0,2);
-    N33 = -M.at<float>(0,0)+M.at<float>(1,1)-M.at<float>(2,2);
-    N34 = M.at<float>(1,2)+M.at<float>(2,1);
-    N44 = -M.at<float>(0,0)-M.at<float>(1,1)+M.at<float>(2,2);
-
-    N = (cv::Mat_<float>(4,4) << N11, N12, N13, N14,
-                                 N12, N22, N23, N24,
-                                 N13, N23, N33, N34,
-                                 N14, N24, N34, N44);
-
+    float N11, N12, N13, N14, N22, N23, N24, N33, N34, N44;
+
+    N11 = M(0,0)+M(1,1)+M(2,2);
+    N12 = M(1,2)-M(2,1);
+    N13 = M(2,0)-M(0,2);
+    N14 = M(0,1)-M(1,0);
+    N22 = M(0,0)-M(1,1)-M(2,2);
+    N23 = M(0,1)+M(1,0);
+    N24 = M(2,0)+M(0,2);
+    N33 = -M(0,0)+M(1,1)-M(2,2);
+    N34 = M(1,2)+M(2,1);
+    N44 = -M(0,0)-M(1,1)+M(2,2);
+
+    Eigen::Matrix4f Nm;
+    Nm << N11, N12, N13, N14,
+          N12, N22, N23, N24,
+          N13, N23, N33, N34,
+          N14, N24, N34, N44;
 
     // Step 4: Eigenvector of the highest eigenvalue
 
-    cv::Mat eval, evec;
-
-    cv::eigen(N,eval,evec); //evec[0] is the quaternion of the desired rotation
-
-    cv::Mat vec(1,3,evec.type());
-    (evec.row(0).colRange(1,4)).copyTo(vec); //extract imaginary part of the quaternion (sin*axis)
-
-    // Rotation angle. sin is the norm of the imaginary part, cos is the real part
-    double ang=atan2(norm(vec),evec.at<float>(0,0));
-
-    vec = 2*ang*vec/norm(vec); //Angle-axis representation. quaternion angle is the half
+    // Eigenvalues are sorted in increasing order, the last eigenvector is the quaternion (w,x,y,z)
+    Eigen::SelfAdjointEigenSolver<Eigen::Matrix4f> eig(Nm);
+    const Eigen::Vector4f q = eig.eigenvectors().col(3);
 
-    mR12i.create(3,3,P1.type());
-
-    cv::Rodrigues(vec,mR12i); // computes the rotation matrix from angle-axis
+    mR12i = Eigen::Quaternionf(q(0),q(1),q(2),q(3)).normalized().toRotationMatrix();
 
     // Step 5: Rotate set 2
 
-    cv::Mat P3 = mR12i*Pr2;
+    const Eigen::Matrix3f P3 = mR12i*Pr2;
 
     // Step 6: Scale
 
     if(!mbFixScale)
     {
-        double nom = Pr1.dot(P3);
-        cv::Mat aux_P3(P3.size(),P3.type());
-        aux_P3=P3;
-        cv::pow(P3,2,aux_P3);
-        double den = 0;
-
-        for(int i=0; i<aux_P3.rows; i++)
-        {
-            for(int j=0; j<aux_P3.cols; j++)
-            {
-                den+=aux_P3.at<float>(i,j);
-            }
-        }
-
+        const double nom = Pr1.cwiseProduct(P3).sum();
+        const double den = P3.squaredNorm();
         ms12i = nom/den;
     }
     else
@@ -312,46 +273,33 @@ void Sim3Solver::ComputeSim3(cv::Mat &P1, cv::Mat &P2)
 
     // Step 7: Translation
 
-    mt12i.create(1,3,P1.type());
     mt12i = O1 - ms12i*mR12i*O2;
-
-    // Step 8: Transformation
-
-    // Step 8.1 T12
-    mT12i = cv::Mat::eye(4,4,P1.type());
-
-    cv::Mat sR = ms12i*mR12i;
-
-    sR.copyTo(mT12i.rowRange(0,3).colRange(0,3));
-    mt12i.copyTo(mT12i.rowRange(0,3).col(3));
-
-    // Step 8.2 T21
-
-    mT21i = cv::Mat::eye(4,4,P1.type());
-
-    cv::Mat sRinv = (1.0/ms12i)*mR12i.t();
-
-    sRinv.copyTo(mT21i.rowRange(0,3).colRange(0,3));
-    cv::Mat tinv = -sRinv*mt12i;
-    tinv.copyTo(mT21i.rowRange(0,3).col(3));
 }
 
 
 void Sim3Solver::CheckInliers()
 {
-    vector<cv::Mat> vP1im2, vP2im1;
-    Project(mvX3Dc2,vP2im1,mT12i,mK1);
-    Project(mvX3Dc1,vP1im2,mT21i,mK2);
+    // Step 8: Transformations T12 and T21 of the current hypothesis
+    const Eigen::Matrix3f sR12 = ms12i*mR12i;
+    const Eigen::Matrix3f sR21 = (1.0f/ms12i)*mR12i.transpose();
+    const Eigen::Vector3f t21 = -sR21*mt12i;
 
     mnInliersi=0;
 
-    for(size_t i=0; i<mvP1im1.size(); i++)
+    for(int i=0; i<N; i++)
     {
-        cv::Mat dist1 = mvP1im1[i]-vP2im1[i];
-        cv::Mat dist2 = vP1im2[i]-mvP2im2[i];
+        // Points of camera 2 projected in image 1 and vice versa
+        const Eigen::Vector3f P2c1 = sR12*mvX3Dc2[i]+mt12i;
+        const Eigen::Vector3f P1c2 = sR21*mvX3Dc1[i]+t21;
+
+        const float invz1 = 1.0f/P2c1(2);
+        const float invz2 = 1.0f/P1c2(2);
 
-        const float err1 = dist1.dot(dist1);
-        const float err2 = dist2.dot(dist2);
+        const Eigen::Vector2f dist1 = mvP1im1[i]-Eigen::Vector2f(fx1*P2c1(0)*invz1+cx1,fy1*P2c1(1)*invz1+cy1);
+        const Eigen::Vector2f dist2 = Eigen::Vector2f(fx2*P1c2(0)*invz2+cx2,fy2*P1c2(1)*invz2+cy2)-mvP2im2[i];
+
+        const float err1 = dist1.squaredNorm();
+        const float err2 = dist2.squaredNorm();
 
         if(err1<mvnMaxError1[i] && err2<mvnMaxError2[i])
         {
@@ -366,12 +314,12 @@ void Sim3Solver::CheckInliers()
 
 cv::Mat Sim3Solver::GetEstimatedRotation()
 {
-    return mBestRotation.clone();
+    return Converter::toCvMat(Eigen::Matrix3d(mBestRotation.cast<double>()));
 }
 
 cv::Mat Sim3Solver::GetEstimatedTranslation()
 {
-    return mBestTranslation.clone();
+    return Converter::toCvMat(Eigen::Matrix<double,3,1>(mBestTranslation.cast<double>()));
 }
 
 float Sim3Solver::GetEstimatedScale()
@@ -379,46 +327,19 @@ float Sim3Solver::GetEstimatedScale()
     return mBestScale;
 }
 
-void Sim3Solver::Project(const vector<cv::Mat> &vP3Dw, vector<cv::Mat> &vP2D, cv::Mat Tcw, cv::Mat K)
+void Sim3Solver::FromCameraToImage(const vector<Eigen::Vector3f> &vP3Dc, vector<Eigen::Vector2f> &vP2D,
+                                   const float fx, const float fy, const float cx, const float cy)
 {
-    cv::Mat Rcw = Tcw.rowRange(0,3).colRange(0,3);
-    cv::Mat tcw = Tcw.rowRange(0,3).col(3);
-    const float &fx = K.at<float>(0,0);
-    const float &fy = K.at<float>(1,1);
-    const float &cx = K.at<float>(0,2);
-    const float &cy = K.at<float>(1,2);
-
-    vP2D.clear();
-    vP2D.reserve(vP3Dw.size());
-
-    for(size_t i=0, iend=vP3Dw.size(); i<iend; i++)
-    {
-        cv::Mat P3Dc = Rcw*vP3Dw[i]+tcw;
-        const float invz = 1/(P3Dc.at<float>(2));
-        const float x = P3Dc.at<float>(0)*invz;
-        const float y = P3Dc.at<float>(1)*invz;
-
-        vP2D.push_back((cv::Mat_<float>(2,1) << fx*x+cx, fy*y+cy));
-    }
-}
-
-void Sim3Solver::FromCameraToImage(const vector<cv::Mat> &vP3Dc, vector<cv::Mat> &vP2D, cv::Mat K)
-{
-    const float &fx = K.at<float>(0,0);
-    const float &fy = K.at<float>(1,1);
-    const float &cx = K.at<float>(0,2);
-    const float &cy = K.at<float>(1,2);
-
     vP2D.clear();
     vP2D.reserve(vP3Dc.size());
 
     for(size_t i=0, iend=vP3Dc.size(); i<iend; i++)
     {
-        const float invz = 1/(vP3Dc[i].at<float>(2));
-        const float x = vP3Dc[i].at<float>(0)*invz;
-        const float y = vP3Dc[i].at<float>(1)*invz;
+        const float invz = 1/(vP3Dc[i](2));
+        const float x = vP3Dc[i](0)*invz;
+        const float y = vP3Dc[i](1)*invz;
 
-        vP2D.push_back((cv::Mat_<float>(2,1) << fx*x+cx, fy*y+cy));
+        vP2D.push_back(Eigen::Vector2f(fx*x+cx, fy*y+cy));
     }
 }
 
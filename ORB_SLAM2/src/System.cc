@@ -35,8 +35,11 @@ namespace ORB_SLAM2
 {
 
 System::System(const string &strVocFile, const string &strSettingsFile, const eSensor sensor,
-               const bool bUseViewer):mSensor(sensor), mpViewer(static_cast<Viewer*>(NULL)), mbReset(false),mbActivateLocalizationMode(false),
-        mbDeactivateLocalizationMode(false)
+               const bool bUseViewer, const bool bRecordSensors):mSensor(sensor), mpViewer(static_cast<Viewer*>(NULL)),
+        mpPublisher(static_cast<Publisher*>(NULL)), mpSensorRecorder(static_cast<SensorRecorder*>(NULL)),
+        mptExtraction(static_cast<thread*>(NULL)), mptPipelineTracking(static_cast<thread*>(NULL)), mbReset(false),mbActivateLocalizationMode(false),
+        mbDeactivateLocalizationMode(false), mTrackingState(Tracking::NO_IMAGES_YET),
+        mbPipelineTracking(false), mbPipelineFinish(false)
 {
     // Output welcome message
     cout << endl <<
@@ -104,6 +107,16 @@ System::System(const string &strVocFile, const string &strSettingsFile, const eS
     mpLoopCloser = new LoopClosing(mpMap, mpKeyFrameDatabase, mpVocabulary, mSensor!=MONOCULAR);
     mptLoopClosing = new thread(&ORB_SLAM2::LoopClosing::Run, mpLoopCloser);
 
+    //Initialize the Dense Exporter thread and launch
+    mpDenseExporter = new DenseExporter(mpMap, strSettingsFile);
+    mptDenseExporter = new thread(&ORB_SLAM2::DenseExporter::Run, mpDenseExporter);
+    mpTracker->SetDenseExporter(mpDenseExporter);
+
+    //Initialize the Trajectory Recorder thread and launch
+    mpTrajectoryRecorder = new TrajectoryRecorder(mpMap, strSettingsFile);
+    mptTrajectoryRecorder = new thread(&ORB_SLAM2::TrajectoryRecorder::Run, mpTrajectoryRecorder);
+    mpTracker->SetTrajectoryRecorder(mpTrajectoryRecorder);
+
     //Initialize the Viewer thread and launch
     if(bUseViewer)
     {
@@ -112,6 +125,28 @@ System::System(const string &strVocFile, const string &strSettingsFile, const eS
         mpTracker->SetViewer(mpViewer);
     }
 
+    //Initialize the Publisher thread and launch, if a port or socket is configured
+    const int nPublisherPort = fsSettings["Publisher.Port"];
+    const string strPublisherSocket = fsSettings["Publisher.Socket"];
+    if(nPublisherPort>0 || !strPublisherSocket.empty())
+    {
+        mpPublisher = new Publisher(mpMap, strSettingsFile);
+        mptPublisher = new thread(&Publisher::Run, mpPublisher);
+        mpTracker->SetPublisher(mpPublisher);
+    }
+
+    //Initialize the Sensor Recorder thread and launch, if a log is configured
+    const string strSensorLog = fsSettings["Recorder.File"];
+    if(bRecordSensors && !strSensorLog.empty())
+    {
+        mpSensorRecorder = new SensorRecorder(strSettingsFile, mSensor);
+        mptSensorRecorder = new thread(&SensorRecorder::Run, mpSensorRecorder);
+    }
+
+    //Frames queued between the stages of the pipelined mode (Track*Async)
+    const int nPipelineQueueSize = fsSettings["Pipeline.QueueSize"];
+    mnPipelineQueueSize = nPipelineQueueSize>0 ? nPipelineQueueSize : 2;
+
     //Set pointers between threads
     mpTracker->SetLocalMapper(mpLocalMapper);
     mpTracker->SetLoopClosing(mpLoopCloser);
@@ -124,64 +159,126 @@ System::System(const string &strVocFile, const string &strSettingsFile, const eS
 }
 
 cv::Mat System::TrackStereo(const cv::Mat &imLeft, const cv::Mat &imRight, const double &timestamp)
+{
+    return TrackStereo(mpTracker->WrapImage(imLeft),mpTracker->WrapImage(imRight),timestamp);
+}
+
+cv::Mat System::TrackRGBD(const cv::Mat &im, const cv::Mat &depthmap, const double &timestamp)
+{
+    return TrackRGBD(mpTracker->WrapImage(im),mpTracker->WrapImage(depthmap),timestamp);
+}
+
+cv::Mat System::TrackMonocular(const cv::Mat &im, const double &timestamp)
+{
+    return TrackMonocular(mpTracker->WrapImage(im),timestamp);
+}
+
+cv::Mat System::TrackStereo(const ImageBuffer &imLeft, const ImageBuffer &imRight, const double &timestamp)
 {
     if(mSensor!=STEREO)
     {
         cerr << "ERROR: you called TrackStereo but input sensor was not set to STEREO." << endl;
         exit(-1);
-    }   
+    }
 
-    // Check mode change
-    {
-        unique_lock<mutex> lock(mMutexMode);
-        if(mbActivateLocalizationMode)
-        {
-            mpLocalMapper->RequestStop();
+    RecordInput(imLeft,imRight,timestamp);
 
-            // Wait until Local Mapping has effectively stopped
-            while(!mpLocalMapper->isStopped())
-            {
-                usleep(1000);
-            }
+    CheckModeAndReset();
 
-            mpTracker->InformOnlyTracking(true);
-            mbActivateLocalizationMode = false;
-        }
-        if(mbDeactivateLocalizationMode)
-        {
-            mpTracker->InformOnlyTracking(false);
-            mpLocalMapper->Release();
-            mbDeactivateLocalizationMode = false;
-        }
-    }
+    cv::Mat Tcw = mpTracker->GrabImageStereo(imLeft,imRight,timestamp);
 
-    // Check reset
-    {
-    unique_lock<mutex> lock(mMutexReset);
-    if(mbReset)
+    UpdateTrackingState(Tcw,timestamp);
+    return Tcw;
+}
+
+cv::Mat System::TrackRGBD(const ImageBuffer &im, const ImageBuffer &depthmap, const double &timestamp)
+{
+    if(mSensor!=RGBD)
     {
-        mpTracker->Reset();
-        mbReset = false;
+        cerr << "ERROR: you called TrackRGBD but input sensor was not set to RGBD." << endl;
+        exit(-1);
     }
+
+    RecordInput(im,depthmap,timestamp);
+
+    CheckModeAndReset();
+
+    cv::Mat Tcw = mpTracker->GrabImageRGBD(im,depthmap,timestamp);
+
+    UpdateTrackingState(Tcw,timestamp);
+    return Tcw;
+}
+
+cv::Mat System::TrackMonocular(const ImageBuffer &im, const double &timestamp)
+{
+    if(mSensor!=MONOCULAR)
+    {
+        cerr << "ERROR: you called TrackMonocular but input sensor was not set to Monocular." << endl;
+        exit(-1);
     }
 
-    cv::Mat Tcw = mpTracker->GrabImageStereo(imLeft,imRight,timestamp);
+    RecordInput(im,ImageBuffer(),timestamp);
 
-    unique_lock<mutex> lock2(mMutexState);
-    mTrackingState = mpTracker->mState;
-    mTrackedMapPoints = mpTracker->mCurrentFrame.mvpMapPoints;
-    mTrackedKeyPointsUn = mpTracker->mCurrentFrame.mvKeysUn;
+    CheckModeAndReset();
+
+    cv::Mat Tcw = mpTracker->GrabImageMonocular(im,timestamp);
+
+    UpdateTrackingState(Tcw,timestamp);
     return Tcw;
 }
 
-cv::Mat System::TrackRGBD(const cv::Mat &im, const cv::Mat &depthmap, const double &timestamp)
+std::future<cv::Mat> System::TrackStereoAsync(const cv::Mat &imLeft, const cv::Mat &imRight, const double &timestamp)
+{
+    return TrackStereoAsync(mpTracker->WrapImage(imLeft),mpTracker->WrapImage(imRight),timestamp);
+}
+
+std::future<cv::Mat> System::TrackRGBDAsync(const cv::Mat &im, const cv::Mat &depthmap, const double &timestamp)
+{
+    return TrackRGBDAsync(mpTracker->WrapImage(im),mpTracker->WrapImage(depthmap),timestamp);
+}
+
+std::future<cv::Mat> System::TrackMonocularAsync(const cv::Mat &im, const double &timestamp)
+{
+    return TrackMonocularAsync(mpTracker->WrapImage(im),timestamp);
+}
+
+std::future<cv::Mat> System::TrackStereoAsync(const ImageBuffer &imLeft, const ImageBuffer &imRight,
+                                              const double &timestamp)
+{
+    if(mSensor!=STEREO)
+    {
+        cerr << "ERROR: you called TrackStereoAsync but input sensor was not set to STEREO." << endl;
+        exit(-1);
+    }
+
+    return EnqueueFrame(imLeft,imRight,timestamp);
+}
+
+std::future<cv::Mat> System::TrackRGBDAsync(const ImageBuffer &im, const ImageBuffer &depthmap,
+                                            const double &timestamp)
 {
     if(mSensor!=RGBD)
     {
-        cerr << "ERROR: you called TrackRGBD but input sensor was not set to RGBD." << endl;
+        cerr << "ERROR: you called TrackRGBDAsync but input sensor was not set to RGBD." << endl;
         exit(-1);
-    }    
+    }
+
+    return EnqueueFrame(im,depthmap,timestamp);
+}
 
+std::future<cv::Mat> System::TrackMonocularAsync(const ImageBuffer &im, const double &timestamp)
+{
+    if(mSensor!=MONOCULAR)
+    {
+        cerr << "ERROR: you called TrackMonocularAsync but input sensor was not set to Monocular." << endl;
+        exit(-1);
+    }
+
+    return EnqueueFrame(im,ImageBuffer(),timestamp);
+}
+
+void System::CheckModeAndReset()
+{
     // Check mode change
     {
         unique_lock<mutex> lock(mMutexMode);
@@ -215,66 +312,179 @@ cv::Mat System::TrackRGBD(const cv::Mat &im, const cv::Mat &depthmap, const doub
         mbReset = false;
     }
     }
+}
 
-    cv::Mat Tcw = mpTracker->GrabImageRGBD(im,depthmap,timestamp);
+bool System::ModeOrResetRequested()
+{
+    {
+        unique_lock<mutex> lock(mMutexMode);
+        if(mbActivateLocalizationMode || mbDeactivateLocalizationMode)
+            return true;
+    }
+
+    return ResetRequested();
+}
 
-    unique_lock<mutex> lock2(mMutexState);
+bool System::ResetRequested()
+{
+    unique_lock<mutex> lock(mMutexReset);
+    return mbReset;
+}
+
+void System::UpdateTrackingState(const cv::Mat &Tcw, const double &timestamp)
+{
+    if(mpPublisher)
+        mpPublisher->PublishPose(mpTracker->mCurrentFrame.mnId, timestamp, mpTracker->mState, Tcw);
+
+    unique_lock<mutex> lock(mMutexState);
     mTrackingState = mpTracker->mState;
     mTrackedMapPoints = mpTracker->mCurrentFrame.mvpMapPoints;
     mTrackedKeyPointsUn = mpTracker->mCurrentFrame.mvKeysUn;
-    return Tcw;
 }
 
-cv::Mat System::TrackMonocular(const cv::Mat &im, const double &timestamp)
+void System::RecordInput(const ImageBuffer &im, const ImageBuffer &im2, const double &timestamp)
 {
-    if(mSensor!=MONOCULAR)
+    if(mpSensorRecorder)
+        mpSensorRecorder->AddFrame(timestamp, im, im2);
+}
+
+std::future<cv::Mat> System::EnqueueFrame(const ImageBuffer &im, const ImageBuffer &im2, const double &timestamp)
+{
+    RecordInput(im,im2,timestamp);
+
+    PipelineInput input;
+    input.im = im;
+    input.im2 = im2;
+    input.timestamp = timestamp;
+    std::future<cv::Mat> result = input.promise.get_future();
+
+    unique_lock<mutex> lock(mMutexPipeline);
+    if(mbPipelineFinish)
     {
-        cerr << "ERROR: you called TrackMonocular but input sensor was not set to Monocular." << endl;
-        exit(-1);
+        input.promise.set_value(cv::Mat());
+        return result;
     }
 
-    // Check mode change
+    // The pipeline threads are launched by the first asynchronous call
+    if(!mptExtraction)
     {
-        unique_lock<mutex> lock(mMutexMode);
-        if(mbActivateLocalizationMode)
+        mptExtraction = new thread(&ORB_SLAM2::System::RunExtraction, this);
+        mptPipelineTracking = new thread(&ORB_SLAM2::System::RunPipelineTracking, this);
+    }
+
+    mcvPipeline.wait(lock, [&]{ return mlPipelineInputs.size()<mnPipelineQueueSize; });
+    mlPipelineInputs.push_back(std::move(input));
+    mcvPipeline.notify_all();
+
+    return result;
+}
+
+void System::RunExtraction()
+{
+    while(true)
+    {
+        PipelineInput input;
         {
-            mpLocalMapper->RequestStop();
+            unique_lock<mutex> lock(mMutexPipeline);
+            mcvPipeline.wait(lock, [&]{ return !mlPipelineInputs.empty() || mbPipelineFinish; });
+            if(mlPipelineInputs.empty())
+                break;
+            input = std::move(mlPipelineInputs.front());
+            mlPipelineInputs.pop_front();
+            mcvPipeline.notify_all();
+        }
 
-            // Wait until Local Mapping has effectively stopped
-            while(!mpLocalMapper->isStopped())
+        // Mode changes and resets modify the tracking state, they are applied once the frames
+        // already extracted have been tracked, or dropped for a reset. No frame is extracted
+        // meanwhile, so the frame ids restart from the reset.
+        if(ModeOrResetRequested())
+        {
             {
-                usleep(1000);
+                unique_lock<mutex> lock(mMutexPipeline);
+                mcvPipeline.wait(lock, [&]{ return mlPipelineFrames.empty() && !mbPipelineTracking; });
             }
-
-            mpTracker->InformOnlyTracking(true);
-            mbActivateLocalizationMode = false;
+            CheckModeAndReset();
         }
-        if(mbDeactivateLocalizationMode)
+
+        PipelineFrame frame;
+        frame.pFrame.reset(new Frame());
+        frame.promise = std::move(input.promise);
+
+        if(mSensor==STEREO)
+            mpTracker->PreprocessStereo(input.im,input.im2,input.timestamp,*frame.pFrame,frame.imGray);
+        else if(mSensor==RGBD)
+            mpTracker->PreprocessRGBD(input.im,input.im2,input.timestamp,*frame.pFrame,frame.imGray);
+        else
         {
-            mpTracker->InformOnlyTracking(false);
-            mpLocalMapper->Release();
-            mbDeactivateLocalizationMode = false;
+            // The tracking state lags the extraction by the queued frames, at worst a few frames
+            // more are extracted with the initializer settings
+            const bool bInitializing = GetTrackingState()<=Tracking::NOT_INITIALIZED;
+            mpTracker->PreprocessMonocular(input.im,input.timestamp,bInitializing,*frame.pFrame,frame.imGray);
         }
+
+        unique_lock<mutex> lock(mMutexPipeline);
+        mcvPipeline.wait(lock, [&]{ return mlPipelineFrames.size()<mnPipelineQueueSize; });
+        mlPipelineFrames.push_back(std::move(frame));
+        mcvPipeline.notify_all();
     }
 
-    // Check reset
-    {
-    unique_lock<mutex> lock(mMutexReset);
-    if(mbReset)
+    // An empty frame tells the tracking stage that there is nothing left
+    unique_lock<mutex> lock(mMutexPipeline);
+    mlPipelineFrames.push_back(PipelineFrame());
+    mcvPipeline.notify_all();
+}
+
+void System::RunPipelineTracking()
+{
+    while(true)
     {
-        mpTracker->Reset();
-        mbReset = false;
-    }
-    }
+        PipelineFrame frame;
+        bool bDrop;
+        {
+            unique_lock<mutex> lock(mMutexPipeline);
+            mcvPipeline.wait(lock, [&]{ return !mlPipelineFrames.empty(); });
+            frame = std::move(mlPipelineFrames.front());
+            mlPipelineFrames.pop_front();
+            if(!frame.pFrame)
+                break;
+            // Frames extracted before a reset request (Tracking makes some) are not tracked
+            bDrop = ResetRequested();
+            mbPipelineTracking = !bDrop;
+            mcvPipeline.notify_all();
+        }
 
-    cv::Mat Tcw = mpTracker->GrabImageMonocular(im,timestamp);
+        if(bDrop)
+        {
+            frame.promise.set_value(cv::Mat());
+            continue;
+        }
 
-    unique_lock<mutex> lock2(mMutexState);
-    mTrackingState = mpTracker->mState;
-    mTrackedMapPoints = mpTracker->mCurrentFrame.mvpMapPoints;
-    mTrackedKeyPointsUn = mpTracker->mCurrentFrame.mvKeysUn;
+        cv::Mat Tcw = mpTracker->TrackPreprocessed(*frame.pFrame,frame.imGray);
+        UpdateTrackingState(Tcw,frame.pFrame->mTimeStamp);
 
-    return Tcw;
+        {
+            unique_lock<mutex> lock(mMutexPipeline);
+            mbPipelineTracking = false;
+            mcvPipeline.notify_all();
+        }
+
+        frame.promise.set_value(Tcw);
+    }
+}
+
+void System::StopPipeline()
+{
+    {
+        unique_lock<mutex> lock(mMutexPipeline);
+        mbPipelineFinish = true;
+        mcvPipeline.notify_all();
+        if(!mptExtraction)
+            return;
+    }
+
+    // The queued frames are tracked before the threads exit
+    mptExtraction->join();
+    mptPipelineTracking->join();
 }
 
 void System::ActivateLocalizationMode()
@@ -310,6 +520,9 @@ void System::Reset()
 
 void System::Shutdown()
 {
+    StopPipeline();
+    mpTracker->StopSegmentation();
+
     mpLocalMapper->RequestFinish();
     mpLoopCloser->RequestFinish();
     if(mpViewer)
@@ -318,6 +531,23 @@ void System::Shutdown()
         while(!mpViewer->isFinished())
             usleep(5000);
     }
+    mpDenseExporter->RequestFinish();
+    while(!mpDenseExporter->isFinished())
+        usleep(5000);
+
+    if(mpPublisher)
+    {
+        mpPublisher->RequestFinish();
+        while(!mpPublisher->isFinished())
+            usleep(5000);
+    }
+
+    if(mpSensorRecorder)
+    {
+        mpSensorRecorder->RequestFinish();
+        while(!mpSensorRecorder->isFinished())
+            usleep(5000);
+    }
 
     // Wait until all thread have effectively stopped
     while(!mpLocalMapper->isFinished() || !mpLoopCloser->isFinished() || mpLoopCloser->isRunningGBA())
@@ -325,6 +555,11 @@ void System::Shutdown()
         usleep(5000);
     }
 
+    // Last, to log the keyframe poses after the final global BA
+    mpTrajectoryRecorder->RequestFinish();
+    while(!mpTrajectoryRecorder->isFinished())
+        usleep(5000);
+
     if(mpViewer)
         pangolin::BindToContext("ORB-SLAM2: Map Viewer");
 }
@@ -338,54 +573,13 @@ void System::SaveTrajectoryTUM(const string &filename)
         return;
     }
 
-    vector<KeyFrame*> vpKFs = mpMap->GetAllKeyFrames();
-    sort(vpKFs.begin(),vpKFs.end(),KeyFrame::lId);
-
-    // Transform all keyframes so that the first keyframe is at the origin.
-    // After a loop closure the first keyframe might not be at the origin.
-    cv::Mat Two = vpKFs[0]->GetPoseInverse();
-
-    ofstream f;
-    f.open(filename.c_str());
-    f << fixed;
-
-    // Frame pose is stored relative to its reference keyframe (which is optimized by BA and pose graph).
-    // We need to get first the keyframe pose and then concatenate the relative transformation.
-    // Frames not localized (tracking failure) are not saved.
-
-    // For each frame we have a reference keyframe (lRit), the timestamp (lT) and a flag
-    // which is true when tracking failed (lbL).
-    list<ORB_SLAM2::KeyFrame*>::iterator lRit = mpTracker->mlpReferences.begin();
-    list<double>::iterator lT = mpTracker->mlFrameTimes.begin();
-    list<bool>::iterator lbL = mpTracker->mlbLost.begin();
-    for(list<cv::Mat>::iterator lit=mpTracker->mlRelativeFramePoses.begin(),
-        lend=mpTracker->mlRelativeFramePoses.end();lit!=lend;lit++, lRit++, lT++, lbL++)
+    // Frame poses are recorded relative to their reference keyframe (which is optimized by BA and pose graph),
+    // they are resolved with the current keyframe poses. Frames not localized (tracking failure) are not saved.
+    if(!mpTrajectoryRecorder->Save(filename, TrajectoryRecorder::TUM))
     {
-        if(*lbL)
-            continue;
-
-        KeyFrame* pKF = *lRit;
-
-        cv::Mat Trw = cv::Mat::eye(4,4,CV_32F);
-
-        // If the reference keyframe was culled, traverse the spanning tree to get a suitable keyframe.
-        while(pKF->isBad())
-        {
-            Trw = Trw*pKF->mTcp;
-            pKF = pKF->GetParent();
-        }
-
-        Trw = Trw*pKF->GetPose()*Two;
-
-        cv::Mat Tcw = (*lit)*Trw;
-        cv::Mat Rwc = Tcw.rowRange(0,3).colRange(0,3).t();
-        cv::Mat twc = -Rwc*Tcw.rowRange(0,3).col(3);
-
-        vector<float> q = Converter::toQuaternion(Rwc);
-
-        f << setprecision(6) << *lT << " " <<  setprecision(9) << twc.at<float>(0) << " " << twc.at<float>(1) << " " << twc.at<float>(2) << " " << q[0] << " " << q[1] << " " << q[2] << " " << q[3] << endl;
+        cerr << "ERROR: no frame poses to save." << endl;
+        return;
     }
-    f.close();
     cout << endl << "trajectory saved!" << endl;
 }
 
@@ -435,50 +629,38 @@ void System::SaveTrajectoryKITTI(const string &filename)
         return;
     }
 
-    vector<KeyFrame*> vpKFs = mpMap->GetAllKeyFrames();
-    sort(vpKFs.begin(),vpKFs.end(),KeyFrame::lId);
-
-    // Transform all keyframes so that the first keyframe is at the origin.
-    // After a loop closure the first keyframe might not be at the origin.
-    cv::Mat Two = vpKFs[0]->GetPoseInverse();
-
-    ofstream f;
-    f.open(filename.c_str());
-    f << fixed;
-
-    // Frame pose is stored relative to its reference keyframe (which is optimized by BA and pose graph).
-    // We need to get first the keyframe pose and then concatenate the relative transformation.
-    // Frames not localized (tracking failure) are not saved.
-
-    // For each frame we have a reference keyframe (lRit), the timestamp (lT) and a flag
-    // which is true when tracking failed (lbL).
-    list<ORB_SLAM2::KeyFrame*>::iterator lRit = mpTracker->mlpReferences.begin();
-    list<double>::iterator lT = mpTracker->mlFrameTimes.begin();
-    for(list<cv::Mat>::iterator lit=mpTracker->mlRelativeFramePoses.begin(), lend=mpTracker->mlRelativeFramePoses.end();lit!=lend;lit++, lRit++, lT++)
+    // Every frame is saved, lost frames with the last pose relative to their reference keyframe
+    if(!mpTrajectoryRecorder->Save(filename, TrajectoryRecorder::KITTI))
     {
-        ORB_SLAM2::KeyFrame* pKF = *lRit;
-
-        cv::Mat Trw = cv::Mat::eye(4,4,CV_32F);
-
-        while(pKF->isBad())
-        {
-          //  cout << "bad parent" << endl;
-            Trw = Trw*pKF->mTcp;
-            pKF = pKF->GetParent();
-        }
-
-        Trw = Trw*pKF->GetPose()*Two;
+        cerr << "ERROR: no frame poses to save." << endl;
+        return;
+    }
+    cout << endl << "trajectory saved!" << endl;
+}
 
-        cv::Mat Tcw = (*lit)*Trw;
-        cv::Mat Rwc = Tcw.rowRange(0,3).colRange(0,3).t();
-        cv::Mat twc = -Rwc*Tcw.rowRange(0,3).col(3);
+bool System::ExportDenseMap(const string &filename, const float resolution)
+{
+    if(mSensor!=RGBD)
+    {
+        cerr << "ERROR: ExportDenseMap needs the depth images of an RGB-D input." << endl;
+        return false;
+    }
+    return mpDenseExporter->RequestExport(filename, resolution);
+}
 
-        f << setprecision(9) << Rwc.at<float>(0,0) << " " << Rwc.at<float>(0,1)  << " " << Rwc.at<float>(0,2) << " "  << twc.at<float>(0) << " " <<
-             Rwc.at<float>(1,0) << " " << Rwc.at<float>(1,1)  << " " << Rwc.at<float>(1,2) << " "  << twc.at<float>(1) << " " <<
-             Rwc.at<float>(2,0) << " " << Rwc.at<float>(2,1)  << " " << Rwc.at<float>(2,2) << " "  << twc.at<float>(2) << endl;
+bool System::ExportDenseMesh(const string &filename)
+{
+    if(mSensor!=RGBD)
+    {
+        cerr << "ERROR: ExportDenseMesh needs the depth images of an RGB-D input." << endl;
+        return false;
     }
-    f.close();
-    cout << endl << "trajectory saved!" << endl;
+    return mpDenseExporter->RequestMeshExport(filename);
+}
+
+float System::GetDenseMapExportProgress()
+{
+    return mpDenseExporter->GetProgress();
 }
 
 int System::GetTrackingState()
@@ -499,4 +681,9 @@ vector<cv::KeyPoint> System::GetTrackedKeyPointsUn()
     return mTrackedKeyPointsUn;
 }
 
+ObjectMap* System::GetObjectMap()
+{
+    return &mpMap->mObjectMap;
+}
+
 } //namespace ORB_SLAM
@@ -0,0 +1,131 @@
+/**
+* This file is part of ORB-SLAM2.
+*
+* Copyright (C) 2014-2016 Raúl Mur-Artal <raulmur at unizar dot es> (University of Zaragoza)
+* For more information see <https://github.com/raulmur/ORB_SLAM2>
+*
+* ORB-SLAM2 is free software: you can redistribute it and/or modify
+* it under the terms of the GNU General Public License as published by
+* the Free Software Foundation, either version 3 of the License, or
+* (at your option) any later version.
+*
+* ORB-SLAM2 is distributed in the hope that it will be useful,
+* but WITHOUT ANY WARRANTY; without even the implied warranty of
+* MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+* GNU General Public License for more details.
+*
+* You should have received a copy of the GNU General Public License
+* along with ORB-SLAM2. If not, see <http://www.gnu.org/licenses/>.
+*/
+
+
+#include "ThreadPool.h"
+
+namespace ORB_SLAM2
+{
+
+ThreadPool& ThreadPool::Instance()
+{
+    // Never destroyed, system threads may still use it while static objects are destroyed
+    static ThreadPool* pPool = new ThreadPool(std::max(1,(int)std::thread::hardware_concurrency())-1);
+    return *pPool;
+}
+
+ThreadPool::ThreadPool(const int nWorkers):mbStop(false)
+{
+    mvWorkers.reserve(nWorkers);
+    for(int i=0; i<nWorkers; i++)
+        mvWorkers.push_back(std::thread(&ThreadPool::WorkerLoop,this));
+}
+
+ThreadPool::~ThreadPool()
+{
+    {
+        std::unique_lock<std::mutex> lock(mMutexBatches);
+        mbStop = true;
+    }
+    mcvBatches.notify_all();
+    for(size_t i=0; i<mvWorkers.size(); i++)
+        mvWorkers[i].join();
+}
+
+bool ThreadPool::RunOne(Batch &batch)
+{
+    const int i = batch.nNext.fetch_add(1);
+    if(i>=batch.nTasks)
+        return false;
+
+    batch.task(i);
+
+    std::unique_lock<std::mutex> lock(batch.mMutex);
+    if(++batch.nDone==batch.nTasks)
+        batch.mcvDone.notify_all();
+    return true;
+}
+
+void ThreadPool::Run(const int nTasks, const std::function<void(int)> &task)
+{
+    if(nTasks<=0)
+        return;
+
+    if(nTasks==1 || mvWorkers.empty())
+    {
+        for(int i=0; i<nTasks; i++)
+            task(i);
+        return;
+    }
+
+    std::shared_ptr<Batch> pBatch = std::make_shared<Batch>();
+    pBatch->task = task;
+    pBatch->nTasks = nTasks;
+    pBatch->nNext = 0;
+    pBatch->nDone = 0;
+
+    {
+        std::unique_lock<std::mutex> lock(mMutexBatches);
+        mdBatches.push_back(pBatch);
+    }
+    if(nTasks-1<(int)mvWorkers.size())
+        for(int i=1; i<nTasks; i++)
+            mcvBatches.notify_one();
+    else
+        mcvBatches.notify_all();
+
+    // The caller works too, and takes whatever the workers did not
+    while(true)
+        if(!RunOne(*pBatch))
+            break;
+
+    {
+        std::unique_lock<std::mutex> lock(mMutexBatches);
+        std::deque<std::shared_ptr<Batch> >::iterator it = std::find(mdBatches.begin(),mdBatches.end(),pBatch);
+        if(it!=mdBatches.end())
+            mdBatches.erase(it);
+    }
+
+    std::unique_lock<std::mutex> lock(pBatch->mMutex);
+    pBatch->mcvDone.wait(lock,[&]{ return pBatch->nDone==pBatch->nTasks; });
+}
+
+void ThreadPool::WorkerLoop()
+{
+    while(true)
+    {
+        std::shared_ptr<Batch> pBatch;
+        {
+            std::unique_lock<std::mutex> lock(mMutexBatches);
+            mcvBatches.wait(lock,[this]{ return mbStop || !mdBatches.empty(); });
+            if(mbStop)
+                return;
+
+            pBatch = mdBatches.front();
+            // Last task handed out, the next workers go to the next batch
+            if(pBatch->nNext>=pBatch->nTasks-1)
+                mdBatches.pop_front();
+        }
+
+        RunOne(*pBatch);
+    }
+}
+
+}// namespace ORB_SLAM
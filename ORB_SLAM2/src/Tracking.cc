@@ -44,9 +44,11 @@ namespace ORB_SLAM2 {
 
 Tracking::Tracking(System *pSys, ORBVocabulary *pVoc, FrameDrawer *pFrameDrawer, MapDrawer *pMapDrawer, Map *pMap,
                    KeyFrameDatabase *pKFDB, const string &strSettingPath, const int sensor) :
-    mState(NO_IMAGES_YET), mSensor(sensor), mbOnlyTracking(false), mbVO(false), mpORBVocabulary(pVoc),
-    mpKeyFrameDB(pKFDB), mpInitializer(static_cast<Initializer *>(NULL)), mpSystem(pSys), mpViewer(NULL),
-    mpFrameDrawer(pFrameDrawer), mpMapDrawer(pMapDrawer), mpMap(pMap), mnLastRelocFrameId(0) {
+    mState(NO_IMAGES_YET), mSensor(sensor), mpLastPoseReference(NULL), mbOnlyTracking(false), mbVO(false),
+    mpORBVocabulary(pVoc), mpKeyFrameDB(pKFDB), mpInitializer(static_cast<Initializer *>(NULL)), mpSystem(pSys),
+    mpViewer(NULL), mpFrameDrawer(pFrameDrawer), mpMapDrawer(pMapDrawer), mpRecorder(NULL), mpDenseExporter(NULL), mpPublisher(NULL), mpMap(pMap),
+    mnLastRelocFrameId(0),
+    mnLastBigChangeIdx(0), mnLastTrackedFrameId(0) {
   // Load camera parameters from settings file
 
   cv::FileStorage fSettings(strSettingPath, cv::FileStorage::READ);
@@ -84,6 +86,10 @@ Tracking::Tracking(System *pSys, ORBVocabulary *pVoc, FrameDrawer *pFrameDrawer,
   mMinFrames = 0;
   mMaxFrames = fps;
 
+  mMaxLostFrames = fSettings["Tracking.MaxLostFrames"];
+  if (mMaxLostFrames <= 0)
+    mMaxLostFrames = 3 * mMaxFrames;
+
   cout << endl << "Camera Parameters: " << endl;
   cout << "- fx: " << fx << endl;
   cout << "- fy: " << fy << endl;
@@ -133,6 +139,19 @@ Tracking::Tracking(System *pSys, ORBVocabulary *pVoc, FrameDrawer *pFrameDrawer,
     cout << endl << "Depth Threshold (Close/Far Points): " << mThDepth << endl;
   }
 
+  // Raw stereo pairs are rectified while they are converted to grayscale, Stereo.Rectify
+  mpRectifierLeft = static_cast<Rectifier *>(NULL);
+  mpRectifierRight = static_cast<Rectifier *>(NULL);
+  if (sensor == System::STEREO && (int) fSettings["Stereo.Rectify"] != 0) {
+    mpRectifierLeft = new Rectifier(fSettings, "LEFT");
+    mpRectifierRight = new Rectifier(fSettings, "RIGHT");
+    if (!mpRectifierLeft->IsValid() || !mpRectifierRight->IsValid()) {
+      cerr << "ERROR: Calibration parameters to rectify stereo are missing!" << endl;
+      exit(-1);
+    }
+    cout << endl << "Stereo rectification in the tracker" << endl;
+  }
+
   if (sensor == System::RGBD) {
     mDepthMapFactor = fSettings["DepthMapFactor"];
     if (fabs(mDepthMapFactor) < 1e-5)
@@ -140,7 +159,35 @@ Tracking::Tracking(System *pSys, ORBVocabulary *pVoc, FrameDrawer *pFrameDrawer,
     else
       mDepthMapFactor = 1.0f / mDepthMapFactor;
   }
+  mnMaxSegInFlight = fSettings["Segmentation.MaxInFlight"];
+  if (mnMaxSegInFlight <= 0)
+    mnMaxSegInFlight = 8;
+  float segTimeout = fSettings["Segmentation.Timeout"];
+  if (segTimeout <= 0)
+    segTimeout = 10.0f;
+  mSegTimeout = std::chrono::duration_cast<std::chrono::steady_clock::duration>(
+      std::chrono::duration<float>(segTimeout));
+  mnNextSegRequestId = 0;
+  mnSegResets = 0;
+  mbSegFinish = false;
+
+  // Features are not extracted on the dynamic objects found by the segmentation server
+  mbMaskDynamic = sensor == System::RGBD && (int) fSettings["Segmentation.MaskDynamic"] != 0;
+  mnDynMaskDilation = fSettings["Segmentation.MaskDilation"];
+  if (mnDynMaskDilation <= 0)
+    mnDynMaskDilation = 10;
+  mnDynMaskMaxAge = fSettings["Segmentation.MaskMaxAge"];
+  if (mnDynMaskMaxAge <= 0)
+    mnDynMaskMaxAge = 30;
+  mpDynMaskKF = static_cast<KeyFrame *>(NULL);
+  mbMotionOK = false;
+  mnMotionFrameId = 0;
+  if (mbMaskDynamic)
+    cout << endl << "Dynamic object masking: dilation " << mnDynMaskDilation << " px, max age "
+         << mnDynMaskMaxAge << " frames" << endl;
+
   mSegmentation.reset(new std::thread(&Tracking::PerformSegmentation, this));
+  mSegmentationResults.reset(new std::thread(&Tracking::ReceiveSegmentation, this));
 }
 
 void Tracking::SetLocalMapper(LocalMapping *pLocalMapper) {
@@ -155,83 +202,139 @@ void Tracking::SetViewer(Viewer *pViewer) {
   mpViewer = pViewer;
 }
 
-cv::Mat Tracking::GrabImageStereo(const cv::Mat &imRectLeft, const cv::Mat &imRectRight, const double &timestamp) {
-  mImGray = imRectLeft;
-  cv::Mat imGrayRight = imRectRight;
+void Tracking::SetTrajectoryRecorder(TrajectoryRecorder *pRecorder) {
+  mpRecorder = pRecorder;
+}
 
-  if (mImGray.channels() == 3) {
-    if (mbRGB) {
-      cvtColor(mImGray, mImGray, CV_RGB2GRAY);
-      cvtColor(imGrayRight, imGrayRight, CV_RGB2GRAY);
-    } else {
-      cvtColor(mImGray, mImGray, CV_BGR2GRAY);
-      cvtColor(imGrayRight, imGrayRight, CV_BGR2GRAY);
+void Tracking::SetDenseExporter(DenseExporter *pDenseExporter) {
+  mpDenseExporter = pDenseExporter;
+}
+
+void Tracking::SetPublisher(Publisher *pPublisher) {
+  mpPublisher = pPublisher;
+}
+
+ImageBuffer Tracking::WrapImage(const cv::Mat &im) const {
+  switch (im.type()) {
+    case CV_8UC3:
+      return ImageBuffer(im, mbRGB ? ImageBuffer::RGB8 : ImageBuffer::BGR8);
+    case CV_8UC4:
+      return ImageBuffer(im, mbRGB ? ImageBuffer::RGBA8 : ImageBuffer::BGRA8);
+    case CV_16UC1:
+      return ImageBuffer(im, ImageBuffer::DEPTH16);
+    case CV_32FC1:
+      return ImageBuffer(im, ImageBuffer::DEPTH32F);
+    default:
+      return ImageBuffer(im, ImageBuffer::GRAY8);
+  }
+}
+
+cv::Mat Tracking::ConvertToGray(const ImageBuffer &im, ORBextractor *pExtractor, const Rectifier *pRectifier) {
+  if (pRectifier) {
+    cv::Mat imGray = pExtractor->CreateInputImage(pRectifier->GetSize());
+    pRectifier->Rectify(im, imGray);
+    return imGray;
+  }
+
+  cv::Mat imGray = pExtractor->CreateInputImage(im.mData.size());
+  im.ToGray(imGray);
+  return imGray;
+}
+
+// True if no frame or keyframe refers to the buffer anymore
+static bool IsUnshared(const cv::Mat &m) {
+#if CV_MAJOR_VERSION >= 3
+  return m.u && m.u->refcount == 1;
+#else
+  return m.refcount && *m.refcount == 1;
+#endif
+}
+
+cv::Mat Tracking::ConvertDepth(const ImageBuffer &depth) {
+  cv::Mat imDepth;
+  for (size_t i = 0; i < mvDepthPool.size(); i++) {
+    if (IsUnshared(mvDepthPool[i]) && mvDepthPool[i].size() == depth.mData.size()) {
+      imDepth = mvDepthPool[i];
+      break;
     }
-  } else if (mImGray.channels() == 4) {
-    if (mbRGB) {
-      cvtColor(mImGray, mImGray, CV_RGBA2GRAY);
-      cvtColor(imGrayRight, imGrayRight, CV_RGBA2GRAY);
-    } else {
-      cvtColor(mImGray, mImGray, CV_BGRA2GRAY);
-      cvtColor(imGrayRight, imGrayRight, CV_BGRA2GRAY);
+  }
+
+  if (imDepth.empty()) {
+    // Buffers kept by keyframes belong to them now
+    if (mvDepthPool.size() >= mcDepthPoolSize) {
+      vector<cv::Mat> vUnshared;
+      for (size_t i = 0; i < mvDepthPool.size(); i++)
+        if (IsUnshared(mvDepthPool[i]))
+          vUnshared.push_back(mvDepthPool[i]);
+      mvDepthPool.swap(vUnshared);
     }
+    imDepth.create(depth.mData.size(), CV_32F);
+    mvDepthPool.push_back(imDepth);
   }
 
-  mCurrentFrame = Frame(mImGray, imGrayRight, timestamp, mpORBextractorLeft, mpORBextractorRight, mpORBVocabulary,
-                        mK, mDistCoef, mbf, mThDepth);
+  depth.mData.convertTo(imDepth, CV_32F, mDepthMapFactor);
+  return imDepth;
+}
 
-  Track();
+void Tracking::PreprocessStereo(const ImageBuffer &imRectLeft, const ImageBuffer &imRectRight,
+                                const double &timestamp, Frame &frame, cv::Mat &imGray) {
+  imGray = ConvertToGray(imRectLeft, mpORBextractorLeft, mpRectifierLeft);
+  cv::Mat imGrayRight = ConvertToGray(imRectRight, mpORBextractorRight, mpRectifierRight);
 
-  return mCurrentFrame.mTcw.clone();
+  frame = Frame(imGray, imGrayRight, timestamp, mpORBextractorLeft, mpORBextractorRight, mpORBVocabulary, mK,
+                mDistCoef, mbf, mThDepth);
 }
 
-cv::Mat Tracking::GrabImageRGBD(const cv::Mat &imRGB, const cv::Mat &imD, const double &timestamp) {
-  mImGray = imRGB;
-  cv::Mat imDepth = imD;
+void Tracking::PreprocessRGBD(const ImageBuffer &imRGB, const ImageBuffer &imD, const double &timestamp,
+                              Frame &frame, cv::Mat &imGray) {
+  imGray = ConvertToGray(imRGB, mpORBextractorLeft);
+  cv::Mat imDepth = ConvertDepth(imD);
 
-  if (mImGray.channels() == 3) {
-    if (mbRGB)
-      cvtColor(mImGray, mImGray, CV_RGB2GRAY);
-    else
-      cvtColor(mImGray, mImGray, CV_BGR2GRAY);
-  } else if (mImGray.channels() == 4) {
-    if (mbRGB)
-      cvtColor(mImGray, mImGray, CV_RGBA2GRAY);
-    else
-      cvtColor(mImGray, mImGray, CV_BGRA2GRAY);
-  }
+  cv::Mat mask;
+  if (mbMaskDynamic)
+    mask = PropagateDynamicMask();
 
-  if ((fabs(mDepthMapFactor - 1.0f) > 1e-5) || imDepth.type() != CV_32F)
-    imDepth.convertTo(imDepth, CV_32F, mDepthMapFactor);
+  frame = Frame(imGray, imRGB.mData, imDepth, timestamp, mpORBextractorLeft, mpORBVocabulary, mK, mDistCoef, mbf,
+                mThDepth, mask);
+  frame.mnColorConversion = imRGB.ColorConversion(mbRGB);
+}
 
-  mCurrentFrame = Frame(mImGray, imRGB, imDepth, timestamp, mpORBextractorLeft, mpORBVocabulary, mK, mDistCoef,
-                        mbf, mThDepth);
+void Tracking::PreprocessMonocular(const ImageBuffer &im, const double &timestamp, const bool bInitializing,
+                                   Frame &frame, cv::Mat &imGray) {
+  ORBextractor *pExtractor = bInitializing ? mpIniORBextractor : mpORBextractorLeft;
+  imGray = ConvertToGray(im, pExtractor);
+
+  frame = Frame(imGray, timestamp, pExtractor, mpORBVocabulary, mK, mDistCoef, mbf, mThDepth);
+}
+
+cv::Mat Tracking::TrackPreprocessed(const Frame &frame, const cv::Mat &imGray) {
+  mCurrentFrame = frame;
+  mImGray = imGray;
 
   Track();
 
   return mCurrentFrame.mTcw.clone();
 }
 
-cv::Mat Tracking::GrabImageMonocular(const cv::Mat &im, const double &timestamp) {
-  mImGray = im;
+cv::Mat Tracking::GrabImageStereo(const ImageBuffer &imRectLeft, const ImageBuffer &imRectRight,
+                                  const double &timestamp) {
+  PreprocessStereo(imRectLeft, imRectRight, timestamp, mCurrentFrame, mImGray);
 
-  if (mImGray.channels() == 3) {
-    if (mbRGB)
-      cvtColor(mImGray, mImGray, CV_RGB2GRAY);
-    else
-      cvtColor(mImGray, mImGray, CV_BGR2GRAY);
-  } else if (mImGray.channels() == 4) {
-    if (mbRGB)
-      cvtColor(mImGray, mImGray, CV_RGBA2GRAY);
-    else
-      cvtColor(mImGray, mImGray, CV_BGRA2GRAY);
-  }
+  Track();
 
-  if (mState == NOT_INITIALIZED || mState == NO_IMAGES_YET)
-    mCurrentFrame = Frame(mImGray, timestamp, mpIniORBextractor, mpORBVocabulary, mK, mDistCoef, mbf, mThDepth);
-  else
-    mCurrentFrame = Frame(mImGray, timestamp, mpORBextractorLeft, mpORBVocabulary, mK, mDistCoef, mbf,
-                          mThDepth);
+  return mCurrentFrame.mTcw.clone();
+}
+
+cv::Mat Tracking::GrabImageRGBD(const ImageBuffer &imRGB, const ImageBuffer &imD, const double &timestamp) {
+  PreprocessRGBD(imRGB, imD, timestamp, mCurrentFrame, mImGray);
+
+  Track();
+
+  return mCurrentFrame.mTcw.clone();
+}
+
+cv::Mat Tracking::GrabImageMonocular(const ImageBuffer &im, const double &timestamp) {
+  PreprocessMonocular(im, timestamp, mState == NOT_INITIALIZED || mState == NO_IMAGES_YET, mCurrentFrame, mImGray);
 
   Track();
 
@@ -248,6 +351,15 @@ void Tracking::Track() {
   // Get Map Mutex -> Map cannot be changed
   unique_lock<mutex> lock(mpMap->mMutexMapUpdate);
 
+  // Keyframes were moved by a loop correction or a global BA since the last frame,
+  // bring the last frame along with its reference keyframe
+  const int nBigChangeIdx = mpMap->GetLastBigChangeIdx();
+  if (nBigChangeIdx != mnLastBigChangeIdx) {
+    mnLastBigChangeIdx = nBigChangeIdx;
+    if (mState == OK && mLastFrame.mpReferenceKF && !mLastRelativePose.empty())
+      mLastFrame.SetPose(mLastRelativePose * mLastFrame.mpReferenceKF->GetPose());
+  }
+
   if (mState == NOT_INITIALIZED) {
     if (mSensor == System::STEREO || mSensor == System::RGBD)
       StereoInitialization();
@@ -350,9 +462,14 @@ void Tracking::Track() {
         bOK = TrackLocalMap();
     }
 
-    if (bOK)
+    if (bOK) {
       mState = OK;
-    else
+      mnLastTrackedFrameId = mCurrentFrame.mnId;
+
+      // Relocalised in another sub-map, the new keyframes belong to it
+      if (mpReferenceKF && mpReferenceKF->mnSubmapId != mpMap->GetCurrentSubmapId())
+        mpMap->SetCurrentSubmapId(mpReferenceKF->mnSubmapId);
+    } else
       mState = LOST;
 
     // Update drawer
@@ -403,12 +520,16 @@ void Tracking::Track() {
       }
     }
 
-    // Reset if the camera get lost soon after initialization
     if (mState == LOST) {
-      if (mpMap->KeyFramesInMap() <= 5) {
+      const bool bSmallSubmap = mpMap->KeyFramesInSubmap(mpMap->GetCurrentSubmapId()) <= 5;
+      if (bSmallSubmap && mpMap->GetKeyFrameOrigins().size() <= 1) {
+        // Reset if the camera get lost soon after initialization
         cout << "Track lost soon after initialisation, reseting..." << endl;
         mpSystem->Reset();
         return;
+      } else if (!mbOnlyTracking && (bSmallSubmap || mCurrentFrame.mnId > mnLastTrackedFrameId + mMaxLostFrames)) {
+        // Keep the previous maps, loop closing will merge them when they are seen again
+        StartNewSubmap();
       }
     }
 
@@ -416,22 +537,17 @@ void Tracking::Track() {
       mCurrentFrame.mpReferenceKF = mpReferenceKF;
 
     mLastFrame = Frame(mCurrentFrame);
+    PublishMotion();
   }
 
   // Store frame pose information to retrieve the complete camera trajectory afterwards.
+  // If tracking is lost the last relative pose is recorded again.
   if (!mCurrentFrame.mTcw.empty()) {
-    cv::Mat Tcr = mCurrentFrame.mTcw * mCurrentFrame.mpReferenceKF->GetPoseInverse();
-    mlRelativeFramePoses.push_back(Tcr);
-    mlpReferences.push_back(mpReferenceKF);
-    mlFrameTimes.push_back(mCurrentFrame.mTimeStamp);
-    mlbLost.push_back(mState == LOST);
-  } else {
-    // This can happen if tracking is lost
-    mlRelativeFramePoses.push_back(mlRelativeFramePoses.back());
-    mlpReferences.push_back(mlpReferences.back());
-    mlFrameTimes.push_back(mlFrameTimes.back());
-    mlbLost.push_back(mState == LOST);
+    mLastRelativePose = mCurrentFrame.mTcw * mCurrentFrame.mpReferenceKF->GetPoseInverse();
+    mpLastPoseReference = mCurrentFrame.mpReferenceKF;
   }
+  if (mpRecorder && mpLastPoseReference)
+    mpRecorder->AddFrame(mCurrentFrame.mnId, mCurrentFrame.mTimeStamp, mpLastPoseReference, mLastRelativePose, mState);
 
 }
 
@@ -443,7 +559,8 @@ void Tracking::StereoInitialization() {
     // Create KeyFrame
     KeyFrame *pKFini = new KeyFrame(mCurrentFrame, mpMap, mpKeyFrameDB);
 
-    // Insert KeyFrame in the map
+    // Insert KeyFrame in the map, origin of a new sub-map
+    mpMap->AddOrigin(pKFini);
     mpMap->AddKeyFrame(pKFini);
 
     // Create MapPoints and asscoiate to KeyFrame
@@ -462,7 +579,8 @@ void Tracking::StereoInitialization() {
       }
     }
 
-    cout << "New map created with " << mpMap->MapPointsInMap() << " points" << endl;
+    const set<MapPoint *> spIniMPs = pKFini->GetMapPoints();
+    cout << "New map created with " << spIniMPs.size() << " points" << endl;
 
     mpLocalMapper->InsertKeyFrame(pKFini);
 
@@ -471,14 +589,12 @@ void Tracking::StereoInitialization() {
     mpLastKeyFrame = pKFini;
 
     mvpLocalKeyFrames.push_back(pKFini);
-    mvpLocalMapPoints = mpMap->GetAllMapPoints();
+    mvpLocalMapPoints.assign(spIniMPs.begin(), spIniMPs.end());
     mpReferenceKF = pKFini;
     mCurrentFrame.mpReferenceKF = pKFini;
 
     mpMap->SetReferenceMapPoints(mvpLocalMapPoints);
 
-    mpMap->mvpKeyFrameOrigins.push_back(pKFini);
-
     mpMapDrawer->SetCurrentCameraPose(mCurrentFrame.mTcw);
 
     mState = OK;
@@ -551,8 +667,9 @@ void Tracking::MonocularInitialization() {
 }
 
 void Tracking::CreateInitialMapMonocular() {
-  // Create KeyFrames
+  // Create KeyFrames, the first one is the origin of a new sub-map
   KeyFrame *pKFini = new KeyFrame(mInitialFrame, mpMap, mpKeyFrameDB);
+  mpMap->AddOrigin(pKFini);
   KeyFrame *pKFcur = new KeyFrame(mCurrentFrame, mpMap, mpKeyFrameDB);
 
   pKFini->ComputeBoW();
@@ -594,17 +711,35 @@ void Tracking::CreateInitialMapMonocular() {
   pKFcur->UpdateConnections();
 
   // Bundle Adjustment
-  cout << "New Map created with " << mpMap->MapPointsInMap() << " points" << endl;
+  const set<MapPoint *> spIniMPs = pKFini->GetMapPoints();
+  vector<MapPoint *> vpIniMPs(spIniMPs.begin(), spIniMPs.end());
+  cout << "New Map created with " << vpIniMPs.size() << " points" << endl;
 
-  Optimizer::GlobalBundleAdjustemnt(mpMap, 20);
+  vector<KeyFrame *> vpIniKFs;
+  vpIniKFs.push_back(pKFini);
+  vpIniKFs.push_back(pKFcur);
+  Optimizer::BundleAdjustment(vpIniKFs, vpIniMPs, 20);
 
   // Set median depth to 1
   float medianDepth = pKFini->ComputeSceneMedianDepth(2);
   float invMedianDepth = 1.0f / medianDepth;
 
   if (medianDepth < 0 || pKFcur->TrackedMapPoints(1) < 100) {
-    cout << "Wrong initialization, reseting..." << endl;
-    Reset();
+    if (mpMap->GetKeyFrameOrigins().size() <= 1) {
+      cout << "Wrong initialization, reseting..." << endl;
+      // Applied before the next frame, by the extraction stage in pipelined mode
+      mpSystem->Reset();
+    } else {
+      // Drop this sub-map only
+      cout << "Wrong initialization, discarding new map..." << endl;
+      for (size_t i = 0; i < vpIniMPs.size(); i++)
+        vpIniMPs[i]->SetBadFlag();
+      pKFcur->SetBadFlag();
+      mpMap->EraseOrigin(pKFini);
+      pKFini->SetBadFlag();
+      delete mpInitializer;
+      mpInitializer = static_cast<Initializer *>(NULL);
+    }
     return;
   }
 
@@ -631,7 +766,7 @@ void Tracking::CreateInitialMapMonocular() {
 
   mvpLocalKeyFrames.push_back(pKFcur);
   mvpLocalKeyFrames.push_back(pKFini);
-  mvpLocalMapPoints = mpMap->GetAllMapPoints();
+  mvpLocalMapPoints = vpIniMPs;
   mpReferenceKF = pKFcur;
   mCurrentFrame.mpReferenceKF = pKFcur;
 
@@ -641,11 +776,24 @@ void Tracking::CreateInitialMapMonocular() {
 
   mpMapDrawer->SetCurrentCameraPose(pKFcur->GetPose());
 
-  mpMap->mvpKeyFrameOrigins.push_back(pKFini);
-
   mState = OK;
 }
 
+void Tracking::StartNewSubmap() {
+  cout << "Track lost for too long, starting a new map..." << endl;
+
+  if (mpInitializer) {
+    delete mpInitializer;
+    mpInitializer = static_cast<Initializer *>(NULL);
+  }
+
+  mVelocity = cv::Mat();
+  mvpLocalKeyFrames.clear();
+  mvpLocalMapPoints.clear();
+
+  mState = NOT_INITIALIZED;
+}
+
 void Tracking::CheckReplacedInLastFrame() {
   for (int i = 0; i < mLastFrame.N; i++) {
     MapPoint *pMP = mLastFrame.mvpMapPoints[i];
@@ -701,7 +849,7 @@ bool Tracking::TrackReferenceKeyFrame() {
 void Tracking::UpdateLastFrame() {
   // Update pose according to reference keyframe
   KeyFrame *pRef = mLastFrame.mpReferenceKF;
-  cv::Mat Tlr = mlRelativeFramePoses.back();
+  cv::Mat Tlr = mLastRelativePose;
 
   mLastFrame.SetPose(Tlr * pRef->GetPose());
 
@@ -909,18 +1057,23 @@ bool Tracking::NeedNewKeyFrame() {
 
   if ((c1a || c1b || c1c) && c2) {
     // If the mapping accepts keyframes, insert keyframe.
-    // Otherwise send a signal to interrupt BA
+    // Otherwise queue it if the backlog allows, and interrupt BA only when keyframes are
+    // already waiting (or cannot be queued, in the monocular case)
     if (bLocalMappingIdle) {
       return true;
     } else {
-      mpLocalMapper->InterruptBA();
+      const int nQueued = mpLocalMapper->KeyframesInQueue();
       if (mSensor != System::MONOCULAR) {
-        if (mpLocalMapper->KeyframesInQueue() < 3)
+        if (nQueued > 0)
+          mpLocalMapper->InterruptBA();
+        if (nQueued < mpLocalMapper->MaxQueuedKeyFrames())
           return true;
         else
           return false;
-      } else
+      } else {
+        mpLocalMapper->InterruptBA();
         return false;
+      }
     }
   } else
     return false;
@@ -996,70 +1149,231 @@ void Tracking::CreateNewKeyFrame() {
   mpLastKeyFrame = pKF;
 
   ImagePair images;
-  images.keyFrameId = pKF->mnId;
-  images.colorImg = mCurrentFrame.mImColor;
-  images.depthImg = mCurrentFrame.mImDepth;
+  images.pKF = pKF;
+  images.colorImg = pKF->mImColor;
+  images.depthImg = pKF->mImDepth;
 
-  std::unique_lock<std::mutex> lck(mMutexImagesQueue);
-  if (mImagesQueue.size() < mcQueueSize) {
-    mImagesQueue.push(images);
-  } else {
-    int count = 0;
-    while (mImagesQueue.size() >= mcQueueSize) {
-      mImagesQueue.pop();
-      std::cout << "Poping images " << ++count << std::endl;
+  {
+    std::unique_lock<std::mutex> lck(mMutexImagesQueue);
+    images.nReset = mnSegResets;
+    if (mImagesQueue.size() < mcQueueSize) {
+      mImagesQueue.push(images);
+    } else {
+      int count = 0;
+      while (mImagesQueue.size() >= mcQueueSize) {
+        mImagesQueue.pop();
+        std::cout << "Poping images " << ++count << std::endl;
+      }
+      mImagesQueue.push(images);
     }
-    mImagesQueue.push(images);
   }
+  mcvImagesQueue.notify_one();
 }
 
 void Tracking::PerformSegmentation() {
   while (true) {
-    std::unique_lock<std::mutex> lck(mMutexImagesQueue);
-    if (!mImagesQueue.empty()) {
-      ImagePair images;
-      images;
+    ImagePair images;
+    {
+      std::unique_lock<std::mutex> lck(mMutexImagesQueue);
+      mcvImagesQueue.wait(lck, [this] { return !mImagesQueue.empty() || mbSegFinish; });
+      if (mbSegFinish)
+        return;
       images = mImagesQueue.front();
       mImagesQueue.pop();
-      std::vector<cv::Mat> color_imgs;
-      color_imgs.push_back(images.colorImg);
-      std::vector<cv::Mat> depth_imgs;
-      depth_imgs.push_back(images.depthImg);
-      mClient.sendImages(color_imgs);
-      mClient.sendImages(depth_imgs);
-      Client::ClsPosPairs clsPosPairs;
-      mClient.getSegResult(clsPosPairs);
-      SaveSegResultToMap(clsPosPairs, images.keyFrameId);
     }
+
+    // Keyframes wait in mImagesQueue, where the oldest are dropped, while the server is saturated.
+    // Requests the server never answered are given up after mSegTimeout, they would block the queue.
+    long unsigned int requestId;
+    {
+      std::unique_lock<std::mutex> lck(mMutexSegInFlight);
+      while ((int) mmSegInFlight.size() >= mnMaxSegInFlight && !mbSegFinish) {
+        mcvSegInFlight.wait_for(lck, std::chrono::seconds(1));
+        const std::chrono::steady_clock::time_point tExpired = std::chrono::steady_clock::now() - mSegTimeout;
+        for (std::map<long unsigned int, SegRequest>::iterator mit = mmSegInFlight.begin();
+             mit != mmSegInFlight.end();) {
+          if (mit->second.tSent < tExpired) {
+            cout << "Segmentation of keyframe " << mit->second.pKF->mnId << " timed out" << endl;
+            mit = mmSegInFlight.erase(mit);
+          } else
+            mit++;
+        }
+      }
+      if (mbSegFinish)
+        return;
+      // The keyframe was deleted by a reset while it was dequeued
+      if (images.nReset != mnSegResets)
+        continue;
+      requestId = mnNextSegRequestId++;
+      SegRequest &request = mmSegInFlight[requestId];
+      request.pKF = images.pKF;
+      request.tSent = std::chrono::steady_clock::now();
+    }
+    mClient.sendRequest(requestId, images.colorImg, images.depthImg);
+  }
+}
+
+void Tracking::ReceiveSegmentation() {
+  while (true) {
+    long unsigned int id;
+    Client::ClsPosPairs clsPosPairs;
+    Client::InstanceMasks instanceMasks;
+    if (!mClient.getSegResult(id, clsPosPairs, instanceMasks))
+      return;
+
+    std::unique_lock<std::mutex> lckResult(mMutexSegResult);
+    KeyFrame *pKF = static_cast<KeyFrame *>(NULL);
+    {
+      std::unique_lock<std::mutex> lck(mMutexSegInFlight);
+      std::map<long unsigned int, SegRequest>::iterator mit = mmSegInFlight.find(id);
+      if (mit != mmSegInFlight.end()) {
+        pKF = mit->second.pKF;
+        mmSegInFlight.erase(mit);
+      }
+    }
+    mcvSegInFlight.notify_one();
+
+    if (pKF) {
+      SaveSegResultToMap(clsPosPairs, pKF);
+      if (mbMaskDynamic)
+        SetDynamicMask(instanceMasks, pKF);
+    }
+  }
+}
+
+void Tracking::StopSegmentation() {
+  {
+    std::unique_lock<std::mutex> lckQueue(mMutexImagesQueue, std::defer_lock);
+    std::unique_lock<std::mutex> lckInFlight(mMutexSegInFlight, std::defer_lock);
+    std::lock(lckQueue, lckInFlight);
+    mbSegFinish = true;
   }
+  mcvImagesQueue.notify_all();
+  mcvSegInFlight.notify_all();
+  mSegmentation->join();
+
+  // The receiver is blocked on the socket until the connection is shut down
+  mClient.shutdownConnection();
+  mSegmentationResults->join();
 
+  std::unique_lock<std::mutex> lck(mMutexSegInFlight);
+  mmSegInFlight.clear();
 }
 
-void Tracking::SaveSegResultToMap(const Client::ClsPosPairs &clsPosPairs, long unsigned int keyFrameId) {
+void Tracking::SetDynamicMask(const Client::InstanceMasks &masks, KeyFrame *pKF) {
+  cv::Mat dynMask;
+  if (!masks.empty()) {
+    dynMask = cv::Mat::zeros(pKF->mImDepth.size(), CV_8U);
+    const cv::Rect image(0, 0, dynMask.cols, dynMask.rows);
+    for (size_t i = 0; i < masks.size(); i++) {
+      const cv::Rect box = masks[i].box & image;
+      if (box.area() == 0 || masks[i].box.size() != masks[i].mask.size())
+        continue;
+      cv::Mat roi = dynMask(box);
+      roi |= masks[i].mask(cv::Rect(box.x - masks[i].box.x, box.y - masks[i].box.y, box.width, box.height));
+    }
+  }
+
+  // Results come in keyframe order, but never replace a newer mask
+  std::unique_lock<std::mutex> lck(mMutexDynMask);
+  if (mpDynMaskKF && mpDynMaskKF->mnId > pKF->mnId)
+    return;
+  mpDynMaskKF = pKF;
+  mDynMask = dynMask;
+}
+
+void Tracking::PublishMotion() {
+  std::unique_lock<std::mutex> lck(mMutexMotion);
+  mbMotionOK = mState == OK && !mLastFrame.mTcw.empty();
+  if (!mbMotionOK)
+    return;
+  mMotionTcw = mLastFrame.mTcw.clone();
+  mMotionVelocity = mVelocity.empty() ? cv::Mat() : mVelocity.clone();
+  mnMotionFrameId = mLastFrame.mnId;
+}
+
+cv::Mat Tracking::PropagateDynamicMask() {
+  KeyFrame *pKF;
+  cv::Mat dynMask;
+  {
+    std::unique_lock<std::mutex> lck(mMutexDynMask);
+    pKF = mpDynMaskKF;
+    dynMask = mDynMask;
+  }
+  if (!pKF || dynMask.empty() || Frame::nNextId - pKF->mnFrameId > (long unsigned int) mnDynMaskMaxAge)
+    return cv::Mat();
+
+  cv::Mat Tcw, velocity;
+  long unsigned int nMotionFrameId;
+  {
+    std::unique_lock<std::mutex> lck(mMutexMotion);
+    if (!mbMotionOK)
+      return cv::Mat();
+    Tcw = mMotionTcw;
+    velocity = mMotionVelocity;
+    nMotionFrameId = mnMotionFrameId;
+  }
+
+  // Pose of the frame about to be extracted, as the motion model predicts it. The velocity is
+  // applied once per frame after the last tracked one, several when the tracking runs behind
+  // the extraction (System pipelined mode).
+  if (!velocity.empty()) {
+    for (long unsigned int id = nMotionFrameId; id < Frame::nNextId; id++)
+      Tcw = velocity * Tcw;
+  }
+  cv::Mat Tck = Tcw * pKF->GetPoseInverse();
+  const cv::Matx33f Rck = Tck.rowRange(0, 3).colRange(0, 3);
+  const cv::Vec3f tck = Tck.rowRange(0, 3).col(3);
+
+  // Back-project the masked pixels with the keyframe depth and splat them in the predicted frame,
+  // one pixel every nStep; the dilation fills the gaps and covers the object motion
+  const int nStep = 2;
+  const cv::Mat &depth = pKF->mImDepth;
+  cv::Mat warped = cv::Mat::zeros(dynMask.size(), CV_8U);
+  for (int v = 0; v < dynMask.rows; v += nStep) {
+    const uchar *m = dynMask.ptr<uchar>(v);
+    const float *d = depth.ptr<float>(v);
+    for (int u = 0; u < dynMask.cols; u += nStep) {
+      if (!m[u])
+        continue;
+      const float z = d[u];
+      if (z <= 0) {
+        // no depth, keep the pixel where it was
+        warped.at<uchar>(v, u) = 255;
+        continue;
+      }
+      const cv::Vec3f Xc = Rck * cv::Vec3f((u - pKF->cx) * z * pKF->invfx, (v - pKF->cy) * z * pKF->invfy, z) + tck;
+      if (Xc[2] <= 0)
+        continue;
+      const int uc = cvRound(pKF->fx * Xc[0] / Xc[2] + pKF->cx);
+      const int vc = cvRound(pKF->fy * Xc[1] / Xc[2] + pKF->cy);
+      if (uc >= 0 && uc < warped.cols && vc >= 0 && vc < warped.rows)
+        warped.at<uchar>(vc, uc) = 255;
+    }
+  }
+
+  const int size = 2 * mnDynMaskDilation + 1;
+  cv::dilate(warped, warped, cv::getStructuringElement(cv::MORPH_ELLIPSE, cv::Size(size, size)));
+  return 255 - warped;
+}
+
+void Tracking::SaveSegResultToMap(const Client::ClsPosPairs &clsPosPairs, KeyFrame *pKF) {
   int posPairSize = clsPosPairs.size();
   for (int i = 0; i < posPairSize; i++) {
-    std::string objname = clsPosPairs[i].first;
-    std::vector<std::vector<double> > poses = clsPosPairs[i].second;
+    const std::string &objname = clsPosPairs[i].first;
+    const std::vector<std::vector<double> > &poses = clsPosPairs[i].second;
 
-    std::unordered_map<long unsigned int, ObjectPos> objKeyFrameMap;
-    ObjectPos objpos;
+    std::vector<Eigen::Vector3d> vPc;
+    vPc.reserve(poses.size());
     int posesSize = poses.size();
     for (int j = 0; j < posesSize; j++) {
-      std::vector<double> pos = poses[j];
-      Eigen::Vector3d Pc(pos.data());
+      Eigen::Vector3d Pc(poses[j].data());
       if ((Pc.array() != 0.0).any()) {
-        objpos.addInstance(Pc);
+        vPc.push_back(Pc);
       }
     }
 
-    objKeyFrameMap[keyFrameId] = objpos;
-    std::unique_lock<mutex> lock(mpMap->mMutexObjectMap);
-    auto it = mpMap->mObjectMap.find(objname);
-    if (it != mpMap->mObjectMap.end()) {
-      it->second.insert(objKeyFrameMap.begin(), objKeyFrameMap.end());
-    } else {
-      mpMap->mObjectMap.insert(std::make_pair(objname, objKeyFrameMap));
-    }
+    mpMap->mObjectMap.AddDetections(pKF, objname, vPc);
   }
 }
 
@@ -1142,21 +1456,15 @@ void Tracking::UpdateLocalPoints() {
 
 void Tracking::UpdateLocalKeyFrames() {
   // Each map point vote for the keyframes in which it has been observed
-  map<KeyFrame *, int> keyframeCounter;
   for (int i = 0; i < mCurrentFrame.N; i++) {
-    if (mCurrentFrame.mvpMapPoints[i]) {
-      MapPoint *pMP = mCurrentFrame.mvpMapPoints[i];
-      if (!pMP->isBad()) {
-        const map<KeyFrame *, size_t> observations = pMP->GetObservations();
-        for (map<KeyFrame *, size_t>::const_iterator it = observations.begin(), itend = observations.end();
-             it != itend; it++)
-          keyframeCounter[it->first]++;
-      } else {
-        mCurrentFrame.mvpMapPoints[i] = NULL;
-      }
-    }
+    MapPoint *pMP = mCurrentFrame.mvpMapPoints[i];
+    if (pMP && pMP->isBad())
+      mCurrentFrame.mvpMapPoints[i] = NULL;
   }
 
+  vector<pair<KeyFrame *, int> > keyframeCounter;
+  KeyFrame::CountCovisibility(mCurrentFrame.mvpMapPoints, keyframeCounter);
+
   if (keyframeCounter.empty())
     return;
 
@@ -1167,7 +1475,7 @@ void Tracking::UpdateLocalKeyFrames() {
   mvpLocalKeyFrames.reserve(3 * keyframeCounter.size());
 
   // All keyframes that observe a map point are included in the local map. Also check which keyframe shares most points
-  for (map<KeyFrame *, int>::const_iterator it = keyframeCounter.begin(), itEnd = keyframeCounter.end();
+  for (vector<pair<KeyFrame *, int> >::const_iterator it = keyframeCounter.begin(), itEnd = keyframeCounter.end();
        it != itEnd; it++) {
     KeyFrame *pKF = it->first;
 
@@ -1388,6 +1696,10 @@ void Tracking::Reset() {
     while (!mpViewer->isStopped())
       usleep(3000);
   }
+  if (mpDenseExporter)
+    mpDenseExporter->RequestStop();
+  if (mpPublisher)
+    mpPublisher->RequestStop();
 
   // Reset Local Mapping
   cout << "Reseting Local Mapper...";
@@ -1404,6 +1716,38 @@ void Tracking::Reset() {
   mpKeyFrameDB->clear();
   cout << " done" << endl;
 
+  // The recorder must not access the keyframes anymore
+  if (mpRecorder)
+    mpRecorder->Reset();
+
+  // Drop the segmentation requests, the results that arrive later are ignored
+  {
+    std::unique_lock<std::mutex> lckResult(mMutexSegResult);
+    std::unique_lock<std::mutex> lckQueue(mMutexImagesQueue, std::defer_lock);
+    std::unique_lock<std::mutex> lckInFlight(mMutexSegInFlight, std::defer_lock);
+    std::lock(lckQueue, lckInFlight);
+    std::queue<ImagePair>().swap(mImagesQueue);
+    mmSegInFlight.clear();
+    mnSegResets++;
+  }
+  mcvSegInFlight.notify_one();
+  {
+    std::unique_lock<std::mutex> lck(mMutexDynMask);
+    mpDynMaskKF = static_cast<KeyFrame *>(NULL);
+    mDynMask.release();
+  }
+
+  // The dense exporter reads the keyframes between two checks of the stop request
+  if (mpDenseExporter) {
+    while (!mpDenseExporter->isStopped())
+      usleep(3000);
+  }
+  // The publisher diffs the keyframes and map points of the map
+  if (mpPublisher) {
+    while (!mpPublisher->isStopped())
+      usleep(3000);
+  }
+
   // Clear Map (this erase MapPoints and KeyFrames)
   mpMap->clear();
 
@@ -1411,18 +1755,25 @@ void Tracking::Reset() {
   Frame::nNextId = 0;
   mState = NO_IMAGES_YET;
 
+  {
+    std::unique_lock<std::mutex> lck(mMutexMotion);
+    mbMotionOK = false;
+  }
+
   if (mpInitializer) {
     delete mpInitializer;
     mpInitializer = static_cast<Initializer *>(NULL);
   }
 
-  mlRelativeFramePoses.clear();
-  mlpReferences.clear();
-  mlFrameTimes.clear();
-  mlbLost.clear();
+  mLastRelativePose.release();
+  mpLastPoseReference = static_cast<KeyFrame *>(NULL);
 
   if (mpViewer)
     mpViewer->Release();
+  if (mpDenseExporter)
+    mpDenseExporter->Release();
+  if (mpPublisher)
+    mpPublisher->Release();
 }
 
 void Tracking::ChangeCalibration(const string &strSettingPath) {
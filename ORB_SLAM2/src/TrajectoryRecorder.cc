@@ -0,0 +1,567 @@
+/**
+* This file is part of ORB-SLAM2.
+*
+* Copyright (C) 2014-2016 Raúl Mur-Artal <raulmur at unizar dot es> (University of Zaragoza)
+* For more information see <https://github.com/raulmur/ORB_SLAM2>
+*
+* ORB-SLAM2 is free software: you can redistribute it and/or modify
+* it under the terms of the GNU General Public License as published by
+* the Free Software Foundation, either version 3 of the License, or
+* (at your option) any later version.
+*
+* ORB-SLAM2 is distributed in the hope that it will be useful,
+* but WITHOUT ANY WARRANTY; without even the implied warranty of
+* MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+* GNU General Public License for more details.
+*
+* You should have received a copy of the GNU General Public License
+* along with ORB-SLAM2. If not, see <http://www.gnu.org/licenses/>.
+*/
+
+
+#include "TrajectoryRecorder.h"
+#include "Map.h"
+#include "KeyFrame.h"
+#include "Tracking.h"
+#include "Converter.h"
+#include "LittleEndian.h"
+
+#include <algorithm>
+#include <cstddef>
+#include <chrono>
+#include <cstring>
+#include <fstream>
+#include <iomanip>
+#include <iostream>
+#include <limits>
+#include <unistd.h>
+#include <fcntl.h>
+#include <sys/mman.h>
+
+namespace ORB_SLAM2
+{
+
+namespace
+{
+
+enum RecordType
+{
+    REC_FRAME = 1,
+    REC_KEYFRAME = 2,
+    REC_RESET = 3
+};
+
+const char kMagic[8] = {'O','R','B','T','R','A','J','1'};
+
+// Records the log is created for, it doubles when full
+const size_t knInitialRecords = 1 << 16;
+
+// The queued records are written at this period (ms), what a crash can lose
+const int knPeriod = 100;
+
+const char kDefaultLogFile[] = "CameraTrajectory.log";
+
+// First three rows of a 4x4 CV_32F transformation, row major
+void ToRows(const cv::Mat &T, float* rows)
+{
+    for(int i=0; i<3; i++)
+        for(int j=0; j<4; j++)
+            rows[4*i+j] = T.at<float>(i,j);
+}
+
+cv::Mat FromRows(const float* rows)
+{
+    cv::Mat T = cv::Mat::eye(4,4,CV_32F);
+    for(int i=0; i<3; i++)
+        for(int j=0; j<4; j++)
+            T.at<float>(i,j) = rows[4*i+j];
+    return T;
+}
+
+}
+
+TrajectoryRecorder::TrajectoryRecorder(Map *pMap, const std::string &strSettingPath):
+    mpMap(pMap), mFd(-1), mpLog(NULL), mnCapacity(0), mnRecords(0), mnSegmentBegin(0), mbLogFailed(false),
+    mnLastBigChangeIdx(0), mbFinishRequested(false), mbFinished(true)
+{
+    static_assert(sizeof(LogHeader)==24 && sizeof(Record)==80, "Unexpected padding in the log records");
+
+    cv::FileStorage fSettings(strSettingPath, cv::FileStorage::READ);
+    mStrLogFile = (std::string) fSettings["Trajectory.Log"];
+    if(mStrLogFile.empty())
+        mStrLogFile = kDefaultLogFile;
+
+    if(!OpenLog())
+    {
+        std::cerr << "Failed to create the trajectory log " << mStrLogFile << std::endl;
+        exit(-1);
+    }
+    std::cout << "Trajectory log: " << mStrLogFile << std::endl;
+}
+
+TrajectoryRecorder::~TrajectoryRecorder()
+{
+    if(mpLog)
+        munmap(mpLog, sizeof(LogHeader)+mnCapacity*sizeof(Record));
+    if(mFd>=0)
+    {
+        // Drop the space reserved for the next records
+        if(ftruncate(mFd, sizeof(LogHeader)+mnRecords*sizeof(Record))!=0)
+            std::cerr << "Failed to trim the trajectory log" << std::endl;
+        close(mFd);
+    }
+}
+
+bool TrajectoryRecorder::OpenLog()
+{
+    mFd = open(mStrLogFile.c_str(), O_RDWR | O_CREAT | O_TRUNC, 0644);
+
+    if(mFd<0 || !GrowLog(knInitialRecords))
+        return false;
+
+    LogHeader* pHeader = reinterpret_cast<LogHeader*>(mpLog);
+    memcpy(pHeader->mMagic, kMagic, sizeof(kMagic));
+    EncodeLittleEndian<uint32_t>(sizeof(Record), &pHeader->mnRecordSize);
+    EncodeLittleEndian<uint32_t>(0, &pHeader->mnReserved);
+    EncodeLittleEndian<uint64_t>(0, &pHeader->mnRecords);
+    return true;
+}
+
+bool TrajectoryRecorder::GrowLog(const size_t nCapacity)
+{
+    const size_t nBytes = sizeof(LogHeader)+nCapacity*sizeof(Record);
+    if(ftruncate(mFd, nBytes)!=0)
+        return false;
+
+    // The previous mapping is kept if the new one fails
+    void* pLog = mmap(NULL, nBytes, PROT_READ | PROT_WRITE, MAP_SHARED, mFd, 0);
+    if(pLog==MAP_FAILED)
+        return false;
+
+    if(mpLog)
+        munmap(mpLog, sizeof(LogHeader)+mnCapacity*sizeof(Record));
+    mpLog = static_cast<char*>(pLog);
+    mnCapacity = nCapacity;
+    return true;
+}
+
+void TrajectoryRecorder::FlushQueue()
+{
+    std::vector<Record> vRecords;
+    {
+        std::unique_lock<std::mutex> lock(mMutexQueue);
+        vRecords.swap(mvQueue);
+    }
+
+    if(vRecords.empty() || mbLogFailed)
+        return;
+
+    if(mnRecords+vRecords.size()>mnCapacity)
+    {
+        size_t nCapacity = mnCapacity;
+        while(mnRecords+vRecords.size()>nCapacity)
+            nCapacity *= 2;
+        if(!GrowLog(nCapacity))
+        {
+            std::cerr << "Failed to grow the trajectory log, no more frames are recorded" << std::endl;
+            mbLogFailed = true;
+            return;
+        }
+    }
+
+    char* pRecords = mpLog+sizeof(LogHeader);
+    for(size_t i=0; i<vRecords.size(); i++)
+    {
+        EncodeRecord(vRecords[i], pRecords+(mnRecords+i)*sizeof(Record));
+        if(vRecords[i].mnType==REC_RESET)
+            mnSegmentBegin = mnRecords+i+1;
+    }
+    mnRecords += vRecords.size();
+
+    // The count last, a reader of the file never sees records that were not written
+    EncodeLittleEndian<uint64_t>(mnRecords, &reinterpret_cast<LogHeader*>(mpLog)->mnRecords);
+    msync(mpLog, sizeof(LogHeader)+mnRecords*sizeof(Record), MS_ASYNC);
+}
+
+void TrajectoryRecorder::Run()
+{
+    mbFinished = false;
+
+    while(1)
+    {
+        {
+            std::unique_lock<std::mutex> lock(mMutexQueue);
+            mcvQueue.wait_for(lock, std::chrono::milliseconds(knPeriod), [this]{ return CheckFinish(); });
+        }
+
+        // Keyframes moved by a loop closure or a global BA are logged again
+        const int nBigChangeIdx = mpMap->GetLastBigChangeIdx();
+        if(nBigChangeIdx!=mnLastBigChangeIdx)
+        {
+            mnLastBigChangeIdx = nBigChangeIdx;
+            SnapshotKeyFrames();
+        }
+
+        {
+            std::unique_lock<std::mutex> lock(mMutexLog);
+            FlushQueue();
+        }
+
+        if(CheckFinish())
+            break;
+    }
+
+    // Final keyframe poses, so that the log alone gives the final trajectory
+    SnapshotKeyFrames();
+    {
+        std::unique_lock<std::mutex> lock(mMutexLog);
+        FlushQueue();
+    }
+
+    SetFinish();
+}
+
+TrajectoryRecorder::Record TrajectoryRecorder::KeyFrameRecord(KeyFrame* pKF)
+{
+    Record record;
+    record.mnType = REC_KEYFRAME;
+    record.mTimeStamp = pKF->mTimeStamp;
+    record.mnId = pKF->mnId;
+
+    KeyFrame* pParent = pKF->GetParent();
+    if(pKF->isBad() && pParent)
+    {
+        record.mnState = 1;
+        record.mnRefId = pParent->mnId;
+        ToRows(pKF->mTcp, record.mT);
+    }
+    else
+    {
+        record.mnState = 0;
+        record.mnRefId = pKF->mnId;
+        ToRows(pKF->GetPose(), record.mT);
+    }
+    return record;
+}
+
+void TrajectoryRecorder::EncodeRecord(const Record &record, char* p)
+{
+    EncodeLittleEndian(record.mnType, p+offsetof(Record,mnType));
+    EncodeLittleEndian(record.mnState, p+offsetof(Record,mnState));
+    EncodeLittleEndian(record.mTimeStamp, p+offsetof(Record,mTimeStamp));
+    EncodeLittleEndian(record.mnId, p+offsetof(Record,mnId));
+    EncodeLittleEndian(record.mnRefId, p+offsetof(Record,mnRefId));
+    for(int i=0; i<12; i++)
+        EncodeLittleEndian(record.mT[i], p+offsetof(Record,mT)+i*sizeof(float));
+}
+
+TrajectoryRecorder::Record TrajectoryRecorder::DecodeRecord(const char* p)
+{
+    Record record;
+    record.mnType = DecodeLittleEndian<uint32_t>(p+offsetof(Record,mnType));
+    record.mnState = DecodeLittleEndian<int32_t>(p+offsetof(Record,mnState));
+    record.mTimeStamp = DecodeLittleEndian<double>(p+offsetof(Record,mTimeStamp));
+    record.mnId = DecodeLittleEndian<uint64_t>(p+offsetof(Record,mnId));
+    record.mnRefId = DecodeLittleEndian<uint64_t>(p+offsetof(Record,mnRefId));
+    for(int i=0; i<12; i++)
+        record.mT[i] = DecodeLittleEndian<float>(p+offsetof(Record,mT)+i*sizeof(float));
+    return record;
+}
+
+void TrajectoryRecorder::DecodeRecords(const char* p, const size_t n, std::vector<Record> &vRecords)
+{
+    vRecords.resize(n);
+    for(size_t i=0; i<n; i++)
+        vRecords[i] = DecodeRecord(p+i*sizeof(Record));
+}
+
+void TrajectoryRecorder::AddFrame(const long unsigned int nFrameId, const double timestamp, KeyFrame* pRefKF,
+                                  const cv::Mat &Tcr, const int state)
+{
+    Record frame;
+    frame.mnType = REC_FRAME;
+    frame.mnState = state;
+    frame.mTimeStamp = timestamp;
+    frame.mnId = nFrameId;
+    frame.mnRefId = pRefKF->mnId;
+    ToRows(Tcr, frame.mT);
+
+    bool bNewKeyFrame = false;
+    Record keyframe;
+    {
+        std::unique_lock<std::mutex> lock(mMutexKeyFrames);
+        if(!mmKeyFrames.count(pRefKF->mnId))
+        {
+            mmKeyFrames[pRefKF->mnId] = pRefKF;
+            keyframe = KeyFrameRecord(pRefKF);
+            bNewKeyFrame = true;
+        }
+    }
+
+    std::unique_lock<std::mutex> lock(mMutexQueue);
+    if(bNewKeyFrame)
+        mvQueue.push_back(keyframe);
+    mvQueue.push_back(frame);
+}
+
+void TrajectoryRecorder::Reset()
+{
+    {
+        std::unique_lock<std::mutex> lock(mMutexKeyFrames);
+        mmKeyFrames.clear();
+    }
+
+    Record reset;
+    memset(&reset, 0, sizeof(reset));
+    reset.mnType = REC_RESET;
+
+    std::unique_lock<std::mutex> lock(mMutexQueue);
+    mvQueue.push_back(reset);
+}
+
+void TrajectoryRecorder::SnapshotKeyFrames()
+{
+    std::vector<Record> vRecords;
+    {
+        std::unique_lock<std::mutex> lock(mMutexKeyFrames);
+
+        std::vector<KeyFrame*> vpKFs;
+        vpKFs.reserve(mmKeyFrames.size());
+        for(std::unordered_map<long unsigned int, KeyFrame*>::const_iterator it=mmKeyFrames.begin(); it!=mmKeyFrames.end(); it++)
+            vpKFs.push_back(it->second);
+
+        vRecords.reserve(vpKFs.size());
+        for(size_t i=0; i<vpKFs.size(); i++)
+        {
+            KeyFrame* pKF = vpKFs[i];
+            vRecords.push_back(KeyFrameRecord(pKF));
+
+            // A culled keyframe is resolved through its parents, they must be in the log too
+            while(pKF->isBad())
+            {
+                pKF = pKF->GetParent();
+                if(!pKF || mmKeyFrames.count(pKF->mnId))
+                    break;
+                mmKeyFrames[pKF->mnId] = pKF;
+                vRecords.push_back(KeyFrameRecord(pKF));
+            }
+        }
+    }
+
+    std::unique_lock<std::mutex> lock(mMutexQueue);
+    mvQueue.insert(mvQueue.end(), vRecords.begin(), vRecords.end());
+}
+
+bool TrajectoryRecorder::KeyFramePose(const uint64_t nId, cv::Mat &Tcw)
+{
+    std::unordered_map<long unsigned int, KeyFrame*>::const_iterator it = mmKeyFrames.find(nId);
+    if(it==mmKeyFrames.end())
+        return false;
+
+    KeyFrame* pKF = it->second;
+    cv::Mat Trw = cv::Mat::eye(4,4,CV_32F);
+
+    // If the keyframe was culled, traverse the spanning tree to get a suitable keyframe.
+    while(pKF->isBad())
+    {
+        Trw = Trw*pKF->mTcp;
+        pKF = pKF->GetParent();
+    }
+
+    Tcw = Trw*pKF->GetPose();
+    return true;
+}
+
+void TrajectoryRecorder::ResolveFrames(const Record* pBegin, const Record* pEnd,
+                                       const std::unordered_map<uint64_t, cv::Mat> &mKeyFramePoses, const bool bSkipLost,
+                                       std::vector<double> &vTimeStamps, std::vector<cv::Mat> &vTwc)
+{
+    vTimeStamps.clear();
+    vTwc.clear();
+    if(mKeyFramePoses.empty())
+        return;
+
+    // Transform all keyframes so that the first keyframe is at the origin.
+    // After a loop closure the first keyframe might not be at the origin.
+    uint64_t nOriginId = std::numeric_limits<uint64_t>::max();
+    for(std::unordered_map<uint64_t, cv::Mat>::const_iterator it=mKeyFramePoses.begin(); it!=mKeyFramePoses.end(); it++)
+        nOriginId = std::min(nOriginId, it->first);
+    const cv::Mat Two = mKeyFramePoses.find(nOriginId)->second.inv();
+
+    for(const Record* pRecord=pBegin; pRecord!=pEnd; pRecord++)
+    {
+        if(pRecord->mnType!=REC_FRAME || (bSkipLost && pRecord->mnState!=Tracking::OK))
+            continue;
+
+        std::unordered_map<uint64_t, cv::Mat>::const_iterator it = mKeyFramePoses.find(pRecord->mnRefId);
+        if(it==mKeyFramePoses.end())
+            continue;
+
+        const cv::Mat Tcw = FromRows(pRecord->mT)*it->second*Two;
+        cv::Mat Rwc = Tcw.rowRange(0,3).colRange(0,3).t();
+        cv::Mat twc = -Rwc*Tcw.rowRange(0,3).col(3);
+        cv::Mat Twc = cv::Mat::eye(4,4,CV_32F);
+        Rwc.copyTo(Twc.rowRange(0,3).colRange(0,3));
+        twc.copyTo(Twc.rowRange(0,3).col(3));
+
+        vTimeStamps.push_back(pRecord->mTimeStamp);
+        vTwc.push_back(Twc);
+    }
+}
+
+void TrajectoryRecorder::GetTrajectory(std::vector<double> &vTimeStamps, std::vector<cv::Mat> &vTwc, const bool bSkipLost)
+{
+    std::unique_lock<std::mutex> lockLog(mMutexLog);
+    FlushQueue();
+
+    std::vector<Record> vRecords;
+    DecodeRecords(mpLog+sizeof(LogHeader)+mnSegmentBegin*sizeof(Record), mnRecords-mnSegmentBegin, vRecords);
+    const Record* pBegin = vRecords.data();
+    const Record* pEnd = vRecords.data()+vRecords.size();
+
+    // Current poses of the reference keyframes
+    std::unordered_map<uint64_t, cv::Mat> mKeyFramePoses;
+    {
+        std::unique_lock<std::mutex> lock(mMutexKeyFrames);
+        for(const Record* pRecord=pBegin; pRecord!=pEnd; pRecord++)
+        {
+            if(pRecord->mnType!=REC_FRAME || mKeyFramePoses.count(pRecord->mnRefId))
+                continue;
+            cv::Mat Tcw;
+            if(KeyFramePose(pRecord->mnRefId, Tcw))
+                mKeyFramePoses[pRecord->mnRefId] = Tcw;
+        }
+    }
+
+    ResolveFrames(pBegin, pEnd, mKeyFramePoses, bSkipLost, vTimeStamps, vTwc);
+}
+
+bool TrajectoryRecorder::Save(const std::string &filename, const eFormat format)
+{
+    std::vector<double> vTimeStamps;
+    std::vector<cv::Mat> vTwc;
+    GetTrajectory(vTimeStamps, vTwc, format==TUM);
+    if(vTwc.empty())
+        return false;
+
+    WriteTrajectory(filename, format, vTimeStamps, vTwc);
+    return true;
+}
+
+bool TrajectoryRecorder::ConvertLog(const std::string &strLogFile, const std::string &filename, const eFormat format)
+{
+    std::ifstream f(strLogFile.c_str(), std::ios::binary);
+    LogHeader header;
+    if(!f.read(reinterpret_cast<char*>(&header), sizeof(header)) || memcmp(header.mMagic, kMagic, sizeof(kMagic))!=0 ||
+       DecodeLittleEndian<uint32_t>(&header.mnRecordSize)!=sizeof(Record))
+    {
+        std::cerr << "Not a trajectory log: " << strLogFile << std::endl;
+        return false;
+    }
+
+    std::vector<char> vBytes(DecodeLittleEndian<uint64_t>(&header.mnRecords)*sizeof(Record));
+    if(!vBytes.empty() && !f.read(&vBytes[0], vBytes.size()))
+    {
+        std::cerr << "Truncated trajectory log: " << strLogFile << std::endl;
+        return false;
+    }
+
+    std::vector<Record> vRecords;
+    DecodeRecords(vBytes.data(), vBytes.size()/sizeof(Record), vRecords);
+
+    // Only the last segment, the keyframe ids were reused after a reset
+    size_t nBegin = 0;
+    for(size_t i=0; i<vRecords.size(); i++)
+        if(vRecords[i].mnType==REC_RESET)
+            nBegin = i+1;
+
+    // Last record of every keyframe
+    std::unordered_map<uint64_t, const Record*> mKeyFrameRecords;
+    for(size_t i=nBegin; i<vRecords.size(); i++)
+        if(vRecords[i].mnType==REC_KEYFRAME)
+            mKeyFrameRecords[vRecords[i].mnId] = &vRecords[i];
+
+    // Culled keyframes are chained to their parents
+    std::unordered_map<uint64_t, cv::Mat> mKeyFramePoses;
+    for(std::unordered_map<uint64_t, const Record*>::const_iterator it=mKeyFrameRecords.begin(); it!=mKeyFrameRecords.end(); it++)
+    {
+        const Record* pRecord = it->second;
+        cv::Mat Trw = cv::Mat::eye(4,4,CV_32F);
+        for(size_t n=0; pRecord && pRecord->mnState==1 && n<mKeyFrameRecords.size(); n++)
+        {
+            Trw = Trw*FromRows(pRecord->mT);
+            std::unordered_map<uint64_t, const Record*>::const_iterator itParent = mKeyFrameRecords.find(pRecord->mnRefId);
+            pRecord = itParent==mKeyFrameRecords.end() ? NULL : itParent->second;
+        }
+        if(pRecord && pRecord->mnState==0)
+            mKeyFramePoses[it->first] = Trw*FromRows(pRecord->mT);
+    }
+
+    std::vector<double> vTimeStamps;
+    std::vector<cv::Mat> vTwc;
+    if(!vRecords.empty())
+        ResolveFrames(&vRecords[0]+nBegin, &vRecords[0]+vRecords.size(), mKeyFramePoses, format==TUM, vTimeStamps, vTwc);
+    if(vTwc.empty())
+    {
+        std::cerr << "No frames to convert in " << strLogFile << std::endl;
+        return false;
+    }
+
+    WriteTrajectory(filename, format, vTimeStamps, vTwc);
+    return true;
+}
+
+void TrajectoryRecorder::WriteTrajectory(const std::string &filename, const eFormat format,
+                                         const std::vector<double> &vTimeStamps, const std::vector<cv::Mat> &vTwc)
+{
+    std::ofstream f;
+    f.open(filename.c_str());
+    f << std::fixed;
+
+    for(size_t i=0; i<vTwc.size(); i++)
+    {
+        const cv::Mat &Twc = vTwc[i];
+        if(format==TUM)
+        {
+            std::vector<float> q = Converter::toQuaternion(Twc.rowRange(0,3).colRange(0,3));
+            f << std::setprecision(6) << vTimeStamps[i] << " " << std::setprecision(9) << Twc.at<float>(0,3) << " " << Twc.at<float>(1,3) << " " << Twc.at<float>(2,3)
+              << " " << q[0] << " " << q[1] << " " << q[2] << " " << q[3] << std::endl;
+        }
+        else
+        {
+            f << std::setprecision(9) << Twc.at<float>(0,0) << " " << Twc.at<float>(0,1) << " " << Twc.at<float>(0,2) << " " << Twc.at<float>(0,3) << " " <<
+                 Twc.at<float>(1,0) << " " << Twc.at<float>(1,1) << " " << Twc.at<float>(1,2) << " " << Twc.at<float>(1,3) << " " <<
+                 Twc.at<float>(2,0) << " " << Twc.at<float>(2,1) << " " << Twc.at<float>(2,2) << " " << Twc.at<float>(2,3) << std::endl;
+        }
+    }
+    f.close();
+}
+
+void TrajectoryRecorder::RequestFinish()
+{
+    {
+        std::unique_lock<std::mutex> lock(mMutexFinish);
+        mbFinishRequested = true;
+    }
+    mcvQueue.notify_one();
+}
+
+bool TrajectoryRecorder::CheckFinish()
+{
+    std::unique_lock<std::mutex> lock(mMutexFinish);
+    return mbFinishRequested;
+}
+
+void TrajectoryRecorder::SetFinish()
+{
+    std::unique_lock<std::mutex> lock(mMutexFinish);
+    mbFinished = true;
+}
+
+bool TrajectoryRecorder::isFinished()
+{
+    std::unique_lock<std::mutex> lock(mMutexFinish);
+    return mbFinished;
+}
+
+}// namespace ORB_SLAM
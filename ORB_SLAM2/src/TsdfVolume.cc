@@ -0,0 +1,585 @@
+/**
+* This file is part of ORB-SLAM2.
+*
+* Copyright (C) 2014-2016 Raúl Mur-Artal <raulmur at unizar dot es> (University of Zaragoza)
+* For more information see <https://github.com/raulmur/ORB_SLAM2>
+*
+* ORB-SLAM2 is free software: you can redistribute it and/or modify
+* it under the terms of the GNU General Public License as published by
+* the Free Software Foundation, either version 3 of the License, or
+* (at your option) any later version.
+*
+* ORB-SLAM2 is distributed in the hope that it will be useful,
+* but WITHOUT ANY WARRANTY; without even the implied warranty of
+* MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+* GNU General Public License for more details.
+*
+* You should have received a copy of the GNU General Public License
+* along with ORB-SLAM2. If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#include "TsdfVolume.h"
+#include "Map.h"
+#include "KeyFrame.h"
+#include "ThreadPool.h"
+#include "LittleEndian.h"
+
+#include <cmath>
+#include <cstring>
+#include <fstream>
+#include <unordered_set>
+#include <array>
+
+namespace ORB_SLAM2
+{
+
+namespace
+{
+
+// Corners of a cube are numbered by their offset bits x + 2y + 4z, edges join corners that
+// differ in one bit, the first corner being the lower one.
+const int kEdgeCorners[12][2] = {
+    {0,1}, {2,3}, {4,5}, {6,7},     // along x
+    {0,2}, {1,3}, {4,6}, {5,7},     // along y
+    {0,4}, {1,5}, {2,6}, {3,7}};    // along z
+
+// Corners of each face in cyclic order
+const int kFaceCorners[6][4] = {
+    {0,2,6,4}, {1,3,7,5},
+    {0,1,5,4}, {2,3,7,6},
+    {0,1,3,2}, {4,5,7,6}};
+
+int EdgeIndex(const int a, const int b)
+{
+    for(int e=0; e<12; e++)
+        if((kEdgeCorners[e][0]==a && kEdgeCorners[e][1]==b) || (kEdgeCorners[e][0]==b && kEdgeCorners[e][1]==a))
+            return e;
+    return -1;
+}
+
+typedef std::vector<std::array<int,3> > EdgeTriangles;
+
+// Triangles (as cube edges) for each of the 256 inside/outside corner configurations. Instead of
+// the usual hand-written table, every face contributes the segments that cut off its inside
+// corners, from the edge where the surface enters the face to the edge where it leaves it going
+// counter-clockwise seen from outside the cube. Both cubes sharing a face take the same decision
+// on ambiguous faces, so the surface has no holes, and the directed segments close into loops
+// around the inside corners, triangulated as fans facing the outside (positive distance).
+const std::vector<EdgeTriangles> &TriangleTable()
+{
+    static std::vector<EdgeTriangles> table;
+    if(!table.empty())
+        return table;
+
+    // Face corners in counter-clockwise order seen from outside
+    int faces[6][4];
+    for(int f=0; f<6; f++)
+    {
+        const int* c = kFaceCorners[f];
+        int p[3][3];
+        for(int k=0; k<3; k++)
+            for(int i=0; i<3; i++)
+                p[k][i] = (c[k]>>i)&1;
+        int d1[3], d2[3];
+        for(int i=0; i<3; i++)
+        {
+            d1[i] = p[1][i]-p[0][i];
+            d2[i] = p[2][i]-p[1][i];
+        }
+        const int normal[3] = {d1[1]*d2[2]-d1[2]*d2[1], d1[2]*d2[0]-d1[0]*d2[2], d1[0]*d2[1]-d1[1]*d2[0]};
+        // The face is at coordinate 0 or 1 of its normal axis
+        int outward = 0;
+        for(int i=0; i<3; i++)
+            if(normal[i]!=0)
+                outward = normal[i]*(p[0][i] ? 1 : -1);
+        for(int k=0; k<4; k++)
+            faces[f][k] = outward>0 ? c[k] : c[(4-k)%4];
+    }
+
+    table.resize(256);
+    for(int config=1; config<255; config++)
+    {
+        int next[12];
+        for(int e=0; e<12; e++)
+            next[e] = -1;
+
+        for(int f=0; f<6; f++)
+        {
+            const int* c = faces[f];
+            bool inside[4];
+            for(int k=0; k<4; k++)
+                inside[k] = config & (1<<c[k]);
+
+            for(int k=0; k<4; k++)
+            {
+                if(!inside[k] || inside[(k+3)%4])
+                    continue;
+                // Enters the face before corner k, leaves it after the run of inside corners.
+                // On ambiguous faces the run is a single corner.
+                int l = k;
+                while(inside[(l+1)%4])
+                    l = (l+1)%4;
+                next[EdgeIndex(c[(k+3)%4],c[k])] = EdgeIndex(c[l],c[(l+1)%4]);
+            }
+        }
+
+        bool visited[12] = {false};
+        for(int start=0; start<12; start++)
+        {
+            if(visited[start] || next[start]<0)
+                continue;
+            std::vector<int> loop;
+            for(int e=start; !visited[e]; e=next[e])
+            {
+                visited[e] = true;
+                loop.push_back(e);
+            }
+            for(size_t i=1; i+1<loop.size(); i++)
+            {
+                std::array<int,3> tri = {{loop[0], loop[i], loop[i+1]}};
+                table[config].push_back(tri);
+            }
+        }
+    }
+    return table;
+}
+
+}
+
+TsdfVolume::TsdfVolume(Map *pMap, const std::string &strSettingPath):
+    mpMap(pMap), mnClearIdx(0)
+{
+    cv::FileStorage fSettings(strSettingPath, cv::FileStorage::READ);
+
+    mVoxelSize = fSettings["DenseMap.TsdfVoxelSize"];
+    if(mVoxelSize<=0)
+        mVoxelSize = 0.02f;
+
+    mTruncation = fSettings["DenseMap.TsdfTruncation"];
+    if(mTruncation<=0)
+        mTruncation = 4*mVoxelSize;
+
+    mMinDepth = fSettings["DenseMap.MinDepth"];
+    if(mMinDepth<=0)
+        mMinDepth = 0.1f;
+
+    mMaxDepth = fSettings["DenseMap.TsdfMaxDepth"];
+    if(mMaxDepth<=0)
+        mMaxDepth = 4.0f;
+
+    mnAllocationStep = fSettings["DenseMap.TsdfAllocationStep"];
+    if(mnAllocationStep<1)
+        mnAllocationStep = 2;
+
+    mReintegrateDist = fSettings["DenseMap.TsdfReintegrateDist"];
+    if(mReintegrateDist<=0)
+        mReintegrateDist = mVoxelSize;
+
+    mReintegrateAngle = fSettings["DenseMap.TsdfReintegrateAngle"];
+    if(mReintegrateAngle<=0)
+        mReintegrateAngle = 1.0f;
+    mReintegrateAngle *= M_PI/180.0f;
+
+    int nRGB = fSettings["Camera.RGB"];
+    mbRGB = nRGB;
+
+    TriangleTable();
+}
+
+TsdfVolume::~TsdfVolume()
+{
+    Clear();
+}
+
+int64_t TsdfVolume::BlockKey(const int bx, const int by, const int bz)
+{
+    const int64_t offset = 1<<20;
+    return ((bx+offset) << 42) | ((by+offset) << 21) | (bz+offset);
+}
+
+void TsdfVolume::BlockCoords(const int64_t key, int &bx, int &by, int &bz)
+{
+    const int64_t offset = 1<<20;
+    const int64_t mask = (1<<21)-1;
+    bx = ((key >> 42) & mask) - offset;
+    by = ((key >> 21) & mask) - offset;
+    bz = (key & mask) - offset;
+}
+
+bool TsdfVolume::Update(KeyFrame *pKF)
+{
+    // The keyframes integrated before a reset do not exist anymore
+    const int nClearIdx = mpMap->GetClearIdx();
+    if(nClearIdx!=mnClearIdx)
+    {
+        Clear();
+        mnClearIdx = nClearIdx;
+    }
+
+    if(pKF->mImDepth.empty())
+        return false;
+
+    std::unordered_map<KeyFrame*, cv::Mat>::iterator it = mmIntegratedPoses.find(pKF);
+
+    if(pKF->isBad())
+    {
+        if(it==mmIntegratedPoses.end())
+            return false;
+        Integrate(pKF, it->second, -1.0f);
+        mmIntegratedPoses.erase(it);
+        return true;
+    }
+
+    const cv::Mat Tcw = pKF->GetPose();
+    if(it==mmIntegratedPoses.end())
+    {
+        Integrate(pKF, Tcw, 1.0f);
+        mmIntegratedPoses[pKF] = Tcw;
+        return true;
+    }
+
+    const cv::Mat &Tcw0 = it->second;
+    const cv::Mat R0 = Tcw0.rowRange(0,3).colRange(0,3);
+    const cv::Mat R = Tcw.rowRange(0,3).colRange(0,3);
+    const cv::Mat O0 = -R0.t()*Tcw0.rowRange(0,3).col(3);
+    const cv::Mat O = -R.t()*Tcw.rowRange(0,3).col(3);
+    const double cosAngle = std::max(-1.0, std::min(1.0, (cv::trace(R*R0.t())[0]-1.0)*0.5));
+    if(cv::norm(O-O0)<mReintegrateDist && std::acos(cosAngle)<mReintegrateAngle)
+        return false;
+
+    Integrate(pKF, Tcw0, -1.0f);
+    Integrate(pKF, Tcw, 1.0f);
+    it->second = Tcw;
+    return true;
+}
+
+void TsdfVolume::RemoveMissing(const std::vector<KeyFrame*> &vpKFs)
+{
+    if(mpMap->GetClearIdx()!=mnClearIdx)
+    {
+        Clear();
+        mnClearIdx = mpMap->GetClearIdx();
+        return;
+    }
+
+    const std::unordered_set<KeyFrame*> spKFs(vpKFs.begin(), vpKFs.end());
+    for(std::unordered_map<KeyFrame*, cv::Mat>::iterator it=mmIntegratedPoses.begin(); it!=mmIntegratedPoses.end(); )
+    {
+        if(spKFs.count(it->first))
+        {
+            it++;
+            continue;
+        }
+        Integrate(it->first, it->second, -1.0f);
+        it = mmIntegratedPoses.erase(it);
+    }
+}
+
+void TsdfVolume::Clear()
+{
+    for(std::unordered_map<int64_t, Block*>::iterator it=mmBlocks.begin(); it!=mmBlocks.end(); it++)
+        delete it->second;
+    mmBlocks.clear();
+    mmIntegratedPoses.clear();
+}
+
+void TsdfVolume::VisibleBlocks(KeyFrame *pKF, const cv::Mat &Tcw, std::vector<int64_t> &vKeys)
+{
+    const cv::Mat &depth = pKF->mImDepth;
+    const cv::Mat Rwc = Tcw.rowRange(0,3).colRange(0,3).t();
+    const cv::Mat twc = -Rwc*Tcw.rowRange(0,3).col(3);
+    const Eigen::Matrix3f R = Eigen::Map<const Eigen::Matrix<float,3,3,Eigen::RowMajor> >(Rwc.ptr<float>());
+    const Eigen::Vector3f t(twc.at<float>(0), twc.at<float>(1), twc.at<float>(2));
+
+    // Back-projection tables of the map, or the keyframe intrinsics if the image size differs
+    std::vector<float> vLookupX(depth.cols), vLookupY(depth.rows);
+    const bool bLookup = mpMap->mLookupX.cols==depth.cols && mpMap->mLookupY.cols==depth.rows;
+    for(int u=0; u<depth.cols; u++)
+        vLookupX[u] = bLookup ? mpMap->mLookupX.at<float>(0,u) : (u-pKF->cx)*pKF->invfx;
+    for(int v=0; v<depth.rows; v++)
+        vLookupY[v] = bLookup ? mpMap->mLookupY.at<float>(0,v) : (v-pKF->cy)*pKF->invfy;
+
+    // The truncation band is shorter than a block, five samples along it cover the blocks it crosses
+    const float invBlock = 1.0f/(mVoxelSize*BLOCK_SIZE);
+    std::unordered_set<int64_t> sKeys;
+    for(int v=0; v<depth.rows; v+=mnAllocationStep)
+    {
+        const float* d = depth.ptr<float>(v);
+        for(int u=0; u<depth.cols; u+=mnAllocationStep)
+        {
+            const float z = d[u];
+            if(!(z>=mMinDepth && z<=mMaxDepth))
+                continue;
+            const Eigen::Vector3f ray = R*Eigen::Vector3f(vLookupX[u], vLookupY[v], 1.0f);
+            for(int s=-2; s<=2; s++)
+            {
+                const Eigen::Vector3f p = (t + ray*(z + s*0.5f*mTruncation))*invBlock;
+                sKeys.insert(BlockKey(std::floor(p[0]), std::floor(p[1]), std::floor(p[2])));
+            }
+        }
+    }
+    vKeys.assign(sKeys.begin(), sKeys.end());
+}
+
+void TsdfVolume::Integrate(KeyFrame *pKF, const cv::Mat &Tcw, const float weight)
+{
+    std::vector<int64_t> vKeys;
+    VisibleBlocks(pKF, Tcw, vKeys);
+
+    // New observations allocate their blocks, removals only touch the existing ones
+    std::vector<Block*> vpBlocks;
+    std::vector<int64_t> vBlockKeys;
+    vpBlocks.reserve(vKeys.size());
+    vBlockKeys.reserve(vKeys.size());
+    for(size_t i=0; i<vKeys.size(); i++)
+    {
+        std::unordered_map<int64_t, Block*>::iterator it = mmBlocks.find(vKeys[i]);
+        if(it==mmBlocks.end())
+        {
+            if(weight<0)
+                continue;
+            it = mmBlocks.insert(std::make_pair(vKeys[i], new Block())).first;
+        }
+        vpBlocks.push_back(it->second);
+        vBlockKeys.push_back(vKeys[i]);
+    }
+
+    std::vector<char> vbEmpty(vpBlocks.size(), false);
+
+    ThreadPool::Instance().ParallelChunks(vpBlocks.size(), 16, [&](const int nBegin, const int nEnd)
+    {
+        IntegrateBlocks(pKF, Tcw, weight, vpBlocks, vBlockKeys, vbEmpty, nBegin, nEnd);
+    });
+
+    // Memory follows the observed surface, blocks with no observation left are freed
+    for(size_t i=0; i<vpBlocks.size(); i++)
+    {
+        if(!vbEmpty[i])
+            continue;
+        delete vpBlocks[i];
+        mmBlocks.erase(vBlockKeys[i]);
+    }
+}
+
+void TsdfVolume::IntegrateBlocks(KeyFrame *pKF, const cv::Mat &Tcw, const float weight,
+                                 const std::vector<Block*> &vpBlocks, const std::vector<int64_t> &vKeys,
+                                 std::vector<char> &vbEmpty, const int nBegin, const int nEnd)
+{
+    const cv::Mat &depth = pKF->mImDepth;
+    const cv::Mat &color = pKF->mImColor;
+    const bool bColor = !color.empty() && color.size()==depth.size() && color.depth()==CV_8U && color.channels()>=3;
+    const int nChannels = bColor ? color.channels() : 0;
+    // Stored as RGB
+    const int r = mbRGB ? 0 : 2;
+    const int b = mbRGB ? 2 : 0;
+
+    const Eigen::Matrix3f Rcw = Eigen::Map<const Eigen::Matrix<float,3,3,Eigen::RowMajor> >(Tcw.rowRange(0,3).colRange(0,3).clone().ptr<float>());
+    const Eigen::Vector3f tcw(Tcw.at<float>(0,3), Tcw.at<float>(1,3), Tcw.at<float>(2,3));
+    const Eigen::Vector3f dx = Rcw.col(0)*mVoxelSize;
+    const float fx = pKF->fx, fy = pKF->fy, cx = pKF->cx, cy = pKF->cy;
+    const float invTruncation = 1.0f/mTruncation;
+    const int width = depth.cols, height = depth.rows;
+
+    for(int i=nBegin; i<nEnd; i++)
+    {
+        Block* pBlock = vpBlocks[i];
+        int bx, by, bz;
+        BlockCoords(vKeys[i], bx, by, bz);
+
+        bool bEmpty = true;
+        for(int z=0; z<BLOCK_SIZE; z++)
+        {
+            for(int y=0; y<BLOCK_SIZE; y++)
+            {
+                const Eigen::Vector3f Xw0((bx*BLOCK_SIZE)*mVoxelSize, (by*BLOCK_SIZE+y)*mVoxelSize, (bz*BLOCK_SIZE+z)*mVoxelSize);
+                const Eigen::Vector3f Xc0 = Rcw*Xw0+tcw;
+
+                // Project the row of voxels at once, this loop is vectorized
+                float us[BLOCK_SIZE], vs[BLOCK_SIZE], zs[BLOCK_SIZE];
+                for(int x=0; x<BLOCK_SIZE; x++)
+                {
+                    const float xc = Xc0[0]+x*dx[0];
+                    const float yc = Xc0[1]+x*dx[1];
+                    const float zc = Xc0[2]+x*dx[2];
+                    const float invz = 1.0f/zc;
+                    us[x] = fx*xc*invz+cx+0.5f;
+                    vs[x] = fy*yc*invz+cy+0.5f;
+                    zs[x] = zc;
+                }
+
+                Voxel* voxels = pBlock->mVoxels + (z*BLOCK_SIZE+y)*BLOCK_SIZE;
+                for(int x=0; x<BLOCK_SIZE; x++)
+                {
+                    Voxel &voxel = voxels[x];
+                    if(zs[x]>0 && us[x]>=0 && vs[x]>=0 && us[x]<width && vs[x]<height)
+                    {
+                        const int u = us[x], v = vs[x];
+                        const float d = depth.at<float>(v,u);
+                        const float sdf = d-zs[x];
+                        if(d>=mMinDepth && d<=mMaxDepth && sdf>=-mTruncation)
+                        {
+                            const float tsdf = std::min(1.0f, sdf*invTruncation);
+                            const float w = voxel.mWeight+weight;
+                            if(w<=1e-3f)
+                                memset(&voxel, 0, sizeof(Voxel));
+                            else
+                            {
+                                const float invw = 1.0f/w;
+                                voxel.mSdf = (voxel.mSdf*voxel.mWeight+tsdf*weight)*invw;
+                                if(bColor)
+                                {
+                                    const unsigned char* pixel = color.ptr<unsigned char>(v)+u*nChannels;
+                                    voxel.mColor[0] = (voxel.mColor[0]*voxel.mWeight+pixel[r]*weight)*invw;
+                                    voxel.mColor[1] = (voxel.mColor[1]*voxel.mWeight+pixel[1]*weight)*invw;
+                                    voxel.mColor[2] = (voxel.mColor[2]*voxel.mWeight+pixel[b]*weight)*invw;
+                                }
+                                voxel.mWeight = w;
+                            }
+                        }
+                    }
+                    if(voxel.mWeight>0)
+                        bEmpty = false;
+                }
+            }
+        }
+
+        vbEmpty[i] = weight<0 && bEmpty;
+    }
+}
+
+void TsdfVolume::ExtractMesh(Mesh &mesh)
+{
+    const std::vector<EdgeTriangles> &table = TriangleTable();
+    const int P = BLOCK_SIZE+1;
+
+    mesh.mvVertices.clear();
+    mesh.mvColors.clear();
+    mesh.mvTriangles.clear();
+
+    // Vertices are on the grid edges, identified by the lower grid point and the axis
+    std::unordered_map<int64_t, int> mEdgeVertices;
+
+    std::vector<const Voxel*> vpVoxels(P*P*P);
+    for(std::unordered_map<int64_t, Block*>::const_iterator bit=mmBlocks.begin(); bit!=mmBlocks.end(); bit++)
+    {
+        int bx, by, bz;
+        BlockCoords(bit->first, bx, by, bz);
+
+        // The block and its last row, column and slice from the neighbor blocks
+        const Block* neighbors[8];
+        for(int n=0; n<8; n++)
+        {
+            if(n==0)
+            {
+                neighbors[n] = bit->second;
+                continue;
+            }
+            std::unordered_map<int64_t, Block*>::const_iterator nit = mmBlocks.find(BlockKey(bx+(n&1), by+((n>>1)&1), bz+((n>>2)&1)));
+            neighbors[n] = nit==mmBlocks.end() ? NULL : nit->second;
+        }
+        for(int z=0; z<P; z++)
+            for(int y=0; y<P; y++)
+                for(int x=0; x<P; x++)
+                {
+                    const int n = (x==BLOCK_SIZE) | ((y==BLOCK_SIZE)<<1) | ((z==BLOCK_SIZE)<<2);
+                    const int lx = x%BLOCK_SIZE, ly = y%BLOCK_SIZE, lz = z%BLOCK_SIZE;
+                    vpVoxels[(z*P+y)*P+x] = neighbors[n] ? &neighbors[n]->mVoxels[(lz*BLOCK_SIZE+ly)*BLOCK_SIZE+lx] : NULL;
+                }
+
+        for(int z=0; z<BLOCK_SIZE; z++)
+            for(int y=0; y<BLOCK_SIZE; y++)
+                for(int x=0; x<BLOCK_SIZE; x++)
+                {
+                    const Voxel* corners[8];
+                    int config = 0;
+                    bool bValid = true;
+                    for(int c=0; c<8 && bValid; c++)
+                    {
+                        corners[c] = vpVoxels[((z+((c>>2)&1))*P+(y+((c>>1)&1)))*P+(x+(c&1))];
+                        bValid = corners[c] && corners[c]->mWeight>0;
+                        if(bValid && corners[c]->mSdf<0)
+                            config |= 1<<c;
+                    }
+                    if(!bValid || config==0 || config==255)
+                        continue;
+
+                    const EdgeTriangles &triangles = table[config];
+                    const int gx = bx*BLOCK_SIZE+x, gy = by*BLOCK_SIZE+y, gz = bz*BLOCK_SIZE+z;
+
+                    for(size_t t=0; t<triangles.size(); t++)
+                    {
+                        int idx[3];
+                        for(int k=0; k<3; k++)
+                        {
+                            const int e = triangles[t][k];
+                            const int a = kEdgeCorners[e][0], b = kEdgeCorners[e][1];
+                            const int axis = e/4;
+                            const int64_t ex = gx+(a&1), ey = gy+((a>>1)&1), ez = gz+((a>>2)&1);
+                            const int64_t offset = 1<<19;
+                            const int64_t key = ((((ex+offset) << 40) | ((ey+offset) << 20) | (ez+offset)) << 2) | axis;
+
+                            std::unordered_map<int64_t, int>::iterator vit = mEdgeVertices.find(key);
+                            if(vit==mEdgeVertices.end())
+                            {
+                                const Voxel* va = corners[a];
+                                const Voxel* vb = corners[b];
+                                const float s = va->mSdf/(va->mSdf-vb->mSdf);
+                                Eigen::Vector3f p(ex, ey, ez);
+                                p[axis] += s;
+                                mesh.mvVertices.push_back(p*mVoxelSize);
+                                Eigen::Matrix<unsigned char,3,1> rgb;
+                                for(int ch=0; ch<3; ch++)
+                                    rgb[ch] = (unsigned char) std::min(255.0f, std::max(0.0f, va->mColor[ch]+s*(vb->mColor[ch]-va->mColor[ch])+0.5f));
+                                mesh.mvColors.push_back(rgb);
+                                vit = mEdgeVertices.insert(std::make_pair(key, (int) mesh.mvVertices.size()-1)).first;
+                            }
+                            idx[k] = vit->second;
+                        }
+
+                        mesh.mvTriangles.push_back(Eigen::Vector3i(idx[0], idx[1], idx[2]));
+                    }
+                }
+    }
+}
+
+bool TsdfVolume::SaveMesh(const Mesh &mesh, const std::string &filename)
+{
+    std::ofstream f(filename.c_str(), std::ios::binary);
+    if(!f.is_open())
+        return false;
+
+    f << "ply" << std::endl
+      << "format binary_little_endian 1.0" << std::endl
+      << "element vertex " << mesh.mvVertices.size() << std::endl
+      << "property float x" << std::endl
+      << "property float y" << std::endl
+      << "property float z" << std::endl
+      << "property uchar red" << std::endl
+      << "property uchar green" << std::endl
+      << "property uchar blue" << std::endl
+      << "element face " << mesh.mvTriangles.size() << std::endl
+      << "property list uchar int vertex_indices" << std::endl
+      << "end_header" << std::endl;
+
+    // Encoded little-endian whatever the host byte order
+    char vertex[3*sizeof(float)+3];
+    for(size_t i=0; i<mesh.mvVertices.size(); i++)
+    {
+        for(int k=0; k<3; k++)
+            EncodeLittleEndian<float>(mesh.mvVertices[i][k], vertex+k*sizeof(float));
+        memcpy(vertex+3*sizeof(float), mesh.mvColors[i].data(), 3);
+        f.write(vertex, sizeof(vertex));
+    }
+    char face[1+3*sizeof(int32_t)];
+    face[0] = 3;
+    for(size_t i=0; i<mesh.mvTriangles.size(); i++)
+    {
+        for(int k=0; k<3; k++)
+            EncodeLittleEndian<int32_t>(mesh.mvTriangles[i][k], face+1+k*sizeof(int32_t));
+        f.write(face, sizeof(face));
+    }
+
+    return f.good();
+}
+
+} //namespace ORB_SLAM
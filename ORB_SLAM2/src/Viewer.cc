@@ -73,6 +73,7 @@ void Viewer::Run()
     pangolin::Var<bool> menuLocalizationMode("menu.Localization Mode",false,true);
     pangolin::Var<bool> menuShowDenseMap("menu.Show DenseMap",false,true);
     pangolin::Var<bool> menuShowSegObjects("menu.Show SegObjects", false, true);
+    pangolin::Var<bool> menuExportDenseMap("menu.Export DenseMap",false,false);
     pangolin::Var<bool> menuReset("menu.Reset",false,false);
     bool bShowObject = true;
     // Define Camera Render Object (for view / scene browsing)
@@ -129,6 +130,7 @@ void Viewer::Run()
         d_cam.Activate(s_cam);
         glClearColor(1.0f,1.0f,1.0f,1.0f);
         mpMapDrawer->DrawCurrentCamera(Twc);
+        mpMapDrawer->UpdateBuffers();
         if(menuShowKeyFrames || menuShowGraph)
             mpMapDrawer->DrawKeyFrames(menuShowKeyFrames,menuShowGraph);
         if(menuShowPoints)
@@ -141,6 +143,13 @@ void Viewer::Run()
             mpMapDrawer->mbCalPointCloud = true;
         }
 
+        if(menuExportDenseMap)
+        {
+            // Written in background by the dense exporter
+            mpSystem->ExportDenseMap("./results/octomap_office.ot");
+            menuExportDenseMap = false;
+        }
+
 
         if(menuShowSegObjects)
         {
@@ -178,10 +187,9 @@ void Viewer::Run()
 
         if(Stop())
         {
-            while(isStopped())
-            {
-                usleep(3000);
-            }
+            unique_lock<mutex> lock(mMutexStop);
+            while(mbStopped)
+                mcvStop.wait(lock);
         }
 
         if(CheckFinish())
@@ -248,8 +256,11 @@ bool Viewer::Stop()
 
 void Viewer::Release()
 {
-    unique_lock<mutex> lock(mMutexStop);
-    mbStopped = false;
+    {
+        unique_lock<mutex> lock(mMutexStop);
+        mbStopped = false;
+    }
+    mcvStop.notify_all();
 }
 
 }
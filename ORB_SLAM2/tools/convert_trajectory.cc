@@ -0,0 +1,40 @@
+// Converts a trajectory log (Trajectory.Log, see TrajectoryRecorder) to the TUM RGB-D or KITTI
+// format, with the last keyframe poses recorded. Also works on the log of a run that crashed.
+//
+// Usage: ./convert_trajectory path_to_log path_to_output [tum|kitti]
+//   tum (default) skips the frames where the tracking was lost, kitti writes all of them
+
+#include <iostream>
+#include <string>
+
+#include "TrajectoryRecorder.h"
+
+using namespace std;
+
+int main(int argc, char **argv)
+{
+    if(argc<3 || argc>4)
+    {
+        cerr << endl << "Usage: ./convert_trajectory path_to_log path_to_output [tum|kitti]" << endl;
+        return 1;
+    }
+
+    ORB_SLAM2::TrajectoryRecorder::eFormat format = ORB_SLAM2::TrajectoryRecorder::TUM;
+    if(argc==4)
+    {
+        const string strFormat = argv[3];
+        if(strFormat=="kitti")
+            format = ORB_SLAM2::TrajectoryRecorder::KITTI;
+        else if(strFormat!="tum")
+        {
+            cerr << "Unknown format " << strFormat << endl;
+            return 1;
+        }
+    }
+
+    if(!ORB_SLAM2::TrajectoryRecorder::ConvertLog(argv[1], argv[2], format))
+        return 1;
+
+    cout << "trajectory saved to " << argv[2] << endl;
+    return 0;
+}
@@ -0,0 +1,136 @@
+// Replays a sensor log recorded by System (Recorder.File, see SensorRecorder) to reproduce a run
+// offline: the same images are given to the same Track* call, with the random generator of
+// DUtils::Random seeded with a fixed value. Reports the tracking times and saves the trajectory.
+//
+// Usage: ./replay_sensor_log path_to_vocabulary path_to_settings path_to_log [speed] [seed] [start_s]
+//   speed 1 (default) replays at the recorded rate, 0 as fast as the tracking goes
+//   seed of the random generator, 0 by default
+//   start_s skips the first seconds of the log, through its index
+
+#include <iostream>
+#include <algorithm>
+#include <chrono>
+#include <vector>
+#include <cstdlib>
+#include <unistd.h>
+
+#include <System.h>
+#include <SensorPlayer.h>
+
+#include "Thirdparty/DBoW2/DUtils/Random.h"
+
+using namespace std;
+
+typedef std::chrono::steady_clock Clock;
+
+int main(int argc, char **argv)
+{
+    if(argc < 4 || argc > 7)
+    {
+        cerr << endl << "Usage: ./replay_sensor_log path_to_vocabulary path_to_settings path_to_log [speed] [seed] [start_s]" << endl;
+        return 1;
+    }
+
+    const double speed = argc > 4 ? atof(argv[4]) : 1.0;
+    const int seed = argc > 5 ? atoi(argv[5]) : 0;
+    const double start = argc > 6 ? atof(argv[6]) : 0.0;
+
+    ORB_SLAM2::SensorPlayer player;
+    if(!player.Open(argv[3]))
+    {
+        cerr << endl << "Failed to open the sensor log at: " << argv[3] << endl;
+        return 1;
+    }
+
+    if(start > 0 && !player.Seek(player.FirstTimeStamp() + start))
+    {
+        cerr << endl << "The log is shorter than " << start << " s" << endl;
+        return 1;
+    }
+
+    // Seeded once, the later SeedRandOnce calls (Initializer) keep this seed
+    DUtils::Random::SeedRandOnce(seed);
+
+    const ORB_SLAM2::System::eSensor sensor = static_cast<ORB_SLAM2::System::eSensor>(player.GetSensor());
+    // Not recorded again, Recorder.File may be the log being replayed
+    ORB_SLAM2::System SLAM(argv[1],argv[2],sensor,false,false);
+
+    cout << endl << "-------" << endl;
+    cout << "Start replaying log ..." << endl;
+    cout << "Frames in the log: " << player.Frames() << endl << endl;
+
+    // Vector for tracking time statistics
+    vector<float> vTimesTrack;
+    vTimesTrack.reserve(player.Frames());
+
+    double tframe;
+    vector<ORB_SLAM2::ImageBuffer> vImages;
+    double tFirstFrame = -1;
+    Clock::time_point tStart;
+    while(player.Next(tframe, vImages))
+    {
+        if(vImages.empty() || (sensor != ORB_SLAM2::System::MONOCULAR && vImages.size() < 2))
+        {
+            cerr << "Skipping incomplete frame at " << tframe << endl;
+            continue;
+        }
+
+        // Wait for the recorded time of the frame
+        if(tFirstFrame < 0)
+        {
+            tFirstFrame = tframe;
+            tStart = Clock::now();
+        }
+        else if(speed > 0)
+        {
+            const Clock::time_point tDue = tStart + std::chrono::duration_cast<Clock::duration>(
+                        std::chrono::duration<double>((tframe - tFirstFrame) / speed));
+            const Clock::time_point tNow = Clock::now();
+            if(tDue > tNow)
+                usleep(std::chrono::duration_cast<std::chrono::microseconds>(tDue - tNow).count());
+        }
+
+        Clock::time_point t1 = Clock::now();
+
+        // Pass the images to the SLAM system
+        if(sensor == ORB_SLAM2::System::STEREO)
+            SLAM.TrackStereo(vImages[0],vImages[1],tframe);
+        else if(sensor == ORB_SLAM2::System::RGBD)
+            SLAM.TrackRGBD(vImages[0],vImages[1],tframe);
+        else
+            SLAM.TrackMonocular(vImages[0],tframe);
+
+        Clock::time_point t2 = Clock::now();
+
+        vTimesTrack.push_back(std::chrono::duration_cast<std::chrono::duration<double> >(t2 - t1).count());
+    }
+
+    // Stop all threads
+    SLAM.Shutdown();
+
+    if(vTimesTrack.empty())
+    {
+        cerr << endl << "No frames replayed." << endl;
+        return 1;
+    }
+
+    // Tracking time statistics
+    sort(vTimesTrack.begin(),vTimesTrack.end());
+    float totaltime = 0;
+    for(size_t ni=0; ni<vTimesTrack.size(); ni++)
+    {
+        totaltime+=vTimesTrack[ni];
+    }
+    cout << "-------" << endl << endl;
+    cout << "frames replayed: " << vTimesTrack.size() << endl;
+    cout << "median tracking time: " << vTimesTrack[vTimesTrack.size()/2] << endl;
+    cout << "mean tracking time: " << totaltime/vTimesTrack.size() << endl;
+    cout << "max tracking time: " << vTimesTrack.back() << endl;
+
+    // Save camera trajectory
+    if(sensor != ORB_SLAM2::System::MONOCULAR)
+        SLAM.SaveTrajectoryTUM("CameraTrajectory.txt");
+    SLAM.SaveKeyFrameTrajectoryTUM("KeyFrameTrajectory.txt");
+
+    return 0;
+}
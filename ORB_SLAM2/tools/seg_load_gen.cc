@@ -0,0 +1,148 @@
+// Load generator for the segmentation server (FCIS/experiments/slxrobot/segmentation_for_slam.py).
+// Sends the keyframes of a TUM RGB-D sequence as pipelined requests, at a fixed rate or as fast
+// as the in-flight window allows, and reports throughput and request latency.
+//
+// Usage: ./seg_load_gen path_to_sequence path_to_association num_requests rate_hz max_in_flight [depth_factor] [host] [port]
+//   rate_hz 0 sends as soon as the window has room, max_in_flight 1 is the old one-at-a-time protocol
+
+#include <iostream>
+#include <algorithm>
+#include <fstream>
+#include <sstream>
+#include <chrono>
+#include <thread>
+#include <mutex>
+#include <condition_variable>
+#include <map>
+#include <vector>
+#include <cstdlib>
+
+#include <opencv2/core/core.hpp>
+#include <opencv2/highgui/highgui.hpp>
+
+#include "Communication.h"
+
+using namespace std;
+
+typedef std::chrono::steady_clock Clock;
+
+void LoadImages(const string &strAssociationFilename, vector<string> &vstrImageFilenamesRGB,
+                vector<string> &vstrImageFilenamesD)
+{
+    ifstream fAssociation(strAssociationFilename.c_str());
+    string s;
+    while(getline(fAssociation,s))
+    {
+        if(s.empty())
+            continue;
+        stringstream ss(s);
+        double t;
+        string sRGB, sD;
+        ss >> t >> sRGB >> t >> sD;
+        vstrImageFilenamesRGB.push_back(sRGB);
+        vstrImageFilenamesD.push_back(sD);
+    }
+}
+
+int main(int argc, char **argv)
+{
+    if(argc < 6)
+    {
+        cerr << endl << "Usage: ./seg_load_gen path_to_sequence path_to_association num_requests rate_hz max_in_flight"
+             << " [depth_factor] [host] [port]" << endl;
+        return 1;
+    }
+
+    const string strSequence = argv[1];
+    const int nRequests = atoi(argv[3]);
+    const double rate = atof(argv[4]);
+    const int nMaxInFlight = max(1, atoi(argv[5]));
+    const float depthFactor = argc > 6 ? atof(argv[6]) : 5000.f;
+    const string host = argc > 7 ? argv[7] : "localhost";
+    const int port = argc > 8 ? atoi(argv[8]) : 7200;
+
+    vector<string> vstrImageFilenamesRGB, vstrImageFilenamesD;
+    LoadImages(argv[2], vstrImageFilenamesRGB, vstrImageFilenamesD);
+    if(vstrImageFilenamesRGB.empty())
+    {
+        cerr << endl << "No images found in provided path." << endl;
+        return 1;
+    }
+
+    // Decode up front so that the disk is not part of the measure, depth in meters as Tracking sends it
+    const size_t nImages = min(vstrImageFilenamesRGB.size(), (size_t) max(nRequests, 1));
+    vector<cv::Mat> vColor(nImages), vDepth(nImages);
+    for(size_t i=0; i<nImages; i++)
+    {
+        vColor[i] = cv::imread(strSequence+"/"+vstrImageFilenamesRGB[i],CV_LOAD_IMAGE_UNCHANGED);
+        cv::Mat imD = cv::imread(strSequence+"/"+vstrImageFilenamesD[i],CV_LOAD_IMAGE_UNCHANGED);
+        if(vColor[i].empty() || imD.empty())
+        {
+            cerr << endl << "Failed to load image " << i << endl;
+            return 1;
+        }
+        imD.convertTo(vDepth[i],CV_32F,1.0f/depthFactor);
+    }
+
+    Client client(host, port);
+
+    std::mutex mutexInFlight;
+    std::condition_variable cvInFlight;
+    std::map<long unsigned int, Clock::time_point> mSent;
+    vector<double> vLatencies;
+    vLatencies.reserve(nRequests);
+
+    std::thread receiver([&]()
+    {
+        for(int i=0; i<nRequests; i++)
+        {
+            long unsigned int id;
+            Client::ClsPosPairs pairs;
+            Client::InstanceMasks masks;
+            client.getSegResult(id, pairs, masks);
+            Clock::time_point now = Clock::now();
+            {
+                std::unique_lock<std::mutex> lock(mutexInFlight);
+                std::map<long unsigned int, Clock::time_point>::iterator mit = mSent.find(id);
+                if(mit!=mSent.end())
+                {
+                    vLatencies.push_back(std::chrono::duration_cast<std::chrono::duration<double> >(now-mit->second).count());
+                    mSent.erase(mit);
+                }
+            }
+            cvInFlight.notify_one();
+        }
+    });
+
+    const Clock::time_point tStart = Clock::now();
+    for(int i=0; i<nRequests; i++)
+    {
+        if(rate>0)
+            std::this_thread::sleep_until(tStart + std::chrono::duration_cast<Clock::duration>(std::chrono::duration<double>(i/rate)));
+        {
+            std::unique_lock<std::mutex> lock(mutexInFlight);
+            cvInFlight.wait(lock, [&] { return (int) mSent.size() < nMaxInFlight; });
+            mSent[i] = Clock::now();
+        }
+        client.sendRequest(i, vColor[i%nImages], vDepth[i%nImages]);
+    }
+    receiver.join();
+    const double tTotal = std::chrono::duration_cast<std::chrono::duration<double> >(Clock::now()-tStart).count();
+
+    sort(vLatencies.begin(),vLatencies.end());
+    double sum = 0;
+    for(size_t i=0; i<vLatencies.size(); i++)
+        sum += vLatencies[i];
+    const size_t n = vLatencies.size();
+
+    cout << "requests: " << n << "  rate: " << (rate>0 ? rate : 0) << " Hz  max in flight: " << nMaxInFlight << endl;
+    cout << "throughput: " << n/tTotal << " keyframes/s" << endl;
+    if(n>0)
+    {
+        cout << "latency mean: " << 1000*sum/n << " ms  median: " << 1000*vLatencies[n/2]
+             << " ms  p90: " << 1000*vLatencies[(n*9)/10] << " ms  p99: " << 1000*vLatencies[(n*99)/100]
+             << " ms  max: " << 1000*vLatencies.back() << " ms" << endl;
+    }
+
+    return 0;
+}